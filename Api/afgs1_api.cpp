@@ -0,0 +1,196 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// afgs1_api - Implementation of the C interface of the AFGS1 shared library (see afgs1.h) on the
+//             database, buffer and message classes of libAFGS1.
+//
+
+#include <cstdio>
+#include <new>
+#include "afgs1.h"
+#include "afgs1_message.h"
+
+struct afgs1_database {
+    Afgs1_film_grain_database db;
+};
+
+struct afgs1_context {
+    const afgs1_database *database;
+    afgs1_context_config config;
+    Afgs1_buffer buffer;
+    int64_t num_pictures;
+};
+
+const char *afgs1_status_string( afgs1_status status )
+{
+    switch( status ) {
+        case AFGS1_OK:                      return "success";
+        case AFGS1_ERROR_INVALID_ARGUMENT:  return "invalid argument";
+        case AFGS1_ERROR_IO:                return "unable to open the parameter file";
+        case AFGS1_ERROR_FORMAT:            return "invalid filmgrn1 parameter file";
+        case AFGS1_ERROR_BUFFER_TOO_SMALL:  return "payload buffer too small";
+        case AFGS1_ERROR_TOO_MANY_SETS:     return "film grain parameter sets cannot be signaled in one message";
+        case AFGS1_ERROR_OUT_OF_MEMORY:     return "out of memory";
+    }
+    return "unknown status";
+}
+
+afgs1_status afgs1_database_create( afgs1_database **database )
+{
+    if( !database )
+        return AFGS1_ERROR_INVALID_ARGUMENT;
+
+    *database = new (std::nothrow) afgs1_database;
+    return *database ? AFGS1_OK : AFGS1_ERROR_OUT_OF_MEMORY;
+}
+
+// Load a table from an open file
+static afgs1_status load_table( afgs1_database *database, FILE *fp, int width, int height )
+{
+    try {
+        return database->db.load_table( fp, width, height ) ? AFGS1_OK : AFGS1_ERROR_FORMAT;
+    }
+    catch( const std::bad_alloc & ) {
+        return AFGS1_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+afgs1_status afgs1_database_load_file( afgs1_database *database, const char *path, int width, int height )
+{
+    if( !database || !path || width <= 0 || height <= 0 )
+        return AFGS1_ERROR_INVALID_ARGUMENT;
+
+    FILE *fp = fopen( path, "rb" );
+    if( !fp )
+        return AFGS1_ERROR_IO;
+
+    afgs1_status status = load_table( database, fp, width, height );
+    fclose( fp );
+    return status;
+}
+
+// The parameter file is parsed with stdio, so the data is read through a memory stream where the C library has
+// one, and through a temporary file otherwise.
+afgs1_status afgs1_database_load_memory( afgs1_database *database, const void *data, size_t size,
+                                         int width, int height )
+{
+    if( !database || ( !data && size ) || width <= 0 || height <= 0 )
+        return AFGS1_ERROR_INVALID_ARGUMENT;
+    if( !size )
+        return AFGS1_ERROR_FORMAT;
+
+#if defined(_WIN32)
+    FILE *fp = tmpfile();
+    if( fp && ( fwrite( data, 1, size, fp ) != size || fseek( fp, 0, SEEK_SET ) ) ) {
+        fclose( fp );
+        fp = NULL;
+    }
+#else
+    FILE *fp = fmemopen( const_cast<void*>( data ), size, "rb" );
+#endif
+    if( !fp )
+        return AFGS1_ERROR_IO;
+
+    afgs1_status status = load_table( database, fp, width, height );
+    fclose( fp );
+    return status;
+}
+
+void afgs1_database_destroy( afgs1_database *database )
+{
+    delete database;
+}
+
+void afgs1_context_config_default( afgs1_context_config *config )
+{
+    if( !config )
+        return;
+
+    config->fps_num = 0;
+    config->fps_denom = 1;
+    config->slot_policy = AFGS1_POLICY_FIXED;
+    config->refresh_interval = 0;
+    config->modulate_seed = 1;
+}
+
+afgs1_status afgs1_context_create( const afgs1_database *database, const afgs1_context_config *config,
+                                   afgs1_context **context )
+{
+    if( !database || !config || !context || config->fps_num < 0 || config->fps_denom <= 0 ||
+        config->slot_policy < AFGS1_POLICY_FIXED || config->slot_policy > AFGS1_POLICY_OPTIMAL ||
+        config->refresh_interval < 0 )
+        return AFGS1_ERROR_INVALID_ARGUMENT;
+
+    *context = new (std::nothrow) afgs1_context;
+    if( !*context )
+        return AFGS1_ERROR_OUT_OF_MEMORY;
+
+    (*context)->database = database;
+    (*context)->config = *config;
+    afgs1_context_reset( *context );
+    return AFGS1_OK;
+}
+
+void afgs1_context_reset( afgs1_context *context )
+{
+    if( !context )
+        return;
+
+    context->buffer.clear_buffer();
+    context->num_pictures = 0;
+}
+
+void afgs1_context_destroy( afgs1_context *context )
+{
+    delete context;
+}
+
+// The message is built against a copy of the buffer model, which replaces the model once the payload is
+// written, so that a failed call leaves the context unchanged.
+afgs1_status afgs1_context_get_t35_payload( afgs1_context *context, int64_t poc, int64_t pts, int irap,
+                                            uint8_t *payload, size_t capacity, size_t *payload_size )
+{
+    if( !context || !payload_size || ( !payload && capacity ) )
+        return AFGS1_ERROR_INVALID_ARGUMENT;
+
+    const afgs1_context_config &config = context->config;
+    if( pts < 0 ) {
+        if( config.fps_num <= 0 )
+            return AFGS1_ERROR_INVALID_ARGUMENT;
+        pts = afgs1_frame_time( poc, config.fps_num, config.fps_denom );
+    }
+
+    Afgs1_buffer buffer = context->buffer;
+    if( irap )
+        buffer.clear_buffer();
+    buffer.set_time( context->num_pictures );
+
+    Afgs1_message message( &context->database->db, pts, buffer, (Afgs1_slot_policy)config.slot_policy,
+                           config.refresh_interval );
+    if( config.modulate_seed )
+        message.update_grain_seed( poc );
+
+    *payload_size = 0;
+    if( message.get_num_param_sets() > 0 ) {
+        if( message.get_num_database_sets() > AFGS1_MAX_PARAM_SETS )
+            return AFGS1_ERROR_TOO_MANY_SETS;
+
+        int size = message.write_t35_payload( payload, capacity );
+        if( size < 0 ) {
+            // Distinguish a small buffer from sets that cannot be signaled together
+            uint8_t full[AFGS1_MAX_T35_PAYLOAD_SIZE];
+            return ( message.write_t35_payload( full, sizeof(full) ) < 0 ) ? AFGS1_ERROR_TOO_MANY_SETS
+                                                                           : AFGS1_ERROR_BUFFER_TOO_SMALL;
+        }
+        *payload_size = size;
+        message.update_buffer( &buffer );
+    }
+
+    context->buffer = buffer;
+    context->num_pictures++;
+    return AFGS1_OK;
+}
@@ -0,0 +1,140 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// afgs1.h - C interface of the AFGS1 shared library, for encoders and packagers that create the AFGS1
+//           ITU-T T.35 payload of each picture in their own process.
+//
+// A database holds the film grain parameters of one or more "filmgrn1" parameter files.  A context holds the
+// state of one stream: the model of the AFGS1 buffer of a decoder and the picture count.  Typical use:
+//
+//     afgs1_database *db;
+//     afgs1_database_create( &db );
+//     afgs1_database_load_file( db, "grain_1080p.fgs", 1920, 1080 );
+//     afgs1_database_load_file( db, "grain_720p.fgs", 1280, 720 );
+//
+//     afgs1_context_config config;
+//     afgs1_context_config_default( &config );
+//     config.fps_num = 24;
+//     afgs1_context *ctx;
+//     afgs1_context_create( db, &config, &ctx );
+//
+//     uint8_t payload[AFGS1_MAX_T35_PAYLOAD_SIZE];
+//     size_t size;
+//     for each picture in decode order:
+//         afgs1_context_get_t35_payload( ctx, poc, -1, irap, payload, sizeof(payload), &size );
+//         if size > 0, insert an ITU-T T.35 message with country code AFGS1_T35_COUNTRY_CODE and the payload
+//
+//     afgs1_context_destroy( ctx );
+//     afgs1_database_destroy( db );
+//
+// Threading: a database is read-only once loaded and may be shared by any number of contexts, which may be
+// used concurrently from different threads.  All the tables must be loaded before the first context is
+// created.  A context must not be used by two threads at the same time.  afgs1_context_get_t35_payload does
+// not allocate memory.
+
+#ifndef AFGS1_H
+#define AFGS1_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(AFGS1_BUILD_SHARED)
+#    define AFGS1_API __declspec(dllexport)
+#  else
+#    define AFGS1_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#  define AFGS1_API __attribute__((visibility("default")))
+#else
+#  define AFGS1_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFGS1_API_VERSION 1
+
+// ITU-T T.35 country code of the AFGS1 message (the payload starts with the terminal provider codes)
+#define AFGS1_T35_COUNTRY_CODE 0xB5
+
+// Upper bound of the size of a payload: the terminal provider codes, one byte of av1_film_grain_param_sets()
+// syntax and eight film_grain_payload() of at most 255 bytes
+#define AFGS1_MAX_T35_PAYLOAD_SIZE 2044
+
+typedef enum afgs1_status {
+    AFGS1_OK = 0,
+    AFGS1_ERROR_INVALID_ARGUMENT = -1,   // a pointer is NULL or a value is out of range
+    AFGS1_ERROR_IO = -2,                 // a parameter file cannot be opened
+    AFGS1_ERROR_FORMAT = -3,             // the data is not a valid "filmgrn1" parameter file
+    AFGS1_ERROR_BUFFER_TOO_SMALL = -4,   // the payload does not fit the buffer of the caller
+    AFGS1_ERROR_TOO_MANY_SETS = -5,      // more parameter sets apply to the picture than a message can carry,
+                                         // or sets of the same resolution apply to it
+    AFGS1_ERROR_OUT_OF_MEMORY = -6
+} afgs1_status;
+
+// Policies for choosing the AFGS1 buffer slot of a parameter set that is not already buffered
+typedef enum afgs1_slot_policy {
+    AFGS1_POLICY_FIXED = 0,              // the slot assigned to the parameter file when it was loaded
+    AFGS1_POLICY_LRU = 1,                // the least recently used slot
+    AFGS1_POLICY_OPTIMAL = 2             // the slot whose parameters are needed furthest in the future
+} afgs1_slot_policy;
+
+typedef struct afgs1_database afgs1_database;
+typedef struct afgs1_context afgs1_context;
+
+typedef struct afgs1_context_config {
+    int fps_num;                         // frame rate, used to derive the presentation time from the POC
+    int fps_denom;
+    afgs1_slot_policy slot_policy;
+    int refresh_interval;                // pictures after which a buffered parameter set is sent again (0: never)
+    int modulate_seed;                   // vary the grain seed with the POC
+} afgs1_context_config;
+
+// Description of a status code
+AFGS1_API const char *afgs1_status_string( afgs1_status status );
+
+// Create an empty database
+AFGS1_API afgs1_status afgs1_database_create( afgs1_database **database );
+
+// Load a "filmgrn1" parameter file for pictures of width x height, from a file or from memory.  Each table is
+// assigned its own buffer slot for AFGS1_POLICY_FIXED.  A table that cannot be read is not added.
+AFGS1_API afgs1_status afgs1_database_load_file( afgs1_database *database, const char *path, int width, int height );
+AFGS1_API afgs1_status afgs1_database_load_memory( afgs1_database *database, const void *data, size_t size,
+                                                   int width, int height );
+
+// Destroy a database.  The contexts created from it must be destroyed first.
+AFGS1_API void afgs1_database_destroy( afgs1_database *database );
+
+// Default configuration: 0/1 fps (which must be set unless presentation times are passed), fixed slots, no
+// refresh and seed modulation
+AFGS1_API void afgs1_context_config_default( afgs1_context_config *config );
+
+// Create the context of a stream.  The database must stay alive and unchanged until the context is destroyed.
+AFGS1_API afgs1_status afgs1_context_create( const afgs1_database *database, const afgs1_context_config *config,
+                                             afgs1_context **context );
+
+// Start a new stream: empty the buffer model and restart the picture count
+AFGS1_API void afgs1_context_reset( afgs1_context *context );
+
+AFGS1_API void afgs1_context_destroy( afgs1_context *context );
+
+// Write the AFGS1 T.35 payload (the bytes that follow the country code) of the next picture in decode
+// (bitstream) order and update the buffer model.  pts is the presentation time in the units of the parameter
+// files (1/10000000 seconds); a negative pts is derived from the POC and the frame rate.  The POC may be
+// negative, for example for leading pictures, and also modulates the grain seed.  irap is non-zero for a
+// random access point, where the buffer model is emptied.  *payload_size is 0 when no parameters apply to the
+// picture, and no message should be sent.  On error the buffer model is unchanged.
+AFGS1_API afgs1_status afgs1_context_get_t35_payload( afgs1_context *context, int64_t poc, int64_t pts, int irap,
+                                                      uint8_t *payload, size_t capacity, size_t *payload_size );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AFGS1_H
@@ -0,0 +1,384 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// OBUAFGS1App - Example program to insert AFGS1 ITU-T T.35 metadata OBUs in an AV1 bit-stream.
+//               Reads one or more "filmgrn1" parameter files, each with an associated width and height.
+//               Reads an AV1 bit-stream in an IVF file or as a sequence of OBUs (Section 5 low overhead
+//               format) and writes it with one METADATA_TYPE_ITUT_T35 metadata OBU carrying the AFGS1
+//               message in each temporal unit.
+//
+//
+// Usage: OBUAFGS1App --input <params_file1>,<width>,<height> --input <param_file2>,<width>,<height>
+//                    --bitstream_in <in_filename> --bitstream_out <out_filename>
+//                    --fps <num>/<denom>
+//                    --slot_policy <policy>
+//                    --refresh_interval <frames>
+//                    --modulate_seed <0|1>
+//
+// Where: <params_file> is a "filmgrn1" parameter file
+//        <width> is the image width associated with the params_file
+//        <height> is the image height associated with the params_file
+//        <in_filename> is the input AV1 bit-stream, either an IVF file or a Section 5 OBU stream
+//        <out_filename> is the output bit-stream, in the format of the input
+//        <fps_num> is the numerator of the frame rate used to generate the params file
+//        <fps_denom> is the denominator of the frame rate used to generate the params file
+//        <policy> selects the AFGS1 buffer slot for parameters that are not buffered: fixed (default), lru or
+//                 optimal
+//        <frames> forces a full retransmission of each buffered parameter set at this interval, in addition to
+//                 the buffer reset at each key frame (default 0)
+//        modulate_seed varies the grain seed with the frame number (default 1)
+//
+// Notes: 1. The "filmgrn1" parameter file may be generated using the noise_model software available with libaom
+//        2. The presentation time of a temporal unit is the IVF timestamp.  For a Section 5 OBU stream, or when
+//           --fps is provided, the temporal unit number and the frame rate are used.  The frame rate of a Section 5
+//           OBU stream is taken from the timing information of the sequence header when --fps is not provided.
+//        3. The metadata OBU is placed before the first frame header of each temporal unit.  The AFGS1 buffer is
+//           reset at each temporal unit that starts with a shown key frame.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include "afgs1_message.h"
+#include "Utilities/av1_obu.h"
+#include "Utilities/file_io.h"
+
+#define IVF_FILE_HEADER_SIZE  32
+#define IVF_FRAME_HEADER_SIZE 12
+
+static uint32_t read_le32( const uint8_t* p ) {
+    return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (uint32_t)p[3] << 24 );
+}
+
+static uint64_t read_le64( const uint8_t* p ) {
+    return read_le32(p) | ( (uint64_t)read_le32(p + 4) << 32 );
+}
+
+static void write_le32( uint8_t* p, uint32_t value ) {
+    for( int i = 0; i < 4; i++ )
+        p[i] = ( value >> ( 8 * i ) ) & 0xff;
+}
+
+// State of the metadata insertion
+struct Afgs1_obu_inserter {
+    Afgs1_film_grain_database db;
+    Afgs1_buffer buffer;
+    Afgs1_slot_policy policy;
+    int refresh_interval;
+    bool modulate_seed;
+
+    Av1Parser parser;
+    int frame_rate_num;
+    int frame_rate_denom;
+    bool frame_rate_command_line;
+
+    int64_t num_temporal_units;
+    int64_t num_key_frames;
+    int64_t num_metadata_obus;
+    int64_t num_referenced_sets;
+    int64_t metadata_bytes;
+    int64_t num_without_time;
+};
+
+// Create the metadata OBU for the temporal unit at the presentation time and update the buffer model.  The OBU is
+// left empty when no parameter set applies to the temporal unit.  Returns false when the parameter sets do not
+// conform.
+static bool create_metadata_obu( Afgs1_obu_inserter *s, int64_t time, bool key_frame, std::vector<uint8_t> *obu ) {
+
+    // The AFGS1 buffer is reset at a random access point
+    if( key_frame ) {
+        s->buffer.clear_buffer();
+        s->num_key_frames++;
+    }
+
+    s->buffer.set_time( s->num_temporal_units );
+    Afgs1_message message( &s->db, time, s->buffer, s->policy, s->refresh_interval );
+    if( s->modulate_seed )
+        message.update_grain_seed( s->num_temporal_units );
+
+    if( message.get_num_param_sets() == 0 )
+        return true;
+
+    std::vector<uint8_t> payload;
+    if( !message.write_t35_payload( &payload ) ) {
+        printf("Error: The film grain parameters of temporal unit %lld do not conform: more than %d sets, or sets "
+               "with the same resolution or film_grain_param_set_idx\n", (long long) s->num_temporal_units,
+               AFGS1_MAX_PARAM_SETS);
+        return false;
+    }
+    av1_write_t35_metadata_obu( AFGS1_T35_COUNTRY_CODE, payload, obu );
+    message.update_buffer( &s->buffer );
+
+    s->num_metadata_obus++;
+    s->num_referenced_sets += message.num_referenced_sets;
+    s->metadata_bytes += obu->size();
+    return true;
+}
+
+// Presentation time of the current temporal unit from the frame rate.  Returns false if no frame rate is known.
+static bool frame_rate_time( Afgs1_obu_inserter *s, int64_t *time ) {
+
+    if( !s->frame_rate_command_line )
+        s->parser.get_frame_rate( &s->frame_rate_num, &s->frame_rate_denom );
+    if( s->frame_rate_num <= 0 || s->frame_rate_denom <= 0 )
+        return false;
+
+    *time = afgs1_frame_time( s->num_temporal_units, s->frame_rate_num, s->frame_rate_denom );
+    return true;
+}
+
+// Parse the OBUs of a temporal unit up to the first frame header.  Returns the offset of the first frame header,
+// or size if there is none.
+static size_t find_first_frame_header( Afgs1_obu_inserter *s, const uint8_t* data, size_t size, bool *key_frame ) {
+
+    size_t pos = 0, end;
+    Av1Obu obu;
+    while( ( end = av1_next_obu( data, size, pos, &obu ) ) != 0 ) {
+        Av1FrameInfo info;
+        if( !s->parser.parse_obu( obu, &info ) )
+            printf("Warning: Unable to parse OBU of type %d\n", obu.type);
+        if( info.is_frame_header ) {
+            *key_frame = !info.show_existing_frame && info.frame_type == AV1_KEY_FRAME && info.show_frame;
+            return pos;
+        }
+        pos = end;
+    }
+    return size;
+}
+
+// Each IVF frame holds one temporal unit.  The metadata OBU is added to the frame and the frame size is updated.
+// Returns false on an invalid file header or when a metadata OBU cannot be created.
+static bool process_ivf( Afgs1_obu_inserter *s, const uint8_t* stream, size_t stream_size, BlockWriter *out ) {
+
+    size_t header_size = stream[6] | ( stream[7] << 8 );
+    if( header_size < IVF_FILE_HEADER_SIZE || header_size > stream_size ) {
+        printf("Error: Invalid IVF file header\n");
+        return false;
+    }
+    uint32_t timebase_den = read_le32( stream + 16 );
+    uint32_t timebase_num = read_le32( stream + 20 );
+    out->write( stream, header_size );
+
+    size_t pos = header_size;
+    while( pos + IVF_FRAME_HEADER_SIZE <= stream_size ) {
+        const uint8_t *frame_header = stream + pos;
+        size_t frame_size = read_le32( frame_header );
+        uint64_t pts = read_le64( frame_header + 4 );
+        const uint8_t *frame = frame_header + IVF_FRAME_HEADER_SIZE;
+        if( frame_size > stream_size - pos - IVF_FRAME_HEADER_SIZE ) {
+            printf("Warning: Truncated IVF frame at the end of the input\n");
+            break;
+        }
+        pos += IVF_FRAME_HEADER_SIZE + frame_size;
+
+        bool key_frame = false;
+        size_t insert = find_first_frame_header( s, frame, frame_size, &key_frame );
+
+        int64_t time;
+        bool time_valid;
+        if( s->frame_rate_command_line || timebase_num == 0 || timebase_den == 0 )
+            time_valid = frame_rate_time( s, &time );
+        else {
+            time = afgs1_frame_time( (int64_t) pts, timebase_den, timebase_num );
+            time_valid = true;
+        }
+
+        if( insert == frame_size || !time_valid ) {
+            if( insert != frame_size )
+                s->num_without_time++;
+            out->write( frame_header, IVF_FRAME_HEADER_SIZE + frame_size );
+            s->num_temporal_units++;
+            continue;
+        }
+
+        std::vector<uint8_t> obu;
+        if( !create_metadata_obu( s, time, key_frame, &obu ) )
+            return false;
+        s->num_temporal_units++;
+
+        uint8_t new_header[IVF_FRAME_HEADER_SIZE];
+        memcpy( new_header, frame_header, IVF_FRAME_HEADER_SIZE );
+        write_le32( new_header, (uint32_t)( frame_size + obu.size() ) );
+        out->write_copy( new_header, IVF_FRAME_HEADER_SIZE );
+        out->write( frame, insert );
+        out->write_copy( obu.data(), obu.size() );
+        out->write( frame + insert, frame_size - insert );
+    }
+
+    // Copy anything that follows the last complete frame
+    out->write( stream + pos, stream_size - pos );
+    return true;
+}
+
+// A temporal unit starts with a temporal delimiter.  The metadata OBU is inserted before its first frame header.
+// Returns false when a metadata OBU cannot be created.
+static bool process_section5( Afgs1_obu_inserter *s, const uint8_t* stream, size_t stream_size, BlockWriter *out ) {
+
+    size_t pos = 0, end;
+    bool started = false;   // the current temporal unit has OBUs
+    bool pending = true;    // the current temporal unit has no metadata OBU yet
+    Av1Obu obu;
+    while( ( end = av1_next_obu( stream, stream_size, pos, &obu ) ) != 0 ) {
+        Av1FrameInfo info;
+        if( !s->parser.parse_obu( obu, &info ) )
+            printf("Warning: Unable to parse OBU of type %d\n", obu.type);
+
+        if( obu.type == AV1_OBU_TEMPORAL_DELIMITER && started ) {
+            s->num_temporal_units++;
+            pending = true;
+        }
+        started = true;
+
+        if( pending && info.is_frame_header ) {
+            pending = false;
+            int64_t time;
+            if( frame_rate_time( s, &time ) ) {
+                std::vector<uint8_t> metadata;
+                bool key_frame = !info.show_existing_frame && info.frame_type == AV1_KEY_FRAME && info.show_frame;
+                if( !create_metadata_obu( s, time, key_frame, &metadata ) )
+                    return false;
+                out->write_copy( metadata.data(), metadata.size() );
+            }
+            else
+                s->num_without_time++;
+        }
+
+        out->write( obu.data, obu.size );
+        pos = end;
+    }
+    if( started )
+        s->num_temporal_units++;
+
+    if( pos < stream_size ) {
+        printf("Warning: Invalid OBU at offset %zu, the remaining data is copied\n", pos);
+        out->write( stream + pos, stream_size - pos );
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+
+    Afgs1_obu_inserter s;
+    s.policy = AFGS1_SLOT_POLICY_FIXED;
+    s.refresh_interval = 0;
+    s.modulate_seed = true;
+    s.frame_rate_num = -1;
+    s.frame_rate_denom = -1;
+    s.frame_rate_command_line = false;
+    s.num_temporal_units = 0;
+    s.num_key_frames = 0;
+    s.num_metadata_obus = 0;
+    s.num_referenced_sets = 0;
+    s.metadata_bytes = 0;
+    s.num_without_time = 0;
+
+    const char *input_filename = NULL;
+    const char *output_filename = NULL;
+
+    // Simple command line processing.
+    for( int i=1; i<argc; i++ ){
+
+        if( i + 1 >= argc ) {
+            printf("Error: %s must be followed by parameter\n", argv[i]);
+            return 1;
+        }
+
+        // Process an input parameter file.  Note that the input is loaded and inserted into a database.
+        if(strcmp( "--input", argv[i]) == 0) {
+
+            char *file_name = strtok( argv[++i], ",");
+            char *width = strtok( NULL, ",");
+            char *height = strtok( NULL, ",");
+            if( !file_name || !width || !height ) {
+                printf("Error: --input must be followed by <params_file>,<width>,<height>\n");
+                return 1;
+            }
+            if( !s.db.load_table(file_name, atoi(width), atoi(height)) ) {
+                printf("Error: Unable to load the parameter file %s\n", file_name);
+                return 1;
+            }
+        }
+        // Process the frame rate.  This is needed to determine the mapping between parameter sets
+        // and frame numbers, as the filmgrn1 files stores data relative to presentation time.
+        else if(strcmp( "--fps", argv[i]) == 0) {
+
+            char *num = strtok( argv[++i], "/");
+            char *denom = strtok( NULL, "/");
+            s.frame_rate_num = num ? atoi( num ) : -1;
+            s.frame_rate_denom = denom ? atoi( denom ) : 1;
+            if( s.frame_rate_num <= 0 || s.frame_rate_denom <= 0 ) {
+                printf("Error: --fps must be followed by <num>/<denom>\n");
+                return 1;
+            }
+            s.frame_rate_command_line = true;
+        }
+        else if(strcmp( "--bitstream_in", argv[i]) == 0)
+            input_filename = argv[++i];
+        else if(strcmp( "--bitstream_out", argv[i]) == 0)
+            output_filename = argv[++i];
+        else if(strcmp( "--slot_policy", argv[i]) == 0) {
+
+            const char *policy = argv[++i];
+            if( strcmp( policy, "fixed" ) == 0 )
+                s.policy = AFGS1_SLOT_POLICY_FIXED;
+            else if( strcmp( policy, "lru" ) == 0 )
+                s.policy = AFGS1_SLOT_POLICY_LRU;
+            else if( strcmp( policy, "optimal" ) == 0 )
+                s.policy = AFGS1_SLOT_POLICY_OPTIMAL;
+            else {
+                printf("Error: Unknown slot policy %s\n", policy);
+                return 1;
+            }
+        }
+        else if(strcmp( "--refresh_interval", argv[i]) == 0)
+            s.refresh_interval = atoi( argv[++i] );
+        else if(strcmp( "--modulate_seed", argv[i]) == 0)
+            s.modulate_seed = atoi( argv[++i] ) != 0;
+        else {
+            printf("Error: Unknown parameter %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if( !input_filename || !output_filename ) {
+        printf("Error: --bitstream_in and --bitstream_out must be provided\n");
+        return 1;
+    }
+
+    MappedFile input;
+    if( !input.open( input_filename ) ) {
+        printf("Error: Unable to open %s for reading\n", input_filename);
+        return 1;
+    }
+    BlockWriter output;
+    if( !output.open( output_filename ) ) {
+        printf("Error: Unable to open %s for writing\n", output_filename);
+        return 1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // The IVF file signature identifies the container, otherwise the input is a sequence of OBUs
+    bool ivf = input.size() >= IVF_FILE_HEADER_SIZE && memcmp( input.data(), "DKIF", 4 ) == 0;
+    bool result = ivf ? process_ivf( &s, input.data(), input.size(), &output )
+                      : process_section5( &s, input.data(), input.size(), &output );
+    output.close();
+    if( !result )
+        return 1;
+
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    printf("%s input: %lld temporal units, %lld key frames\n", ivf ? "IVF" : "OBU", (long long) s.num_temporal_units,
+           (long long) s.num_key_frames);
+    printf("AFGS1 metadata OBUs: %lld written (%lld bytes), %lld parameter sets referenced from the buffer\n",
+           (long long) s.num_metadata_obus, (long long) s.metadata_bytes, (long long) s.num_referenced_sets);
+    if( s.num_without_time )
+        printf("AFGS1 metadata OBUs not created for %lld temporal units without a frame rate\n",
+               (long long) s.num_without_time);
+    printf("Processing: %.3f s, %.1f MB/s\n", seconds, seconds > 0 ? input.size() / seconds / 1e6 : 0.0);
+
+    return 0;
+}
@@ -51,92 +51,42 @@
 
 #include "SEIAfgsAppCfg.h"
 #include "TLibEncoder/SEIwrite.h"
-#include "afgs1_buffer.h"
-#include "afgs1_database.h"
-#include "afgs1_bitstream.h"
+#include "afgs1_message.h"
 
 using namespace std;
 
-class SEIAfgs1 : public SEIUserDataRegistered
+class SEIAfgs1 : public SEIUserDataRegistered, public Afgs1_message
 {
-    BitStream write_buffer;
-    std::list<Afgs1_film_grain_params> afgs1_film_grain_param_sets;
-
 public:
 
     // Create the list of one or more film grain parameters from the database corresponding to the input
     // presentation time.  The presentation time calculation mimics what is used to generate
     // the "filmgrn1" parameter file.
     SEIAfgs1( Afgs1_film_grain_database *afgs1_db, int poc, frameRateInfo framerate_info )
+            : Afgs1_message( afgs1_db, afgs1_frame_time( poc, framerate_info.numerator, framerate_info.denominator ) )
     {
-        int index = poc * 10000000ULL * framerate_info.denominator / framerate_info.numerator;
-        afgs1_film_grain_param_sets = afgs1_db->find_frames(index);
-
-        // The grain seed in the database is constant for each entry.  We modulate it here.
-        update_grain_seed( poc );
-    }
-
-    // Create the list of one or more film grain parameters from the database corresponding to the input
-    // presentation time.  Additionally, update the film grain parameters based on the status of the buffer
-    // (that emulates the AFGS1 buffer at a decoder).  For example, the film grain parameters that already
-    // exist in the buffer can be signaled by setting the update_parameters flag to 0.
-    SEIAfgs1( Afgs1_film_grain_database *afgs1_db, int poc, frameRateInfo framerate_info, Afgs1_buffer buffer ) : SEIAfgs1( afgs1_db, poc, framerate_info )
-    {
-        std::list<Afgs1_film_grain_params>::iterator it;
-        for( it = afgs1_film_grain_param_sets.begin(); it != afgs1_film_grain_param_sets.end(); ++it )
-        {
-            int index = buffer.find_params( *it );
-            if( index >= 0 ) {
-                it->film_grain_param_set_idx = index;
-                it->update_parameters = 0;
-            }
-        }
     }
 
-    // Update the AFGS1 buffer using the SEI data
-    void update_buffer( Afgs1_buffer *buffer )
+    // As above, with the parameters signaled against the AFGS1 buffer (see Afgs1_message)
+    SEIAfgs1( Afgs1_film_grain_database *afgs1_db, int poc, frameRateInfo framerate_info, Afgs1_buffer buffer,
+              Afgs1_slot_policy policy = AFGS1_SLOT_POLICY_FIXED, int refresh_interval = 0 )
+            : Afgs1_message( afgs1_db, afgs1_frame_time( poc, framerate_info.numerator, framerate_info.denominator ),
+                             buffer, policy, refresh_interval )
     {
-        for( auto p : afgs1_film_grain_param_sets )
-        {
-            buffer->update_buffer(p);
-        }
     }
 
-    // Update the grain seed based on the POC
-    void update_grain_seed( int poc )
-    {
-        std::list<Afgs1_film_grain_params>::iterator it;
-        for( it = afgs1_film_grain_param_sets.begin(); it != afgs1_film_grain_param_sets.end(); ++it )
-        {
-            it->grain_seed = ( it->grain_seed + poc ) % ( (1<<16) - 1);
-        }
-    }
-
-    // Encode one or more film grain parameters in an ITU-T T35 message.
+    // Encode one or more film grain parameters in an ITU-T T35 message.  Returns NULL if the film grain
+    // parameters do not conform (see write_film_grain_param_sets).
     SEIUserDataRegistered *create_itut_t35_sei()
     {
-        // Convert the AFGS1 parameters to a bitstream
-        // Note: This corresponds to the av1_film_grain_param_sets() syntax
-        write_film_grain_param_sets(&afgs1_film_grain_param_sets, &write_buffer);
-
-        // Create the ITU-T T35 SEI message
         SEIUserDataRegistered *sei = new SEIUserDataRegistered;
-        sei->m_ituCountryCode = 0xB5;
-        sei->m_userData.push_back(0x58);
-        sei->m_userData.push_back(0x90);
-        sei->m_userData.push_back(0x01);
-
-        int num_bytes = write_buffer.get_position() / 8;
-
-        for( int i=0; i < num_bytes; i++ )
-            sei->m_userData.push_back( write_buffer.get_byte(i) );
-
-        // Clear the write buffer
-        write_buffer.clear();
-
+        sei->m_ituCountryCode = AFGS1_T35_COUNTRY_CODE;
+        if( !write_t35_payload( &sei->m_userData ) ) {
+            delete sei;
+            return NULL;
+        }
         return sei;
     };
 
 };
 #endif // __SEIAFGS1__
-
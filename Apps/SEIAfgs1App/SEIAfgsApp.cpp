@@ -45,162 +45,1077 @@
 #include <list>
 #include <vector>
 #include <cstdio>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <map>
+#include <sstream>
 
 #include "SEIAfgs.h"
 #include "SEIAfgsApp.h"
-#include "TLibDecoder/AnnexBread.h"
+#include "Utilities/annexb.h"
+#include "Utilities/file_io.h"
+#include "Utilities/spsc_queue.h"
 
 SEIAfgs1App::SEIAfgs1App()
+: m_batchJob(false)
+, m_stream(NULL)
+, m_streamSize(0)
+, m_scanPosition(0)
+, m_stdoutFd(-1)
+, m_sampleIndex(0)
+, m_sampleEnd(0)
+, m_detailedStats(false)
+, m_numPicturesWritten(0)
 {
-    // Initialize (and clear) the AFGS1 decoder buffer
-    m_afgs1Buffer.clear_buffer();
+    for( Int i = 0; i < NUM_STAGES; i++ ) {
+        m_stageStats[i].items = 0;
+        m_stageStats[i].bytes = 0;
+        m_stageStats[i].seconds = 0;
+        m_stageStats[i].cpuSeconds = 0;
+    }
+    m_stageStats[STAGE_SCAN].name = "scan";
+    m_stageStats[STAGE_PARSE].name = "parse";
+    m_stageStats[STAGE_BUILD].name = "build SEI";
+    m_stageStats[STAGE_WRITE].name = "write";
+    m_database = &m_afgs1Database;
 }
 
-Void SEIAfgs1App::load_database()
+// Load the parameter files of the command line.  Returns false, after reporting the file, if one cannot be loaded.
+Bool SEIAfgs1App::load_database()
 {
-    for( auto p : m_parameterFileInfo )
-        m_afgs1Database.load_table(p.filename.c_str(), p.width, p.height);
+    return xLoadDatabase( m_parameterFileInfo, &m_afgs1Database );
 }
 
-UInt SEIAfgs1App::process()
+Bool SEIAfgs1App::xLoadDatabase( const std::vector<parameterFileInfo> &fileInfo, Afgs1_film_grain_database *database )
+{
+    for( auto p : fileInfo ) {
+        if( !database->load_table(p.filename.c_str(), p.width, p.height) ) {
+            std::cerr << "failed to load film grain parameter file " << p.filename << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Determine the refresh interval in pictures.  An interval in milliseconds is converted using the frame rate.
+Int SEIAfgs1App::getRefreshInterval( const frameRateInfo &frameRate )
+{
+    if( m_refreshIntervalMs && frameRate.numerator > 0 && frameRate.denominator > 0 ) {
+        UInt64 scale = 1000ULL * frameRate.denominator;
+        Int pictures = (Int)( ( (UInt64)m_refreshIntervalMs * frameRate.numerator + scale - 1 ) / scale );
+        return pictures > 0 ? pictures : 1;
+    }
+    return m_refreshInterval;
+}
+
+// Read a sample index: the size in bytes of each sample of the input, one per line
+static Bool read_sample_index( const std::string &fileName, std::vector<UInt64> *sizes )
+{
+  std::ifstream file( fileName.c_str() );
+  if( !file )
+    return false;
+
+  UInt64 size;
+  while( file >> size )
+    sizes->push_back( size );
+  return file.eof();
+}
+
+static Bool write_sample_index( const std::string &fileName, const std::vector<UInt64> &sizes )
+{
+  std::ofstream file( fileName.c_str() );
+  for( size_t i = 0; i < sizes.size(); i++ )
+    file << sizes[i] << "\n";
+  return (Bool)file;
+}
+
+// Number of NAL units in flight between the stages of the pipelined mode
+#define PIPELINE_DEPTH 256
+
+// Segments in flight per worker thread of the parallel segments mode
+#define SEGMENTS_PER_THREAD 2
+
+static Double elapsed_seconds( std::chrono::steady_clock::time_point start )
+{
+  return std::chrono::duration<Double>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// Start the timing of the work of a stage.  The CPU time is only read when the run statistics are
+// collected, as the thread CPU clock is a system call on most platforms.
+StageTimer SEIAfgs1App::xStartStage() const
+{
+  StageTimer timer;
+  timer.wall = std::chrono::steady_clock::now();
+  timer.cpu = m_detailedStats ? thread_cpu_seconds() : 0;
+  return timer;
+}
+
+// Record the work done by a stage for one NAL unit
+Void SEIAfgs1App::xUpdateStageStats( StageStats *stats, const NalUnitItem *item, const StageTimer &start )
+{
+  stats->items++;
+  stats->bytes += item->end - item->nal.prefix;
+  stats->seconds += elapsed_seconds( start.wall );
+  if( m_detailedStats )
+    stats->cpuSeconds += thread_cpu_seconds() - start.cpu;
+}
+
+// Record the latency of each picture once its first slice segment has been written, and print a progress line
+// every ProgressInterval seconds.  Called by the write stage after each NAL unit.
+Void SEIAfgs1App::xUpdateProgress( const NalUnitItem *item )
+{
+  if( item->nal.size && item->firstSliceSegmentInPic ) {
+    m_numPicturesWritten++;
+    if( m_detailedStats )
+      m_pictureLatencies.push_back( elapsed_seconds( item->scanStart ) );
+  }
+  if( !m_progressInterval )
+    return;
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if( now < m_nextProgress )
+    return;
+  m_nextProgress = now + std::chrono::seconds( m_progressInterval );
+  Double seconds = elapsed_seconds( m_startTime );
+  const StageStats &written = m_stageStats[STAGE_WRITE];
+  printf("Progress: %u pictures, %llu NAL units, %.1f MB, %.1f s, %.1f MB/s\n", m_numPicturesWritten,
+         (unsigned long long)written.items, written.bytes / 1e6, seconds, seconds > 0 ? written.bytes / seconds / 1e6 : 0.0);
+  fflush( stdout );
+}
+
+// Stage 1: locate the next NAL unit in the input.  Returns false at the end of the input.
+Bool SEIAfgs1App::xScanNalUnit( NalUnitItem *item )
 {
+  if( m_nalLengthSize ) {
+    size_t position = m_scanPosition;
+    m_scanPosition = length_prefixed_next_nal_unit( m_stream, m_streamSize, position, m_nalLengthSize, &item->nal );
+    if( m_scanPosition == 0 && position < m_streamSize )
+      std::cerr << "Warning: Truncated NAL unit at the end of the input is discarded" << std::endl;
+  }
+  else
+    m_scanPosition = annexb_next_nal_unit( m_stream, m_streamSize, m_scanPosition, &item->nal );
+  if( m_scanPosition == 0 )
+    return false;
+
+  // The input bytes of the NAL unit end here, including any trailing zero bytes
+  item->end = m_stream + m_scanPosition;
+  item->insertSEI = false;
+  item->replaceNalUnit = false;
+  return true;
+}
+
+// Stage 2: parse the high level syntax needed to determine the picture boundaries and the POC
+Void SEIAfgs1App::xParseNalUnit( NalUnitItem *item, HevcParser *parser )
+{
+  item->firstSliceSegmentInPic = false;
+  if( item->nal.size == 0 )
+    return;
+
+  // The parser works on an unescaped view of the start of the NAL unit.  The input bytes themselves are
+  // never modified and are written to the output unchanged.
+  if( !parser->parse_nal_unit( item->nal.data, item->nal.size, &item->info ) )
+    std::cerr << "Warning: Unable to parse NAL unit of type " << item->info.nal_unit_type << std::endl;
+  item->firstSliceSegmentInPic = item->info.first_slice_segment_in_pic;
+  item->poc = parser->get_poc();
+  item->irap = parser->is_irap();
+  item->frameRatePresent = parser->get_frame_rate( &item->frameRateNumerator, &item->frameRateDenominator );
+}
 
-  // Open the input bit-stream
-  ifstream bitstreamFileIn(m_bitstreamFileNameIn.c_str(), ifstream::in | ifstream::binary);
-  if (!bitstreamFileIn)
+// Stage 3: create the AFGS1 SEI NAL unit for the first slice segment of each picture, against the model of
+// the decoder AFGS1 buffer
+Void SEIAfgs1App::xBuildSEI( NalUnitItem *item, SEIAfgs1State *state )
+{
+  if( item->nal.size == 0 )
   {
-    std::cerr << "failed to open bitstream file " << m_bitstreamFileNameIn.c_str() << " for reading";
-    exit(1);
+    /* this can happen if the following occur:
+     *  - two back-to-back start_code_prefixes
+     *  - start_code_prefix immediately followed by EOF
+     */
+    std::cerr << "Warning: Attempt to process an empty NAL unit" <<  std::endl;
+    return;
+  }
+  if( m_seiFilterMask && item->info.nal_unit_type == HEVC_NAL_PREFIX_SEI ) {
+    xFilterSEI( item, state );
+    return;
   }
+  if( !item->firstSliceSegmentInPic )
+    return;
+  if( !m_insertAFGS1 ) {
+    state->numPictures++;
+    return;
+  }
+
+  Int poc = item->poc;
 
-  // Define the output bitstream
-  ofstream bitstreamFileOut(m_bitstreamFileNameOut.c_str(), ifstream::out | ifstream::binary);
+  // Reset the AFGS1 buffer on an IRAP
+  if( item->irap ) {
+      state->afgs1Buffer.clear_buffer();
+      state->prevGrainStateValid = false;
+  }
+
+  // --Determine the frame rate parameters in the bitstream (if not provided on the command line).  The
+  //   parser provides the timing of the active SPS.
+  if( !state->frameRate.command_line_value && item->frameRatePresent ) {
+      state->frameRate.numerator = item->frameRateNumerator;
+      state->frameRate.denominator = item->frameRateDenominator;
+  }
 
-  // Initialize the input byte stream
-  InputByteStream bytestream(bitstreamFileIn);
-  bitstreamFileIn.clear();
-  bitstreamFileIn.seekg( 0, ios::beg );
+  // --Without a frame rate the picture cannot be located in the film grain timeline.  This happens when the
+  //   frame rate is not on the command line and no timing information has been received yet (for example
+  //   when streaming and the parameter sets with the timing arrive late).
+  if( state->frameRate.numerator <= 0 || state->frameRate.denominator <= 0 ) {
+      if( state->numPicturesWithoutFrameRate++ == 0 )
+          std::cerr << "Warning: No frame rate available for POC " << poc << ", AFGS1 message not created" << std::endl;
+      state->numPictures++;
+      return;
+  }
+
+  // --Create the SEI message from the database
+  state->afgs1Buffer.set_time( state->numPictures );
+  SEIAfgs1 sei( m_database, poc, state->frameRate, state->afgs1Buffer, m_slotPolicy,
+                getRefreshInterval( state->frameRate ) );
+  if( m_modulateGrainSeed )
+      sei.update_grain_seed( poc );
+  state->numPictures++;
+
+  // --The film grain persists until the next AFGS1 message, so the message may be omitted when the
+  //   picture uses the same film grain as the previous message.  A message is always sent for an IRAP.
+  if( m_suppressRedundant && state->prevGrainStateValid && sei.same_grain_state( state->prevGrainState ) ) {
+      state->numSuppressedSEIs++;
+      return;
+  }
+
+  // --Create the list of SEI messages.  Parameters that do not conform cannot be signaled, which fails the job
+  //   once the rest of the bit-stream has been written.
+  SEIUserDataRegistered *t35 = sei.create_itut_t35_sei();
+  if( !t35 ) {
+      if( state->numNonconformingPictures++ == 0 )
+          std::cerr << "Error: The film grain parameters of POC " << poc << " do not conform: more than "
+                    << AFGS1_MAX_PARAM_SETS << " sets, or sets with the same resolution or film_grain_param_set_idx"
+                    << std::endl;
+      return;
+  }
+  SEIMessages SEIs;
+  SEIs.push_back( t35 );
 
-  // Initialize the decoder for use in decoding the slice headers and determining the POC
-  m_cTDecTop.create();
-  m_cTDecTop.init();
+  state->numReferencedSets += sei.num_referenced_sets;
+  state->numFullUpdates += sei.num_full_updates();
+  state->fullUpdateBytesAvoided += sei.full_update_bytes_avoided;
+  state->numRefreshedSets += sei.num_refreshed_sets;
+  state->maxAcquisitionDelay = max<Int64>( state->maxAcquisitionDelay, (Int64)sei.max_reference_age );
 
-  while (!!bitstreamFileIn)
+  // --Write the NALU
+  OutputNALUnit outNalu(NAL_UNIT_PREFIX_SEI, item->info.temporal_id);
+  state->seiWriter.writeSEImessages(outNalu.m_Bitstream, SEIs, state->parameterSetManager.getActiveSPS(), false);
+  NALUnitEBSP naluWithHeader(outNalu);
+  item->seiData = naluWithHeader.m_nalUnitData.str();
+  item->insertSEI = true;
+  state->seiBytes += item->nal.prefix_size + item->seiData.size();
+  state->numSEIs++;
+
+  // Update the AFGS1 buffer
+  sei.update_buffer( &state->afgs1Buffer );
+  state->prevGrainState = sei.get_param_sets();
+  state->prevGrainStateValid = true;
+}
+
+// Remove the selected SEI messages from a prefix SEI NAL unit of the input.  The NAL unit is replaced by the
+// remaining messages, or removed when none remain.
+Void SEIAfgs1App::xFilterSEI( NalUnitItem *item, SEIAfgs1State *state )
+{
+  Int removed = sei_filter_nal_unit( item->nal.data, item->nal.size, m_seiFilterMask, &item->replacementData );
+  if( removed == 0 )
+    return;
+
+  item->replaceNalUnit = true;
+  state->numRemovedSEIs += removed;
+  if( item->replacementData.empty() )
+    state->numRemovedNalUnits++;
+}
+
+// Stage 4: write the NAL unit, preceded by the AFGS1 SEI NAL unit when one was created
+// In the streaming mode the input buffer is reused before the output is flushed, so the input bytes are copied
+Void SEIAfgs1App::xWriteInput( BlockWriter *writer, const uint8_t *data, size_t size )
+{
+  if( m_streaming )
+    writer->write_copy( data, size );
+  else
+    writer->write( data, size );
+}
+
+// Write the start code of the NAL unit.  The start code of a removed NAL unit takes the place of the start
+// code of the NAL unit that follows it, so that removing an inserted AFGS1 SEI NAL unit restores the input.
+Void SEIAfgs1App::xWritePrefix( NalUnitItem *item, BlockWriter *writer )
+{
+  if( m_pendingPrefix.empty() ) {
+      xWriteInput( writer, item->nal.prefix, item->nal.prefix_size );
+      return;
+  }
+  writer->write_copy( m_pendingPrefix.data(), m_pendingPrefix.size() );
+  xUpdateSampleSize( item, (Int64)m_pendingPrefix.size() - (Int64)item->nal.prefix_size );
+  m_pendingPrefix.clear();
+}
+
+// Returns false, after reporting the error, if an SEI NAL unit does not fit the length field of the input
+Bool SEIAfgs1App::xWriteNalUnit( NalUnitItem *item, BlockWriter *writer )
+{
+  if( item->replaceNalUnit && item->replacementData.empty() ) {
+      // The NAL unit is dropped together with its length field.  In a byte stream, the start code is kept
+      // for the next NAL unit.
+      xUpdateSampleSize( item, -(Int64)( item->end - item->nal.prefix ) );
+      if( !m_nalLengthSize && m_pendingPrefix.empty() )
+          m_pendingPrefix.assign( item->nal.prefix, item->nal.prefix + item->nal.prefix_size );
+  }
+  else if( item->replaceNalUnit ) {
+      // The filtered NAL unit keeps the start code of the input, or has a new length field
+      const uint8_t *nalEnd = item->nal.data + item->nal.size;
+      if( m_nalLengthSize ) {
+          uint8_t lengthField[4];
+          if( !length_prefixed_write_length( lengthField, m_nalLengthSize, item->replacementData.size() ) ) {
+              std::cerr << "SEI NAL unit of " << item->replacementData.size() << " bytes does not fit a "
+                        << m_nalLengthSize << " byte length field" << std::endl;
+              return false;
+          }
+          writer->write_copy( lengthField, m_nalLengthSize );
+      }
+      else
+          xWritePrefix( item, writer );
+      writer->write_copy( item->replacementData.data(), item->replacementData.size() );
+      xWriteInput( writer, nalEnd, item->end - nalEnd );
+      xUpdateSampleSize( item, (Int64)item->replacementData.size() - (Int64)item->nal.size );
+  }
+  else if( item->insertSEI && m_nalLengthSize ) {
+      if( !m_quiet )
+        printf("Creating AFGS1 message (POC %d)\n", item->poc );
+
+      // The SEI NAL unit is added to the sample before the slice, with its own length field
+      uint8_t lengthField[4];
+      if( !length_prefixed_write_length( lengthField, m_nalLengthSize, item->seiData.size() ) ) {
+          std::cerr << "AFGS1 SEI NAL unit of " << item->seiData.size() << " bytes does not fit a "
+                    << m_nalLengthSize << " byte length field" << std::endl;
+          return false;
+      }
+      writer->write_copy( lengthField, m_nalLengthSize );
+      writer->write_copy( reinterpret_cast<const uint8_t*>(item->seiData.data()), item->seiData.size() );
+      xWriteInput( writer, item->nal.prefix, item->end - item->nal.prefix );
+      xUpdateSampleSize( item, m_nalLengthSize + item->seiData.size() );
+  }
+  else if( item->insertSEI ) {
+      if( !m_quiet )
+        printf("Creating AFGS1 message (POC %d)\n", item->poc );
+
+      // The SEI NAL unit takes the start code (and any zero bytes) that preceded the slice in the input,
+      // and the slice follows with a three byte start code.
+      static const uint8_t startCodePrefix[] = { 0,0,1 };
+      xWritePrefix( item, writer );
+      writer->write_copy( reinterpret_cast<const uint8_t*>(item->seiData.data()), item->seiData.size() );
+      writer->write( startCodePrefix, 3 );
+      xWriteInput( writer, item->nal.data, item->end - item->nal.data );
+      xUpdateSampleSize( item, item->nal.prefix_size + item->seiData.size() );
+  }
+  else if( !m_pendingPrefix.empty() ) {
+      xWritePrefix( item, writer );
+      xWriteInput( writer, item->nal.data, item->end - item->nal.data );
+  }
+  else {
+      xWriteInput( writer, item->nal.prefix, item->end - item->nal.prefix );
+  }
+  return true;
+}
+
+// Add the bytes inserted (or removed) at the NAL unit to the size of the sample that contains it
+Void SEIAfgs1App::xUpdateSampleSize( const NalUnitItem *item, Int64 sizeChange )
+{
+  if( m_sampleSizes.empty() )
+    return;
+
+  UInt64 offset = item->nal.data - m_stream;
+  while( offset >= m_sampleEnd && m_sampleIndex + 1 < m_sampleSizes.size() ) {
+    m_sampleIndex++;
+    m_sampleEnd += m_sampleSizes[m_sampleIndex];
+  }
+  m_sampleSizesOut[m_sampleIndex] += sizeChange;
+}
+
+// Run the stages one after the other for each NAL unit.  The processing modes return false if a NAL unit
+// cannot be written.
+Bool SEIAfgs1App::xProcessSerial( BlockWriter *writer )
+{
+  NalUnitItem item;
+  while( true )
   {
-    /* location serves to work around a design fault in the decoder, whereby
-     * the process of reading a new slice that is the first slice of a new frame
-     * requires the SEIAfgsApp::process() method to be called again with the same
-     * nal unit. */
-    AnnexBStats stats = AnnexBStats();
+    StageTimer start = xStartStage();
+    if( !xScanNalUnit( &item ) )
+      break;
+    item.scanStart = start.wall;
+    xUpdateStageStats( &m_stageStats[STAGE_SCAN], &item, start );
 
-    InputNALUnit nalu;
-    byteStreamNALUnit(bytestream, nalu.getBitstream().getFifo(), stats);
+    start = xStartStage();
+    xParseNalUnit( &item, &m_hevcParser );
+    xUpdateStageStats( &m_stageStats[STAGE_PARSE], &item, start );
 
-    // call actual decoding function
-    if (nalu.getBitstream().getFifo().empty())
-    {
-      /* this can happen if the following occur:
-       *  - empty input file
-       *  - two back-to-back start_code_prefixes
-       *  - start_code_prefix immediately followed by EOF
-       */
-      std::cerr << "Warning: Attempt to process an empty NAL unit" <<  std::endl;
+    start = xStartStage();
+    xBuildSEI( &item, &m_state );
+    xUpdateStageStats( &m_state.buildStats, &item, start );
+
+    start = xStartStage();
+    if( !xWriteNalUnit( &item, writer ) )
+      return false;
+    xUpdateStageStats( &m_stageStats[STAGE_WRITE], &item, start );
+    xUpdateProgress( &item );
+  }
+  return true;
+}
+
+// Run each stage on its own thread.  The NAL units are passed between the stages in order through bounded
+// single producer / single consumer queues, and the items are returned to the scan stage once written.  Each
+// stage owns the state it modifies (scan position, parser, AFGS1 buffer, output), so the output is identical
+// to the serial mode.  A null item marks the end of the input.  When a NAL unit cannot be written, the scan
+// stage stops and the items in flight are returned without being written.
+Bool SEIAfgs1App::xProcessPipelined( BlockWriter *writer )
+{
+  std::vector<NalUnitItem> items( PIPELINE_DEPTH );
+  SpscQueue<NalUnitItem*> freeQueue( PIPELINE_DEPTH );
+  SpscQueue<NalUnitItem*> parseQueue( PIPELINE_DEPTH );
+  SpscQueue<NalUnitItem*> buildQueue( PIPELINE_DEPTH );
+  SpscQueue<NalUnitItem*> writeQueue( PIPELINE_DEPTH );
+  for( size_t i = 0; i < items.size(); i++ )
+    freeQueue.push( &items[i] );
+  std::atomic<Bool> writeFailed( false );
+
+  std::thread scanThread( [&]() {
+    while( true ) {
+      NalUnitItem *item = freeQueue.pop();
+      StageTimer start = xStartStage();
+      if( writeFailed || !xScanNalUnit( item ) ) {
+        parseQueue.push( NULL );
+        break;
+      }
+      item->scanStart = start.wall;
+      xUpdateStageStats( &m_stageStats[STAGE_SCAN], item, start );
+      parseQueue.push( item );
     }
-    else
-    {
+  } );
 
-      // Read the NALU
-      // Note the fourth input to decode instructs the function to decode the HLS
-      // while skipping CABAC and reconstruction
-      int iSkipFrame = 0;
-      int iPOCLastDisplay = 0;
-      read( nalu );
-      m_pcSlice = m_cTDecTop.getApcSlicePilot();
-      m_cTDecTop.decode(nalu, iSkipFrame, iPOCLastDisplay, true);
-
-      // Kludge - The decoder removes the emulation prevention bytes inside the read function (above).
-      // Since we've already decoded the header and will simply copy this data back into the bitstream,
-      // we add the prevention bytes back here.
-      {
-        vector<uint8_t> &buf = nalu.getBitstream().getFifo();
-        vector<unsigned int> prevention_locations = nalu.getBitstream().getEmulationPreventionByteLocation();
+  std::thread parseThread( [&]() {
+    NalUnitItem *item;
+    while( ( item = parseQueue.pop() ) != NULL ) {
+      StageTimer start = xStartStage();
+      xParseNalUnit( item, &m_hevcParser );
+      xUpdateStageStats( &m_stageStats[STAGE_PARSE], item, start );
+      buildQueue.push( item );
+    }
+    buildQueue.push( NULL );
+  } );
 
-        for (auto loc: prevention_locations) {
-          buf.insert( buf.begin() + loc, 3 );
-        }
-        nalu.getBitstream().clearEmulationPreventionByteLocation();
+  std::thread buildThread( [&]() {
+    NalUnitItem *item;
+    while( ( item = buildQueue.pop() ) != NULL ) {
+      StageTimer start = xStartStage();
+      xBuildSEI( item, &m_state );
+      xUpdateStageStats( &m_state.buildStats, item, start );
+      writeQueue.push( item );
+    }
+    writeQueue.push( NULL );
+  } );
+
+  // The write stage runs on the calling thread
+  NalUnitItem *item;
+  while( ( item = writeQueue.pop() ) != NULL ) {
+    if( !writeFailed ) {
+      StageTimer start = xStartStage();
+      if( xWriteNalUnit( item, writer ) ) {
+        xUpdateStageStats( &m_stageStats[STAGE_WRITE], item, start );
+        xUpdateProgress( item );
       }
+      else
+        writeFailed = true;
+    }
+    freeQueue.push( item );
+  }
 
-      // Reset the AFGS1 buffer on an IRAP
-      if( nalu.isSlice() && m_pcSlice->isIRAP() )
-          m_afgs1Buffer.clear_buffer();
-
-      // Add the AFGS1 message before each slice
-      // TODO: Should check if this is the first slice of a frame
-      if( nalu.isSlice() && bitstreamFileOut ) {
-
-          // Create the AFGS1 SEI message
-          printf("Creating AFGS1 message (POC %d)\n", m_pcSlice->getPOC() );
-
-          // --Determine the frame rate parameters in the bitstream (if not provided on the command line)
-          if( !m_frameRateInfo.command_line_value ) {
-
-              if( m_pcSlice->getVPS() )
-              {
-                  const TimingInfo *m_timing_info = m_pcSlice->getVPS()->getTimingInfo();
-                  if( m_timing_info->getTimingInfoPresentFlag() ) {
-                      m_frameRateInfo.numerator = m_timing_info->getTimeScale();
-                      m_frameRateInfo.denominator = m_timing_info->getNumUnitsInTick();
-                  }
-              }
-
-              if( m_pcSlice->getSPS() && m_pcSlice->getSPS()->getVuiParametersPresentFlag() )
-              {
-                  const TimingInfo *m_timing_info = m_pcSlice->getSPS()->getVuiParameters()->getTimingInfo();
-                  if( m_timing_info->getTimingInfoPresentFlag() ) {
-                      m_frameRateInfo.numerator = m_timing_info->getTimeScale();
-                      m_frameRateInfo.denominator = m_timing_info->getNumUnitsInTick();
-                  }
-              }
+  scanThread.join();
+  parseThread.join();
+  buildThread.join();
+  return !writeFailed;
+}
+
+// A segment of the parallel segments mode starts at the first slice segment of an IRAP picture of the base
+// layer.  It is located from the NAL unit header and the first bit of the slice segment header, before the NAL
+// unit is parsed.  The third byte of a NAL unit is never an emulation prevention byte, as the second byte of a
+// valid NAL unit header is not zero.
+static Bool starts_segment( const AnnexBNalUnit &nal )
+{
+  if( nal.size < 3 || ( nal.data[1] & 0x7 ) == 0 )
+    return false;
+  Int type = ( nal.data[0] >> 1 ) & 0x3f;
+  Int layerId = ( ( nal.data[0] & 1 ) << 5 ) | ( nal.data[1] >> 3 );
+  return type >= HEVC_NAL_BLA_W_LP && type <= HEVC_NAL_CRA && layerId == 0 && ( nal.data[2] & 0x80 );
+}
+
+// Process the segments of the bit-stream that start at an IRAP in parallel.  The AFGS1 buffer is cleared at
+// each IRAP, so the AFGS1 SEI messages of a segment depend only on the picture number and the frame rate at
+// the start of the segment.  The calling thread scans the input and hands each segment to a pool of worker
+// threads, which parse the segment and create its SEI messages, and writes the segments in order as they
+// complete.  At most SEGMENTS_PER_THREAD segments per worker are held in memory.
+//
+// The parameter sets and the POC derivation carry over from one segment to the next, so each segment is
+// parsed from the parser state at the end of the previous segment.  Parsing reads only the headers and is
+// cheap, so a worker waits briefly for the previous segment to be parsed, and the SEI messages of the
+// segments are then created in parallel.  The output is identical to the serial mode.
+Bool SEIAfgs1App::xProcessSegments( BlockWriter *writer )
+{
+  struct Segment {
+    std::vector<NalUnitItem> items;
+    HevcParser    parser;                               // parser state at the end of the segment
+    UInt          numPictures;                          // pictures up to the end of the segment
+    frameRateInfo frameRate;                            // frame rate in use at the end of the segment
+    Bool          parsed;
+    Bool          done;
+  };
+
+  size_t numThreads = m_numThreads ? m_numThreads : std::thread::hardware_concurrency();
+  numThreads = max( (size_t)1, numThreads );
+  size_t window = SEGMENTS_PER_THREAD * numThreads;
+  std::vector<Segment> segments( window );              // segment k is held in segments[k % window]
+  size_t numScanned = 0;
+  size_t nextSegment = 0;
+  Bool scanDone = false;
+  std::mutex mutex;
+  std::condition_variable segmentScanned;
+  std::condition_variable segmentParsed;
+  std::condition_variable segmentDone;
+
+  std::vector<SEIAfgs1State> states( numThreads );
+  std::vector<StageStats> parseStats( numThreads, m_stageStats[STAGE_PARSE] );
+  std::vector<std::thread> workers;
+  for( size_t w = 0; w < numThreads; w++ ) {
+    parseStats[w].items = 0;
+    parseStats[w].bytes = 0;
+    parseStats[w].seconds = 0;
+    parseStats[w].cpuSeconds = 0;
+    workers.push_back( std::thread( [&, w]() {
+      SEIAfgs1State &state = states[w];
+      while( true ) {
+        size_t k;
+        {
+          std::unique_lock<std::mutex> lock( mutex );
+          segmentScanned.wait( lock, [&]() { return nextSegment < numScanned || scanDone; } );
+          if( nextSegment == numScanned )
+            break;
+          k = nextSegment++;
+          segmentParsed.wait( lock, [&]() { return k == 0 || segments[( k - 1 ) % window].parsed; } );
+        }
+        Segment &segment = segments[k % window];
+        const Segment *previous = k > 0 ? &segments[( k - 1 ) % window] : NULL;
+        segment.parser = previous ? previous->parser : m_hevcParser;
+        segment.numPictures = previous ? previous->numPictures : 0;
+        segment.frameRate = previous ? previous->frameRate : m_state.frameRate;
+
+        // The SEI messages are created from the picture number and the frame rate at the start of the segment
+        state.afgs1Buffer.clear_buffer();
+        state.prevGrainStateValid = false;
+        state.numPictures = segment.numPictures;
+        state.frameRate = segment.frameRate;
+
+        for( size_t i = 0; i < segment.items.size(); i++ ) {
+          NalUnitItem &item = segment.items[i];
+          StageTimer start = xStartStage();
+          xParseNalUnit( &item, &segment.parser );
+          xUpdateStageStats( &parseStats[w], &item, start );
+
+          // Follow the frame rate as the SEI construction does
+          if( item.nal.size && item.firstSliceSegmentInPic ) {
+            if( !segment.frameRate.command_line_value && item.frameRatePresent ) {
+              segment.frameRate.numerator = item.frameRateNumerator;
+              segment.frameRate.denominator = item.frameRateDenominator;
+            }
+            segment.numPictures++;
           }
+        }
+        {
+          std::lock_guard<std::mutex> lock( mutex );
+          segment.parsed = true;
+          segmentParsed.notify_all();
+        }
 
-          // --Create the SEI message from the database
-          SEIAfgs1 sei( &m_afgs1Database, m_pcSlice->getPOC(), m_frameRateInfo, m_afgs1Buffer );
+        for( size_t i = 0; i < segment.items.size(); i++ ) {
+          StageTimer start = xStartStage();
+          xBuildSEI( &segment.items[i], &state );
+          xUpdateStageStats( &state.buildStats, &segment.items[i], start );
+        }
 
-          // Insert the SEI message into the output bit-stream
-          // --Create the list of SEI messages
-          SEIMessages SEIs;
-          SEIs.push_back( sei.create_itut_t35_sei() );
+        std::lock_guard<std::mutex> lock( mutex );
+        segment.done = true;
+        segmentDone.notify_all();
+      }
+    } ) );
+  }
 
-          // --Write the start code
-          static const UChar startCodePrefix[] = { 0,0,0,1 };
-          bitstreamFileOut.write(reinterpret_cast<const char*>(startCodePrefix + 1), 3);
+  // Write the oldest segment once it is complete, and release its slot.  After a write error, the remaining
+  // segments are not written.
+  size_t numWritten = 0;
+  Bool writeFailed = false;
+  UInt numPictures = 0;
+  frameRateInfo frameRate = m_state.frameRate;
+  auto writeSegment = [&]() {
+    Segment &segment = segments[numWritten % window];
+    {
+      std::unique_lock<std::mutex> lock( mutex );
+      segmentDone.wait( lock, [&]() { return segment.done; } );
+    }
+    for( size_t i = 0; i < segment.items.size() && !writeFailed; i++ ) {
+      StageTimer start = xStartStage();
+      if( !xWriteNalUnit( &segment.items[i], writer ) ) {
+        writeFailed = true;
+        break;
+      }
+      xUpdateStageStats( &m_stageStats[STAGE_WRITE], &segment.items[i], start );
+      xUpdateProgress( &segment.items[i] );
+    }
+    numPictures = segment.numPictures;
+    frameRate = segment.frameRate;
+    segment.items.clear();
+    numWritten++;
+  };
 
-          // --Write the NALU
-          OutputNALUnit outNalu(NAL_UNIT_PREFIX_SEI, nalu.m_temporalId);
-          m_seiWriter.writeSEImessages(outNalu.m_Bitstream, SEIs, m_parameterSetManager.getActiveSPS(), false);
-          NALUnitEBSP naluWithHeader(outNalu);
-          bitstreamFileOut << naluWithHeader.m_nalUnitData.str();
+  // Scan the input into segments.  The NAL unit that starts the next segment is held until the current
+  // segment has been handed to the workers.
+  NalUnitItem item;
+  Bool pending = false;
+  while( !writeFailed ) {
+    if( numScanned - numWritten == window )
+      writeSegment();
 
-          // Update the AFGS1 buffer
-          sei.update_buffer( &m_afgs1Buffer );
+    Segment &segment = segments[numScanned % window];
+    if( pending )
+      segment.items.push_back( item );
+    pending = false;
+    while( true ) {
+      StageTimer start = xStartStage();
+      if( !xScanNalUnit( &item ) )
+        break;
+      item.scanStart = start.wall;
+      xUpdateStageStats( &m_stageStats[STAGE_SCAN], &item, start );
+      if( !segment.items.empty() && starts_segment( item.nal ) ) {
+        pending = true;
+        break;
+      }
+      segment.items.push_back( item );
+    }
+    if( segment.items.empty() )
+      break;
 
+    std::lock_guard<std::mutex> lock( mutex );
+    segment.parsed = false;
+    segment.done = false;
+    numScanned++;
+    segmentScanned.notify_one();
+    if( !pending )
+      break;
+  }
+  {
+    std::lock_guard<std::mutex> lock( mutex );
+    scanDone = true;
+    segmentScanned.notify_all();
+  }
+  while( numWritten < numScanned )
+    writeSegment();
+
+  for( size_t w = 0; w < workers.size(); w++ )
+    workers[w].join();
+
+  // Combine the statistics of the workers
+  for( size_t w = 0; w < states.size(); w++ ) {
+    m_state.accumulate( states[w] );
+    m_stageStats[STAGE_PARSE].items += parseStats[w].items;
+    m_stageStats[STAGE_PARSE].bytes += parseStats[w].bytes;
+    m_stageStats[STAGE_PARSE].seconds += parseStats[w].seconds;
+    m_stageStats[STAGE_PARSE].cpuSeconds += parseStats[w].cpuSeconds;
+  }
+  m_state.numPictures = numPictures;
+  m_state.frameRate = frameRate;
+  return !writeFailed;
+}
+
+// Process the input as it arrives, for input from a pipe.  A NAL unit is processed once the start code of
+// the following NAL unit (or the end of the input) has been received, and the output is flushed at each
+// access unit boundary, so that the added latency is at most one access unit.
+Bool SEIAfgs1App::xProcessStreaming( StreamReader *reader, BlockWriter *writer )
+{
+  NalUnitItem item;
+  size_t position = 0;
+  while( true )
+  {
+    StageTimer start = xStartStage();
+    m_stream = reader->data();
+    m_streamSize = reader->size();
+    m_scanPosition = position;
+    Bool found = xScanNalUnit( &item );
+
+    // The NAL unit may continue in input that has not been received yet.  The input before it has been
+    // written and is discarded.
+    if( !reader->is_eof() && ( !found || m_scanPosition == m_streamSize ) ) {
+      if( position > 0 ) {
+        reader->discard( position );
+        position = 0;
+      }
+      reader->read_more();
+      continue;
+    }
+    if( !found )
+      break;
+    position = m_scanPosition;
+    item.scanStart = start.wall;
+    xUpdateStageStats( &m_stageStats[STAGE_SCAN], &item, start );
+
+    start = xStartStage();
+    xParseNalUnit( &item, &m_hevcParser );
+    xUpdateStageStats( &m_stageStats[STAGE_PARSE], &item, start );
+
+    start = xStartStage();
+    xBuildSEI( &item, &m_state );
+    xUpdateStageStats( &m_state.buildStats, &item, start );
+
+    // Output the previous access unit before the first NAL unit of the next one
+    start = xStartStage();
+    if( item.nal.size && item.info.access_unit_start )
+      writer->flush();
+    if( !xWriteNalUnit( &item, writer ) )
+      return false;
+    xUpdateStageStats( &m_stageStats[STAGE_WRITE], &item, start );
+    xUpdateProgress( &item );
+  }
+  return true;
+}
+
+// Process the jobs of a manifest.  Each line of the manifest holds the input and output bit-streams of a job,
+// optionally followed by its film grain parameter string (or "-" for the ParameterString option) and its frame
+// rate.  Empty lines and lines starting with '#' are ignored.  Each distinct set of parameter files is loaded
+// once and shared read-only by its jobs.  The jobs are processed on a pool of worker threads, each job with its
+// own parser, AFGS1 buffer and SEI construction state, so that the output of a job is identical to processing it
+// alone.
+UInt SEIAfgs1App::xProcessBatch()
+{
+  struct Job {
+    std::string                 fileNameIn;
+    std::string                 fileNameOut;
+    Afgs1_film_grain_database*  database;
+    frameRateInfo               frameRate;
+    UInt                        result;
+  };
+
+  std::ifstream manifest( m_jobManifest.c_str() );
+  if( !manifest )
+  {
+    std::cerr << "failed to open job manifest " << m_jobManifest.c_str() << std::endl;
+    return 1;
+  }
+
+  // Read the jobs and load the parameter files they use
+  std::vector<Job> jobs;
+  std::map<std::string, std::unique_ptr<Afgs1_film_grain_database> > databases;
+  std::string line;
+  for( Int lineNumber = 1; std::getline( manifest, line ); lineNumber++ )
+  {
+    std::istringstream fields( line );
+    std::string parameterString, frameRateString, extra;
+    Job job;
+    if( !( fields >> job.fileNameIn ) || job.fileNameIn[0] == '#' )
+      continue;
+    if( !( fields >> job.fileNameOut ) || ( fields >> parameterString >> frameRateString >> extra ) ||
+        job.fileNameIn == "-" || job.fileNameOut == "-" )
+    {
+      std::cerr << m_jobManifest << ":" << lineNumber << ": expected <in> <out> [<parameters>|-] [<num>/<denom>]" << std::endl;
+      return 1;
+    }
+
+    job.database = &m_afgs1Database;
+    if( !parameterString.empty() && parameterString != "-" )
+    {
+      std::unique_ptr<Afgs1_film_grain_database> &database = databases[parameterString];
+      if( !database )
+      {
+        std::vector<parameterFileInfo> fileInfo;
+        database.reset( new Afgs1_film_grain_database );
+        if( !parseParameterString( parameterString, &fileInfo ) || !xLoadDatabase( fileInfo, database.get() ) )
+          return 1;
       }
+      job.database = database.get();
+    }
+
+    job.frameRate = m_frameRateInfo;
+    if( !frameRateString.empty() && !parseFrameRate( frameRateString, &job.frameRate ) )
+      return 1;
+    job.result = 0;
+    jobs.push_back( job );
+  }
+
+  // Process the jobs
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  size_t numThreads = m_numThreads ? m_numThreads : std::thread::hardware_concurrency();
+  numThreads = max( (size_t)1, min( numThreads, jobs.size() ) );
+  std::atomic<size_t> nextJob( 0 );
+  std::mutex mutex;
+
+  std::vector<std::thread> workers;
+  for( size_t w = 0; w < numThreads && !jobs.empty(); w++ ) {
+    workers.push_back( std::thread( [&]() {
+      size_t k;
+      while( ( k = nextJob++ ) < jobs.size() ) {
+        Job &job = jobs[k];
+        std::chrono::steady_clock::time_point jobStart = std::chrono::steady_clock::now();
+
+        std::unique_ptr<SEIAfgs1App> app( new SEIAfgs1App );
+        static_cast<SEIAfgs1AppCfg&>( *app ) = *this;
+        app->m_jobManifest.clear();
+        app->m_bitstreamFileNameIn = job.fileNameIn;
+        app->m_bitstreamFileNameOut = job.fileNameOut;
+        app->m_frameRateInfo = job.frameRate;
+        app->m_database = job.database;
+        app->m_batchJob = true;
+        app->m_quiet = true;
+        app->m_progressInterval = 0;
+        job.result = app->process();
 
-      // Copy the input NALU to the output bitstream
-      if( bitstreamFileOut ){
-          if (nalu.m_nalUnitType < 16) { stats.m_numZeroByteBytes--; }
-          int iNumZeros = stats.m_numLeadingZero8BitsBytes + stats.m_numZeroByteBytes + stats.m_numStartCodePrefixBytes - 1;
-          char ch = 0;
-          for (int i = 0; i < iNumZeros; i++) { bitstreamFileOut.write(&ch, 1); }
-          ch = 1; bitstreamFileOut.write(&ch, 1);
-          bitstreamFileOut.write((const char*)nalu.getBitstream().getFifo().data(), nalu.getBitstream().getFifo().size());
+        std::lock_guard<std::mutex> lock( mutex );
+        if( job.result )
+          printf("Job %zu: %s failed\n", k + 1, job.fileNameIn.c_str());
+        else
+          printf("Job %zu: %s -> %s: %u AFGS1 SEI messages (%llu bytes) for %u pictures, %.3f s\n", k + 1,
+                 job.fileNameIn.c_str(), job.fileNameOut.c_str(), app->m_state.numSEIs,
+                 (unsigned long long)app->m_state.seiBytes, app->m_state.numPictures, elapsed_seconds( jobStart ));
       }
+    } ) );
+  }
+  for( size_t w = 0; w < workers.size(); w++ )
+    workers[w].join();
+
+  size_t numFailed = 0;
+  for( size_t k = 0; k < jobs.size(); k++ )
+    numFailed += jobs[k].result ? 1 : 0;
+  printf("Batch processing: %zu jobs (%zu failed), %zu parameter file sets loaded, %zu threads, %.3f s\n",
+         jobs.size(), numFailed, databases.size() + ( m_parameterFileInfo.empty() ? 0 : 1 ), numThreads,
+         elapsed_seconds( start ));
+  return numFailed ? 1 : 0;
+}
+
+// Write the run statistics to the StatsFile as a JSON document: the processing time, the counters of the
+// SEI construction, the wall clock and CPU time of each stage and the percentiles of the picture latency,
+// which is the time from the scan of the first slice segment of a picture to its write.
+Bool SEIAfgs1App::xWriteStatistics( const char *mode, Double seconds, Double cpuSeconds, UInt64 bytesOut )
+{
+  static const char *stageKeys[NUM_STAGES] = { "scan", "parse", "build_sei", "write" };
+
+  FILE *fp = fopen( m_statsFile.c_str(), "w" );
+  if( !fp )
+    return false;
+
+  const SEIAfgs1State &state = m_state;
+  JsonWriter json( fp );
+  json.begin_object();
+  json.member( "mode", mode );
+  json.member( "input", m_bitstreamFileNameIn );
+  json.member( "output", m_bitstreamFileNameOut );
+  json.member( "wall_seconds", seconds );
+  json.member( "cpu_seconds", cpuSeconds );
+
+  json.begin_object( "counters" );
+  json.member( "nal_units", m_stageStats[STAGE_SCAN].items );
+  json.member( "pictures", state.numPictures );
+  json.member( "afgs1_seis_written", state.numSEIs );
+  json.member( "afgs1_seis_suppressed", state.numSuppressedSEIs );
+  json.member( "afgs1_sei_bytes", state.seiBytes );
+  json.member( "parameter_sets_full_updates", state.numFullUpdates );
+  json.member( "parameter_sets_buffer_hits", state.numReferencedSets );
+  json.member( "buffer_hit_bytes_avoided", state.fullUpdateBytesAvoided );
+  json.member( "parameter_sets_refreshed", state.numRefreshedSets );
+  json.member( "pictures_without_frame_rate", state.numPicturesWithoutFrameRate );
+  json.member( "seis_removed", state.numRemovedSEIs );
+  json.member( "sei_nal_units_removed", state.numRemovedNalUnits );
+  json.member( "bytes_in", m_stageStats[STAGE_SCAN].bytes );
+  json.member( "bytes_out", bytesOut );
+  json.end_object();
+
+  json.begin_object( "stages" );
+  for( Int i = 0; i < NUM_STAGES; i++ ) {
+    const StageStats &stats = m_stageStats[i];
+    json.begin_object( stageKeys[i] );
+    json.member( "nal_units", stats.items );
+    json.member( "bytes", stats.bytes );
+    json.member( "wall_seconds", stats.seconds );
+    json.member( "cpu_seconds", stats.cpuSeconds );
+    json.end_object();
+  }
+  json.end_object();
 
+  std::vector<Double> latencies = m_pictureLatencies;
+  json.begin_object( "picture_latency_ms" );
+  json.member( "pictures", (UInt64)latencies.size() );
+  json.member( "p50", 1000.0 * percentile( &latencies, 0.5 ) );
+  json.member( "p99", 1000.0 * percentile( &latencies, 0.99 ) );
+  json.member( "max", 1000.0 * percentile( &latencies, 1.0 ) );
+  json.end_object();
+
+  json.end_object();
+  return fclose( fp ) == 0;
+}
+
+// When the output bit-stream is written to stdout, the messages printed to stdout are sent to stderr.  Returns
+// false if stdout cannot be redirected.
+Bool SEIAfgs1App::redirectStdout()
+{
+  if( m_bitstreamFileNameOut != "-" )
+    return true;
+
+  m_stdoutFd = redirect_stdout_to_stderr();
+  if( m_stdoutFd < 0 )
+  {
+    std::cerr << "failed to redirect stdout for the output bitstream" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+UInt SEIAfgs1App::process()
+{
+  if( !m_jobManifest.empty() )
+    return xProcessBatch();
+
+  // Open the input bit-stream.  A file is mapped, while the input of the streaming mode is read as it
+  // arrives.
+  MappedFile bitstreamFileIn;
+  StreamReader bitstreamStreamIn;
+  if (m_streaming ? !bitstreamStreamIn.open(m_bitstreamFileNameIn.c_str()) : !bitstreamFileIn.open(m_bitstreamFileNameIn.c_str()))
+  {
+    std::cerr << "failed to open bitstream file " << m_bitstreamFileNameIn.c_str() << " for reading" << std::endl;
+    return 1;
+  }
+
+  // Define the output bitstream.  Unmodified input bytes are written directly from the mapped input.
+  BlockWriter bitstreamFileOut;
+  if (m_bitstreamFileNameOut == "-" ? !bitstreamFileOut.open_fd(m_stdoutFd) : !bitstreamFileOut.open(m_bitstreamFileNameOut.c_str()))
+  {
+    std::cerr << "failed to open bitstream file " << m_bitstreamFileNameOut.c_str() << " for writing" << std::endl;
+    return 1;
+  }
+
+  // Initialize the parser used to decode the slice headers and determine the POC
+  m_hevcParser.reset();
+
+  m_stream = bitstreamFileIn.data();
+  m_streamSize = bitstreamFileIn.size();
+  m_scanPosition = 0;
+  m_state.frameRate = m_frameRateInfo;
+
+  // Load the sample index of the input.  The sizes of the output samples are updated as SEI NAL units are
+  // inserted.
+  if( !m_sampleIndexFileIn.empty() ) {
+    if( !read_sample_index( m_sampleIndexFileIn, &m_sampleSizes ) )
+    {
+      std::cerr << "failed to read sample index " << m_sampleIndexFileIn.c_str() << std::endl;
+      return 1;
     }
+    UInt64 total = 0;
+    for( size_t i = 0; i < m_sampleSizes.size(); i++ )
+      total += m_sampleSizes[i];
+    if( total != m_streamSize )
+      std::cerr << "Warning: The sample index covers " << total << " bytes of a " << m_streamSize << " byte input" << std::endl;
+    m_sampleSizesOut = m_sampleSizes;
+    m_sampleIndex = 0;
+    m_sampleEnd = m_sampleSizes.empty() ? 0 : m_sampleSizes[0];
+  }
+
+  m_detailedStats = !m_statsFile.empty();
+  m_startTime = std::chrono::steady_clock::now();
+  m_nextProgress = m_startTime + std::chrono::seconds( m_progressInterval );
+  Double cpuStart = m_detailedStats ? process_cpu_seconds() : 0;
+  const char *mode;
+  Bool written;
+  if( m_streaming ) {
+    mode = "Streaming";
+    written = xProcessStreaming( &bitstreamStreamIn, &bitstreamFileOut );
+  }
+  else if( m_parallelSegments ) {
+    mode = "Segment parallel";
+    written = xProcessSegments( &bitstreamFileOut );
+  }
+  else if( m_pipeline ) {
+    mode = "Pipelined";
+    written = xProcessPipelined( &bitstreamFileOut );
+  }
+  else {
+    mode = "Serial";
+    written = xProcessSerial( &bitstreamFileOut );
+  }
+  bitstreamFileOut.close();
 
-  } // end bitstreamFileIn
+  // The errors of a job are returned, so that the other jobs of a batch complete
+  if( !written )
+    return 1;
+  if( m_state.numNonconformingPictures ) {
+    std::cerr << "AFGS1 SEI messages not created for " << m_state.numNonconformingPictures
+              << " pictures with film grain parameters that do not conform" << std::endl;
+    return 1;
+  }
+  Double processingSeconds = elapsed_seconds( m_startTime );
+  Double processingCpuSeconds = m_detailedStats ? process_cpu_seconds() - cpuStart : 0;
+  m_stageStats[STAGE_BUILD] = m_state.buildStats;
 
-  m_cTDecTop.destroy();
+  if( !m_sampleIndexFileOut.empty() && !write_sample_index( m_sampleIndexFileOut, m_sampleSizesOut ) )
+  {
+    std::cerr << "failed to write sample index " << m_sampleIndexFileOut.c_str() << std::endl;
+    return 1;
+  }
+
+  if( m_detailedStats &&
+      !xWriteStatistics( mode, processingSeconds, processingCpuSeconds, bitstreamFileOut.get_bytes_written() ) )
+  {
+    std::cerr << "failed to write statistics file " << m_statsFile.c_str() << std::endl;
+    return 1;
+  }
+
+  // The batch mode reports a summary of each job
+  if( m_batchJob )
+    return 0;
+
+  const SEIAfgs1State &state = m_state;
+  printf("AFGS1 SEI messages: %u written, %u suppressed for %u pictures\n",
+         state.numSEIs, state.numSuppressedSEIs, state.numPictures);
+  printf("AFGS1 parameter sets: %u full updates, %u referenced from the buffer (%llu bytes avoided), %u refreshed\n",
+         state.numFullUpdates, state.numReferencedSets, (unsigned long long)state.fullUpdateBytesAvoided,
+         state.numRefreshedSets);
+  if( m_seiFilterMask )
+      printf("SEI messages removed from the input: %u (%u prefix SEI NAL units removed)\n",
+             state.numRemovedSEIs, state.numRemovedNalUnits);
+  if( state.numPicturesWithoutFrameRate )
+      printf("AFGS1 SEI messages not created for %u pictures without a frame rate\n", state.numPicturesWithoutFrameRate);
+
+  // Report the SEI bitrate and the worst-case delay for a decoder joining between IRAPs to acquire the parameters
+  const frameRateInfo &frameRate = state.frameRate;
+  if( state.numPictures && frameRate.numerator > 0 && frameRate.denominator > 0 ) {
+      Double seconds = (Double)state.numPictures * frameRate.denominator / frameRate.numerator;
+      Double delayMs = 1000.0 * ( state.maxAcquisitionDelay + 1 ) * frameRate.denominator / frameRate.numerator;
+      printf("AFGS1 SEI: %llu bytes, %.3f kbps, worst-case parameter acquisition %lld pictures (%.1f ms)\n",
+             (unsigned long long)state.seiBytes, 8.0 * state.seiBytes / seconds / 1000.0,
+             (long long)( state.maxAcquisitionDelay + 1 ), delayMs);
+  }
+
+  // Report the throughput of each stage.  The stage time excludes the time spent waiting for other stages.
+  // With parallel segments, the SEI construction time is the sum over the worker threads.
+  printf("%s processing: %.3f s, %.1f MB/s\n", mode, processingSeconds,
+         processingSeconds > 0 ? m_stageStats[STAGE_SCAN].bytes / processingSeconds / 1e6 : 0.0);
+  for( Int i = 0; i < NUM_STAGES; i++ ) {
+      const StageStats &stats = m_stageStats[i];
+      printf("  %-10s %10llu NAL units %8.3f s %10.1f MB/s", stats.name, (unsigned long long)stats.items,
+             stats.seconds, stats.seconds > 0 ? stats.bytes / stats.seconds / 1e6 : 0.0);
+      if( m_detailedStats )
+          printf(" %8.3f s CPU", stats.cpuSeconds);
+      printf("\n");
+  }
   return 0;
 }
@@ -52,20 +52,139 @@
 #include <stdio.h>
 #include <fstream>
 #include <iostream>
+#include <chrono>
+#include <string>
+#include <list>
+#include <vector>
 #include "SEIAfgsAppCfg.h"
 #include "TLibCommon/CommonDef.h"
 #include "TLibCommon/TComSlice.h"
-#include "TLibDecoder/NALread.h"
 #include "TLibEncoder/NALwrite.h"
-#include "TLibDecoder/SEIread.h"
 #include "TLibEncoder/SEIwrite.h"
-#include "TLibDecoder/TDecTop.h"
+#include "Utilities/annexb.h"
+#include "Utilities/file_io.h"
+#include "Utilities/hevc_parser.h"
+#include "Utilities/run_stats.h"
+#include "Utilities/sei_filter.h"
 #include "afgs1_buffer.h"
 #include "afgs1_database.h"
 #include "afgs1_bitstream.h"
 
 using namespace std;
 
+// Processing stages of the application
+enum SEIAfgs1Stage {
+  STAGE_SCAN = 0,                                       ///< start code scanning of the input
+  STAGE_PARSE,                                          ///< high level syntax parsing and POC derivation
+  STAGE_BUILD,                                          ///< AFGS1 SEI construction against the buffer model
+  STAGE_WRITE,                                          ///< ordered output
+  NUM_STAGES
+};
+
+// A NAL unit of the input and the results of each stage for it
+struct NalUnitItem {
+  AnnexBNalUnit         nal;
+  const uint8_t*        end;                            ///< end of the input bytes of the NAL unit
+  std::chrono::steady_clock::time_point scanStart;      ///< start of the scan of the NAL unit, for the picture latency
+  HevcNalInfo           info;
+  Bool                  firstSliceSegmentInPic;
+  Int                   poc;
+  Bool                  irap;
+  Bool                  frameRatePresent;               ///< frame rate of the active SPS
+  Int                   frameRateNumerator;
+  Int                   frameRateDenominator;
+  Bool                  insertSEI;                      ///< write seiData before the NAL unit
+  std::string           seiData;
+  Bool                  replaceNalUnit;                 ///< write replacementData instead of the NAL unit
+  std::vector<uint8_t>  replacementData;                ///< filtered prefix SEI NAL unit (empty: the NAL unit is removed)
+};
+
+struct StageStats {
+  const char*           name;
+  UInt64                items;
+  UInt64                bytes;
+  Double                seconds;                        ///< time spent in the stage, excluding waits
+  Double                cpuSeconds;                     ///< CPU time of the stage, when the run statistics are collected
+};
+
+// Start of the work of a stage on a NAL unit
+struct StageTimer {
+  std::chrono::steady_clock::time_point wall;
+  Double                cpu;
+};
+
+// State of the AFGS1 SEI construction.  The AFGS1 buffer is cleared at each IRAP, so the segments of the
+// bit-stream that start at an IRAP can each be processed with their own state.
+struct SEIAfgs1State {
+  ParameterSetManager   parameterSetManager;
+  SEIWriter             seiWriter;
+  Afgs1_buffer          afgs1Buffer;
+  frameRateInfo         frameRate;
+
+  std::list<Afgs1_film_grain_params> prevGrainState;   ///< film grain signaled by the last AFGS1 SEI
+  Bool                  prevGrainStateValid;
+
+  UInt                  numPictures;                    ///< pictures processed (the time of the AFGS1 buffer)
+  UInt                  numPicturesWithoutFrameRate;    ///< pictures without an AFGS1 SEI as the frame rate was unknown
+  UInt                  numNonconformingPictures;       ///< pictures without an AFGS1 SEI as the sets do not conform
+  UInt                  numFullUpdates;                 ///< parameter sets sent with update_parameters equal to 1
+  UInt                  numReferencedSets;              ///< parameter sets sent with update_parameters equal to 0
+  UInt64                fullUpdateBytesAvoided;         ///< payload bytes saved by referencing buffered sets
+  UInt                  numRefreshedSets;               ///< buffered parameter sets resent by the refresh interval
+  UInt                  numSEIs;                        ///< AFGS1 SEI messages written
+  UInt                  numSuppressedSEIs;              ///< AFGS1 SEI messages omitted because the grain was unchanged
+  UInt64                seiBytes;                       ///< bytes written for AFGS1 SEI NAL units
+  UInt                  numRemovedSEIs;                 ///< SEI messages removed from the input
+  UInt                  numRemovedNalUnits;             ///< prefix SEI NAL units removed as no message remained
+  Int64                 maxAcquisitionDelay;            ///< worst-case pictures before a joining decoder has the parameters
+  StageStats            buildStats;
+
+  SEIAfgs1State()
+  : prevGrainStateValid(false)
+  , numPictures(0)
+  , numPicturesWithoutFrameRate(0)
+  , numNonconformingPictures(0)
+  , numFullUpdates(0)
+  , numReferencedSets(0)
+  , fullUpdateBytesAvoided(0)
+  , numRefreshedSets(0)
+  , numSEIs(0)
+  , numSuppressedSEIs(0)
+  , seiBytes(0)
+  , numRemovedSEIs(0)
+  , numRemovedNalUnits(0)
+  , maxAcquisitionDelay(0)
+  {
+    afgs1Buffer.clear_buffer();
+    buildStats.name = "build SEI";
+    buildStats.items = 0;
+    buildStats.bytes = 0;
+    buildStats.seconds = 0;
+    buildStats.cpuSeconds = 0;
+  }
+
+  // Add the statistics of another state (the picture count is not a statistic and is not added)
+  Void accumulate( const SEIAfgs1State &s )
+  {
+    numPicturesWithoutFrameRate += s.numPicturesWithoutFrameRate;
+    numNonconformingPictures += s.numNonconformingPictures;
+    numFullUpdates += s.numFullUpdates;
+    numReferencedSets += s.numReferencedSets;
+    fullUpdateBytesAvoided += s.fullUpdateBytesAvoided;
+    numRefreshedSets += s.numRefreshedSets;
+    numSEIs += s.numSEIs;
+    numSuppressedSEIs += s.numSuppressedSEIs;
+    seiBytes += s.seiBytes;
+    numRemovedSEIs += s.numRemovedSEIs;
+    numRemovedNalUnits += s.numRemovedNalUnits;
+    maxAcquisitionDelay = max( maxAcquisitionDelay, s.maxAcquisitionDelay );
+    buildStats.items += s.buildStats.items;
+    buildStats.bytes += s.buildStats.bytes;
+    buildStats.seconds += s.buildStats.seconds;
+    buildStats.cpuSeconds += s.buildStats.cpuSeconds;
+  }
+};
+
 class SEIAfgs1App : public SEIAfgs1AppCfg
 {
 
@@ -74,17 +193,55 @@ public:
   virtual ~SEIAfgs1App()  {}
 
   UInt  process            (); ///< main decoding function
-  Void  load_database      ();
+  Bool  load_database      ();
+  Bool  redirectStdout     (); ///< send messages to stderr when the bitstream is written to stdout
 
 protected:
-  ParameterSetManager   m_parameterSetManager;
-  SEIReader             m_seiReader;
-  SEIWriter             m_seiWriter;
-  TDecTop               m_cTDecTop;                     ///< decoder class
-  TComSlice*            m_pcSlice;                      ///< slice header class
-
-  Afgs1_buffer          m_afgs1Buffer;
+  HevcParser            m_hevcParser;                   ///< high level syntax parser used to determine the POC
   Afgs1_film_grain_database m_afgs1Database;
+  Afgs1_film_grain_database* m_database;                ///< database in use: m_afgs1Database, or shared by a batch
+  Bool                  m_batchJob;                     ///< a job of the batch mode, which reports only a summary
+  SEIAfgs1State         m_state;                        ///< SEI construction state of the serial and pipelined modes
+
+  const uint8_t*        m_stream;                       ///< mapped input bit-stream
+  size_t                m_streamSize;
+  size_t                m_scanPosition;
+  Int                   m_stdoutFd;                     ///< original stdout, when the bitstream is written to stdout
+
+  std::vector<UInt64>   m_sampleSizes;                  ///< sizes of the input samples, from the sample index
+  std::vector<UInt64>   m_sampleSizesOut;               ///< sizes of the output samples
+  size_t                m_sampleIndex;                  ///< sample of the last NAL unit written
+  UInt64                m_sampleEnd;                    ///< input offset of the end of that sample
+  StageStats            m_stageStats[NUM_STAGES];
+  std::vector<uint8_t>  m_pendingPrefix;                ///< start code of a removed NAL unit, written before the next one
+
+  Bool                  m_detailedStats;                ///< collect the CPU time and the picture latency for StatsFile
+  UInt                  m_numPicturesWritten;
+  std::vector<Double>   m_pictureLatencies;             ///< seconds from the scan to the write of each picture
+  std::chrono::steady_clock::time_point m_startTime;    ///< start of the processing
+  std::chrono::steady_clock::time_point m_nextProgress; ///< time of the next progress line
+
+  Int                   getRefreshInterval( const frameRateInfo &frameRate );
+
+  Bool                  xScanNalUnit      ( NalUnitItem *item );
+  Void                  xParseNalUnit     ( NalUnitItem *item, HevcParser *parser );
+  Void                  xBuildSEI         ( NalUnitItem *item, SEIAfgs1State *state );
+  Void                  xFilterSEI        ( NalUnitItem *item, SEIAfgs1State *state );
+  Bool                  xWriteNalUnit     ( NalUnitItem *item, BlockWriter *writer );
+  Void                  xWriteInput       ( BlockWriter *writer, const uint8_t *data, size_t size );
+  Void                  xWritePrefix      ( NalUnitItem *item, BlockWriter *writer );
+  Void                  xUpdateSampleSize ( const NalUnitItem *item, Int64 sizeChange );
+  StageTimer            xStartStage       () const;
+  Void                  xUpdateStageStats ( StageStats *stats, const NalUnitItem *item, const StageTimer &start );
+  Void                  xUpdateProgress   ( const NalUnitItem *item );
+  Bool                  xWriteStatistics  ( const char *mode, Double seconds, Double cpuSeconds, UInt64 bytesOut );
+  Bool                  xProcessSerial    ( BlockWriter *writer );
+  Bool                  xProcessPipelined ( BlockWriter *writer );
+  Bool                  xProcessSegments  ( BlockWriter *writer );
+  Bool                  xProcessStreaming ( StreamReader *reader, BlockWriter *writer );
+  UInt                  xProcessBatch     ();
+
+  static Bool           xLoadDatabase     ( const std::vector<parameterFileInfo> &fileInfo, Afgs1_film_grain_database *database );
 
 };
 
@@ -51,6 +51,74 @@
 using namespace std;
 namespace po = df::program_options_lite;
 
+// Convert a parameter string of the form <filename>,<width>,<height>,... to parameter file information
+Bool SEIAfgs1AppCfg::parseParameterString( std::string parameterString, std::vector<parameterFileInfo> *fileInfo )
+{
+    // Convert the command line to a series of tokens
+    // TODO: Improve command line handling
+    std::deque<std::string> v;
+    char *token = strtok( const_cast<char*>(parameterString.c_str()), ",");
+    while( token ) {
+        v.push_back(string(token));
+        token = strtok(nullptr, ",");
+    }
+
+    // Error checking
+    if( v.size() % 3 )
+    {
+        std::cerr << "Parameter string must be of the form <filename>,<width>,<height>,..." << std::endl;
+        return false;
+    }
+
+    // Convert to ParameterInfo structures
+    while( v.size() )
+    {
+        parameterFileInfo p;
+
+        p.filename = v.front();
+        v.pop_front();
+
+        p.width    = stoi(v.front());
+        v.pop_front();
+
+        p.height   = stoi(v.front());
+        v.pop_front();
+
+        fileInfo->push_back(p);
+    }
+    return true;
+}
+
+// Convert a frame rate string of the form <numerator>/<denominator>
+Bool SEIAfgs1AppCfg::parseFrameRate( std::string frameRateString, frameRateInfo *frameRate )
+{
+    frameRate->command_line_value = true;
+
+    // Convert the command line to a series of tokens
+    std::deque<std::string> v;
+    char *token = strtok( const_cast<char*>(frameRateString.c_str()), "/");
+    while( token ) {
+        v.push_back(string(token));
+        token = strtok(nullptr, "/");
+    }
+
+    // Error checking
+    if( v.size() != 2 )
+    {
+        std::cerr << "Frame Rate string must be of the form <numerator>/<denominator>" << std::endl;
+        return false;
+    }
+
+    // Convert to FrameRateInfo structures
+    frameRate->numerator = stoi(v.front());
+    v.pop_front();
+
+    frameRate->denominator = stoi(v.front());
+    v.pop_front();
+
+    return true;
+}
+
 Bool SEIAfgs1AppCfg::parseCfg( Int argc, TChar* argv[] )
 {
   Bool do_help = false;
@@ -64,7 +132,25 @@ Bool SEIAfgs1AppCfg::parseCfg( Int argc, TChar* argv[] )
   ("ParameterString,p",         m_parameterString,                     string(""), "film grain parameter info <filename>,<width>,<height>,...")
   ("BitstreamFileIn,b",         m_bitstreamFileNameIn,                 string(""), "bitstream input file name")
   ("BitstreamFileOut,o",        m_bitstreamFileNameOut,                string(""), "bitstream output file name")
+  ("NalLengthSize",             m_nalLengthSize,                       0u,         "NAL units are preceded by a length field of 1, 2 or 4 bytes (0: Annex B byte stream)")
+  ("SampleIndexIn",             m_sampleIndexFileIn,                   string(""), "input sample index: the size of each sample in bytes, one per line")
+  ("SampleIndexOut",            m_sampleIndexFileOut,                  string(""), "output sample index with the sample sizes updated for the inserted SEI")
   ("Fps, f",                    m_frameRateString,                     string(""), "frame rate used for film grain parameter files")
+  ("SlotPolicy",                m_slotPolicyString,                    string("fixed"), "AFGS1 buffer slot allocation: fixed, lru or optimal")
+  ("RefreshInterval",           m_refreshInterval,                     0u,         "resend buffered film grain parameters every N pictures (0: only at IRAP)")
+  ("RefreshIntervalMs",         m_refreshIntervalMs,                   0u,         "resend buffered film grain parameters every N milliseconds (0: only at IRAP)")
+  ("ModulateGrainSeed",         m_modulateGrainSeed,                   true,       "vary the grain seed of each parameter set with the POC")
+  ("ExistingAFGS1",             m_existingAfgs1String,                 string("keep"), "AFGS1 SEI messages already in the bit-stream: keep, replace or remove")
+  ("RemoveFilmGrainCharacteristics", m_removeFilmGrainCharacteristics, false,     "remove the film grain characteristics SEI messages of the bit-stream")
+  ("SuppressRedundant",         m_suppressRedundant,                   false,      "omit the AFGS1 SEI when the film grain matches the previous picture")
+  ("Pipeline",                  m_pipeline,                            false,      "run the processing stages on separate threads")
+  ("ParallelSegments",          m_parallelSegments,                    false,      "process the IRAP delimited segments of the bit-stream in parallel")
+  ("Streaming",                 m_streaming,                           false,      "read the input as it arrives, for pipes (implied by the file name -)")
+  ("JobManifest",               m_jobManifest,                         string(""), "process the jobs of a manifest: <in> <out> [<filename>,<width>,<height>,...|-] [<num>/<denom>] per line")
+  ("Threads",                   m_numThreads,                          0u,         "worker threads for ParallelSegments or JobManifest (0: number of cores)")
+  ("StatsFile",                 m_statsFile,                           string(""), "write the run statistics (stage times, counters, picture latency) to a JSON file")
+  ("ProgressInterval",          m_progressInterval,                    0u,         "print a progress line every N seconds (0: disabled)")
+  ("Quiet",                     m_quiet,                               false,      "do not print a line for each AFGS1 SEI message")
   ("WarnUnknowParameter,w",     warnUnknowParameter,                   0,          "warn for unknown configuration parameters instead of failing")
   ;
 
@@ -92,81 +178,94 @@ Bool SEIAfgs1AppCfg::parseCfg( Int argc, TChar* argv[] )
     }
   }
 
-  if (m_bitstreamFileNameIn.empty())
+  if (m_bitstreamFileNameIn.empty() && m_jobManifest.empty())
   {
     std::cerr << "No input file specified, aborting" << std::endl;
     return false;
   }
-  if (m_bitstreamFileNameOut.empty())
+  if (m_bitstreamFileNameOut.empty() && m_jobManifest.empty())
   {
     std::cerr << "No output file specified, aborting" << std::endl;
     return false;
   }
 
-  if (!m_parameterString.empty()) {
-
-    // Convert the command line to a series of tokens
-    // TODO: Improve command line handling
-    std::deque<std::string> v;
-    char *token = strtok( const_cast<char*>(m_parameterString.c_str()), ",");
-    while( token ) {
-        v.push_back(string(token));
-        token = strtok(nullptr, ",");
-    }
-
-    // Error checking
-    if( v.size() % 3 )
-    {
-        std::cerr << "Parameter string must be of the form <filename>,<width>,<height>,..." << std::endl;
-        return false;
-    }
-
-    // Convert to ParameterInfo structures
-    while( v.size() )
-    {
-        parameterFileInfo* p = new parameterFileInfo;
-
-        p->filename = v.front();
-        v.pop_front();
-
-        p->width    = stoi(v.front());
-        v.pop_front();
+  if (!m_parameterString.empty() && !parseParameterString(m_parameterString, &m_parameterFileInfo)) {
+    return false;
+  }
 
-        p->height   = stoi(v.front());
-        v.pop_front();
+  if (!m_frameRateString.empty() && !parseFrameRate(m_frameRateString, &m_frameRateInfo)) {
+    return false;
+  }
 
-        m_parameterFileInfo.push_back(*p);
-    }
+  if (m_slotPolicyString == "fixed") {
+    m_slotPolicy = AFGS1_SLOT_POLICY_FIXED;
+  } else if (m_slotPolicyString == "lru") {
+    m_slotPolicy = AFGS1_SLOT_POLICY_LRU;
+  } else if (m_slotPolicyString == "optimal") {
+    m_slotPolicy = AFGS1_SLOT_POLICY_OPTIMAL;
+  } else {
+    std::cerr << "Slot policy must be one of fixed, lru or optimal" << std::endl;
+    return false;
+  }
 
+  // Existing AFGS1 messages are removed when replaced, and no new messages are inserted when removed
+  if (m_existingAfgs1String == "keep") {
+    m_seiFilterMask = 0;
+  } else if (m_existingAfgs1String == "replace" || m_existingAfgs1String == "remove") {
+    m_seiFilterMask = SEI_FILTER_AFGS1;
+    m_insertAFGS1 = m_existingAfgs1String == "replace";
+  } else {
+    std::cerr << "ExistingAFGS1 must be one of keep, replace or remove" << std::endl;
+    return false;
+  }
+  if (m_removeFilmGrainCharacteristics) {
+    m_seiFilterMask |= SEI_FILTER_FILM_GRAIN_CHARACTERISTICS;
   }
 
-    if (!m_frameRateString.empty()) {
+  if (m_refreshInterval && m_refreshIntervalMs) {
+    std::cerr << "Only one of RefreshInterval and RefreshIntervalMs may be specified" << std::endl;
+    return false;
+  }
 
-        m_frameRateInfo.command_line_value = true;
+  // The file name "-" reads from stdin or writes to stdout, which requires the streaming mode
+  if (m_bitstreamFileNameIn == "-" || m_bitstreamFileNameOut == "-")
+  {
+    m_streaming = true;
+  }
 
-        // Convert the command line to a series of tokens
-        std::deque<std::string> v;
-        char *token = strtok( const_cast<char*>(m_frameRateString.c_str()), "/");
-        while( token ) {
-            v.push_back(string(token));
-            token = strtok(nullptr, "/");
-        }
+  if (m_nalLengthSize != 0 && m_nalLengthSize != 1 && m_nalLengthSize != 2 && m_nalLengthSize != 4)
+  {
+    std::cerr << "NalLengthSize must be 0, 1, 2 or 4" << std::endl;
+    return false;
+  }
 
-        // Error checking
-        if( v.size() != 2 )
-        {
-            std::cerr << "Frame Rate string must be of the form <numerator>/<denominator>" << std::endl;
-            return false;
-        }
+  // The jobs of a manifest are processed concurrently, each in the serial mode.  The sample index and statistics
+  // files are those of a single bit-stream, which concurrent jobs would overwrite.
+  if (!m_jobManifest.empty() && (!m_bitstreamFileNameIn.empty() || !m_bitstreamFileNameOut.empty() ||
+                                 m_pipeline || m_parallelSegments || m_streaming || !m_sampleIndexFileIn.empty() ||
+                                 !m_sampleIndexFileOut.empty() || !m_statsFile.empty()))
+  {
+    std::cerr << "JobManifest may not be combined with BitstreamFileIn, BitstreamFileOut, Pipeline, ParallelSegments, "
+                 "Streaming, SampleIndexIn, SampleIndexOut or StatsFile" << std::endl;
+    return false;
+  }
 
-        // Convert to FrameRateInfo structures
-        m_frameRateInfo.numerator = stoi(v.front());
-        v.pop_front();
+  if (!m_sampleIndexFileOut.empty() && m_sampleIndexFileIn.empty())
+  {
+    std::cerr << "SampleIndexOut requires SampleIndexIn" << std::endl;
+    return false;
+  }
 
-        m_frameRateInfo.denominator = stoi(v.front());
-        v.pop_front();
+  if (m_streaming && (m_nalLengthSize || !m_sampleIndexFileIn.empty()))
+  {
+    std::cerr << "NalLengthSize and SampleIndexIn are not supported in the streaming mode" << std::endl;
+    return false;
+  }
 
-    }
+  if ((Int)m_pipeline + (Int)m_parallelSegments + (Int)m_streaming > 1) {
+    std::cerr << "Only one of Pipeline, ParallelSegments and Streaming may be specified" << std::endl;
+    return false;
+  }
 
   return true;
 }
@@ -174,6 +273,21 @@ Bool SEIAfgs1AppCfg::parseCfg( Int argc, TChar* argv[] )
 SEIAfgs1AppCfg::SEIAfgs1AppCfg()
 : m_bitstreamFileNameIn()
 , m_bitstreamFileNameOut()
+, m_slotPolicy(AFGS1_SLOT_POLICY_FIXED)
+, m_refreshInterval(0)
+, m_refreshIntervalMs(0)
+, m_modulateGrainSeed(true)
+, m_removeFilmGrainCharacteristics(false)
+, m_seiFilterMask(0)
+, m_insertAFGS1(true)
+, m_suppressRedundant(false)
+, m_pipeline(false)
+, m_parallelSegments(false)
+, m_numThreads(0)
+, m_streaming(false)
+, m_nalLengthSize(0)
+, m_progressInterval(0)
+, m_quiet(false)
 {
 }
 
@@ -50,6 +50,8 @@
 #endif // _MSC_VER > 1000
 
 #include "TLibCommon/CommonDef.h"
+#include "afgs1_buffer.h"
+#include "Utilities/sei_filter.h"
 #include <vector>
 
 // Struct for storing frame rate ino
@@ -67,6 +69,12 @@ protected:
   std::string   m_bitstreamFileNameOut;               ///< input bitstream file name
   std::string   m_parameterString;                    ///< parameter file info: <width>,<height>,<filename>
   std::string   m_frameRateString;                    ///< frame rate info: <frame_rate_num>/<frame_rate_denom>
+  std::string   m_sampleIndexFileIn;                  ///< input sample index: the size of each sample, one per line
+  std::string   m_sampleIndexFileOut;                 ///< output sample index
+  std::string   m_slotPolicyString;                   ///< AFGS1 buffer slot allocation policy: fixed, lru or optimal
+  std::string   m_jobManifest;                        ///< job manifest of the batch mode
+  std::string   m_existingAfgs1String;                ///< AFGS1 SEI messages of the input: keep, replace or remove
+  std::string   m_statsFile;                          ///< JSON file for the run statistics (empty: not collected)
 
   struct parameterFileInfo {
       unsigned width;
@@ -76,12 +84,31 @@ protected:
   std::vector<struct parameterFileInfo> m_parameterFileInfo;
 
   frameRateInfo m_frameRateInfo;
+  Afgs1_slot_policy m_slotPolicy;
+  UInt          m_refreshInterval;                    ///< resend buffered parameters every N pictures (0: only at IRAP)
+  UInt          m_refreshIntervalMs;                  ///< resend buffered parameters every N milliseconds (0: only at IRAP)
+  Bool          m_modulateGrainSeed;                  ///< vary the grain seed of the database entries with the POC
+  Bool          m_removeFilmGrainCharacteristics;     ///< remove the film grain characteristics SEI messages of the input
+  UInt          m_seiFilterMask;                      ///< SEI messages removed from the prefix SEI NAL units of the input
+  Bool          m_insertAFGS1;                        ///< insert an AFGS1 SEI before each picture
+  Bool          m_suppressRedundant;                  ///< omit the SEI when the grain is unchanged from the previous picture
+  Bool          m_pipeline;                           ///< run the processing stages on separate threads
+  Bool          m_parallelSegments;                   ///< process the IRAP delimited segments in parallel
+  UInt          m_numThreads;                         ///< worker threads for the parallel segments (0: number of cores)
+  Bool          m_streaming;                          ///< read the input as it arrives and flush the output per access unit
+  UInt          m_nalLengthSize;                      ///< size of the NAL unit length fields (0: Annex B byte stream)
+  UInt          m_progressInterval;                   ///< seconds between progress lines (0: no progress lines)
+  Bool          m_quiet;                              ///< do not print a line for each AFGS1 SEI message
 
 public:
   SEIAfgs1AppCfg();
   virtual ~SEIAfgs1AppCfg();
 
   Bool  parseCfg        ( Int argc, TChar* argv[] );   ///< initialize option class from configuration
+
+protected:
+  static Bool parseParameterString( std::string parameterString, std::vector<parameterFileInfo> *fileInfo );
+  static Bool parseFrameRate( std::string frameRateString, frameRateInfo *frameRate );
 };
 
 
@@ -49,22 +49,65 @@
 //
 // Usage: SEIAFGS1App --ParameterString <params_file1>,<width>,<height> --ParameterString <param_file2>,<width>,<height>
 //                    --BitstreamFileIn <in_filename> --BitstreamFileOut <out_filename>
+//                    --NalLengthSize <length_size> --SampleIndexIn <index_in> --SampleIndexOut <index_out>
 //                    --WarnUnknowParameter <warn_value>
 //                    --fps <num>/<denom>
+//                    --SlotPolicy <policy>
+//                    --RefreshInterval <pictures> | --RefreshIntervalMs <milliseconds>
+//                    --ModulateGrainSeed <0|1> --SuppressRedundant <0|1>
+//                    --ExistingAFGS1 <existing> --RemoveFilmGrainCharacteristics <0|1>
+//                    --Pipeline <0|1> | --ParallelSegments <0|1> --Threads <threads> | --Streaming <0|1>
+//                    --StatsFile <stats_file> --ProgressInterval <seconds> --Quiet <0|1>
+//        or:    SEIAFGS1App --ParameterString ... --JobManifest <manifest> --Threads <threads>
 //
 // Where: <params_file> is a "filmgrn1" parameter file
 //        <width> is the image width associated with the params_file
 //        <height> is the image height associated with the params_file
 //        <in_filename> is the input bitstream filename
 //        <out_filename> is the output bitstream filename
+//        <length_size> selects length-prefixed NAL units (the MP4/MKV sample format) with a 1, 2 or 4 byte length
+//                 field instead of an Annex B byte stream (default 0: Annex B).  The AFGS1 SEI NAL unit is added to
+//                 the sample of each picture, before its first slice segment.
+//        <index_in>/<index_out> are text files with the size in bytes of each sample of the input/output, one per
+//                 line.  The output sizes include the inserted SEI NAL units.
 //        <warn_value> enables warnings for unknown configuration parametres instead of failing
 //        <fps_num> is the numerator of the frame rate used to generate the params file
 //        <fps_denom> is the denominator of the frame rate used to generate the params file
+//        <policy> selects the AFGS1 buffer slot for parameters that are not buffered: fixed (one slot per
+//                 params_file), lru (least recently used) or optimal (needed furthest in the future)
+//        <pictures>/<milliseconds> forces a full retransmission of each buffered parameter set at this interval,
+//                 in addition to the buffer reset at each IRAP
+//        ModulateGrainSeed varies the grain seed with the POC (default 1).  SuppressRedundant omits the AFGS1
+//                 message for a picture with the same film grain (including the seed) as the previous message.
+//        <existing> selects the handling of the AFGS1 messages already in the input: keep (default), replace (the
+//                 existing messages are removed and new messages inserted) or remove (no messages are inserted).
+//                 RemoveFilmGrainCharacteristics also removes the film grain characteristics SEI messages
+//                 (default 0).  Only the prefix SEI NAL units that hold such messages are rewritten, and a NAL unit
+//                 is dropped when no message remains.  All other bytes are copied unchanged.
+//        Pipeline runs the scan, parse, SEI construction and write stages on separate threads (default 0).  The
+//                 output is identical to the serial mode.  The throughput of each stage is reported.
+//        ParallelSegments creates the AFGS1 messages of the segments starting at each IRAP on <threads> worker
+//                 threads (default 0: one per core).  The output is identical to the serial mode.
+//        Streaming reads the input as it arrives (for a pipe or FIFO) and flushes the output at each access unit,
+//                 adding at most one access unit of latency.  An <in_filename> or <out_filename> of "-" reads
+//                 stdin or writes stdout and implies Streaming; the messages are then printed to stderr.
+//        <stats_file> receives the run statistics as JSON: the wall clock and CPU time of each stage, the counters
+//                 (NAL units, pictures, AFGS1 SEI messages, buffered parameter set hits, bytes in and out) and the
+//                 p50/p99 latency of the pictures from their scan to their write.  The CPU time and the latency are
+//                 only measured when a <stats_file> is given.
+//        <seconds> prints a progress line at this interval (default 0: no progress lines).  Quiet omits the line
+//                 printed for each AFGS1 SEI message.
+//        <manifest> is a text file with one job per line: <in_filename> <out_filename>, optionally followed by the
+//                 film grain parameters of the job as <params_file>,<width>,<height>,... (or "-" for the
+//                 ParameterString options) and its frame rate as <num>/<denom>.  Each distinct set of parameter files
+//                 is loaded once.  The jobs are processed on <threads> worker threads (default 0: one per core), each
+//                 with the serial mode, and a one line summary is printed per job.
 //
 // Notes: 1. The "filmgrn1" parameter file may be generated using the noise_model software available with libaom
 //        2. One or more input parameters may be provided
+//        3. One AFGS1 SEI message is inserted before the first slice segment of each picture
 
-#include <ctime>
+#include <chrono>
 #include <cstdlib>
 #include <cstdio>
 #include "SEIAfgsApp.h"
@@ -74,6 +117,23 @@ int main(int argc, char* argv[])
 {
   Int returnCode = EXIT_SUCCESS;
 
+  // initialize the class
+  SEIAfgs1App *pcSEIApp = new SEIAfgs1App;
+
+  // parse configuration
+  if(!pcSEIApp->parseCfg( argc, argv ))
+  {
+    returnCode = EXIT_FAILURE;
+    return returnCode;
+  }
+
+  // When the bitstream is written to stdout, the information below is printed to stderr
+  if( !pcSEIApp->redirectStdout() )
+  {
+    delete pcSEIApp;
+    return EXIT_FAILURE;
+  }
+
   // print information
   fprintf( stdout, "\n" );
   fprintf( stdout, "HM: SEIAfgs1App Version %s ", NV_VERSION );
@@ -86,33 +146,27 @@ int main(int argc, char* argv[])
 #endif
   fprintf( stdout, "\n" );
 
-  // initialize the class
-  SEIAfgs1App *pcSEIApp = new SEIAfgs1App;
-
-  // parse configuration
-  if(!pcSEIApp->parseCfg( argc, argv ))
+  // load the film grain database
+  if( !pcSEIApp->load_database() )
   {
-    returnCode = EXIT_FAILURE;
-    return returnCode;
+    delete pcSEIApp;
+    return EXIT_FAILURE;
   }
 
-  // load the film grain database
-  pcSEIApp->load_database();
-
   // starting time
-  Double dResult;
-  clock_t lBefore = clock();
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  Double cpuStart = process_cpu_seconds();
 
   // call decoding function
   if( 0 != pcSEIApp->process() )
   {
-    printf( "\n\n***ERROR*** A decoding mismatch occurred: signalled md5sum does not match\n" );
+    printf( "\n\n***ERROR*** The bit-stream could not be processed\n" );
     returnCode = EXIT_FAILURE;
   }
 
   // ending time
-  dResult = (Double)(clock()-lBefore) / CLOCKS_PER_SEC;
-  printf("\n Total Time: %12.3f sec.\n", dResult);
+  Double dResult = std::chrono::duration<Double>( std::chrono::steady_clock::now() - startTime ).count();
+  printf("\n Total Time: %12.3f sec. (CPU %.3f sec.)\n", dResult, process_cpu_seconds() - cpuStart);
 
   delete pcSEIApp;
 
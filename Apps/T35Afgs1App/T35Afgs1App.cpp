@@ -12,24 +12,100 @@
 //
 // Usage: T35AFGS1App --input <params_file1>,<width>,<height> --input <param_file2>,<width>,<height>
 //                    --fps <num>/<denom>
-//                    --output_frame <output_frame>
-//                    --output <file_name>
+//                    --output_frame <output_frame> | --frames <start>:<end> | --frames all
+//                    --output <file_name> | --verify <file_name>
 //
 // Where: <params_file> is a "filmgrn1" parameter file
 //        <width> is the image width associated with the params_file
 //        <height> is the image height associated with the params_file
 //        <fps_num> is the numerator of the frame rate used to generate the params file
 //        <fps_denom> is the denominator of the frame rate used to generate the params file
-//        <output_frame> is the frame number to be used for output
-//        <file_name> is the output file name
+//        <output_frame> is the frame number to be used for output (the first frame is 0)
+//        <start>:<end> is an inclusive range of frame numbers, and "all" selects the frames from 0 to the end of
+//                 the film grain timeline.  The payloads of the frames are written to a single sidecar file with
+//                 an index of the payload of each frame (see afgs1_sidecar.h).
+//        <file_name> is the output file name.  With --verify, the sidecar file written for the same inputs and
+//                 --frames is read instead: the payload of each frame is located in the file and compared with the
+//                 payload written from the parameter files.  The exit code is 1 if any frame differs.
 //
 // Notes: 1. The "filmgrn1" parameter file may be generated using the noise_model software available with libaom
 //        2. One or more input parameters may be provided
+//        3. A frame without film grain parameters has an empty payload in the sidecar file
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include "afgs1_database.h"
 #include "afgs1_bitstream.h"
+#include "afgs1_message.h"
+#include "afgs1_sidecar.h"
+#include "Utilities/file_io.h"
+
+// Write the AFGS1 syntax of the film grain parameters of a frame.  The payload is empty when the frame has no
+// film grain parameters.  Returns false if the parameters of the frame do not conform.
+static bool frame_payload( const Afgs1_film_grain_database &afgs_db, int64_t frame, int frame_rate_num,
+                           int frame_rate_denom, std::vector<uint8_t> *payload ) {
+
+    std::list<Afgs1_film_grain_params> afgs1_film_grain_param_sets =
+            afgs_db.find_frames( afgs1_frame_time( frame, frame_rate_num, frame_rate_denom ) );
+
+    payload->clear();
+    if( afgs1_film_grain_param_sets.empty() )
+        return true;
+
+    BitStream write_buffer;
+    if( !write_film_grain_param_sets(&afgs1_film_grain_param_sets, &write_buffer) )
+        return false;
+    int num_bytes = write_buffer.get_position() / 8;
+    for( int i=0; i < num_bytes; i++ )
+        payload->push_back( write_buffer.get_byte(i) );
+    return true;
+}
+
+static void print_nonconforming_sets( long long frame ) {
+    printf("Error: The film grain parameters of frame %lld do not conform: more than %d sets, or sets with the same "
+           "resolution or film_grain_param_set_idx\n", frame, AFGS1_MAX_PARAM_SETS);
+}
+
+// Locate the payload of each frame of a range in a sidecar file and compare it with the payload written from the
+// database.  Returns false, after reporting the frames that differ, if the file does not match.
+static bool verify_sidecar( const Afgs1_film_grain_database &afgs_db, int64_t first_frame, int64_t last_frame,
+                            int frame_rate_num, int frame_rate_denom, const char *fname ) {
+
+    MappedFile sidecar;
+    if( !sidecar.open( fname ) ) {
+        printf("Error: Unable to open %s for reading\n", fname);
+        return false;
+    }
+
+    std::vector<uint8_t> payload;
+    long long num_differences = 0;
+    for( int64_t frame = first_frame; frame <= last_frame; frame++ ) {
+        if( !frame_payload( afgs_db, frame, frame_rate_num, frame_rate_denom, &payload ) ) {
+            print_nonconforming_sets( frame );
+            return false;
+        }
+
+        const uint8_t *stored;
+        size_t stored_size;
+        if( !afgs1_sidecar_find( sidecar.data(), sidecar.size(), frame, &stored, &stored_size ) ) {
+            printf("Error: Frame %lld is not found in %s\n", (long long)frame, fname);
+            num_differences++;
+        }
+        else if( stored_size != payload.size() || ( stored_size && memcmp( stored, payload.data(), stored_size ) ) ) {
+            printf("Error: The payload of frame %lld differs in %s\n", (long long)frame, fname);
+            num_differences++;
+        }
+    }
+
+    if( num_differences ) {
+        printf("Error: %lld of the frames %lld to %lld differ\n", num_differences, (long long)first_frame,
+               (long long)last_frame);
+        return false;
+    }
+    printf("Verified the AFGS1 payloads of frames %lld to %lld\n", (long long)first_frame, (long long)last_frame);
+    return true;
+}
 
 int main(int argc, char **argv) {
 
@@ -37,15 +113,17 @@ int main(int argc, char **argv) {
     int frame_rate_num = -1;
     int frame_rate_denom = -1;
     int output_frame_num = -1;
+    const char *frames = NULL;
     char *output_filename = NULL;
+    const char *verify_filename = NULL;
 
     // Simple command line processing.
-    for( int i=0; i<argc; i++ ){
+    for( int i=1; i<argc; i++ ){
 
         // Process an input parameter file.  Note that the input is loaded and inserted into a database.
         if(strncmp( "--input", argv[i], 8) == 0) {
 
-            if( i == argc){
+            if( i + 1 >= argc){
                 printf("Error: --input must be followed by parameter\n");
                 return 1;
             }
@@ -54,14 +132,17 @@ int main(int argc, char **argv) {
             int width = atoi(strtok( NULL, ","));
             int height = atoi(strtok( NULL, ","));
 
-            afgs_db.load_table(file_name, width, height);
+            if( !afgs_db.load_table(file_name, width, height) ) {
+                printf("Error: Unable to load the parameter file %s\n", file_name);
+                return 1;
+            }
 
         }
         // Process the frame rate.  This is needed to determine the mapping between parameter sets
         // and frame numbers, as the filmgrn1 files stores data relative to presentation time.
         else if(strncmp( "--fps", argv[i], 6) == 0) {
 
-            if( i == argc){
+            if( i + 1 >= argc){
                 printf("Error: --fps must be followed by parameter\n");
                 return 1;
             }
@@ -74,36 +155,113 @@ int main(int argc, char **argv) {
         // Process the frame number
         else if(strncmp( "--output_frame", argv[i], 15) == 0) {
 
-            if( i == argc){
+            if( i + 1 >= argc){
                 printf("Error: --output_frame must be followed by parameter\n");
                 return 1;
             }
 
             output_frame_num = atoi( argv[++i] );
-            assert( output_frame_num > 0 );
+            assert( output_frame_num >= 0 );
+        }
+        // Process a range of frames
+        else if(strncmp( "--frames", argv[i], 9) == 0) {
+
+            if( i + 1 >= argc){
+                printf("Error: --frames must be followed by parameter\n");
+                return 1;
+            }
+
+            frames = argv[++i];
         }
         // Process the output file name
         else if(strncmp( "--output", argv[i], 9) == 0){
 
-            if( i == argc){
+            if( i + 1 >= argc){
                 printf("Error: --output must be followed by parameter\n");
                 return 1;
             }
 
             output_filename = argv[++i];
         }
+        // Process the sidecar file to verify
+        else if(strncmp( "--verify", argv[i], 9) == 0){
 
+            if( i + 1 >= argc){
+                printf("Error: --verify must be followed by parameter\n");
+                return 1;
+            }
+
+            verify_filename = argv[++i];
+        }
+
+    }
+
+    if( ( output_filename == NULL && verify_filename == NULL ) || frame_rate_num <= 0 || frame_rate_denom <= 0 ) {
+        printf("Error: --output (or --verify) and --fps must be provided\n");
+        return 1;
+    }
+    if( verify_filename && !frames ) {
+        printf("Error: --verify must be used with --frames\n");
+        return 1;
+    }
+
+    // Write the payloads of a range of frames to a sidecar file.  The database is loaded once for all frames.
+    if( frames ) {
+        int64_t first_frame, last_frame;
+        long long start, end;
+        if( strcmp( frames, "all" ) == 0 ) {
+            first_frame = 0;
+            last_frame = -1;
+            while( afgs1_frame_time( last_frame + 1, frame_rate_num, frame_rate_denom ) < afgs_db.end_time() )
+                last_frame++;
+        }
+        else if( sscanf( frames, "%lld:%lld", &start, &end ) == 2 && start >= 0 && end >= start ) {
+            first_frame = start;
+            last_frame = end;
+        }
+        else {
+            printf("Error: --frames must be <start>:<end> or all\n");
+            return 1;
+        }
+
+        if( verify_filename )
+            return verify_sidecar( afgs_db, first_frame, last_frame, frame_rate_num, frame_rate_denom,
+                                   verify_filename ) ? 0 : 1;
+
+        Afgs1_sidecar_writer sidecar( first_frame, frame_rate_num, frame_rate_denom );
+        std::vector<uint8_t> payload;
+        for( int64_t frame = first_frame; frame <= last_frame; frame++ ) {
+            if( !frame_payload( afgs_db, frame, frame_rate_num, frame_rate_denom, &payload ) ) {
+                print_nonconforming_sets( frame );
+                return 1;
+            }
+            sidecar.add_frame( payload );
+        }
+        if( !sidecar.write( output_filename ) ) {
+            printf("Error: Unable to write %s\n", output_filename);
+            return 1;
+        }
+        printf("Wrote the AFGS1 payloads of frames %lld to %lld\n", (long long)first_frame, (long long)last_frame);
+        return 0;
+    }
+
+    if( output_frame_num < 0 ) {
+        printf("Error: --output_frame or --frames must be provided\n");
+        return 1;
     }
 
     // Create an AFGS1 bit-stream
     // - Extract the parameters for output_frame_num from the database.
     // -- The output frame number is converted to a presentation time as defined in the filmgrn1 file.
     std::list<Afgs1_film_grain_params> afgs1_film_grain_param_sets =
-            afgs_db.find_frames(output_frame_num * 10000000ULL * frame_rate_denom / frame_rate_num);
+            afgs_db.find_frames( afgs1_frame_time( output_frame_num, frame_rate_num, frame_rate_denom ) );
 
     // - Write the AFGS1 syntax to the write_buffer object
     BitStream write_buffer;
-    write_film_grain_param_sets(&afgs1_film_grain_param_sets, &write_buffer);
+    if( !write_film_grain_param_sets(&afgs1_film_grain_param_sets, &write_buffer) ) {
+        print_nonconforming_sets( output_frame_num );
+        return 1;
+    }
 
     // - Output the buffer to a file
     write_buffer.write_stream_to_file(output_filename);
@@ -0,0 +1,342 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// VVCAFGS1App - Example program to insert AFGS1 SEI messages in an H.266/VVC bit-stream.
+//               Reads one or more "filmgrn1" parameter files, each with an associated width and height.
+//               Reads a VVC Annex B byte stream and writes it with a prefix SEI NAL unit carrying the
+//               AFGS1 message in a user_data_registered_itu_t_t35 SEI message before each picture.
+//
+//
+// Usage: VVCAFGS1App --input <params_file1>,<width>,<height> --input <param_file2>,<width>,<height>
+//                    --bitstream_in <in_filename> --bitstream_out <out_filename>
+//                    --fps <num>/<denom>
+//                    --slot_policy <policy>
+//                    --refresh_interval <frames>
+//                    --modulate_seed <0|1>
+//                    --existing_afgs1 <existing>
+//                    --remove_fgc <0|1>
+//
+// Where: <params_file> is a "filmgrn1" parameter file
+//        <width> is the image width associated with the params_file
+//        <height> is the image height associated with the params_file
+//        <in_filename> is the input VVC Annex B byte stream
+//        <out_filename> is the output VVC Annex B byte stream
+//        <fps_num> is the numerator of the frame rate used to generate the params file
+//        <fps_denom> is the denominator of the frame rate used to generate the params file
+//        <policy> selects the AFGS1 buffer slot for parameters that are not buffered: fixed (default), lru or
+//                 optimal
+//        <frames> forces a full retransmission of each buffered parameter set at this interval, in addition to
+//                 the buffer reset at each IRAP and GDR picture (default 0)
+//        modulate_seed varies the grain seed with the POC (default 1)
+//        <existing> selects the handling of the AFGS1 messages already in the input: keep (default), replace (the
+//                   existing messages are removed and new messages inserted) or remove (no messages are inserted)
+//        remove_fgc removes the film grain characteristics SEI messages of the input (default 0)
+//
+// Notes: 1. The "filmgrn1" parameter file may be generated using the noise_model software available with libaom
+//        2. The frame rate is required.  The timing information of a VVC bit-stream is carried in the HRD
+//           parameters that follow most of the SPS syntax, and the parser only reads the start of the SPS.
+//        3. The presentation time of a picture is derived from its POC and the frame rate.  The SEI NAL unit is
+//           placed before the first slice of each picture of the base layer.  The AFGS1 buffer is reset at each
+//           IRAP and GDR picture.
+//        4. Only the prefix SEI NAL units that hold removed messages are rewritten, and a NAL unit is dropped when no
+//           message remains.  All other bytes are copied unchanged.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include "afgs1_message.h"
+#include "Utilities/annexb.h"
+#include "Utilities/vvc_parser.h"
+#include "Utilities/sei_filter.h"
+#include "Utilities/file_io.h"
+
+// State of the SEI insertion
+struct Afgs1_sei_inserter {
+    Afgs1_film_grain_database db;
+    Afgs1_buffer buffer;
+    Afgs1_slot_policy policy;
+    int refresh_interval;
+    bool modulate_seed;
+    bool insert_afgs1;
+    unsigned sei_filter_mask;
+
+    VvcParser parser;
+    int frame_rate_num;
+    int frame_rate_denom;
+
+    int64_t num_nal_units;
+    int64_t num_pictures;
+    int64_t num_random_access_points;
+    int64_t num_seis;
+    int64_t num_referenced_sets;
+    int64_t sei_bytes;
+    int64_t num_removed_seis;
+    int64_t num_removed_nal_units;
+};
+
+// Create the SEI NAL unit for the first slice of a picture and update the buffer model.  The NAL unit is left
+// empty when no parameter set applies to the picture.  Returns false when the parameter sets do not conform.
+static bool create_sei_nal_unit( Afgs1_sei_inserter *s, const VvcNalInfo &info, std::vector<uint8_t> *nal ) {
+
+    int poc = s->parser.get_poc();
+
+    // The AFGS1 buffer is reset at a random access point
+    if( s->parser.is_irap() || s->parser.is_gdr() ) {
+        s->buffer.clear_buffer();
+        s->num_random_access_points++;
+    }
+
+    s->buffer.set_time( s->num_pictures );
+    Afgs1_message message( &s->db, afgs1_frame_time( poc, s->frame_rate_num, s->frame_rate_denom ), s->buffer,
+                           s->policy, s->refresh_interval );
+    if( s->modulate_seed )
+        message.update_grain_seed( poc );
+
+    if( message.get_num_param_sets() == 0 )
+        return true;
+
+    std::vector<uint8_t> payload;
+    if( !message.write_t35_payload( &payload ) ) {
+        printf("Error: The film grain parameters of POC %d do not conform: more than %d sets, or sets with the same "
+               "resolution or film_grain_param_set_idx\n", poc, AFGS1_MAX_PARAM_SETS);
+        return false;
+    }
+    vvc_write_t35_sei_nal_unit( info.layer_id, info.temporal_id, AFGS1_T35_COUNTRY_CODE, payload, nal );
+    message.update_buffer( &s->buffer );
+
+    s->num_seis++;
+    s->num_referenced_sets += message.num_referenced_sets;
+    return true;
+}
+
+// The SEI NAL unit takes the start code (and any zero bytes) that preceded the slice in the input, and the
+// slice follows with a three byte start code.  A filtered prefix SEI NAL unit keeps its start code.  When no
+// message remains, the NAL unit is dropped and its start code takes the place of the start code of the next
+// NAL unit, so that removing an inserted SEI NAL unit restores the input.  All other bytes of the input are
+// written unchanged.  Returns false when an SEI message cannot be created.
+static bool process_annexb( Afgs1_sei_inserter *s, const uint8_t* stream, size_t stream_size, BlockWriter *out ) {
+
+    static const uint8_t start_code_prefix[] = { 0, 0, 1 };
+
+    size_t pos = 0, end;
+    AnnexBNalUnit nal;
+    const uint8_t *removed_prefix = NULL;
+    size_t removed_prefix_size = 0;
+    while( ( end = annexb_next_nal_unit( stream, stream_size, pos, &nal ) ) != 0 ) {
+        s->num_nal_units++;
+
+        VvcNalInfo info;
+        if( nal.size > 0 && !s->parser.parse_nal_unit( nal.data, nal.size, &info ) )
+            printf("Warning: Unable to parse NAL unit of type %d\n", info.nal_unit_type);
+
+        bool first_slice = nal.size > 0 && info.first_slice_in_pic;
+        std::vector<uint8_t> filtered;
+        int removed = 0;
+        if( nal.size > 0 && s->sei_filter_mask && info.nal_unit_type == VVC_NAL_PREFIX_SEI )
+            removed = sei_filter_nal_unit( nal.data, nal.size, s->sei_filter_mask, &filtered );
+
+        if( removed && filtered.empty() ) {
+            s->num_removed_seis += removed;
+            s->num_removed_nal_units++;
+            if( !removed_prefix ) {
+                removed_prefix = nal.prefix;
+                removed_prefix_size = nal.prefix_size;
+            }
+            pos = end;
+            continue;
+        }
+        if( removed_prefix ) {
+            nal.prefix = removed_prefix;
+            nal.prefix_size = removed_prefix_size;
+            removed_prefix = NULL;
+        }
+
+        if( removed ) {
+            const uint8_t *nal_end = nal.data + nal.size;
+            s->num_removed_seis += removed;
+            out->write( nal.prefix, nal.prefix_size );
+            out->write_copy( filtered.data(), filtered.size() );
+            out->write( nal_end, stream + end - nal_end );
+        }
+        else if( first_slice && s->insert_afgs1 ) {
+            std::vector<uint8_t> sei;
+            if( !create_sei_nal_unit( s, info, &sei ) )
+                return false;
+
+            out->write( nal.prefix, nal.prefix_size );
+            if( !sei.empty() ) {
+                s->sei_bytes += nal.prefix_size + sei.size();
+                out->write_copy( sei.data(), sei.size() );
+                out->write( start_code_prefix, 3 );
+            }
+            out->write( nal.data, stream + end - nal.data );
+        }
+        else {
+            // The writer merges the two writes when the start code is that of the NAL unit
+            out->write( nal.prefix, nal.prefix_size );
+            out->write( nal.data, stream + end - nal.data );
+        }
+
+        if( first_slice )
+            s->num_pictures++;
+        pos = end;
+    }
+
+    // Copy anything that precedes the first start code of an empty stream
+    if( pos == 0 )
+        out->write( stream, stream_size );
+    return true;
+}
+
+int main(int argc, char **argv) {
+
+    Afgs1_sei_inserter s;
+    s.policy = AFGS1_SLOT_POLICY_FIXED;
+    s.refresh_interval = 0;
+    s.modulate_seed = true;
+    s.insert_afgs1 = true;
+    s.sei_filter_mask = 0;
+    s.frame_rate_num = -1;
+    s.frame_rate_denom = -1;
+    s.num_nal_units = 0;
+    s.num_pictures = 0;
+    s.num_random_access_points = 0;
+    s.num_seis = 0;
+    s.num_referenced_sets = 0;
+    s.sei_bytes = 0;
+    s.num_removed_seis = 0;
+    s.num_removed_nal_units = 0;
+
+    const char *input_filename = NULL;
+    const char *output_filename = NULL;
+
+    // Simple command line processing.
+    for( int i=1; i<argc; i++ ){
+
+        if( i + 1 >= argc ) {
+            printf("Error: %s must be followed by parameter\n", argv[i]);
+            return 1;
+        }
+
+        // Process an input parameter file.  Note that the input is loaded and inserted into a database.
+        if(strcmp( "--input", argv[i]) == 0) {
+
+            char *file_name = strtok( argv[++i], ",");
+            char *width = strtok( NULL, ",");
+            char *height = strtok( NULL, ",");
+            if( !file_name || !width || !height ) {
+                printf("Error: --input must be followed by <params_file>,<width>,<height>\n");
+                return 1;
+            }
+            if( !s.db.load_table(file_name, atoi(width), atoi(height)) ) {
+                printf("Error: Unable to load the parameter file %s\n", file_name);
+                return 1;
+            }
+        }
+        // Process the frame rate.  This is needed to determine the mapping between parameter sets
+        // and POC values, as the filmgrn1 files stores data relative to presentation time.
+        else if(strcmp( "--fps", argv[i]) == 0) {
+
+            char *num = strtok( argv[++i], "/");
+            char *denom = strtok( NULL, "/");
+            s.frame_rate_num = num ? atoi( num ) : -1;
+            s.frame_rate_denom = denom ? atoi( denom ) : 1;
+            if( s.frame_rate_num <= 0 || s.frame_rate_denom <= 0 ) {
+                printf("Error: --fps must be followed by <num>/<denom>\n");
+                return 1;
+            }
+        }
+        else if(strcmp( "--bitstream_in", argv[i]) == 0)
+            input_filename = argv[++i];
+        else if(strcmp( "--bitstream_out", argv[i]) == 0)
+            output_filename = argv[++i];
+        else if(strcmp( "--slot_policy", argv[i]) == 0) {
+
+            const char *policy = argv[++i];
+            if( strcmp( policy, "fixed" ) == 0 )
+                s.policy = AFGS1_SLOT_POLICY_FIXED;
+            else if( strcmp( policy, "lru" ) == 0 )
+                s.policy = AFGS1_SLOT_POLICY_LRU;
+            else if( strcmp( policy, "optimal" ) == 0 )
+                s.policy = AFGS1_SLOT_POLICY_OPTIMAL;
+            else {
+                printf("Error: Unknown slot policy %s\n", policy);
+                return 1;
+            }
+        }
+        else if(strcmp( "--refresh_interval", argv[i]) == 0)
+            s.refresh_interval = atoi( argv[++i] );
+        else if(strcmp( "--modulate_seed", argv[i]) == 0)
+            s.modulate_seed = atoi( argv[++i] ) != 0;
+        // Existing AFGS1 messages are removed when replaced, and no new messages are inserted when removed
+        else if(strcmp( "--existing_afgs1", argv[i]) == 0) {
+
+            const char *existing = argv[++i];
+            if( strcmp( existing, "keep" ) == 0 ) {
+                s.sei_filter_mask &= ~SEI_FILTER_AFGS1;
+                s.insert_afgs1 = true;
+            }
+            else if( strcmp( existing, "replace" ) == 0 || strcmp( existing, "remove" ) == 0 ) {
+                s.sei_filter_mask |= SEI_FILTER_AFGS1;
+                s.insert_afgs1 = strcmp( existing, "replace" ) == 0;
+            }
+            else {
+                printf("Error: Unknown handling of existing AFGS1 messages %s\n", existing);
+                return 1;
+            }
+        }
+        else if(strcmp( "--remove_fgc", argv[i]) == 0) {
+            if( atoi( argv[++i] ) )
+                s.sei_filter_mask |= SEI_FILTER_FILM_GRAIN_CHARACTERISTICS;
+            else
+                s.sei_filter_mask &= ~SEI_FILTER_FILM_GRAIN_CHARACTERISTICS;
+        }
+        else {
+            printf("Error: Unknown parameter %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if( !input_filename || !output_filename ) {
+        printf("Error: --bitstream_in and --bitstream_out must be provided\n");
+        return 1;
+    }
+    if( s.frame_rate_num <= 0 && s.insert_afgs1 ) {
+        printf("Error: --fps must be provided\n");
+        return 1;
+    }
+
+    MappedFile input;
+    if( !input.open( input_filename ) ) {
+        printf("Error: Unable to open %s for reading\n", input_filename);
+        return 1;
+    }
+    BlockWriter output;
+    if( !output.open( output_filename ) ) {
+        printf("Error: Unable to open %s for writing\n", output_filename);
+        return 1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool ok = process_annexb( &s, input.data(), input.size(), &output );
+    output.close();
+    if( !ok )
+        return 1;
+
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    printf("VVC input: %lld NAL units, %lld pictures, %lld IRAP or GDR pictures\n", (long long) s.num_nal_units,
+           (long long) s.num_pictures, (long long) s.num_random_access_points);
+    printf("AFGS1 SEI messages: %lld written (%lld bytes), %lld parameter sets referenced from the buffer\n",
+           (long long) s.num_seis, (long long) s.sei_bytes, (long long) s.num_referenced_sets);
+    if( s.sei_filter_mask )
+        printf("SEI messages removed from the input: %lld (%lld prefix SEI NAL units removed)\n",
+               (long long) s.num_removed_seis, (long long) s.num_removed_nal_units);
+    printf("Processing: %.3f s, %.1f MB/s\n", seconds, seconds > 0 ? input.size() / seconds / 1e6 : 0.0);
+
+    return 0;
+}
@@ -0,0 +1,895 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Afgs1Bench - Microbenchmarks of the libAFGS1 hot paths on deterministic synthetic workloads.
+//              The film grain parameters and the "filmgrn1" files are generated from a fixed seed, so
+//              that the results of two versions of the library can be compared line by line.
+//
+//
+// Usage: Afgs1Bench --min_time <seconds> --max_entries <entries> --filter <text> --tmp_dir <directory>
+//        Afgs1Bench --self_check
+//
+// Where: <seconds> is the minimum measurement time of each benchmark (default 0.25)
+//        <entries> is the largest "filmgrn1" file generated, in entries (default 100000, up to 1000000).  The
+//                 files have 1000, 10000, 100000 and 1000000 entries up to this size.
+//        <text> runs only the benchmarks whose name contains the text
+//        <directory> receives the generated "filmgrn1" files, which are removed afterwards (default .)
+//        --self_check checks the output of the film grain synthesis against stored regression hashes, at 8, 10
+//                 and 12 bits, for each instruction set and with 1 and 3 threads, instead of benchmarking.
+//                 The exit code is 1 if any output differs.
+//
+// Output: One line per benchmark: the name with its parameters, the time per operation, and the number and
+//         size of the operator new allocations per operation.  The operation of each benchmark is given by the
+//         unit after the name (a literal, a call, an entry, a lookup, a sample or a frame).  The film grain
+//         synthesis is measured for each instruction set supported by the processor, the lookup of the scaling
+//         functions is compared with their evaluation from the scaling points, the synthesis of a 2160p frame is
+//         measured with 1 to 16 threads, and the hit rate of the grain cache is reported for a timeline of
+//         parameter sets.  The estimation of the film grain parameters is measured on a 1080p frame of synthesized
+//         grain, with and without its denoised version.
+//
+// Notes: 1. The allocations made with malloc and realloc (the BitStream buffer, the C library) are not counted.
+//        2. A database of 1000000 entries needs about 1 GB of memory.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+#include "afgs1_bitstream.h"
+#include "afgs1_buffer.h"
+#include "afgs1_database.h"
+#include "afgs1_estimation.h"
+#include "afgs1_grain_cache.h"
+#include "afgs1_synthesis.h"
+
+// Allocation counters of the global operator new.  The worker threads of the synthesis allocate too, so the
+// counters are atomic; the counts need no ordering with other memory.
+static std::atomic<uint64_t> num_allocations( 0 );
+static std::atomic<uint64_t> allocated_bytes( 0 );
+
+void* operator new( size_t size ) {
+    num_allocations.fetch_add( 1, std::memory_order_relaxed );
+    allocated_bytes.fetch_add( size, std::memory_order_relaxed );
+    void *p = malloc( size ? size : 1 );
+    if( !p )
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[]( size_t size ) {
+    return operator new( size );
+}
+
+void operator delete( void* p ) noexcept {
+    free( p );
+}
+
+void operator delete[]( void* p ) noexcept {
+    free( p );
+}
+
+// Options
+static double min_time = 0.25;
+static long max_entries = 100000;
+static const char* filter = NULL;
+static std::string tmp_dir = ".";
+
+// Deterministic pseudo-random numbers (a 64-bit linear congruential generator)
+struct Random {
+    uint64_t state;
+
+    explicit Random( uint64_t seed ) : state( seed ) {}
+
+    // Uniform in [0, range)
+    int next( int range ) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (int)( ( state >> 33 ) % (uint64_t)range );
+    }
+};
+
+// Prevent the compiler from removing the work of a benchmark
+static volatile uint64_t sink;
+
+// Run the benchmark repeatedly for at least min_time and print the time and the allocations per operation.
+// Each call of fn performs ops_per_call operations.
+template<class Fn>
+static void run_benchmark( const std::string &name, const char* unit, uint64_t ops_per_call, Fn fn ) {
+
+    if( filter && !strstr( name.c_str(), filter ) )
+        return;
+
+    // Warm up
+    fn();
+
+    uint64_t calls = 0;
+    uint64_t allocations = num_allocations;
+    uint64_t bytes = allocated_bytes;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double seconds;
+    do {
+        fn();
+        calls++;
+        seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    } while( seconds < min_time );
+
+    double ops = (double)calls * ops_per_call;
+    printf("%-58s %12.2f ns/%-7s %10.2f allocs/op %12.1f B/op\n", name.c_str(), seconds * 1e9 / ops, unit,
+           ( num_allocations - allocations ) / ops, ( allocated_bytes - bytes ) / ops);
+    fflush(stdout);
+}
+
+// Create a valid parameter set with the AR lag and random scaling functions and coefficients
+static Afgs1_film_grain_params random_params( Random *r, int lag, int index, int width, int height ) {
+
+    Afgs1_film_grain_params p;
+    p.film_grain_param_set_idx = index;
+    p.apply_grain = 1;
+    p.grain_seed = (short)r->next( 1 << 15 );
+    p.update_parameters = 1;
+    p.apply_horz_resolution = width;
+    p.apply_vert_resolution = height;
+    p.luma_only_flag = 0;
+    p.subsampling_x = 1;
+    p.subsampling_y = 1;
+    p.video_signal_characteristics_flag = 0;
+    p.bit_depth = 8;
+    p.color_primaries = 1;
+    p.transfer_characteristics = 1;
+    p.matrix_coefficients = 1;
+    p.video_full_range_flag = 0;
+
+    p.num_y_points = 1 + r->next( 14 );
+    p.num_cb_points = r->next( 11 );
+    p.num_cr_points = r->next( 11 );
+    for( int i = 0; i < p.num_y_points; i++ ) {
+        p.scaling_points_y[i][0] = i * 18;
+        p.scaling_points_y[i][1] = r->next( 256 );
+    }
+    for( int i = 0; i < p.num_cb_points; i++ ) {
+        p.scaling_points_cb[i][0] = i * 25;
+        p.scaling_points_cb[i][1] = r->next( 256 );
+    }
+    for( int i = 0; i < p.num_cr_points; i++ ) {
+        p.scaling_points_cr[i][0] = i * 25;
+        p.scaling_points_cr[i][1] = r->next( 256 );
+    }
+
+    p.scaling_shift = 8 + r->next( 4 );
+    p.ar_coeff_lag = lag;
+    for( int i = 0; i < 24; i++ )
+        p.ar_coeffs_y[i] = r->next( 256 ) - 128;
+    for( int i = 0; i < 25; i++ ) {
+        p.ar_coeffs_cb[i] = r->next( 256 ) - 128;
+        p.ar_coeffs_cr[i] = r->next( 256 ) - 128;
+    }
+    p.ar_coeff_shift = 6 + r->next( 4 );
+    p.cb_mult = r->next( 256 );
+    p.cb_luma_mult = r->next( 256 );
+    p.cb_offset = r->next( 512 );
+    p.cr_mult = r->next( 256 );
+    p.cr_luma_mult = r->next( 256 );
+    p.cr_offset = r->next( 512 );
+    p.overlap_flag = r->next( 2 );
+    p.clip_to_restricted_range = 0;
+    p.chroma_scaling_from_luma = 0;
+    p.grain_scale_shift = r->next( 4 );
+    return p;
+}
+
+// One parameter set per resolution, with distinct widths and indices as required by the AFGS1 syntax
+static std::list<Afgs1_film_grain_params> random_param_sets( Random *r, int num_sets, int lag ) {
+
+    std::list<Afgs1_film_grain_params> sets;
+    for( int i = 0; i < num_sets; i++ )
+        sets.push_back( random_params( r, lag, i, 3840 - 240 * i, 2160 - 135 * i ) );
+    return sets;
+}
+
+// Write a "filmgrn1" file with consecutive entries of one picture each.  The AR lag cycles through all lags
+// and every fourth entry reuses the parameters of the previous entry.
+static bool write_filmgrn1( const std::string &fname, long entries ) {
+
+    FILE *fp = fopen( fname.c_str(), "wb" );
+    if( !fp )
+        return false;
+
+    Random r( 1 );
+    fprintf( fp, "filmgrn1\n" );
+    for( long e = 0; e < entries; e++ ) {
+        const int64_t duration = 417083;
+        int update = ( e % 4 ) != 3;
+        Afgs1_film_grain_params p = random_params( &r, e % 4, 0, 0, 0 );
+        fprintf( fp, "E %lld %lld 1 %d %d\n", (long long)( e * duration ), (long long)( ( e + 1 ) * duration ),
+                 p.grain_seed, update );
+        if( !update )
+            continue;
+
+        fprintf( fp, "\tp %d %d %d %d %d %d %d %d %d %d %d %d\n", p.ar_coeff_lag, p.ar_coeff_shift,
+                 p.grain_scale_shift, p.scaling_shift, p.chroma_scaling_from_luma, p.overlap_flag, p.cb_mult,
+                 p.cb_luma_mult, p.cb_offset, p.cr_mult, p.cr_luma_mult, p.cr_offset );
+        fprintf( fp, "\tsY %d ", p.num_y_points );
+        for( int i = 0; i < p.num_y_points; i++ )
+            fprintf( fp, " %d %d", p.scaling_points_y[i][0], p.scaling_points_y[i][1] );
+        fprintf( fp, "\n\tsCb %d", p.num_cb_points );
+        for( int i = 0; i < p.num_cb_points; i++ )
+            fprintf( fp, " %d %d", p.scaling_points_cb[i][0], p.scaling_points_cb[i][1] );
+        fprintf( fp, "\n\tsCr %d", p.num_cr_points );
+        for( int i = 0; i < p.num_cr_points; i++ )
+            fprintf( fp, " %d %d", p.scaling_points_cr[i][0], p.scaling_points_cr[i][1] );
+        const int n = 2 * p.ar_coeff_lag * ( p.ar_coeff_lag + 1 );
+        fprintf( fp, "\n\tcY" );
+        for( int i = 0; i < n; i++ )
+            fprintf( fp, " %d", p.ar_coeffs_y[i] );
+        fprintf( fp, "\n\tcCb" );
+        for( int i = 0; i <= n; i++ )
+            fprintf( fp, " %d", p.ar_coeffs_cb[i] );
+        fprintf( fp, "\n\tcCr" );
+        for( int i = 0; i <= n; i++ )
+            fprintf( fp, " %d", p.ar_coeffs_cr[i] );
+        fprintf( fp, "\n" );
+    }
+    return fclose( fp ) == 0;
+}
+
+static void bench_write_literal() {
+
+    static const int bit_counts[] = { 1, 8, 16, 24 };
+    for( int b : bit_counts ) {
+        const int num_literals = 4096;
+        BitStream wb;
+        Random r( 2 );
+        std::vector<int> values( num_literals );
+        for( int i = 0; i < num_literals; i++ )
+            values[i] = r.next( 1 << b );
+
+        run_benchmark( "write_literal/bits:" + std::to_string( b ), "literal", num_literals, [&]() {
+            wb.clear();
+            for( int i = 0; i < num_literals; i++ )
+                wb.write_literal( values[i], b );
+            sink = wb.get_position();
+        } );
+    }
+}
+
+static void bench_write_param_sets() {
+
+    static const int set_counts[] = { 1, 4, 8 };
+    for( int n : set_counts ) {
+        for( int lag = 0; lag <= 3; lag++ ) {
+            Random r( 3 );
+            std::list<Afgs1_film_grain_params> sets = random_param_sets( &r, n, lag );
+            std::string suffix = "/sets:" + std::to_string( n ) + "/lag:" + std::to_string( lag );
+
+            run_benchmark( "write_film_grain_param_sets" + suffix, "call", 1, [&]() {
+                BitStream wb;
+                write_film_grain_param_sets( &sets, &wb );
+                sink = wb.get_position();
+            } );
+
+            run_benchmark( "write_afgs1_t35_payload" + suffix, "call", 1, [&]() {
+                std::vector<uint8_t> payload;
+                write_afgs1_t35_payload( &sets, &payload );
+                sink = payload.size();
+            } );
+        }
+    }
+}
+
+static void bench_read_literal() {
+
+    static const int bit_counts[] = { 1, 8, 16, 24 };
+    for( int b : bit_counts ) {
+        const int num_literals = 4096;
+        BitStream wb;
+        Random r( 2 );
+        for( int i = 0; i < num_literals; i++ )
+            wb.write_literal( r.next( 1 << b ), b );
+        wb.write_literal( 0, 7 );
+        std::vector<uint8_t> data( wb.get_position() / 8 );
+        for( size_t i = 0; i < data.size(); i++ )
+            data[i] = wb.get_byte( (int)i );
+
+        run_benchmark( "read_literal/bits:" + std::to_string( b ), "literal", num_literals, [&]() {
+            BitReader rb( &data[0], data.size() );
+            uint32_t sum = 0;
+            for( int i = 0; i < num_literals; i++ )
+                sum += rb.read_literal( b );
+            sink = sum;
+        } );
+    }
+}
+
+static void bench_read_param_sets() {
+
+    static const int set_counts[] = { 1, 4, 8 };
+    for( int n : set_counts ) {
+        for( int lag = 0; lag <= 3; lag++ ) {
+            Random r( 3 );
+            std::list<Afgs1_film_grain_params> sets = random_param_sets( &r, n, lag );
+            std::vector<uint8_t> payload;
+            write_afgs1_t35_payload( &sets, &payload );
+            std::string suffix = "/sets:" + std::to_string( n ) + "/lag:" + std::to_string( lag );
+
+            Afgs1_film_grain_params read_sets[AFGS1_MAX_PARAM_SETS];
+            run_benchmark( "read_afgs1_t35_payload" + suffix, "call", 1, [&]() {
+                sink = read_afgs1_t35_payload( &payload[0], payload.size(), read_sets );
+            } );
+
+            int indices[AFGS1_MAX_PARAM_SETS];
+            run_benchmark( "read_film_grain_param_set_indices" + suffix, "call", 1, [&]() {
+                BitReader rb( &payload[AFGS1_T35_HEADER_SIZE], payload.size() - AFGS1_T35_HEADER_SIZE );
+                sink = read_film_grain_param_set_indices( &rb, indices );
+            } );
+        }
+    }
+}
+
+static void bench_buffer() {
+
+    static const int filled_counts[] = { 1, 8 };
+    for( int n : filled_counts ) {
+        Random r( 4 );
+        std::list<Afgs1_film_grain_params> sets = random_param_sets( &r, n, 3 );
+        std::vector<Afgs1_film_grain_params> queries( sets.begin(), sets.end() );
+        Afgs1_buffer buffer;
+        for( auto &p : sets )
+            buffer.update_buffer( p );
+
+        // Half of the queries are buffered sets and half have a different seed, and are not found
+        const int num_queries = 256;
+        std::vector<Afgs1_film_grain_params> lookups;
+        for( int i = 0; i < num_queries; i++ ) {
+            Afgs1_film_grain_params p = queries[r.next( n )];
+            if( i & 1 )
+                p.grain_seed ^= 1;
+            lookups.push_back( p );
+        }
+
+        std::string suffix = "/filled:" + std::to_string( n );
+        run_benchmark( "Afgs1_buffer::find_params" + suffix, "lookup", num_queries, [&]() {
+            int found = 0;
+            for( int i = 0; i < num_queries; i++ )
+                found += buffer.find_params( lookups[i] ) >= 0;
+            sink = found;
+        } );
+        run_benchmark( "Afgs1_buffer::find_content" + suffix, "lookup", num_queries, [&]() {
+            int found = 0;
+            for( int i = 0; i < num_queries; i++ )
+                found += buffer.find_content( lookups[i] ) >= 0;
+            sink = found;
+        } );
+    }
+}
+
+static void bench_database() {
+
+    static const long entry_counts[] = { 1000, 10000, 100000, 1000000 };
+    static const int resolution_counts[] = { 1, 8 };
+    for( long entries : entry_counts ) {
+        if( entries > max_entries )
+            break;
+
+        std::string fname = tmp_dir + "/afgs1_bench_" + std::to_string( entries ) + ".fgs";
+        if( !write_filmgrn1( fname, entries ) ) {
+            printf("Error: Unable to write %s\n", fname.c_str());
+            exit(1);
+        }
+
+        for( int res : resolution_counts ) {
+            std::string suffix = "/entries:" + std::to_string( entries ) + "/res:" + std::to_string( res );
+
+            // Loading includes parsing each entry with load_params
+            run_benchmark( "Afgs1_film_grain_database::load_table" + suffix, "entry", (uint64_t)entries * res, [&]() {
+                Afgs1_film_grain_database db;
+                for( int i = 0; i < res; i++ )
+                    db.load_table( fname.c_str(), 3840 - 240 * i, 2160 - 135 * i );
+                sink = db.all_frames().size();
+            } );
+
+            Afgs1_film_grain_database db;
+            for( int i = 0; i < res; i++ )
+                db.load_table( fname.c_str(), 3840 - 240 * i, 2160 - 135 * i );
+
+            const int num_lookups = 16;
+            Random r( 5 );
+            std::vector<int64_t> times( num_lookups );
+            for( int i = 0; i < num_lookups; i++ )
+                times[i] = (int64_t)r.next( (int)entries ) * 417083 + r.next( 417083 );
+
+            run_benchmark( "Afgs1_film_grain_database::find_frames" + suffix, "lookup", num_lookups, [&]() {
+                size_t found = 0;
+                for( int i = 0; i < num_lookups; i++ )
+                    found += db.find_frames( times[i] ).size();
+                sink = found;
+            } );
+        }
+        remove( fname.c_str() );
+    }
+}
+
+// Scaling function of a sample evaluated from the scaling points, without a lookup table: the segment of the
+// 8-bit function that contains the sample is searched and interpolated, and 10 and 12-bit samples interpolate
+// between two 8-bit values
+static int piecewise_scaling( const int (*points)[2], int num_points, int value_8 ) {
+
+    if( num_points == 0 )
+        return 0;
+    if( value_8 < points[0][0] )
+        return points[0][1];
+    for( int i = 0; i < num_points - 1; i++ ) {
+        if( value_8 < points[i + 1][0] ) {
+            int delta_x = points[i + 1][0] - points[i][0];
+            int delta = ( points[i + 1][1] - points[i][1] ) * ( ( 65536 + ( delta_x >> 1 ) ) / delta_x );
+            return (uint8_t)( points[i][1] + ( ( ( value_8 - points[i][0] ) * delta + 32768 ) >> 16 ) );
+        }
+    }
+    return points[num_points - 1][1];
+}
+
+static int piecewise_scaling( const int (*points)[2], int num_points, int bit_depth, int value ) {
+
+    int shift = bit_depth - 8;
+    int x = value >> shift;
+    int start = piecewise_scaling( points, num_points, x );
+    if( shift == 0 || x == 255 )
+        return start;
+    int end = piecewise_scaling( points, num_points, x + 1 );
+    return start + ( ( ( end - start ) * ( value & ( ( 1 << shift ) - 1 ) ) + ( 1 << ( shift - 1 ) ) ) >> shift );
+}
+
+static void bench_scaling_function() {
+
+    static const char* level_names[] = { "c", "sse4", "avx2" };
+    const int width = 1920;
+
+    Random r( 9 );
+    Afgs1_film_grain_params p = random_params( &r, 0, 0, width, 1080 );
+    std::vector<uint8_t> lut( AFGS1_MAX_SCALING_LUT_SIZE + AFGS1_SCALING_LUT_PADDING );
+    std::vector<uint8_t> row_8( width );
+    std::vector<uint16_t> row_16( width );
+    std::vector<int16_t> scale( width );
+
+    for( int bit_depth = 8; bit_depth <= 12; bit_depth += 2 ) {
+        std::string suffix = "/" + std::to_string( bit_depth ) + "bit";
+        for( int x = 0; x < width; x++ ) {
+            row_16[x] = (uint16_t)r.next( 1 << bit_depth );
+            row_8[x] = (uint8_t)row_16[x];
+        }
+
+        run_benchmark( "afgs1_build_scaling_lut" + suffix, "call", 1, [&]() {
+            afgs1_build_scaling_lut( p.scaling_points_y, p.num_y_points, bit_depth, &lut[0] );
+            sink = lut[0];
+        } );
+
+        run_benchmark( "scaling_function/piecewise" + suffix, "sample", width, [&]() {
+            for( int x = 0; x < width; x++ )
+                scale[x] = (int16_t)piecewise_scaling( p.scaling_points_y, p.num_y_points, bit_depth, row_16[x] );
+            sink = scale[width - 1];
+        } );
+
+        // Only the instruction sets with their own lookup kernels are measured (SSE4.1 uses the scalar kernels)
+        for( int level = AFGS1_SIMD_NONE; level <= AFGS1_SIMD_AVX2; level++ ) {
+            Afgs1_grain_synthesis synthesis( (Afgs1_simd_level)level );
+            if( synthesis.get_simd_level() != level )
+                continue;
+            const Afgs1_grain_kernels &kernels = synthesis.get_kernels();
+            if( level != AFGS1_SIMD_NONE && kernels.lookup_scaling == afgs1_lookup_scaling_c )
+                continue;
+            run_benchmark( "scaling_function/lookup" + suffix + "/" + level_names[level], "sample", width, [&]() {
+                if( bit_depth == 8 )
+                    kernels.lookup_scaling( &lut[0], &row_8[0], &scale[0], width );
+                else
+                    kernels.lookup_scaling_16( &lut[0], &row_16[0], &scale[0], width );
+                sink = scale[width - 1];
+            } );
+        }
+    }
+}
+
+static void bench_synthesis() {
+
+    static const char* level_names[] = { "c", "sse4", "avx2" };
+    const int width = 1920;
+    const int height = 1080;
+
+    // A frame of smooth gradients with a little texture, restored before each application
+    std::vector<uint8_t> source( width * height * 3 / 2 );
+    Random r( 6 );
+    for( size_t i = 0; i < source.size(); i++ )
+        source[i] = (uint8_t)( ( i % width ) / 8 + r.next( 16 ) );
+    std::vector<uint8_t> frame_data( source.size() );
+    Afgs1_frame frame;
+    frame.planes[0] = &frame_data[0];
+    frame.planes[1] = frame.planes[0] + width * height;
+    frame.planes[2] = frame.planes[1] + width * height / 4;
+    frame.stride[0] = width;
+    frame.stride[1] = frame.stride[2] = width / 2;
+    frame.planes_16[0] = frame.planes_16[1] = frame.planes_16[2] = NULL;
+    frame.width = width;
+    frame.height = height;
+    frame.bit_depth = 8;
+
+    // The same frame with 10-bit samples
+    std::vector<uint16_t> source_10( source.size() );
+    for( size_t i = 0; i < source.size(); i++ )
+        source_10[i] = (uint16_t)( ( source[i] << 2 ) + r.next( 4 ) );
+    std::vector<uint16_t> frame_10_data( source_10.size() );
+    Afgs1_frame frame_10;
+    frame_10.planes[0] = frame_10.planes[1] = frame_10.planes[2] = NULL;
+    frame_10.planes_16[0] = &frame_10_data[0];
+    frame_10.planes_16[1] = frame_10.planes_16[0] + width * height;
+    frame_10.planes_16[2] = frame_10.planes_16[1] + width * height / 4;
+    frame_10.stride[0] = width;
+    frame_10.stride[1] = frame_10.stride[2] = width / 2;
+    frame_10.width = width;
+    frame_10.height = height;
+    frame_10.bit_depth = 10;
+
+    for( int lag = 0; lag <= 3; lag += 3 ) {
+        Random rp( 7 );
+        Afgs1_film_grain_params p = random_params( &rp, lag, 0, width, height );
+        p.num_cb_points = p.num_cr_points = 8;
+        std::string suffix = "/lag:" + std::to_string( lag );
+
+        Afgs1_grain_synthesis templates;
+        run_benchmark( "Afgs1_grain_synthesis::set_params" + suffix, "call", 1, [&]() {
+            templates.set_params( p );
+            sink = templates.get_luma_grain()[0];
+        } );
+
+        Afgs1_grain_cache cache;
+        run_benchmark( "Afgs1_grain_synthesis::set_params/cached" + suffix, "call", 1, [&]() {
+            templates.set_params( p, 8, &cache );
+            sink = templates.get_luma_grain()[0];
+        } );
+
+        for( int level = AFGS1_SIMD_NONE; level <= AFGS1_SIMD_AVX2; level++ ) {
+            Afgs1_grain_synthesis synthesis( (Afgs1_simd_level)level );
+            if( synthesis.get_simd_level() != level )
+                continue;
+            synthesis.set_params( p );
+            run_benchmark( "Afgs1_grain_synthesis::add_grain/1080p" + suffix + "/" + level_names[level], "frame", 1,
+                           [&]() {
+                memcpy( &frame_data[0], &source[0], source.size() );
+                synthesis.add_grain( &frame );
+                sink = frame_data[width + 1];
+            } );
+        }
+
+        for( int level = AFGS1_SIMD_NONE; level <= AFGS1_SIMD_AVX2; level++ ) {
+            Afgs1_grain_synthesis synthesis( (Afgs1_simd_level)level );
+            if( synthesis.get_simd_level() != level )
+                continue;
+            synthesis.set_params( p, 10 );
+            run_benchmark( "Afgs1_grain_synthesis::add_grain/1080p/10-bit" + suffix + "/" + level_names[level],
+                           "frame", 1, [&]() {
+                memcpy( &frame_10_data[0], &source_10[0], source_10.size() * sizeof(uint16_t) );
+                synthesis.add_grain( &frame_10 );
+                sink = frame_10_data[width + 1];
+            } );
+        }
+    }
+
+    // A 2160p frame shared by the threads of a pool, with the best instruction set
+    {
+        const int width_4k = 3840;
+        const int height_4k = 2160;
+        std::vector<uint8_t> source_4k( width_4k * height_4k * 3 / 2 );
+        for( size_t i = 0; i < source_4k.size(); i++ )
+            source_4k[i] = (uint8_t)( ( i % width_4k ) / 16 + r.next( 16 ) );
+        std::vector<uint8_t> frame_4k_data( source_4k.size() );
+        Afgs1_frame frame_4k;
+        frame_4k.planes[0] = &frame_4k_data[0];
+        frame_4k.planes[1] = frame_4k.planes[0] + width_4k * height_4k;
+        frame_4k.planes[2] = frame_4k.planes[1] + width_4k * height_4k / 4;
+        frame_4k.stride[0] = width_4k;
+        frame_4k.stride[1] = frame_4k.stride[2] = width_4k / 2;
+        frame_4k.planes_16[0] = frame_4k.planes_16[1] = frame_4k.planes_16[2] = NULL;
+        frame_4k.width = width_4k;
+        frame_4k.height = height_4k;
+        frame_4k.bit_depth = 8;
+
+        Random rp( 7 );
+        Afgs1_film_grain_params p = random_params( &rp, 3, 0, width_4k, height_4k );
+        p.overlap_flag = 1;
+        Afgs1_grain_synthesis synthesis;
+        synthesis.set_params( p );
+        for( int threads = 1; threads <= 16; threads *= 2 ) {
+            ThreadPool pool( threads );
+            run_benchmark( "Afgs1_grain_synthesis::add_grain/2160p/threads:" + std::to_string( threads ), "frame", 1,
+                           [&]() {
+                memcpy( &frame_4k_data[0], &source_4k[0], source_4k.size() );
+                synthesis.add_grain( &frame_4k, &pool );
+                sink = frame_4k_data[width_4k + 1];
+            } );
+        }
+    }
+
+    // A timeline of 64 parameter sets of 24 frames each, applied to a 1080p and a 720p rendition through a cache
+    // of 16 templates shared by the renditions.  Each set is generated once per pass over the timeline.
+    std::vector<Afgs1_film_grain_params> timeline;
+    Random rt( 8 );
+    for( int i = 0; i < 64; i++ )
+        timeline.push_back( random_params( &rt, 3, 0, width, height ) );
+
+    // The 720p rendition is the top left of the frame buffer
+    Afgs1_frame rendition = frame;
+    rendition.width = 1280;
+    rendition.height = 720;
+
+    Afgs1_grain_cache cache;
+    Afgs1_grain_synthesis synthesis[2];
+    int frame_num = 0;
+    run_benchmark( "Afgs1_grain_synthesis::add_grain/cached_timeline/1080p+720p", "frame", 1, [&]() {
+        const Afgs1_film_grain_params &p = timeline[( frame_num++ / 24 ) % timeline.size()];
+        memcpy( &frame_data[0], &source[0], source.size() );
+        synthesis[0].set_params( p, 8, &cache );
+        synthesis[0].add_grain( &frame );
+        synthesis[1].set_params( p, 8, &cache );
+        synthesis[1].add_grain( &rendition );
+        sink = frame_data[width + 1];
+    } );
+    if( !filter || strstr( "Afgs1_grain_synthesis::add_grain/cached_timeline/1080p+720p", filter ) ) {
+        printf("%-58s %12.2f %%\n", "Afgs1_grain_cache::hit_rate/cached_timeline", 100.0 * cache.get_hit_rate());
+        fflush(stdout);
+    }
+}
+
+static void bench_estimation() {
+
+    const int width = 1920;
+    const int height = 1080;
+
+    // A frame of smooth gradients with the film grain of random parameters, and the frame without the grain
+    std::vector<uint8_t> clean( width * height * 3 / 2 );
+    for( size_t i = 0; i < clean.size(); i++ ) {
+        int plane_width = i < (size_t)( width * height ) ? width : width / 2;
+        clean[i] = (uint8_t)( 64 + ( i % plane_width ) * 128 / plane_width );
+    }
+    std::vector<uint8_t> grainy( clean );
+    Afgs1_frame frame[2];
+    uint8_t *data[2] = { &grainy[0], &clean[0] };
+    for( int k = 0; k < 2; k++ ) {
+        frame[k].planes[0] = data[k];
+        frame[k].planes[1] = frame[k].planes[0] + width * height;
+        frame[k].planes[2] = frame[k].planes[1] + width * height / 4;
+        frame[k].stride[0] = width;
+        frame[k].stride[1] = frame[k].stride[2] = width / 2;
+        frame[k].planes_16[0] = frame[k].planes_16[1] = frame[k].planes_16[2] = NULL;
+        frame[k].width = width;
+        frame[k].height = height;
+        frame[k].bit_depth = 8;
+    }
+    // The grain of a film: constant scaling functions and weak AR coefficients, so that the blocks are flat
+    Random rp( 9 );
+    Afgs1_film_grain_params p = random_params( &rp, 3, 0, width, height );
+    p.num_y_points = p.num_cb_points = p.num_cr_points = 2;
+    for( int i = 0; i < 2; i++ ) {
+        p.scaling_points_y[i][0] = p.scaling_points_cb[i][0] = p.scaling_points_cr[i][0] = i * 255;
+        p.scaling_points_y[i][1] = 48;
+        p.scaling_points_cb[i][1] = p.scaling_points_cr[i][1] = 32;
+    }
+    p.scaling_shift = 10;
+    for( int i = 0; i < 24; i++ )
+        p.ar_coeffs_y[i] /= 4;
+    for( int i = 0; i < 25; i++ ) {
+        p.ar_coeffs_cb[i] /= 4;
+        p.ar_coeffs_cr[i] /= 4;
+    }
+    p.ar_coeff_shift = 8;
+    p.grain_scale_shift = 0;
+    Afgs1_grain_synthesis synthesis;
+    synthesis.set_params( p );
+    synthesis.add_grain( &frame[0] );
+
+    for( int lag = 0; lag <= 3; lag += 3 ) {
+        Afgs1_film_grain_database database;
+        Afgs1_grain_estimation estimation( &database, lag );
+        Afgs1_noise_statistics stats;
+        std::string suffix = "/lag:" + std::to_string( lag );
+        run_benchmark( "Afgs1_grain_estimation::analyze_frame/1080p" + suffix, "frame", 1, [&]() {
+            estimation.analyze_frame( frame[0], NULL, NULL, &stats );
+            sink = stats.num_observations[0];
+        } );
+        run_benchmark( "Afgs1_grain_estimation::analyze_frame/denoised" + suffix, "frame", 1, [&]() {
+            estimation.analyze_frame( frame[0], &frame[1], NULL, &stats );
+            sink = stats.num_observations[0];
+        } );
+    }
+
+    // Frames added to the timeline with the blocks shared by the threads of a pool
+    for( int threads = 1; threads <= 16; threads *= 4 ) {
+        Afgs1_film_grain_database database;
+        Afgs1_grain_estimation estimation( &database );
+        ThreadPool pool( threads );
+        int64_t time = 0;
+        run_benchmark( "Afgs1_grain_estimation::add_frame/1080p/threads:" + std::to_string( threads ), "frame", 1,
+                       [&]() {
+            estimation.add_frame( frame[0], NULL, time, time + 1, &pool );
+            time++;
+        } );
+        sink = database.end_time();
+    }
+}
+
+// Self-check of the film grain synthesis.  Each case synthesizes the grain of fixed-seed parameters onto a
+// fixed-seed frame, and the FNV-1a hash of the output samples is compared with the hash stored in the case.  The
+// stored hashes are regression hashes of the output of this implementation: they detect changes of the output,
+// and differences between the instruction sets and thread counts, but do not by themselves show conformance.
+// Every instruction set supported by the processor is checked, on the calling thread and with a pool of 3 threads.
+struct Self_check_case {
+    int bit_depth;
+    int lag;
+    int overlap_flag;
+    int chroma_scaling_from_luma;
+    int clip_to_restricted_range;
+    int width;
+    int height;
+    uint64_t hash;
+};
+
+static const Self_check_case self_check_cases[] = {
+    {  8, 0, 0, 0, 0, 352, 288, 0x34dd3aeb95dde718ULL },
+    {  8, 1, 1, 0, 1, 350, 198, 0x38cda37010323a4aULL },
+    {  8, 2, 1, 1, 0,  97,  61, 0xd16d344ca8966f5bULL },
+    {  8, 3, 0, 0, 0, 720, 480, 0xf3829ec7b2521d93ULL },
+    { 10, 0, 1, 0, 1, 352, 288, 0xd12545ad49842d06ULL },
+    { 10, 1, 0, 1, 0, 201, 117, 0x80383b46f5da51ceULL },
+    { 10, 2, 1, 0, 0, 640, 360, 0x90e0e6f781eb9e2bULL },
+    { 10, 3, 1, 1, 1, 350, 198, 0xc1c2f742852e64f8ULL },
+    { 12, 0, 0, 0, 0, 176, 144, 0x265acefd7e2ca415ULL },
+    { 12, 1, 1, 0, 0, 333, 199, 0x61823becf54405dbULL },
+    { 12, 2, 0, 1, 1, 352, 288, 0x092c7985abb412beULL },
+    { 12, 3, 1, 0, 0, 640, 360, 0xf8c9dc44ffcd0373ULL },
+};
+
+static Afgs1_film_grain_params self_check_params( const Self_check_case &c, int index ) {
+
+    Random r( 1000 + index );
+    Afgs1_film_grain_params p = random_params( &r, c.lag, 0, c.width, c.height );
+    p.bit_depth = c.bit_depth;
+    p.overlap_flag = c.overlap_flag;
+    p.clip_to_restricted_range = c.clip_to_restricted_range;
+    p.chroma_scaling_from_luma = c.chroma_scaling_from_luma;
+    if( p.chroma_scaling_from_luma )
+        p.num_cb_points = p.num_cr_points = 0;
+    return p;
+}
+
+// The samples of the planes of the frame of a case: gradients with a little texture.  The chroma planes have
+// half the size, rounded up.
+static void self_check_frame( const Self_check_case &c, int index, std::vector<uint16_t> planes[3] ) {
+
+    Random r( 2000 + index );
+    int max_value = ( 1 << c.bit_depth ) - 1;
+    for( int plane = 0; plane < 3; plane++ ) {
+        int width = plane ? ( c.width + 1 ) / 2 : c.width;
+        int height = plane ? ( c.height + 1 ) / 2 : c.height;
+        planes[plane].resize( width * height );
+        for( int y = 0; y < height; y++ )
+            for( int x = 0; x < width; x++ ) {
+                int value = ( x * 3 + y * 5 + plane * 77 ) << ( c.bit_depth - 8 );
+                value += r.next( 40 << ( c.bit_depth - 8 ) );
+                planes[plane][y * width + x] = (uint16_t)( value & max_value );
+            }
+    }
+}
+
+// FNV-1a hash of the samples of a frame, with the samples of 10 and 12-bit frames hashed as two bytes, least
+// significant first
+static uint64_t frame_hash( const Afgs1_frame &frame ) {
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for( int plane = 0; plane < 3; plane++ ) {
+        int width = plane ? ( frame.width + 1 ) / 2 : frame.width;
+        int height = plane ? ( frame.height + 1 ) / 2 : frame.height;
+        for( int y = 0; y < height; y++ )
+            for( int x = 0; x < width; x++ ) {
+                int value = frame.bit_depth > 8 ? frame.planes_16[plane][y * frame.stride[plane] + x]
+                                                : frame.planes[plane][y * frame.stride[plane] + x];
+                hash = ( hash ^ ( value & 0xff ) ) * 0x100000001b3ULL;
+                if( frame.bit_depth > 8 )
+                    hash = ( hash ^ ( value >> 8 ) ) * 0x100000001b3ULL;
+            }
+    }
+    return hash;
+}
+
+// Run the self-check.  Returns false if the output of any case differs from the stored hash.
+static bool self_check() {
+
+    static const char* level_names[] = { "c", "sse4", "avx2" };
+    ThreadPool pool( 3 );
+    int num_cases = (int)( sizeof(self_check_cases) / sizeof(self_check_cases[0]) );
+    int num_failed = 0;
+    for( int i = 0; i < num_cases; i++ ) {
+        const Self_check_case &c = self_check_cases[i];
+        Afgs1_film_grain_params p = self_check_params( c, i );
+        std::vector<uint16_t> source[3];
+        self_check_frame( c, i, source );
+
+        for( int level = AFGS1_SIMD_NONE; level <= AFGS1_SIMD_AVX2; level++ ) {
+            Afgs1_grain_synthesis synthesis( (Afgs1_simd_level)level );
+            if( synthesis.get_simd_level() != level )
+                continue;
+            synthesis.set_params( p, c.bit_depth );
+
+            for( int threads = 1; threads <= 3; threads += 2 ) {
+                std::vector<uint8_t> samples[3];
+                std::vector<uint16_t> samples_16[3];
+                Afgs1_frame frame;
+                frame.width = c.width;
+                frame.height = c.height;
+                frame.bit_depth = c.bit_depth;
+                for( int plane = 0; plane < 3; plane++ ) {
+                    frame.stride[plane] = plane ? ( c.width + 1 ) / 2 : c.width;
+                    samples_16[plane] = source[plane];
+                    samples[plane].assign( source[plane].begin(), source[plane].end() );
+                    frame.planes[plane] = c.bit_depth > 8 ? NULL : &samples[plane][0];
+                    frame.planes_16[plane] = c.bit_depth > 8 ? &samples_16[plane][0] : NULL;
+                }
+
+                bool applied = synthesis.add_grain( &frame, threads > 1 ? &pool : NULL );
+                uint64_t hash = applied ? frame_hash( frame ) : 0;
+                bool ok = hash == c.hash;
+                printf("self_check/%d-bit/lag:%d/%dx%d/%s/threads:%d %s (%016llx)\n", c.bit_depth, c.lag, c.width,
+                       c.height, level_names[level], threads, ok ? "ok" : "FAILED", (unsigned long long)hash);
+                if( !ok )
+                    num_failed++;
+            }
+        }
+    }
+
+    printf("self_check: %d failed\n", num_failed);
+    return num_failed == 0;
+}
+
+int main(int argc, char **argv) {
+
+    bool run_self_check = false;
+    for( int i=1; i<argc; i++ ){
+
+        if(strcmp( "--self_check", argv[i]) == 0) {
+            run_self_check = true;
+            continue;
+        }
+        if( i + 1 >= argc ) {
+            printf("Error: %s must be followed by parameter\n", argv[i]);
+            exit(1);
+        }
+
+        if(strcmp( "--min_time", argv[i]) == 0)
+            min_time = atof( argv[++i] );
+        else if(strcmp( "--max_entries", argv[i]) == 0)
+            max_entries = atol( argv[++i] );
+        else if(strcmp( "--filter", argv[i]) == 0)
+            filter = argv[++i];
+        else if(strcmp( "--tmp_dir", argv[i]) == 0)
+            tmp_dir = argv[++i];
+        else {
+            printf("Error: Unknown parameter %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    if( run_self_check )
+        return self_check() ? 0 : 1;
+
+    bench_write_literal();
+    bench_write_param_sets();
+    bench_read_literal();
+    bench_read_param_sets();
+    bench_buffer();
+    bench_database();
+    bench_scaling_function();
+    bench_synthesis();
+    bench_estimation();
+    return 0;
+}
@@ -0,0 +1,130 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Annex B byte stream functions - Locate the NAL units in a byte stream held in memory.  Streams of
+// length-prefixed NAL units (the sample format of ISO/IEC 14496-15) are also supported.
+//
+
+#include "annexb.h"
+#include <cstring>
+
+// Find the first position at or after pos where the three byte sequence 0x000000 or 0x000001 starts.
+// Returns stream_size if there is no such position.
+static size_t find_zero_sequence( const uint8_t* stream, size_t stream_size, size_t pos )
+{
+    while( pos + 2 < stream_size ) {
+        const uint8_t *p = (const uint8_t*) memchr( stream + pos, 0, stream_size - pos - 2 );
+        if( p == NULL )
+            break;
+
+        pos = p - stream;
+        if( stream[pos + 1] == 0 && stream[pos + 2] <= 1 )
+            return pos;
+        pos += ( stream[pos + 1] == 0 ) ? 1 : 2;
+    }
+    return stream_size;
+}
+
+// The NAL unit ends at the next zero sequence (the start of trailing zero bytes or of the next start code).
+// For the last NAL unit in the stream, trailing zero bytes are excluded from the NAL unit and the returned
+// position is the end of the stream, so that [nal->prefix, stream + return value) always covers the bytes
+// of the stream that belong to the NAL unit.
+size_t annexb_next_nal_unit( const uint8_t* stream, size_t stream_size, size_t pos, AnnexBNalUnit *nal )
+{
+    // Locate the start code prefix
+    size_t start = pos;
+    while( true ) {
+        start = find_zero_sequence( stream, stream_size, start );
+        if( start == stream_size )
+            return 0;
+        if( stream[start + 2] == 1 )
+            break;
+        start++;
+    }
+
+    nal->prefix = stream + pos;
+    nal->prefix_size = start + 3 - pos;
+    nal->data = stream + start + 3;
+
+    // Locate the end of the NAL unit
+    size_t end = find_zero_sequence( stream, stream_size, start + 3 );
+    if( end == stream_size ) {
+        while( end > start + 3 && stream[end - 1] == 0 )
+            end--;
+        nal->size = end - ( start + 3 );
+        return stream_size;
+    }
+
+    nal->size = end - ( start + 3 );
+    return end;
+}
+
+size_t length_prefixed_next_nal_unit( const uint8_t* stream, size_t stream_size, size_t pos, int length_size,
+                                      AnnexBNalUnit *nal )
+{
+    if( pos + length_size > stream_size )
+        return 0;
+
+    size_t length = 0;
+    for( int i = 0; i < length_size; i++ )
+        length = ( length << 8 ) | stream[pos + i];
+    if( length > stream_size - pos - length_size )
+        return 0;
+
+    nal->prefix = stream + pos;
+    nal->prefix_size = length_size;
+    nal->data = stream + pos + length_size;
+    nal->size = length;
+    return pos + length_size + length;
+}
+
+bool length_prefixed_write_length( uint8_t* field, int length_size, size_t size )
+{
+    if( length_size < 4 && size >= ( (size_t)1 << ( 8 * length_size ) ) )
+        return false;
+    if( (uint64_t)size > 0xffffffffULL )
+        return false;
+
+    for( int i = length_size - 1; i >= 0; i-- ) {
+        field[i] = (uint8_t)( size & 0xff );
+        size >>= 8;
+    }
+    return true;
+}
+
+size_t annexb_remove_emulation_prevention( const uint8_t* data, size_t size, uint8_t* rbsp, size_t max_size )
+{
+    size_t n = 0;
+    int zeros = 0;
+
+    for( size_t i = 0; i < size && n < max_size; i++ ) {
+        // Drop the 0x03 byte of each 0x000003 sequence
+        if( zeros >= 2 && data[i] == 3 ) {
+            zeros = 0;
+            continue;
+        }
+        zeros = ( data[i] == 0 ) ? zeros + 1 : 0;
+        rbsp[n++] = data[i];
+    }
+
+    return n;
+}
+
+void annexb_add_emulation_prevention( const uint8_t* rbsp, size_t size, std::vector<uint8_t> *nal )
+{
+    int zeros = 0;
+
+    for( size_t i = 0; i < size; i++ ) {
+        // Insert 0x03 before a byte 0x00..0x03 that follows two zero bytes
+        if( zeros >= 2 && rbsp[i] <= 3 ) {
+            nal->push_back( 3 );
+            zeros = 0;
+        }
+        zeros = ( rbsp[i] == 0 ) ? zeros + 1 : 0;
+        nal->push_back( rbsp[i] );
+    }
+}
@@ -0,0 +1,52 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Annex B byte stream functions - Locate the NAL units in a byte stream held in memory.  Streams of
+// length-prefixed NAL units (the sample format of ISO/IEC 14496-15) are also supported.
+//
+
+#ifndef ANNEXB_H
+#define ANNEXB_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// A NAL unit located in a byte stream.  The NAL unit data includes the NAL unit header and any
+// emulation prevention bytes.  The prefix contains the leading zero bytes and the start code prefix,
+// as well as any trailing zero bytes of the previous NAL unit.  For a length-prefixed NAL unit, the
+// prefix is the length field.
+struct AnnexBNalUnit {
+    const uint8_t *prefix;
+    size_t prefix_size;
+    const uint8_t *data;
+    size_t size;
+};
+
+// Find the NAL unit that follows position pos in the byte stream.  Returns the position following the
+// NAL unit, or 0 if there are no further NAL units.
+size_t annexb_next_nal_unit( const uint8_t* stream, size_t stream_size, size_t pos, AnnexBNalUnit *nal );
+
+// Find the length-prefixed NAL unit at position pos, where each NAL unit is preceded by its size in
+// length_size (1, 2 or 4) bytes, most significant byte first.  Returns the position following the NAL
+// unit, or 0 if there are no further NAL units or the NAL unit extends past the end of the stream.
+size_t length_prefixed_next_nal_unit( const uint8_t* stream, size_t stream_size, size_t pos, int length_size,
+                                      AnnexBNalUnit *nal );
+
+// Write the length field of a length-prefixed NAL unit.  Returns false if the size does not fit.
+bool length_prefixed_write_length( uint8_t* field, int length_size, size_t size );
+
+// Copy NAL unit data to rbsp while removing the emulation prevention bytes.  At most max_size bytes are
+// written, so that a parser can view the start of a NAL unit without converting all of it.  Returns the
+// number of bytes written.
+size_t annexb_remove_emulation_prevention( const uint8_t* data, size_t size, uint8_t* rbsp, size_t max_size );
+
+// Append rbsp to nal while inserting the emulation prevention bytes, so that the data does not contain a
+// start code.  The NAL unit header is expected to be in nal already.
+void annexb_add_emulation_prevention( const uint8_t* rbsp, size_t size, std::vector<uint8_t> *nal );
+
+#endif
@@ -0,0 +1,189 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// AV1 OBU functions - Locate the OBUs of an AV1 low overhead bit-stream (Section 5), parse the
+// sequence header and the start of the frame headers to track the temporal units and the key
+// frames, and write ITU-T T.35 metadata OBUs.  Tile data is never parsed.
+//
+
+#include "av1_obu.h"
+#include "rbsp_reader.h"
+
+size_t av1_read_leb128( const uint8_t* data, size_t size, uint64_t *value ) {
+
+    uint64_t v = 0;
+    for( size_t i = 0; i < 8 && i < size; i++ ) {
+        v |= (uint64_t)( data[i] & 0x7f ) << ( 7 * i );
+        if( !( data[i] & 0x80 ) ) {
+            *value = v;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+size_t av1_write_leb128( uint64_t value, uint8_t* data ) {
+
+    size_t n = 0;
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        data[n++] = byte | ( value ? 0x80 : 0 );
+    } while( value && n < 8 );
+    return n;
+}
+
+size_t av1_next_obu( const uint8_t* stream, size_t stream_size, size_t pos, Av1Obu *obu ) {
+
+    if( pos >= stream_size )
+        return 0;
+
+    // obu_header()
+    const uint8_t *p = stream + pos;
+    size_t available = stream_size - pos;
+    if( p[0] & 0x80 )
+        return 0;
+    obu->type = ( p[0] >> 3 ) & 0xf;
+    bool extension_flag = ( p[0] >> 2 ) & 1;
+    bool has_size_field = ( p[0] >> 1 ) & 1;
+
+    size_t header_size = 1;
+    obu->temporal_id = 0;
+    obu->spatial_id = 0;
+    if( extension_flag ) {
+        if( available < 2 )
+            return 0;
+        obu->temporal_id = ( p[1] >> 5 ) & 7;
+        obu->spatial_id = ( p[1] >> 3 ) & 3;
+        header_size = 2;
+    }
+    if( available < header_size )
+        return 0;
+
+    // obu_size
+    uint64_t payload_size = available - header_size;
+    if( has_size_field ) {
+        size_t n = av1_read_leb128( p + header_size, available - header_size, &payload_size );
+        if( n == 0 || payload_size > available - header_size - n )
+            return 0;
+        header_size += n;
+    }
+
+    obu->data = p;
+    obu->payload = p + header_size;
+    obu->payload_size = (size_t) payload_size;
+    obu->size = header_size + obu->payload_size;
+    return pos + obu->size;
+}
+
+void av1_write_t35_metadata_obu( int country_code, const std::vector<uint8_t> &payload, std::vector<uint8_t> *obu ) {
+
+    // metadata_type, itu_t_t35_country_code, the payload bytes and trailing_bits()
+    uint8_t metadata_type[8];
+    size_t metadata_type_size = av1_write_leb128( AV1_METADATA_TYPE_ITUT_T35, metadata_type );
+    uint64_t obu_size = metadata_type_size + 1 + payload.size() + 1;
+
+    uint8_t size_field[8];
+    size_t size_field_size = av1_write_leb128( obu_size, size_field );
+
+    obu->push_back( ( AV1_OBU_METADATA << 3 ) | 0x02 );   // obu_has_size_field
+    obu->insert( obu->end(), size_field, size_field + size_field_size );
+    obu->insert( obu->end(), metadata_type, metadata_type + metadata_type_size );
+    obu->push_back( (uint8_t) country_code );
+    obu->insert( obu->end(), payload.begin(), payload.end() );
+    obu->push_back( 0x80 );
+}
+
+Av1Parser::Av1Parser() {
+    reset();
+}
+
+void Av1Parser::reset() {
+
+    sequence_header_present = false;
+    reduced_still_picture_header = false;
+    timing_info_present = false;
+    num_units_in_display_tick = 0;
+    time_scale = 0;
+}
+
+bool Av1Parser::get_frame_rate( int *numerator, int *denominator ) const {
+
+    if( !timing_info_present || num_units_in_display_tick == 0 || time_scale == 0 )
+        return false;
+
+    *numerator = (int) time_scale;
+    *denominator = (int) num_units_in_display_tick;
+    return true;
+}
+
+bool Av1Parser::parse_obu( const Av1Obu &obu, Av1FrameInfo *info ) {
+
+    info->is_frame_header = false;
+    info->show_existing_frame = false;
+    info->frame_type = -1;
+    info->show_frame = false;
+
+    switch( obu.type ) {
+
+        case AV1_OBU_SEQUENCE_HEADER:
+            return parse_sequence_header( obu.payload, obu.payload_size );
+
+        case AV1_OBU_FRAME_HEADER:
+        case AV1_OBU_FRAME:
+            info->is_frame_header = true;
+            return parse_frame_header( obu.payload, obu.payload_size, info );
+
+        default:
+            return true;
+    }
+}
+
+// sequence_header_obu() up to the timing information
+bool Av1Parser::parse_sequence_header( const uint8_t* data, size_t size ) {
+
+    RbspReader r( data, size );
+
+    r.skip_bits( 3 );   // seq_profile
+    r.skip_bits( 1 );   // still_picture
+    reduced_still_picture_header = r.read_flag();
+
+    timing_info_present = false;
+    if( !reduced_still_picture_header ) {
+        timing_info_present = r.read_flag();
+        if( timing_info_present ) {
+            num_units_in_display_tick = r.read_bits(32);
+            time_scale = r.read_bits(32);
+        }
+    }
+
+    sequence_header_present = !r.is_overrun();
+    return sequence_header_present;
+}
+
+// uncompressed_header() up to show_frame.  A shown key frame is a random access point.
+bool Av1Parser::parse_frame_header( const uint8_t* data, size_t size, Av1FrameInfo *info ) {
+
+    if( !sequence_header_present )
+        return false;
+
+    if( reduced_still_picture_header ) {
+        info->frame_type = AV1_KEY_FRAME;
+        info->show_frame = true;
+        return true;
+    }
+
+    RbspReader r( data, size );
+    info->show_existing_frame = r.read_flag();
+    if( info->show_existing_frame ) {
+        info->show_frame = true;
+        return !r.is_overrun();
+    }
+    info->frame_type = r.read_bits(2);
+    info->show_frame = r.read_flag();
+    return !r.is_overrun();
+}
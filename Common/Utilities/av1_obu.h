@@ -0,0 +1,94 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// AV1 OBU functions - Locate the OBUs of an AV1 low overhead bit-stream (Section 5), parse the
+// sequence header and the start of the frame headers to track the temporal units and the key
+// frames, and write ITU-T T.35 metadata OBUs.  Tile data is never parsed.
+//
+
+#ifndef AV1_OBU_H
+#define AV1_OBU_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define AV1_OBU_SEQUENCE_HEADER         1
+#define AV1_OBU_TEMPORAL_DELIMITER      2
+#define AV1_OBU_FRAME_HEADER            3
+#define AV1_OBU_TILE_GROUP              4
+#define AV1_OBU_METADATA                5
+#define AV1_OBU_FRAME                   6
+#define AV1_OBU_REDUNDANT_FRAME_HEADER  7
+#define AV1_OBU_TILE_LIST               8
+#define AV1_OBU_PADDING                15
+
+#define AV1_METADATA_TYPE_ITUT_T35      4
+
+#define AV1_KEY_FRAME                   0
+
+// An OBU located in a bit-stream
+struct Av1Obu {
+    const uint8_t *data;          // start of the OBU header
+    size_t size;                  // size of the OBU, including the header and the size field
+    int type;
+    int temporal_id;
+    int spatial_id;
+    const uint8_t *payload;
+    size_t payload_size;
+};
+
+// Information about the frame of an OBU_FRAME_HEADER or OBU_FRAME
+struct Av1FrameInfo {
+    bool is_frame_header;
+    bool show_existing_frame;
+    int frame_type;
+    bool show_frame;
+};
+
+// Read a leb128() value.  Returns the number of bytes read, or 0 if the value is invalid.
+size_t av1_read_leb128( const uint8_t* data, size_t size, uint64_t *value );
+
+// Write a leb128() value using the fewest bytes.  Returns the number of bytes written (at most 8).
+size_t av1_write_leb128( uint64_t value, uint8_t* data );
+
+// Find the OBU at position pos.  An OBU without a size field extends to the end of the stream.  Returns
+// the position following the OBU, or 0 if there are no further OBUs or the OBU is invalid.
+size_t av1_next_obu( const uint8_t* stream, size_t stream_size, size_t pos, Av1Obu *obu );
+
+// Append a metadata OBU of type METADATA_TYPE_ITUT_T35 with the country code and the payload that follows
+// it.  The OBU has a size field and no extension header, so that it applies to all layers.
+void av1_write_t35_metadata_obu( int country_code, const std::vector<uint8_t> &payload, std::vector<uint8_t> *obu );
+
+class Av1Parser {
+
+public:
+    Av1Parser();
+
+    void reset();
+
+    // Parse an OBU.  The sequence header is parsed for the timing information, and the start of the frame
+    // headers for the frame type.  Returns false if the OBU could not be parsed.
+    bool parse_obu( const Av1Obu &obu, Av1FrameInfo *info );
+
+    // Frame rate of the sequence header (time_scale / num_units_in_display_tick).  Returns false if the
+    // timing information is not present.
+    bool get_frame_rate( int *numerator, int *denominator ) const;
+
+private:
+    bool parse_sequence_header( const uint8_t* data, size_t size );
+    bool parse_frame_header( const uint8_t* data, size_t size, Av1FrameInfo *info );
+
+    bool sequence_header_present;
+    bool reduced_still_picture_header;
+    bool timing_info_present;
+    uint32_t num_units_in_display_tick;
+    uint32_t time_scale;
+
+};
+
+#endif
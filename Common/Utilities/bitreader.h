@@ -0,0 +1,119 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Bit reader class - Reads the bit buffers written by BitStream, most significant bit first
+//
+// The bits are read from a 64-bit cache that is refilled with 8 bytes at a time, so that a literal is read with
+// a shift instead of a loop over its bits.
+//
+
+#ifndef BITREADER_H
+#define BITREADER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+class BitReader {
+
+public:
+    BitReader( const uint8_t* data, size_t size ) {
+        next = data;
+        end = data + size;
+        cache = 0;
+        cache_bits = 0;
+        position = 0;
+        overrun = false;
+    }
+
+    // Read num_bits (0..32) bits.  Reading past the end of the data returns zero bits and sets the overrun flag.
+    uint32_t read_literal( int num_bits ) {
+        if( num_bits == 0 )
+            return 0;
+        if( cache_bits < num_bits ) {
+            refill();
+            if( cache_bits < num_bits ) {
+                // The bits after the end of the data are zero in the cache
+                overrun = true;
+                cache_bits = num_bits;
+            }
+        }
+        uint32_t value = (uint32_t)( cache >> ( 64 - num_bits ) );
+        cache <<= num_bits;
+        cache_bits -= num_bits;
+        position += num_bits;
+        return value;
+    }
+
+    int read_bit() { return (int)read_literal(1); }
+
+    // Skip num_bits bits.  The bytes that are skipped entirely are not read.
+    void skip_bits( size_t num_bits ) {
+        if( num_bits <= (size_t)cache_bits ) {
+            cache <<= num_bits;
+            cache_bits -= (int)num_bits;
+            position += num_bits;
+            return;
+        }
+
+        size_t remaining = num_bits - cache_bits;
+        position += cache_bits;
+        cache = 0;
+        cache_bits = 0;
+        if( ( remaining >> 3 ) > (size_t)( end - next ) ) {
+            overrun = true;
+            position += remaining;
+            next = end;
+            return;
+        }
+        next += remaining >> 3;
+        position += remaining & ~(size_t)7;
+        read_literal( (int)( remaining & 7 ) );
+    }
+
+    // Skip to the next byte boundary
+    void byte_align() { skip_bits( ( 8 - ( position & 7 ) ) & 7 ); }
+
+    size_t get_position() const { return position; }
+    bool is_overrun() const { return overrun; }
+
+private:
+    const uint8_t *next;                // next byte to load into the cache
+    const uint8_t *end;
+    uint64_t cache;                     // the next cache_bits bits, from the most significant bit
+    int cache_bits;
+    size_t position;                    // bits read, including the bits read past the end of the data
+    bool overrun;
+
+    // Fill the cache with at least 56 bits, or with the rest of the data.  With 8 bytes left, the whole word is
+    // added below the bits of the cache and the pointer advances by the complete bytes that fit: the bits of the
+    // next byte that also enter the cache are loaded again, with the same value, by the next refill.
+    void refill() {
+        if( end - next >= 8 ) {
+            uint64_t word;
+            memcpy( &word, next, 8 );
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            word = __builtin_bswap64( word );
+#else
+            const uint8_t *bytes = next;
+            word = 0;
+            for( int i = 0; i < 8; i++ )
+                word = ( word << 8 ) | bytes[i];
+#endif
+            cache |= word >> cache_bits;
+            next += ( 63 - cache_bits ) >> 3;
+            cache_bits |= 56;
+            return;
+        }
+        while( cache_bits <= 56 && next < end ) {
+            cache |= (uint64_t)*next++ << ( 56 - cache_bits );
+            cache_bits += 8;
+        }
+    }
+};
+
+#endif //BITREADER_H
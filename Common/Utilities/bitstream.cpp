@@ -22,10 +22,21 @@ BitStream::BitStream() {
     bit_offset = 0;
     buffer_size = BUFFER_CHUNK_SIZE;
     bit_buffer = (uint8_t*) malloc(buffer_size);
+    external = false;
+    overflow = false;
 };
 
+BitStream::BitStream( uint8_t* buffer, uint32_t size ) {
+    bit_offset = 0;
+    buffer_size = size;
+    bit_buffer = buffer;
+    external = true;
+    overflow = false;
+}
+
 BitStream::~BitStream() {
-    free(bit_buffer);
+    if( !external )
+        free(bit_buffer);
 }
 
 void BitStream::write_bit(int bit) {
@@ -35,7 +46,14 @@ void BitStream::write_bit(int bit) {
 
     // Check that there is room in the buffer
     // TODO: Add error checking
-    if( (bit_offset >> 3 ) + 1 >= buffer_size) {
+    // A bit that does not fit an external buffer is dropped, but counted in the position so that the size of
+    // the syntax can still be determined
+    if( external && (bit_offset >> 3) >= buffer_size ) {
+        overflow = true;
+        bit_offset++;
+        return;
+    }
+    if( !external && (bit_offset >> 3 ) + 1 >= buffer_size) {
         //printf("Info: Bitstream buffer is not large enough, extending.\n");
         buffer_size += BUFFER_CHUNK_SIZE;
         bit_buffer = (uint8_t*) realloc( bit_buffer, buffer_size);
@@ -81,6 +99,9 @@ unsigned char BitStream::get_byte(int position) {
 
 void BitStream::clear() {
     bit_offset = 0;
+    overflow = false;
+    if( external )
+        return;
     buffer_size = BUFFER_CHUNK_SIZE;
     bit_buffer = (uint8_t*) realloc( bit_buffer, buffer_size);
 }
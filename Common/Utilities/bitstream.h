@@ -21,17 +21,27 @@ public:
     BitStream();
     ~BitStream();
 
+    // Write into a buffer owned by the caller.  The buffer is never reallocated: the bits that do not fit
+    // are dropped and overflowed() returns true.
+    BitStream( uint8_t* buffer, uint32_t size );
+
+    BitStream( const BitStream& ) = delete;
+    BitStream& operator=( const BitStream& ) = delete;
+
     void write_bit( int bit );
     void write_literal( int value, int num_bits);
     uint32_t get_position();
     unsigned char get_byte(int position);
     void clear();
     void write_stream_to_file(char* fname);
+    bool overflowed() const { return overflow; }
 
 private:
     uint8_t *bit_buffer;
     uint32_t bit_offset;
     uint32_t buffer_size;
+    bool external;              // the buffer is owned by the caller
+    bool overflow;
 
 };
 
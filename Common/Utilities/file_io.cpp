@@ -0,0 +1,350 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// File I/O classes - Read-only memory mapped input files, a sequential reader for pipes and an
+// output file writer that gathers many small writes into large vectored writes
+//
+
+#include "file_io.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#define WRITER_CLOSE _close
+#define READER_READ(fd, buf, size) _read( fd, buf, (unsigned)(size) )
+#define STDIN_FILENO 0
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <climits>
+#define WRITER_CLOSE ::close
+#define READER_READ(fd, buf, size) ::read( fd, buf, size )
+#endif
+
+// Amount of data requested from the input by each read of a StreamReader
+#define READER_READ_SIZE (1 << 16)
+
+// Output is issued once this much data is pending
+#define WRITER_FLUSH_SIZE (8 << 20)
+
+// Maximum number of chunks in a single vectored write
+#ifdef IOV_MAX
+#define WRITER_MAX_IOV IOV_MAX
+#else
+#define WRITER_MAX_IOV 1024
+#endif
+
+MappedFile::MappedFile() {
+    file_data = NULL;
+    file_size = 0;
+    mapped = false;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+// Map the file read-only.  When mapping is not available, the file is read into memory.
+bool MappedFile::open( const char* fname ) {
+
+    close();
+
+#ifndef _WIN32
+    int fd = ::open( fname, O_RDONLY );
+    if( fd < 0 )
+        return false;
+
+    struct stat st;
+    if( fstat( fd, &st ) == 0 && S_ISREG(st.st_mode) ) {
+        file_size = st.st_size;
+        if( file_size == 0 ) {
+            ::close(fd);
+            return true;
+        }
+
+        void *p = mmap( NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if( p != MAP_FAILED ) {
+            madvise( p, file_size, MADV_SEQUENTIAL );
+            ::close(fd);
+            file_data = (uint8_t*) p;
+            mapped = true;
+            return true;
+        }
+    }
+    ::close(fd);
+#endif
+
+    FILE *fid = fopen( fname, "rb" );
+    if( fid == NULL )
+        return false;
+
+    size_t capacity = 0;
+    file_size = 0;
+    while( true ) {
+        if( file_size == capacity ) {
+            capacity = capacity ? 2 * capacity : (1 << 20);
+            file_data = (uint8_t*) realloc( file_data, capacity );
+        }
+        size_t n = fread( file_data + file_size, 1, capacity - file_size, fid );
+        if( n == 0 )
+            break;
+        file_size += n;
+    }
+    fclose(fid);
+
+    return true;
+}
+
+void MappedFile::close() {
+
+#ifndef _WIN32
+    if( mapped )
+        munmap( file_data, file_size );
+    else
+#endif
+        free( file_data );
+
+    file_data = NULL;
+    file_size = 0;
+    mapped = false;
+}
+
+StreamReader::StreamReader() {
+    fd = -1;
+    close_fd = false;
+    buffer_size = 0;
+    eof = true;
+}
+
+StreamReader::~StreamReader() {
+    close();
+}
+
+bool StreamReader::open( const char* fname ) {
+
+    close();
+
+    if( strcmp( fname, "-" ) == 0 ) {
+        fd = STDIN_FILENO;
+        close_fd = false;
+#ifdef _WIN32
+        _setmode( fd, _O_BINARY );
+#endif
+    }
+    else {
+#ifdef _WIN32
+        fd = _open( fname, _O_RDONLY | _O_BINARY );
+#else
+        fd = ::open( fname, O_RDONLY );
+#endif
+        close_fd = true;
+    }
+
+    buffer_size = 0;
+    eof = ( fd < 0 );
+    return fd >= 0;
+}
+
+void StreamReader::close() {
+
+    if( fd >= 0 && close_fd )
+        WRITER_CLOSE(fd);
+    fd = -1;
+    buffer.clear();
+    buffer_size = 0;
+    eof = true;
+}
+
+bool StreamReader::read_more() {
+
+    if( eof )
+        return false;
+
+    if( buffer.size() < buffer_size + READER_READ_SIZE )
+        buffer.resize( buffer_size + READER_READ_SIZE );
+
+    while( true ) {
+        int n = (int) READER_READ( fd, buffer.data() + buffer_size, READER_READ_SIZE );
+        if( n < 0 && errno == EINTR )
+            continue;
+        if( n < 0 ) {
+            printf("Exiting: Error reading input in StreamReader::read_more.\n");
+            exit(1);
+        }
+        if( n == 0 ) {
+            eof = true;
+            return false;
+        }
+        buffer_size += n;
+        return true;
+    }
+}
+
+void StreamReader::discard( size_t size ) {
+
+    if( size > buffer_size )
+        size = buffer_size;
+    memmove( buffer.data(), buffer.data() + size, buffer_size - size );
+    buffer_size -= size;
+}
+
+int redirect_stdout_to_stderr() {
+
+    fflush( stdout );
+#ifdef _WIN32
+    int fd = _dup( STDOUT_FILENO );
+    if( fd < 0 || _dup2( STDERR_FILENO, STDOUT_FILENO ) < 0 )
+        return -1;
+    _setmode( fd, _O_BINARY );
+#else
+    int fd = dup( STDOUT_FILENO );
+    if( fd < 0 || dup2( STDERR_FILENO, STDOUT_FILENO ) < 0 )
+        return -1;
+#endif
+    return fd;
+}
+
+BlockWriter::BlockWriter() {
+    fd = -1;
+    pending_bytes = 0;
+    bytes_written = 0;
+}
+
+BlockWriter::~BlockWriter() {
+    close();
+}
+
+bool BlockWriter::open( const char* fname ) {
+
+    close();
+
+#ifdef _WIN32
+    fd = _open( fname, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644 );
+#else
+    fd = ::open( fname, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+#endif
+    bytes_written = 0;
+
+    return fd >= 0;
+}
+
+bool BlockWriter::open_fd( int file_descriptor ) {
+
+    close();
+
+    fd = file_descriptor;
+    bytes_written = 0;
+
+    return fd >= 0;
+}
+
+void BlockWriter::close() {
+
+    if( fd < 0 )
+        return;
+
+    flush();
+    WRITER_CLOSE(fd);
+    fd = -1;
+}
+
+void BlockWriter::write( const uint8_t* data, size_t size ) {
+
+    if( size == 0 )
+        return;
+
+    // Merge with the previous chunk when the data is contiguous in memory
+    if( !chunks.empty() && chunks.back().data && chunks.back().data + chunks.back().size == data )
+        chunks.back().size += size;
+    else {
+        chunk c = { data, 0, size };
+        chunks.push_back(c);
+    }
+
+    pending_bytes += size;
+    if( pending_bytes >= WRITER_FLUSH_SIZE )
+        flush();
+}
+
+void BlockWriter::write_copy( const uint8_t* data, size_t size ) {
+
+    if( size == 0 )
+        return;
+
+    // The copy buffer may be reallocated, so the chunk stores an offset and not a pointer
+    if( !chunks.empty() && !chunks.back().data && chunks.back().offset + chunks.back().size == copy_buffer.size() )
+        chunks.back().size += size;
+    else {
+        chunk c = { NULL, copy_buffer.size(), size };
+        chunks.push_back(c);
+    }
+    copy_buffer.insert( copy_buffer.end(), data, data + size );
+
+    pending_bytes += size;
+    if( pending_bytes >= WRITER_FLUSH_SIZE )
+        flush();
+}
+
+void BlockWriter::flush() {
+
+    if( fd < 0 || chunks.empty() )
+        return;
+
+#ifdef _WIN32
+    for( size_t i = 0; i < chunks.size(); i++ ) {
+        const uint8_t *p = chunks[i].data ? chunks[i].data : copy_buffer.data() + chunks[i].offset;
+        if( _write( fd, p, (unsigned) chunks[i].size ) != (int) chunks[i].size ) {
+            printf("Exiting: Error writing output in BlockWriter::flush.\n");
+            exit(1);
+        }
+    }
+#else
+    std::vector<struct iovec> iov( chunks.size() );
+    for( size_t i = 0; i < chunks.size(); i++ ) {
+        iov[i].iov_base = (void*)( chunks[i].data ? chunks[i].data : copy_buffer.data() + chunks[i].offset );
+        iov[i].iov_len = chunks[i].size;
+    }
+
+    // Issue the vectored writes, resuming after partial writes
+    size_t first = 0;
+    while( first < iov.size() ) {
+        int count = (int)( iov.size() - first < WRITER_MAX_IOV ? iov.size() - first : WRITER_MAX_IOV );
+        ssize_t n = writev( fd, &iov[first], count );
+        if( n < 0 ) {
+            if( errno == EINTR )
+                continue;
+            printf("Exiting: Error writing output in BlockWriter::flush.\n");
+            exit(1);
+        }
+
+        while( n > 0 ) {
+            if( (size_t) n >= iov[first].iov_len ) {
+                n -= iov[first].iov_len;
+                first++;
+            } else {
+                iov[first].iov_base = (uint8_t*) iov[first].iov_base + n;
+                iov[first].iov_len -= n;
+                n = 0;
+            }
+        }
+    }
+#endif
+
+    bytes_written += pending_bytes;
+    pending_bytes = 0;
+    chunks.clear();
+    copy_buffer.clear();
+}
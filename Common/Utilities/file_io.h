@@ -0,0 +1,107 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// File I/O classes - Read-only memory mapped input files, a sequential reader for pipes and an
+// output file writer that gathers many small writes into large vectored writes
+//
+
+#ifndef FILE_IO_H
+#define FILE_IO_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class MappedFile {
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open( const char* fname );
+    void close();
+
+    const uint8_t* data() const { return file_data; }
+    size_t size() const { return file_size; }
+
+private:
+    uint8_t *file_data;
+    size_t file_size;
+    bool mapped;
+
+};
+
+// Sequential reader for input that may not be seekable, such as a pipe, a FIFO or stdin.  The data read
+// so far is held in a buffer, from which data that is no longer needed is discarded.
+class StreamReader {
+
+public:
+    StreamReader();
+    ~StreamReader();
+
+    // The file name "-" reads from stdin
+    bool open( const char* fname );
+    void close();
+
+    // Read more data into the buffer, waiting until some is available.  Returns false at the end of
+    // the input.  Pointers into the buffer become invalid.
+    bool read_more();
+
+    // Discard the first size bytes of the buffer.  Pointers into the buffer become invalid.
+    void discard( size_t size );
+
+    const uint8_t* data() const { return buffer.data(); }
+    size_t size() const { return buffer_size; }
+    bool is_eof() const { return eof; }
+
+private:
+    int fd;
+    bool close_fd;
+    std::vector<uint8_t> buffer;
+    size_t buffer_size;
+    bool eof;
+
+};
+
+// Redirect stdout to stderr, so that messages printed to stdout do not mix with data written to the
+// original stdout.  Returns a file descriptor for the original stdout, or -1 on failure.
+int redirect_stdout_to_stderr();
+
+class BlockWriter {
+
+public:
+    BlockWriter();
+    ~BlockWriter();
+
+    bool open( const char* fname );
+    bool open_fd( int file_descriptor );  // takes ownership of the file descriptor
+    void close();
+
+    // Queue data for output.  The data passed to write must remain valid until the next flush, while
+    // write_copy stores its own copy of the data.
+    void write( const uint8_t* data, size_t size );
+    void write_copy( const uint8_t* data, size_t size );
+    void flush();
+
+    uint64_t get_bytes_written() const { return bytes_written; }
+
+private:
+    struct chunk {
+        const uint8_t *data;  // NULL for data stored in copy_buffer
+        size_t offset;
+        size_t size;
+    };
+
+    int fd;
+    std::vector<chunk> chunks;
+    std::vector<uint8_t> copy_buffer;
+    size_t pending_bytes;
+    uint64_t bytes_written;
+
+};
+
+#endif
@@ -0,0 +1,454 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// HEVC high level syntax parser - Parses the parameter sets and the start of the slice segment
+// headers of an HEVC bit-stream to determine the picture boundaries, the picture order count
+// and the timing information.  Slice data is never parsed.
+//
+
+#include "hevc_parser.h"
+#include "annexb.h"
+#include "rbsp_reader.h"
+
+// Number of bytes of a slice segment NAL unit that are unescaped to parse the slice segment header up to
+// slice_pic_order_cnt_lsb
+#define HEVC_SLICE_HEADER_BYTES 32
+
+HevcParser::HevcParser() {
+    reset();
+}
+
+void HevcParser::reset() {
+
+    for( int i = 0; i < HEVC_MAX_VPS; i++ )
+        vps_list[i].valid = false;
+    for( int i = 0; i < HEVC_MAX_SPS; i++ )
+        sps_list[i].valid = false;
+    for( int i = 0; i < HEVC_MAX_PPS; i++ )
+        pps_list[i].valid = false;
+
+    first_picture = true;
+    prev_tid0_poc = 0;
+    poc = 0;
+    irap = false;
+    vcl_in_access_unit = false;
+
+    active_sps = -1;
+    frame_rate_present = false;
+    frame_rate_num = 0;
+    frame_rate_denom = 0;
+}
+
+bool HevcParser::get_frame_rate( int *numerator, int *denominator ) const {
+
+    if( !frame_rate_present )
+        return false;
+
+    *numerator = (int) frame_rate_num;
+    *denominator = (int) frame_rate_denom;
+    return true;
+}
+
+bool HevcParser::parse_nal_unit( const uint8_t* data, size_t size, HevcNalInfo *info ) {
+
+    info->is_slice = false;
+    info->first_slice_segment_in_pic = false;
+    info->access_unit_start = false;
+
+    if( size < 2 )
+        return false;
+
+    // NAL unit header
+    info->nal_unit_type = ( data[0] >> 1 ) & 0x3f;
+    info->layer_id = ( ( data[0] & 1 ) << 5 ) | ( data[1] >> 3 );
+    info->temporal_id = ( data[1] & 0x7 ) - 1;
+    info->is_slice = info->nal_unit_type <= HEVC_NAL_CRA &&
+                     !( info->nal_unit_type > HEVC_NAL_RASL_R && info->nal_unit_type < HEVC_NAL_BLA_W_LP );
+
+    if( ( data[0] & 0x80 ) || info->temporal_id < 0 )
+        return false;
+
+    // Only the base layer is considered
+    if( info->layer_id > 0 )
+        return true;
+
+    if( info->is_slice ) {
+        uint8_t rbsp[HEVC_SLICE_HEADER_BYTES];
+        size_t rbsp_size = annexb_remove_emulation_prevention( data + 2, size - 2, rbsp, HEVC_SLICE_HEADER_BYTES );
+        bool result = parse_slice_header( rbsp, rbsp_size, info );
+        update_access_unit( info );
+        return result;
+    }
+    update_access_unit( info );
+
+    switch( info->nal_unit_type ) {
+
+        case HEVC_NAL_VPS:
+        case HEVC_NAL_SPS:
+        case HEVC_NAL_PPS: {
+            rbsp_buffer.resize( size - 2 );
+            size_t rbsp_size = annexb_remove_emulation_prevention( data + 2, size - 2, rbsp_buffer.data(), size - 2 );
+
+            // A new parameter set may change the timing of the active SPS
+            active_sps = -1;
+
+            if( info->nal_unit_type == HEVC_NAL_VPS )
+                return parse_vps( rbsp_buffer.data(), rbsp_size );
+            if( info->nal_unit_type == HEVC_NAL_SPS )
+                return parse_sps( rbsp_buffer.data(), rbsp_size );
+            return parse_pps( rbsp_buffer.data(), rbsp_size );
+        }
+
+        case HEVC_NAL_EOS:
+        case HEVC_NAL_EOB:
+            // The next picture starts a new coded video sequence
+            first_picture = true;
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+// The first of these NAL units after the last VCL NAL unit of a picture starts a new access unit (7.4.2.4.4):
+// an access unit delimiter, a parameter set, a prefix SEI, NAL unit types 41..44 and 48..55, or the first
+// slice segment of a picture
+void HevcParser::update_access_unit( HevcNalInfo *info ) {
+
+    int type = info->nal_unit_type;
+    bool first = ( info->is_slice && info->first_slice_segment_in_pic ) ||
+                 ( type >= HEVC_NAL_VPS && type <= HEVC_NAL_AUD ) || type == HEVC_NAL_PREFIX_SEI ||
+                 ( type >= 41 && type <= 44 ) || ( type >= 48 && type <= 55 );
+
+    info->access_unit_start = first && vcl_in_access_unit;
+    if( info->access_unit_start )
+        vcl_in_access_unit = false;
+    if( type < HEVC_NAL_VPS )
+        vcl_in_access_unit = true;
+}
+
+// profile_tier_level( 1, max_sub_layers_minus1 )
+static void skip_profile_tier_level( RbspReader &r, int max_sub_layers_minus1 ) {
+
+    r.skip_bits( 96 );  // general profile, tier and level
+
+    bool sub_layer_profile_present[8];
+    bool sub_layer_level_present[8];
+    for( int i = 0; i < max_sub_layers_minus1; i++ ) {
+        sub_layer_profile_present[i] = r.read_flag();
+        sub_layer_level_present[i] = r.read_flag();
+    }
+    if( max_sub_layers_minus1 > 0 )
+        r.skip_bits( 2 * ( 8 - max_sub_layers_minus1 ) );
+
+    for( int i = 0; i < max_sub_layers_minus1; i++ ) {
+        if( sub_layer_profile_present[i] )
+            r.skip_bits( 88 );
+        if( sub_layer_level_present[i] )
+            r.skip_bits( 8 );
+    }
+}
+
+bool HevcParser::parse_vps( const uint8_t* rbsp, size_t size ) {
+
+    RbspReader r( rbsp, size );
+
+    int vps_id = r.read_bits(4);
+    r.skip_bits( 2 );   // vps_base_layer_internal_flag, vps_base_layer_available_flag
+    r.skip_bits( 6 );   // vps_max_layers_minus1
+    int max_sub_layers_minus1 = r.read_bits(3);
+    r.skip_bits( 17 );  // vps_temporal_id_nesting_flag, vps_reserved_0xffff_16bits
+    skip_profile_tier_level( r, max_sub_layers_minus1 );
+
+    bool sub_layer_ordering_info_present = r.read_flag();
+    for( int i = sub_layer_ordering_info_present ? 0 : max_sub_layers_minus1; i <= max_sub_layers_minus1; i++ ) {
+        r.read_ue();  // vps_max_dec_pic_buffering_minus1
+        r.read_ue();  // vps_max_num_reorder_pics
+        r.read_ue();  // vps_max_latency_increase_plus1
+    }
+
+    int max_layer_id = r.read_bits(6);
+    uint32_t num_layer_sets_minus1 = r.read_ue();
+    if( num_layer_sets_minus1 > 1023 )
+        return false;
+    r.skip_bits( (size_t) num_layer_sets_minus1 * ( max_layer_id + 1 ) );
+
+    vps &v = vps_list[vps_id];
+    v.timing_info_present = r.read_flag();
+    if( v.timing_info_present ) {
+        v.num_units_in_tick = r.read_bits(32);
+        v.time_scale = r.read_bits(32);
+    }
+
+    v.valid = !r.is_overrun();
+    return v.valid;
+}
+
+// scaling_list_data( )
+static void skip_scaling_list_data( RbspReader &r ) {
+
+    for( int size_id = 0; size_id < 4; size_id++ ) {
+        for( int matrix_id = 0; matrix_id < 6; matrix_id += ( size_id == 3 ) ? 3 : 1 ) {
+            if( !r.read_flag() ) {
+                r.read_ue();  // scaling_list_pred_matrix_id_delta
+            } else {
+                int coef_num = ( 1 << ( 4 + ( size_id << 1 ) ) ) < 64 ? ( 1 << ( 4 + ( size_id << 1 ) ) ) : 64;
+                if( size_id > 1 )
+                    r.read_se();  // scaling_list_dc_coef_minus8
+                for( int i = 0; i < coef_num; i++ )
+                    r.read_se();  // scaling_list_delta_coef
+            }
+        }
+    }
+}
+
+// st_ref_pic_set( idx ) in an SPS.  Returns NumDeltaPocs[ idx ], or -1 for an invalid set.
+static int skip_st_ref_pic_set( RbspReader &r, int idx, const int *num_delta_pocs ) {
+
+    if( idx != 0 && r.read_flag() ) {  // inter_ref_pic_set_prediction_flag
+        r.read_flag();  // delta_rps_sign
+        r.read_ue();    // abs_delta_rps_minus1
+
+        int count = 0;
+        for( int j = 0; j <= num_delta_pocs[idx - 1]; j++ ) {
+            bool used_by_curr_pic_flag = r.read_flag();
+            bool use_delta_flag = used_by_curr_pic_flag ? true : r.read_flag();
+            count += use_delta_flag ? 1 : 0;
+        }
+        return count;
+    }
+
+    uint32_t num_negative_pics = r.read_ue();
+    uint32_t num_positive_pics = r.read_ue();
+    if( num_negative_pics > 16 || num_positive_pics > 16 )
+        return -1;
+    for( uint32_t i = 0; i < num_negative_pics + num_positive_pics; i++ ) {
+        r.read_ue();    // delta_poc_s0_minus1 / delta_poc_s1_minus1
+        r.read_flag();  // used_by_curr_pic_s0_flag / used_by_curr_pic_s1_flag
+    }
+    return num_negative_pics + num_positive_pics;
+}
+
+bool HevcParser::parse_sps( const uint8_t* rbsp, size_t size ) {
+
+    RbspReader r( rbsp, size );
+
+    int vps_id = r.read_bits(4);
+    int max_sub_layers_minus1 = r.read_bits(3);
+    r.read_flag();  // sps_temporal_id_nesting_flag
+    skip_profile_tier_level( r, max_sub_layers_minus1 );
+
+    uint32_t sps_id = r.read_ue();
+    if( sps_id >= HEVC_MAX_SPS )
+        return false;
+
+    sps s;
+    s.vps_id = vps_id;
+    s.separate_colour_plane = false;
+    s.timing_info_present = false;
+
+    uint32_t chroma_format_idc = r.read_ue();
+    if( chroma_format_idc == 3 )
+        s.separate_colour_plane = r.read_flag();
+    r.read_ue();  // pic_width_in_luma_samples
+    r.read_ue();  // pic_height_in_luma_samples
+    if( r.read_flag() ) {  // conformance_window_flag
+        for( int i = 0; i < 4; i++ )
+            r.read_ue();
+    }
+    r.read_ue();  // bit_depth_luma_minus8
+    r.read_ue();  // bit_depth_chroma_minus8
+
+    uint32_t log2_max_poc_lsb_minus4 = r.read_ue();
+    if( log2_max_poc_lsb_minus4 > 12 )
+        return false;
+    s.log2_max_poc_lsb = log2_max_poc_lsb_minus4 + 4;
+
+    bool sub_layer_ordering_info_present = r.read_flag();
+    for( int i = sub_layer_ordering_info_present ? 0 : max_sub_layers_minus1; i <= max_sub_layers_minus1; i++ ) {
+        r.read_ue();  // sps_max_dec_pic_buffering_minus1
+        r.read_ue();  // sps_max_num_reorder_pics
+        r.read_ue();  // sps_max_latency_increase_plus1
+    }
+
+    for( int i = 0; i < 6; i++ )
+        r.read_ue();  // coding block, transform block and transform hierarchy sizes
+
+    if( r.read_flag() ) {  // scaling_list_enabled_flag
+        if( r.read_flag() )  // sps_scaling_list_data_present_flag
+            skip_scaling_list_data( r );
+    }
+    r.read_flag();  // amp_enabled_flag
+    r.read_flag();  // sample_adaptive_offset_enabled_flag
+    if( r.read_flag() ) {  // pcm_enabled_flag
+        r.skip_bits( 8 );  // pcm_sample_bit_depth_luma_minus1, pcm_sample_bit_depth_chroma_minus1
+        r.read_ue();       // log2_min_pcm_luma_coding_block_size_minus3
+        r.read_ue();       // log2_diff_max_min_pcm_luma_coding_block_size
+        r.read_flag();     // pcm_loop_filter_disabled_flag
+    }
+
+    uint32_t num_short_term_ref_pic_sets = r.read_ue();
+    if( num_short_term_ref_pic_sets > 64 )
+        return false;
+    int num_delta_pocs[64];
+    for( uint32_t i = 0; i < num_short_term_ref_pic_sets; i++ ) {
+        num_delta_pocs[i] = skip_st_ref_pic_set( r, i, num_delta_pocs );
+        if( num_delta_pocs[i] < 0 || r.is_overrun() )
+            return false;
+    }
+
+    if( r.read_flag() ) {  // long_term_ref_pics_present_flag
+        uint32_t num_long_term_ref_pics_sps = r.read_ue();
+        if( num_long_term_ref_pics_sps > 32 )
+            return false;
+        r.skip_bits( num_long_term_ref_pics_sps * ( s.log2_max_poc_lsb + 1 ) );
+    }
+    r.read_flag();  // sps_temporal_mvp_enabled_flag
+    r.read_flag();  // strong_intra_smoothing_enabled_flag
+
+    if( r.read_flag() ) {  // vui_parameters_present_flag
+        if( r.read_flag() ) {  // aspect_ratio_info_present_flag
+            if( r.read_bits(8) == 255 )  // aspect_ratio_idc == EXTENDED_SAR
+                r.skip_bits( 32 );
+        }
+        if( r.read_flag() )  // overscan_info_present_flag
+            r.read_flag();
+        if( r.read_flag() ) {  // video_signal_type_present_flag
+            r.skip_bits( 4 );
+            if( r.read_flag() )  // colour_description_present_flag
+                r.skip_bits( 24 );
+        }
+        if( r.read_flag() ) {  // chroma_loc_info_present_flag
+            r.read_ue();
+            r.read_ue();
+        }
+        r.skip_bits( 3 );  // neutral_chroma_indication_flag, field_seq_flag, frame_field_info_present_flag
+        if( r.read_flag() ) {  // default_display_window_flag
+            for( int i = 0; i < 4; i++ )
+                r.read_ue();
+        }
+        s.timing_info_present = r.read_flag();
+        if( s.timing_info_present ) {
+            s.num_units_in_tick = r.read_bits(32);
+            s.time_scale = r.read_bits(32);
+        }
+    }
+
+    s.valid = !r.is_overrun();
+    if( s.valid )
+        sps_list[sps_id] = s;
+    return s.valid;
+}
+
+bool HevcParser::parse_pps( const uint8_t* rbsp, size_t size ) {
+
+    RbspReader r( rbsp, size );
+
+    uint32_t pps_id = r.read_ue();
+    uint32_t sps_id = r.read_ue();
+    if( pps_id >= HEVC_MAX_PPS || sps_id >= HEVC_MAX_SPS )
+        return false;
+
+    pps &p = pps_list[pps_id];
+    p.sps_id = sps_id;
+    r.read_flag();  // dependent_slice_segments_enabled_flag
+    p.output_flag_present = r.read_flag();
+    p.num_extra_slice_header_bits = r.read_bits(3);
+
+    p.valid = !r.is_overrun();
+    return p.valid;
+}
+
+// Determine the timing information when an SPS is activated
+void HevcParser::activate_sps( int sps_id ) {
+
+    const sps &s = sps_list[sps_id];
+    const vps &v = vps_list[s.vps_id];
+
+    active_sps = sps_id;
+    frame_rate_present = false;
+
+    if( v.valid && v.timing_info_present ) {
+        frame_rate_present = true;
+        frame_rate_num = v.time_scale;
+        frame_rate_denom = v.num_units_in_tick;
+    }
+
+    if( s.timing_info_present ) {
+        frame_rate_present = true;
+        frame_rate_num = s.time_scale;
+        frame_rate_denom = s.num_units_in_tick;
+    }
+}
+
+// Parse the slice segment header up to slice_pic_order_cnt_lsb and derive the POC (8.3.1)
+bool HevcParser::parse_slice_header( const uint8_t* rbsp, size_t size, HevcNalInfo *info ) {
+
+    RbspReader r( rbsp, size );
+    int nal_unit_type = info->nal_unit_type;
+
+    bool first_slice_segment_in_pic = r.read_flag();
+    if( !first_slice_segment_in_pic )
+        return true;
+
+    bool irap_pic = nal_unit_type >= HEVC_NAL_BLA_W_LP && nal_unit_type <= HEVC_NAL_RSV_IRAP_23;
+    if( irap_pic )
+        r.read_flag();  // no_output_of_prior_pics_flag
+
+    uint32_t pps_id = r.read_ue();
+    if( pps_id >= HEVC_MAX_PPS || !pps_list[pps_id].valid || !sps_list[pps_list[pps_id].sps_id].valid )
+        return false;
+    const pps &p = pps_list[pps_id];
+    const sps &s = sps_list[p.sps_id];
+
+    r.skip_bits( p.num_extra_slice_header_bits );  // slice_reserved_flag
+    r.read_ue();  // slice_type
+    if( p.output_flag_present )
+        r.read_flag();  // pic_output_flag
+    if( s.separate_colour_plane )
+        r.skip_bits( 2 );  // colour_plane_id
+
+    int poc_lsb = 0;
+    if( nal_unit_type != HEVC_NAL_IDR_W_RADL && nal_unit_type != HEVC_NAL_IDR_N_LP )
+        poc_lsb = r.read_bits( s.log2_max_poc_lsb );
+
+    if( r.is_overrun() )
+        return false;
+
+    // Derive the POC
+    int max_poc_lsb = 1 << s.log2_max_poc_lsb;
+    int poc_msb;
+    bool no_rasl_output = irap_pic && ( nal_unit_type != HEVC_NAL_CRA || first_picture );
+    if( no_rasl_output ) {
+        poc_msb = 0;
+    } else {
+        int prev_poc_lsb = prev_tid0_poc & ( max_poc_lsb - 1 );
+        int prev_poc_msb = prev_tid0_poc - prev_poc_lsb;
+        if( poc_lsb < prev_poc_lsb && prev_poc_lsb - poc_lsb >= max_poc_lsb / 2 )
+            poc_msb = prev_poc_msb + max_poc_lsb;
+        else if( poc_lsb > prev_poc_lsb && poc_lsb - prev_poc_lsb > max_poc_lsb / 2 )
+            poc_msb = prev_poc_msb - max_poc_lsb;
+        else
+            poc_msb = prev_poc_msb;
+    }
+    poc = poc_msb + poc_lsb;
+    irap = irap_pic;
+    first_picture = false;
+
+    // Update prevTid0Pic, excluding RADL, RASL and sub-layer non-reference pictures
+    bool sub_layer_non_reference = nal_unit_type <= 14 && ( nal_unit_type % 2 ) == 0;
+    bool leading = nal_unit_type >= 6 && nal_unit_type <= HEVC_NAL_RASL_R;
+    if( info->temporal_id == 0 && !leading && !sub_layer_non_reference )
+        prev_tid0_poc = poc;
+
+    // Activate the SPS
+    if( active_sps != p.sps_id )
+        activate_sps( p.sps_id );
+
+    info->first_slice_segment_in_pic = true;
+    return true;
+}
@@ -0,0 +1,122 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// HEVC high level syntax parser - Parses the parameter sets and the start of the slice segment
+// headers of an HEVC bit-stream to determine the picture boundaries, the picture order count
+// and the timing information.  Slice data is never parsed.
+//
+
+#ifndef HEVC_PARSER_H
+#define HEVC_PARSER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define HEVC_NAL_RASL_R        9
+#define HEVC_NAL_BLA_W_LP     16
+#define HEVC_NAL_IDR_W_RADL   19
+#define HEVC_NAL_IDR_N_LP     20
+#define HEVC_NAL_CRA          21
+#define HEVC_NAL_RSV_IRAP_23  23
+#define HEVC_NAL_VPS          32
+#define HEVC_NAL_SPS          33
+#define HEVC_NAL_PPS          34
+#define HEVC_NAL_AUD          35
+#define HEVC_NAL_EOS          36
+#define HEVC_NAL_EOB          37
+#define HEVC_NAL_PREFIX_SEI   39
+#define HEVC_NAL_SUFFIX_SEI   40
+
+#define HEVC_MAX_VPS 16
+#define HEVC_MAX_SPS 16
+#define HEVC_MAX_PPS 64
+
+// Information about a single NAL unit
+struct HevcNalInfo {
+    int nal_unit_type;
+    int layer_id;
+    int temporal_id;
+    bool is_slice;                    // coded slice segment of a picture
+    bool first_slice_segment_in_pic;  // first slice segment of a picture (the POC is valid)
+    bool access_unit_start;           // first NAL unit of an access unit that follows a coded picture
+};
+
+class HevcParser {
+
+public:
+    HevcParser();
+
+    void reset();
+
+    // Parse a NAL unit.  The data is the escaped NAL unit including the two byte NAL unit header.
+    // Returns false if the NAL unit could not be parsed.
+    bool parse_nal_unit( const uint8_t* data, size_t size, HevcNalInfo *info );
+
+    // Properties of the current picture, i.e. the picture of the last first slice segment
+    int get_poc() const { return poc; }
+    bool is_irap() const { return irap; }
+
+    // Frame rate of the active SPS (time_scale / num_units_in_tick).  The VUI timing information
+    // takes precedence over the VPS timing information.  Returns false if neither is present.
+    bool get_frame_rate( int *numerator, int *denominator ) const;
+
+private:
+    struct vps {
+        bool valid;
+        bool timing_info_present;
+        uint32_t num_units_in_tick;
+        uint32_t time_scale;
+    };
+
+    struct sps {
+        bool valid;
+        int vps_id;
+        bool separate_colour_plane;
+        int log2_max_poc_lsb;
+        bool timing_info_present;
+        uint32_t num_units_in_tick;
+        uint32_t time_scale;
+    };
+
+    struct pps {
+        bool valid;
+        int sps_id;
+        bool output_flag_present;
+        int num_extra_slice_header_bits;
+    };
+
+    bool parse_vps( const uint8_t* rbsp, size_t size );
+    bool parse_sps( const uint8_t* rbsp, size_t size );
+    bool parse_pps( const uint8_t* rbsp, size_t size );
+    bool parse_slice_header( const uint8_t* rbsp, size_t size, HevcNalInfo *info );
+    void activate_sps( int sps_id );
+    void update_access_unit( HevcNalInfo *info );
+
+    vps vps_list[HEVC_MAX_VPS];
+    sps sps_list[HEVC_MAX_SPS];
+    pps pps_list[HEVC_MAX_PPS];
+    std::vector<uint8_t> rbsp_buffer;
+
+    // POC derivation state
+    bool first_picture;       // the next picture starts a coded video sequence (NoRaslOutputFlag)
+    int prev_tid0_poc;
+    int poc;
+    bool irap;
+
+    // Access unit boundary detection
+    bool vcl_in_access_unit;  // a VCL NAL unit was received since the start of the access unit
+
+    // Timing of the active SPS, updated when an SPS is activated or received
+    int active_sps;
+    bool frame_rate_present;
+    uint32_t frame_rate_num;
+    uint32_t frame_rate_denom;
+
+};
+
+#endif
@@ -0,0 +1,84 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// RBSP reader class - Reads fixed length and Exp-Golomb coded values from a raw byte sequence
+// payload (i.e. NAL unit data with the emulation prevention bytes removed)
+//
+
+#ifndef RBSP_READER_H
+#define RBSP_READER_H
+
+#include <cstdint>
+#include <cstddef>
+
+class RbspReader {
+
+public:
+    RbspReader( const uint8_t* data, size_t size ) {
+        buffer = data;
+        buffer_size = size;
+        bit_offset = 0;
+        overrun = false;
+    }
+
+    // Read num_bits (0..32) bits.  Reading past the end of the data returns zero bits and sets the
+    // overrun flag.
+    uint32_t read_bits( int num_bits ) {
+        uint32_t value = 0;
+        for( int i = 0; i < num_bits; i++ ) {
+            size_t p = bit_offset >> 3;
+            uint32_t bit = 0;
+            if( p < buffer_size )
+                bit = ( buffer[p] >> ( 7 - ( bit_offset & 7 ) ) ) & 1;
+            else
+                overrun = true;
+            value = ( value << 1 ) | bit;
+            bit_offset++;
+        }
+        return value;
+    }
+
+    uint32_t read_flag() { return read_bits(1); }
+
+    // ue(v)
+    uint32_t read_ue() {
+        int leading_zeros = 0;
+        while( !read_bits(1) ) {
+            if( overrun || ++leading_zeros > 31 ) {
+                overrun = true;
+                return 0;
+            }
+        }
+        if( leading_zeros == 0 )
+            return 0;
+        return (uint32_t)( ( 1ULL << leading_zeros ) - 1 + read_bits(leading_zeros) );
+    }
+
+    // se(v)
+    int32_t read_se() {
+        uint32_t k = read_ue();
+        return ( k & 1 ) ? (int32_t)( ( k + 1 ) >> 1 ) : -(int32_t)( k >> 1 );
+    }
+
+    void skip_bits( size_t num_bits ) {
+        bit_offset += num_bits;
+        if( bit_offset > buffer_size * 8 )
+            overrun = true;
+    }
+
+    size_t get_position() const { return bit_offset; }
+    bool is_overrun() const { return overrun; }
+
+private:
+    const uint8_t *buffer;
+    size_t buffer_size;
+    size_t bit_offset;
+    bool overrun;
+
+};
+
+#endif
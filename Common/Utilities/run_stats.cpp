@@ -0,0 +1,151 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Run statistics - CPU time clocks, latency percentiles and a minimal JSON writer used to report the
+// statistics of the applications in a machine-readable form
+//
+
+#include "run_stats.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef _WIN32
+#include <windows.h>
+
+static double filetime_seconds( const FILETIME &kernel, const FILETIME &user )
+{
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return ( k.QuadPart + u.QuadPart ) * 1e-7;
+}
+
+double thread_cpu_seconds()
+{
+    FILETIME creation, exit, kernel, user;
+    if( !GetThreadTimes( GetCurrentThread(), &creation, &exit, &kernel, &user ) )
+        return 0;
+    return filetime_seconds( kernel, user );
+}
+
+double process_cpu_seconds()
+{
+    FILETIME creation, exit, kernel, user;
+    if( !GetProcessTimes( GetCurrentProcess(), &creation, &exit, &kernel, &user ) )
+        return 0;
+    return filetime_seconds( kernel, user );
+}
+#else
+#include <time.h>
+
+static double clock_seconds( clockid_t clock )
+{
+    struct timespec ts;
+    if( clock_gettime( clock, &ts ) )
+        return 0;
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+double thread_cpu_seconds()
+{
+    return clock_seconds( CLOCK_THREAD_CPUTIME_ID );
+}
+
+double process_cpu_seconds()
+{
+    return clock_seconds( CLOCK_PROCESS_CPUTIME_ID );
+}
+#endif
+
+double percentile( std::vector<double> *values, double p )
+{
+    if( values->empty() )
+        return 0;
+
+    // Nearest rank: the smallest value with at least the fraction p of the values at or below it
+    size_t rank = (size_t)std::ceil( p * values->size() );
+    size_t index = rank > 0 ? std::min( rank - 1, values->size() - 1 ) : 0;
+    std::nth_element( values->begin(), values->begin() + index, values->end() );
+    return (*values)[index];
+}
+
+JsonWriter::JsonWriter( FILE* fp )
+: fp(fp)
+{
+}
+
+void JsonWriter::begin_object( const char* name )
+{
+    if( name )
+        write_name( name );
+    fputc( '{', fp );
+    first_member.push_back( true );
+}
+
+void JsonWriter::end_object()
+{
+    first_member.pop_back();
+    fprintf( fp, "\n%*s}", (int)( 2 * first_member.size() ), "" );
+    if( first_member.empty() )
+        fputc( '\n', fp );
+}
+
+void JsonWriter::member( const char* name, const char* value )
+{
+    write_name( name );
+    write_string( value );
+}
+
+void JsonWriter::member( const char* name, unsigned long long value )
+{
+    write_name( name );
+    fprintf( fp, "%llu", value );
+}
+
+void JsonWriter::member( const char* name, double value )
+{
+    write_name( name );
+    // JSON has no representation of infinity or NaN
+    if( std::isfinite( value ) )
+        fprintf( fp, "%.6g", value );
+    else
+        fputs( "null", fp );
+}
+
+void JsonWriter::member( const char* name, bool value )
+{
+    write_name( name );
+    fputs( value ? "true" : "false", fp );
+}
+
+// Start a member of the innermost open object
+void JsonWriter::write_name( const char* name )
+{
+    if( first_member.empty() )
+        return;
+    fputs( first_member.back() ? "\n" : ",\n", fp );
+    first_member.back() = false;
+    fprintf( fp, "%*s", (int)( 2 * first_member.size() ), "" );
+    write_string( name );
+    fputs( ": ", fp );
+}
+
+void JsonWriter::write_string( const char* value )
+{
+    fputc( '"', fp );
+    for( const char* c = value; *c; c++ ) {
+        if( *c == '"' || *c == '\\' )
+            fprintf( fp, "\\%c", *c );
+        else if( (unsigned char)*c < 0x20 )
+            fprintf( fp, "\\u%04x", (unsigned char)*c );
+        else
+            fputc( *c, fp );
+    }
+    fputc( '"', fp );
+}
@@ -0,0 +1,56 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Run statistics - CPU time clocks, latency percentiles and a minimal JSON writer used to report the
+// statistics of the applications in a machine-readable form
+//
+
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// CPU time in seconds used by the calling thread and by the whole process
+double thread_cpu_seconds();
+double process_cpu_seconds();
+
+// Return the value below which the fraction p (0 to 1) of the values lie, using the nearest rank.  The
+// values are reordered.  Returns 0 when there are no values.
+double percentile( std::vector<double> *values, double p );
+
+// Writes a JSON document with nested objects to a file.  The members are written in the order of the
+// calls, and a separator is added between the members of each object.
+class JsonWriter {
+
+public:
+    explicit JsonWriter( FILE* fp );
+
+    void begin_object( const char* name = NULL );   // the name is omitted for the top level object
+    void end_object();
+
+    void member( const char* name, const char* value );
+    void member( const char* name, const std::string &value ) { member( name, value.c_str() ); }
+    // The unsigned integer types are distinct on every platform, whichever of them uint64_t (or HM's UInt64) is
+    void member( const char* name, unsigned long long value );
+    void member( const char* name, unsigned long value ) { member( name, (unsigned long long)value ); }
+    void member( const char* name, unsigned value ) { member( name, (unsigned long long)value ); }
+    void member( const char* name, double value );
+    void member( const char* name, bool value );
+
+private:
+    void write_name( const char* name );
+    void write_string( const char* value );
+
+    FILE *fp;
+    std::vector<bool> first_member;                 // no member yet in each open object
+
+};
+
+#endif
@@ -0,0 +1,84 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// SEI filter functions - Remove selected SEI messages from the SEI NAL units of an HEVC or VVC
+// bit-stream, so that film grain messages already present in a bit-stream can be replaced.
+//
+
+#include "sei_filter.h"
+#include "annexb.h"
+#include <cstring>
+
+// Start of the payload of an ITU-T T.35 message that carries AFGS1: the country code, the terminal
+// provider code and the terminal provider oriented code
+static const uint8_t afgs1_t35_prefix[] = { 0xB5, 0x58, 0x90, 0x01 };
+
+// Read a payload type or payload size coded as a sequence of 0xFF bytes and a final byte.  Returns false
+// if the value extends past the end of the data.
+static bool read_sei_value( const uint8_t* rbsp, size_t size, size_t *pos, size_t *value ) {
+
+    *value = 0;
+    while( *pos < size && rbsp[*pos] == 0xff ) {
+        *value += 255;
+        (*pos)++;
+    }
+    if( *pos >= size )
+        return false;
+    *value += rbsp[(*pos)++];
+    return true;
+}
+
+static bool is_selected( size_t payload_type, const uint8_t* payload, size_t payload_size, unsigned filter_mask ) {
+
+    if( ( filter_mask & SEI_FILTER_AFGS1 ) && payload_type == SEI_PAYLOAD_USER_DATA_REGISTERED_ITU_T_T35 &&
+        payload_size >= sizeof(afgs1_t35_prefix) && memcmp( payload, afgs1_t35_prefix, sizeof(afgs1_t35_prefix) ) == 0 )
+        return true;
+
+    return ( filter_mask & SEI_FILTER_FILM_GRAIN_CHARACTERISTICS ) &&
+           payload_type == SEI_PAYLOAD_FILM_GRAIN_CHARACTERISTICS;
+}
+
+int sei_filter_nal_unit( const uint8_t* data, size_t size, unsigned filter_mask, std::vector<uint8_t> *nal ) {
+
+    if( size < 3 )
+        return 0;
+
+    std::vector<uint8_t> rbsp( size - 2 );
+    size_t rbsp_size = annexb_remove_emulation_prevention( data + 2, size - 2, rbsp.data(), size - 2 );
+
+    // Locate the SEI messages.  The SEI payloads are byte aligned, so the messages end at the byte that
+    // holds the rbsp_trailing_bits( ).
+    std::vector<uint8_t> kept;
+    int removed = 0;
+    size_t pos = 0;
+    while( pos + 1 < rbsp_size ) {
+        size_t start = pos;
+        size_t payload_type, payload_size;
+        if( !read_sei_value( rbsp.data(), rbsp_size, &pos, &payload_type ) ||
+            !read_sei_value( rbsp.data(), rbsp_size, &pos, &payload_size ) || payload_size > rbsp_size - pos )
+            return 0;
+        pos += payload_size;
+
+        if( is_selected( payload_type, rbsp.data() + pos - payload_size, payload_size, filter_mask ) )
+            removed++;
+        else
+            kept.insert( kept.end(), rbsp.begin() + start, rbsp.begin() + pos );
+    }
+    if( pos + 1 != rbsp_size || rbsp[pos] != 0x80 || removed == 0 )
+        return 0;
+
+    nal->clear();
+    if( kept.empty() )
+        return removed;
+
+    // The remaining messages are written with the input NAL unit header and new trailing bits
+    kept.push_back( 0x80 );
+    nal->push_back( data[0] );
+    nal->push_back( data[1] );
+    annexb_add_emulation_prevention( kept.data(), kept.size(), nal );
+    return removed;
+}
@@ -0,0 +1,33 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// SEI filter functions - Remove selected SEI messages from the SEI NAL units of an HEVC or VVC
+// bit-stream, so that film grain messages already present in a bit-stream can be replaced.
+//
+
+#ifndef SEI_FILTER_H
+#define SEI_FILTER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define SEI_PAYLOAD_USER_DATA_REGISTERED_ITU_T_T35   4
+#define SEI_PAYLOAD_FILM_GRAIN_CHARACTERISTICS      19
+
+// SEI messages selected for removal
+#define SEI_FILTER_AFGS1                        1   // ITU-T T.35 messages that carry an AFGS1 payload
+#define SEI_FILTER_FILM_GRAIN_CHARACTERISTICS   2
+
+// Remove the SEI messages selected by filter_mask from an SEI NAL unit with a two byte NAL unit header
+// (HEVC and VVC).  The data is the escaped NAL unit including the header.  Returns the number of messages
+// removed.  When messages are removed, nal receives the NAL unit with the remaining messages, or is empty
+// when no message remains.  Otherwise, including when the NAL unit cannot be parsed, nal is not modified
+// and the NAL unit should be copied unchanged.
+int sei_filter_nal_unit( const uint8_t* data, size_t size, unsigned filter_mask, std::vector<uint8_t> *nal );
+
+#endif
@@ -0,0 +1,77 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Queue class - Bounded lock-free queue with a single producer thread and a single consumer thread
+//
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <cstddef>
+
+template <typename T>
+class SpscQueue {
+
+public:
+    // The capacity is rounded up to a power of two
+    explicit SpscQueue( size_t capacity ) {
+        size_t size = 1;
+        while( size < capacity )
+            size <<= 1;
+        slots.resize( size );
+        mask = size - 1;
+        head.store( 0, std::memory_order_relaxed );
+        tail.store( 0, std::memory_order_relaxed );
+    }
+
+    // Producer: returns false if the queue is full
+    bool try_push( const T &value ) {
+        size_t t = tail.load( std::memory_order_relaxed );
+        if( t - head.load( std::memory_order_acquire ) > mask )
+            return false;
+        slots[t & mask] = value;
+        tail.store( t + 1, std::memory_order_release );
+        return true;
+    }
+
+    // Consumer: returns false if the queue is empty
+    bool try_pop( T &value ) {
+        size_t h = head.load( std::memory_order_relaxed );
+        if( h == tail.load( std::memory_order_acquire ) )
+            return false;
+        value = slots[h & mask];
+        head.store( h + 1, std::memory_order_release );
+        return true;
+    }
+
+    // Blocking versions that yield while waiting for the other thread
+    void push( const T &value ) {
+        while( !try_push( value ) )
+            std::this_thread::yield();
+    }
+
+    T pop() {
+        T value;
+        while( !try_pop( value ) )
+            std::this_thread::yield();
+        return value;
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+
+    // The indices are kept on separate cache lines to avoid false sharing between the threads
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+
+};
+
+#endif
@@ -0,0 +1,141 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Thread pool class - Runs the tasks of a parallel loop on a fixed set of threads.  The calling thread takes part
+// in the loop, so a pool of one thread runs the tasks in the caller without starting any thread.
+//
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+
+public:
+    // Start the threads of the pool.  A num_threads of 0 uses one thread per core.
+    explicit ThreadPool( int num_threads = 0 ) {
+        if( num_threads <= 0 )
+            num_threads = std::max( 1, (int)std::thread::hardware_concurrency() );
+        this->num_threads = num_threads;
+        stop = false;
+        generation = 0;
+        job = NULL;
+        job_context = NULL;
+        num_tasks = 0;
+        active = 0;
+        next_task.store( 0 );
+        for( int thread = 1; thread < num_threads; thread++ )
+            workers.push_back( std::thread( &ThreadPool::worker, this, thread ) );
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            stop = true;
+        }
+        start.notify_all();
+        for( size_t i = 0; i < workers.size(); i++ )
+            workers[i].join();
+    }
+
+    ThreadPool( const ThreadPool& ) = delete;
+    ThreadPool& operator=( const ThreadPool& ) = delete;
+
+    int get_num_threads() const {
+        return num_threads;
+    }
+
+    // Call fn( task, thread ) for each task from 0 to num_tasks - 1 and return when all the tasks are done.  thread
+    // is the index of the thread that runs the task (0 for the calling thread), so that the tasks can use
+    // per-thread memory.  The order in which the tasks run is not specified.  run() must not be called from two
+    // threads at the same time, nor from a task.
+    template<class Fn>
+    void run( int num_tasks, Fn fn ) {
+        if( num_tasks <= 0 )
+            return;
+        if( workers.empty() || num_tasks == 1 ) {
+            for( int task = 0; task < num_tasks; task++ )
+                fn( task, 0 );
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            job = &call<Fn>;
+            job_context = &fn;
+            this->num_tasks = num_tasks;
+            next_task.store( 0 );
+            active = (int)workers.size();
+            generation++;
+        }
+        start.notify_all();
+
+        run_tasks( 0 );
+
+        std::unique_lock<std::mutex> lock( mutex );
+        done.wait( lock, [this]() { return active == 0; } );
+        job = NULL;
+        job_context = NULL;
+    }
+
+private:
+    typedef void (*job_fn)( void *context, int task, int thread );
+
+    template<class Fn>
+    static void call( void *context, int task, int thread ) {
+        ( *(Fn*)context )( task, thread );
+    }
+
+    void run_tasks( int thread ) {
+        int task;
+        while( ( task = next_task.fetch_add( 1 ) ) < num_tasks )
+            job( job_context, task, thread );
+    }
+
+    void worker( int thread ) {
+        uint64_t seen = 0;
+        for( ;; ) {
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                start.wait( lock, [&]() { return stop || generation != seen; } );
+                if( stop )
+                    return;
+                seen = generation;
+            }
+
+            run_tasks( thread );
+
+            std::lock_guard<std::mutex> lock( mutex );
+            if( --active == 0 )
+                done.notify_one();
+        }
+    }
+
+    int num_threads;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    bool stop;
+    uint64_t generation;
+
+    // The loop that is running
+    job_fn job;
+    void *job_context;
+    int num_tasks;
+    int active;                         // workers that have not finished the loop
+    std::atomic<int> next_task;
+};
+
+#endif //THREAD_POOL_H
@@ -0,0 +1,334 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// VVC high level syntax parser - Parses the start of the sequence parameter sets, the picture
+// parameter sets and the picture headers of an H.266/VVC bit-stream to determine the picture
+// boundaries, the picture order count and the random access points.  Also writes ITU-T T.35
+// SEI NAL units.  Slice data is never parsed.
+//
+
+#include "vvc_parser.h"
+#include "annexb.h"
+#include "rbsp_reader.h"
+
+// Number of bytes of a picture header or slice NAL unit that are unescaped to parse the picture header
+// up to ph_pic_order_cnt_lsb
+#define VVC_PICTURE_HEADER_BYTES 32
+
+// Number of flags of general_constraints_info( ) that precede gci_num_additional_bits
+#define VVC_GCI_NUM_FLAG_BITS 71
+
+void vvc_write_t35_sei_nal_unit( int layer_id, int temporal_id, int country_code, const std::vector<uint8_t> &payload,
+                                 std::vector<uint8_t> *nal ) {
+
+    // sei_message( ): the payload type and size are coded as a sequence of 0xFF bytes and a final byte
+    std::vector<uint8_t> rbsp;
+    rbsp.push_back( VVC_SEI_USER_DATA_REGISTERED_ITU_T_T35 );
+    size_t payload_size = 1 + payload.size();
+    while( payload_size >= 255 ) {
+        rbsp.push_back( 0xff );
+        payload_size -= 255;
+    }
+    rbsp.push_back( (uint8_t) payload_size );
+    rbsp.push_back( (uint8_t) country_code );
+    rbsp.insert( rbsp.end(), payload.begin(), payload.end() );
+
+    // rbsp_trailing_bits( )
+    rbsp.push_back( 0x80 );
+
+    // nal_unit_header( ): forbidden_zero_bit, nuh_reserved_zero_bit, nuh_layer_id, nal_unit_type and
+    // nuh_temporal_id_plus1
+    nal->push_back( (uint8_t)( layer_id & 0x3f ) );
+    nal->push_back( (uint8_t)( ( VVC_NAL_PREFIX_SEI << 3 ) | ( ( temporal_id + 1 ) & 7 ) ) );
+    annexb_add_emulation_prevention( rbsp.data(), rbsp.size(), nal );
+}
+
+VvcParser::VvcParser() {
+    reset();
+}
+
+void VvcParser::reset() {
+
+    for( int i = 0; i < VVC_MAX_SPS; i++ )
+        sps_list[i].valid = false;
+    for( int i = 0; i < VVC_MAX_PPS; i++ )
+        pps_list[i].valid = false;
+
+    ph.valid = false;
+    ph_pending = false;
+
+    first_picture = true;
+    prev_tid0_poc = 0;
+    poc = 0;
+    irap = false;
+    gdr = false;
+}
+
+bool VvcParser::parse_nal_unit( const uint8_t* data, size_t size, VvcNalInfo *info ) {
+
+    info->is_slice = false;
+    info->first_slice_in_pic = false;
+
+    if( size < 2 )
+        return false;
+
+    // NAL unit header
+    info->layer_id = data[0] & 0x3f;
+    info->nal_unit_type = data[1] >> 3;
+    info->temporal_id = ( data[1] & 0x7 ) - 1;
+    info->is_slice = info->nal_unit_type <= VVC_NAL_GDR &&
+                     !( info->nal_unit_type > VVC_NAL_RASL && info->nal_unit_type < VVC_NAL_IDR_W_RADL );
+
+    if( ( data[0] & 0x80 ) || info->temporal_id < 0 )
+        return false;
+
+    // Only the base layer is considered
+    if( info->layer_id > 0 )
+        return true;
+
+    if( info->is_slice ) {
+        uint8_t rbsp[VVC_PICTURE_HEADER_BYTES];
+        size_t rbsp_size = annexb_remove_emulation_prevention( data + 2, size - 2, rbsp, VVC_PICTURE_HEADER_BYTES );
+        return parse_slice_header( rbsp, rbsp_size, info );
+    }
+
+    switch( info->nal_unit_type ) {
+
+        case VVC_NAL_PH: {
+            uint8_t rbsp[VVC_PICTURE_HEADER_BYTES];
+            size_t rbsp_size = annexb_remove_emulation_prevention( data + 2, size - 2, rbsp, VVC_PICTURE_HEADER_BYTES );
+            ph_pending = parse_picture_header( rbsp, rbsp_size, 0 );
+            return ph_pending;
+        }
+
+        case VVC_NAL_SPS:
+        case VVC_NAL_PPS: {
+            rbsp_buffer.resize( size - 2 );
+            size_t rbsp_size = annexb_remove_emulation_prevention( data + 2, size - 2, rbsp_buffer.data(), size - 2 );
+            if( info->nal_unit_type == VVC_NAL_SPS )
+                return parse_sps( rbsp_buffer.data(), rbsp_size );
+            return parse_pps( rbsp_buffer.data(), rbsp_size );
+        }
+
+        case VVC_NAL_EOS:
+        case VVC_NAL_EOB:
+            // The next picture starts a new coded layer video sequence
+            first_picture = true;
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+// general_constraints_info( )
+static void skip_general_constraints_info( RbspReader &r ) {
+
+    if( r.read_flag() ) {  // gci_present_flag
+        r.skip_bits( VVC_GCI_NUM_FLAG_BITS );
+        int num_additional_bits = r.read_bits(8);
+        r.skip_bits( num_additional_bits );
+    }
+    while( r.get_position() & 7 )
+        r.read_flag();  // gci_alignment_zero_bit
+}
+
+// profile_tier_level( 1, max_sublayers_minus1 )
+static void skip_profile_tier_level( RbspReader &r, int max_sublayers_minus1 ) {
+
+    r.skip_bits( 8 );   // general_profile_idc, general_tier_flag
+    r.skip_bits( 10 );  // general_level_idc, ptl_frame_only_constraint_flag, ptl_multilayer_enabled_flag
+    skip_general_constraints_info( r );
+
+    bool sublayer_level_present[8];
+    for( int i = max_sublayers_minus1 - 1; i >= 0; i-- )
+        sublayer_level_present[i] = r.read_flag();
+    while( r.get_position() & 7 )
+        r.read_flag();  // ptl_reserved_zero_bit
+    for( int i = max_sublayers_minus1 - 1; i >= 0; i-- ) {
+        if( sublayer_level_present[i] )
+            r.skip_bits( 8 );
+    }
+
+    int num_sub_profiles = r.read_bits(8);
+    r.skip_bits( 32 * num_sub_profiles );
+}
+
+// Number of bits of a value in the range 0..max_value - 1, i.e. Ceil( Log2( max_value ) )
+static int ceil_log2( uint32_t max_value ) {
+
+    int bits = 0;
+    while( ( 1u << bits ) < max_value && bits < 32 )
+        bits++;
+    return bits;
+}
+
+bool VvcParser::parse_sps( const uint8_t* rbsp, size_t size ) {
+
+    RbspReader r( rbsp, size );
+
+    int sps_id = r.read_bits(4);
+    r.skip_bits( 4 );  // sps_video_parameter_set_id
+    int max_sublayers_minus1 = r.read_bits(3);
+    if( max_sublayers_minus1 > 6 )
+        return false;
+    r.skip_bits( 2 );  // sps_chroma_format_idc
+    int ctb_size = 1 << ( r.read_bits(2) + 5 );
+    if( r.read_flag() )  // sps_ptl_dpb_hrd_params_present_flag
+        skip_profile_tier_level( r, max_sublayers_minus1 );
+
+    r.read_flag();  // sps_gdr_enabled_flag
+    if( r.read_flag() )  // sps_ref_pic_resampling_enabled_flag
+        r.read_flag();  // sps_res_change_in_clvs_allowed_flag
+    uint32_t pic_width = r.read_ue();
+    uint32_t pic_height = r.read_ue();
+    if( r.read_flag() ) {  // sps_conformance_window_flag
+        for( int i = 0; i < 4; i++ )
+            r.read_ue();
+    }
+
+    if( r.read_flag() ) {  // sps_subpic_info_present_flag
+        uint32_t num_subpics_minus1 = r.read_ue();
+        if( num_subpics_minus1 > 599 )
+            return false;
+        bool independent_subpics = true;
+        bool subpic_same_size = false;
+        if( num_subpics_minus1 > 0 ) {
+            independent_subpics = r.read_flag();
+            subpic_same_size = r.read_flag();
+        }
+
+        int width_bits = ceil_log2( ( pic_width + ctb_size - 1 ) / ctb_size );
+        int height_bits = ceil_log2( ( pic_height + ctb_size - 1 ) / ctb_size );
+        for( uint32_t i = 0; num_subpics_minus1 > 0 && i <= num_subpics_minus1; i++ ) {
+            if( !subpic_same_size || i == 0 ) {
+                if( i > 0 && pic_width > (uint32_t) ctb_size )
+                    r.skip_bits( width_bits );   // sps_subpic_ctu_top_left_x
+                if( i > 0 && pic_height > (uint32_t) ctb_size )
+                    r.skip_bits( height_bits );  // sps_subpic_ctu_top_left_y
+                if( i < num_subpics_minus1 && pic_width > (uint32_t) ctb_size )
+                    r.skip_bits( width_bits );   // sps_subpic_width_minus1
+                if( i < num_subpics_minus1 && pic_height > (uint32_t) ctb_size )
+                    r.skip_bits( height_bits );  // sps_subpic_height_minus1
+            }
+            if( !independent_subpics )
+                r.skip_bits( 2 );  // sps_subpic_treated_as_pic_flag, sps_loop_filter_across_subpic_enabled_flag
+        }
+
+        uint32_t subpic_id_len_minus1 = r.read_ue();
+        if( subpic_id_len_minus1 > 15 )
+            return false;
+        if( r.read_flag() ) {  // sps_subpic_id_mapping_explicitly_signalled_flag
+            if( r.read_flag() )  // sps_subpic_id_mapping_present_flag
+                r.skip_bits( (size_t)( num_subpics_minus1 + 1 ) * ( subpic_id_len_minus1 + 1 ) );
+        }
+    }
+
+    r.read_ue();  // sps_bitdepth_minus8
+    r.skip_bits( 2 );  // sps_entropy_coding_sync_enabled_flag, sps_entry_point_offsets_present_flag
+
+    sps s;
+    s.log2_max_poc_lsb = r.read_bits(4) + 4;
+
+    s.valid = !r.is_overrun();
+    if( s.valid )
+        sps_list[sps_id] = s;
+    return s.valid;
+}
+
+bool VvcParser::parse_pps( const uint8_t* rbsp, size_t size ) {
+
+    RbspReader r( rbsp, size );
+
+    int pps_id = r.read_bits(6);
+    int sps_id = r.read_bits(4);
+
+    pps &p = pps_list[pps_id];
+    p.sps_id = sps_id;
+
+    p.valid = !r.is_overrun();
+    return p.valid;
+}
+
+// Parse picture_header_structure( ) up to ph_pic_order_cnt_lsb, starting at bit_offset.  The picture type
+// flags are not needed, as the random access point is determined from the NAL unit type of the slices.
+bool VvcParser::parse_picture_header( const uint8_t* rbsp, size_t size, size_t bit_offset ) {
+
+    RbspReader r( rbsp, size );
+    r.skip_bits( bit_offset );
+
+    ph.valid = false;
+    bool gdr_or_irap_pic = r.read_flag();
+    ph.non_ref_pic = r.read_flag();
+    if( gdr_or_irap_pic )
+        r.read_flag();  // ph_gdr_pic_flag
+    if( r.read_flag() )  // ph_inter_slice_allowed_flag
+        r.read_flag();  // ph_intra_slice_allowed_flag
+
+    uint32_t pps_id = r.read_ue();
+    if( pps_id >= VVC_MAX_PPS || !pps_list[pps_id].valid || !sps_list[pps_list[pps_id].sps_id].valid )
+        return false;
+    ph.pps_id = pps_id;
+    ph.poc_lsb = r.read_bits( sps_list[pps_list[pps_id].sps_id].log2_max_poc_lsb );
+
+    ph.valid = !r.is_overrun();
+    return ph.valid;
+}
+
+// The first slice of a picture either follows the picture header NAL unit or holds the picture header
+bool VvcParser::parse_slice_header( const uint8_t* rbsp, size_t size, VvcNalInfo *info ) {
+
+    if( size == 0 )
+        return false;
+
+    bool picture_header_in_slice_header = rbsp[0] >> 7;
+    if( picture_header_in_slice_header ) {
+        if( !parse_picture_header( rbsp, size, 1 ) )
+            return false;
+    }
+    else if( !ph_pending )
+        return true;
+    ph_pending = false;
+
+    derive_poc( info );
+    info->first_slice_in_pic = true;
+    return true;
+}
+
+// Derive the POC (8.3.1).  ph_poc_msb_cycle_val is not supported.
+void VvcParser::derive_poc( const VvcNalInfo *info ) {
+
+    int nal_unit_type = info->nal_unit_type;
+    irap = nal_unit_type >= VVC_NAL_IDR_W_RADL && nal_unit_type <= VVC_NAL_CRA;
+    gdr = nal_unit_type == VVC_NAL_GDR;
+
+    const sps &s = sps_list[pps_list[ph.pps_id].sps_id];
+    int max_poc_lsb = 1 << s.log2_max_poc_lsb;
+    int poc_lsb = ph.poc_lsb;
+    int poc_msb;
+    bool idr = nal_unit_type == VVC_NAL_IDR_W_RADL || nal_unit_type == VVC_NAL_IDR_N_LP;
+    bool no_output_before_recovery = idr || ( ( nal_unit_type == VVC_NAL_CRA || gdr ) && first_picture );
+    if( no_output_before_recovery ) {
+        poc_msb = 0;
+    } else {
+        int prev_poc_lsb = prev_tid0_poc & ( max_poc_lsb - 1 );
+        int prev_poc_msb = prev_tid0_poc - prev_poc_lsb;
+        if( poc_lsb < prev_poc_lsb && prev_poc_lsb - poc_lsb >= max_poc_lsb / 2 )
+            poc_msb = prev_poc_msb + max_poc_lsb;
+        else if( poc_lsb > prev_poc_lsb && poc_lsb - prev_poc_lsb > max_poc_lsb / 2 )
+            poc_msb = prev_poc_msb - max_poc_lsb;
+        else
+            poc_msb = prev_poc_msb;
+    }
+    poc = poc_msb + poc_lsb;
+    first_picture = false;
+
+    // Update prevTid0Pic, excluding RADL, RASL and non-reference pictures
+    bool leading = nal_unit_type == VVC_NAL_RADL || nal_unit_type == VVC_NAL_RASL;
+    if( info->temporal_id == 0 && !leading && !ph.non_ref_pic )
+        prev_tid0_poc = poc;
+}
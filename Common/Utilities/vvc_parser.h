@@ -0,0 +1,113 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// VVC high level syntax parser - Parses the start of the sequence parameter sets, the picture
+// parameter sets and the picture headers of an H.266/VVC bit-stream to determine the picture
+// boundaries, the picture order count and the random access points.  Also writes ITU-T T.35
+// SEI NAL units.  Slice data is never parsed.
+//
+
+#ifndef VVC_PARSER_H
+#define VVC_PARSER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define VVC_NAL_RADL           2
+#define VVC_NAL_RASL           3
+#define VVC_NAL_IDR_W_RADL     7
+#define VVC_NAL_IDR_N_LP       8
+#define VVC_NAL_CRA            9
+#define VVC_NAL_GDR           10
+#define VVC_NAL_SPS           15
+#define VVC_NAL_PPS           16
+#define VVC_NAL_PH            19
+#define VVC_NAL_AUD           20
+#define VVC_NAL_EOS           21
+#define VVC_NAL_EOB           22
+#define VVC_NAL_PREFIX_SEI    23
+#define VVC_NAL_SUFFIX_SEI    24
+
+#define VVC_MAX_SPS 16
+#define VVC_MAX_PPS 64
+
+#define VVC_SEI_USER_DATA_REGISTERED_ITU_T_T35 4
+
+// Information about a single NAL unit
+struct VvcNalInfo {
+    int nal_unit_type;
+    int layer_id;
+    int temporal_id;
+    bool is_slice;                    // coded slice of a picture
+    bool first_slice_in_pic;          // first slice of a picture (the POC is valid)
+};
+
+// Append a prefix SEI NAL unit, including the two byte NAL unit header, that holds one
+// user_data_registered_itu_t_t35 SEI message with the country code and the payload that follows it
+void vvc_write_t35_sei_nal_unit( int layer_id, int temporal_id, int country_code, const std::vector<uint8_t> &payload,
+                                 std::vector<uint8_t> *nal );
+
+class VvcParser {
+
+public:
+    VvcParser();
+
+    void reset();
+
+    // Parse a NAL unit.  The data is the escaped NAL unit including the two byte NAL unit header.
+    // Returns false if the NAL unit could not be parsed.
+    bool parse_nal_unit( const uint8_t* data, size_t size, VvcNalInfo *info );
+
+    // Properties of the current picture, i.e. the picture of the last first slice
+    int get_poc() const { return poc; }
+    bool is_irap() const { return irap; }
+    bool is_gdr() const { return gdr; }
+
+private:
+    struct sps {
+        bool valid;
+        int log2_max_poc_lsb;
+    };
+
+    struct pps {
+        bool valid;
+        int sps_id;
+    };
+
+    // Syntax elements of the picture header of the current picture
+    struct picture_header {
+        bool valid;
+        bool non_ref_pic;
+        int pps_id;
+        int poc_lsb;
+    };
+
+    bool parse_sps( const uint8_t* rbsp, size_t size );
+    bool parse_pps( const uint8_t* rbsp, size_t size );
+    bool parse_picture_header( const uint8_t* rbsp, size_t size, size_t bit_offset );
+    bool parse_slice_header( const uint8_t* rbsp, size_t size, VvcNalInfo *info );
+    void derive_poc( const VvcNalInfo *info );
+
+    sps sps_list[VVC_MAX_SPS];
+    pps pps_list[VVC_MAX_PPS];
+    std::vector<uint8_t> rbsp_buffer;
+
+    // The picture header received for the next picture.  The first slice of the picture follows.
+    picture_header ph;
+    bool ph_pending;
+
+    // POC derivation state
+    bool first_picture;       // the next picture starts a coded layer video sequence (NoOutputBeforeRecoveryFlag)
+    int prev_tid0_poc;
+    int poc;
+    bool irap;
+    bool gdr;
+
+};
+
+#endif
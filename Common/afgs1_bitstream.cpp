@@ -5,16 +5,20 @@
 // for Open Media Patent License 1.0 was not distributed with this source code in
 // the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
 //
-// AFGS1 bitstream syntax class - Supports writing film grain parameters using the AFGS1 syntax
+// AFGS1 bitstream syntax class - Supports writing and reading film grain parameters using the AFGS1 syntax
 //
 // Created by Segall, Andrew on 3/25/24.
 //
 
 #include <cstdlib>
 #include <cassert>
+#include <algorithm>
 
 #include "afgs1_bitstream.h"
 
+// Upper bound of the size of a film_grain_payload(), whose size is signaled with 8 bits
+#define AFGS1_MAX_PAYLOAD_SIZE 256
+
 // Thunking commands for backwards compatibility
 void aom_wb_write_bit( BitStream *wb, int bit){
     wb->write_bit(bit);
@@ -265,7 +269,8 @@ void write_film_grain_payload( const Afgs1_film_grain_params* pars, BitStream *w
 
     // Create an initial version of the bit-stream to see how large it will be
     {
-        BitStream temp;
+        uint8_t temp_data[AFGS1_MAX_PAYLOAD_SIZE];
+        BitStream temp( temp_data, sizeof(temp_data) );
         write_film_grain_params(pars, &temp);
         payload_bits = temp.get_position();
     }
@@ -288,86 +293,389 @@ void write_film_grain_payload( const Afgs1_film_grain_params* pars, BitStream *w
     int payloadBits = currentPosition - startPosition;
 
     // Zero pad (and byte align) to the payload size
-    wb->write_literal(0, payload_size * 8 - payloadBits);
+    if( payload_size * 8 > payloadBits )
+        wb->write_literal(0, payload_size * 8 - payloadBits);
     assert(payload_bits == (wb->get_position() - startPosition) );
 
     return;
 }
 
-#include <set>
-struct size {
-    int width;
-    int height;
+// Write an AFGS1 ITU-T T.35 payload, the T.35 header followed by the film grain parameter sets
+bool write_afgs1_t35_payload( std::list<Afgs1_film_grain_params> *sets, std::vector<uint8_t> *payload )
+{
+    BitStream write_buffer;
+    if( !write_film_grain_param_sets(sets, &write_buffer) )
+        return false;
+
+    payload->push_back(0x58);
+    payload->push_back(0x90);
+    payload->push_back(0x01);
+
+    int num_bytes = write_buffer.get_position() / 8;
+    for( int i=0; i < num_bytes; i++ )
+        payload->push_back( write_buffer.get_byte(i) );
+    return true;
+}
 
-    bool operator<(const size& rhs) const
-    {
-        return width < rhs.width;
+// Determine the number of bytes used by write_film_grain_payload for a set of film grain parameters
+int film_grain_payload_size( const Afgs1_film_grain_params* pars )
+{
+    uint8_t temp_data[AFGS1_MAX_PAYLOAD_SIZE];
+    BitStream temp( temp_data, sizeof(temp_data) );
+    write_film_grain_payload(pars, &temp);
+    return temp.get_position() >> 3;
+}
+
+// Write one or more film grain parameter payloads as defined in the AFGS1 specification
+bool write_film_grain_param_sets( const Afgs1_film_grain_params *sets, int num_sets, BitStream *wb )
+{
+
+    // Conformance checks
+    // - Confirm that we have between 1 and AFGS1_MAX_PARAM_SETS sets without duplicate resolutions or film grain
+    //   parameter set ids
+    if( num_sets < 1 || num_sets > AFGS1_MAX_PARAM_SETS )
+        return false;
+
+    for( int i = 0; i < num_sets; i++ ) {
+        for( int j = 0; j < i; j++ ) {
+            if( sets[i].apply_horz_resolution == sets[j].apply_horz_resolution &&
+                sets[i].apply_vert_resolution == sets[j].apply_vert_resolution )
+                return false;
+            if( sets[i].film_grain_param_set_idx == sets[j].film_grain_param_set_idx )
+                return false;
+        }
     }
 
-    bool operator==(const size& rhs) const
-    {
-        return ( width == rhs.width ) && ( height == rhs.height );
+    // Write the bit-stream
+    // - Signal the afgs1_enable_flag
+    int afgs1_enable_flag = 1;
+    wb->write_bit(afgs1_enable_flag);
+
+    // - Add reserved bits so that av1 film_grain_payload is byte aligned */
+    wb->write_literal(0, 4);
+
+    // - Write the film gain payloads
+    int num_film_grain_sets_minus_1 = num_sets - 1;
+    wb->write_literal(num_film_grain_sets_minus_1, 3);
+    for( int i = 0; i < num_sets; i++ ){
+        write_film_grain_payload(&sets[i], wb);
     }
 
-};
+    return true;
+}
 
+// Write an AFGS1 ITU-T T.35 payload into a buffer.  Returns the payload size, or -1 on failure.
+int write_afgs1_t35_payload( const Afgs1_film_grain_params *sets, int num_sets, uint8_t *payload, size_t capacity )
+{
+    if( capacity < AFGS1_T35_HEADER_SIZE )
+        return -1;
+
+    payload[0] = 0x58;
+    payload[1] = 0x90;
+    payload[2] = 0x01;
+
+    BitStream write_buffer( payload + AFGS1_T35_HEADER_SIZE, (uint32_t)( capacity - AFGS1_T35_HEADER_SIZE ) );
+    if( !write_film_grain_param_sets( sets, num_sets, &write_buffer ) || write_buffer.overflowed() )
+        return -1;
+
+    return AFGS1_T35_HEADER_SIZE + write_buffer.get_position() / 8;
+}
 
 // Write one or more film grain parameter payloads as defined in the AFGS1 specification
-void write_film_grain_param_sets( std::list<Afgs1_film_grain_params> *sets, BitStream *wb)
+bool write_film_grain_param_sets( std::list<Afgs1_film_grain_params> *sets, BitStream *wb)
 {
+    Afgs1_film_grain_params array[AFGS1_MAX_PARAM_SETS];
+    int num_sets = 0;
 
-    // Conformance checks
-    // - Confirm that we don't have duplicate resolutions
-    {
+    for( auto p: *sets ){
+        if( num_sets == AFGS1_MAX_PARAM_SETS )
+            return false;
+        array[num_sets++] = p;
+    }
 
-        std::set<struct size> unique;
+    return write_film_grain_param_sets( array, num_sets, wb );
+}
 
-        for( auto p: *sets ){
-            struct size s{ .width=p.apply_horz_resolution, .height=p.apply_vert_resolution };
-            unique.insert(s);
-        }
+// Read a scaling function signaled with point increments, with an offset added to the scaling values (0 for
+// luma).  Returns false if the points exceed the 8-bit range.
+static bool read_scaling_points( BitReader *rb, int max_points, bool has_offset, int (*points)[2],
+                                 int *num_points )
+{
+    *num_points = rb->read_literal(4);
+    if( *num_points > max_points )
+        return false;
+    if( !*num_points )
+        return true;
+
+    int bitsIncr = rb->read_literal(3) + 1;
+    int bitsScal = rb->read_literal(2) + 5;
+    int offset = has_offset ? rb->read_literal(8) : 0;
+
+    int value = 0;
+    for( int i = 0; i < *num_points; i++ ) {
+        value += rb->read_literal(bitsIncr);
+        points[i][0] = value;
+        points[i][1] = rb->read_literal(bitsScal) + offset;
+        if( points[i][0] > 255 || points[i][1] > 255 )
+            return false;
+    }
+    return true;
+}
 
-        if (unique.size() != sets->size()) {
-            printf("Error: Multiple parameter sets have the same value for resolution\n");
-            exit(1);
-        }
+// Read a scaling function predicted from the one of the reference: the scaling values of the reference are
+// scaled (in units of 1/16) and offset, and corrected by residuals of a granularity
+static void read_predicted_scaling_points( BitReader *rb, const int (*ref_points)[2], int ref_num_points,
+                                           int (*points)[2], int *num_points )
+{
+    int scaling_mult = (int)rb->read_literal(9) - 256;
+    int scaling_offset = (int)rb->read_literal(9) - 256;
+    int bitsRes = rb->read_literal(3);
+
+    int residual[14] = { 0 };
+    int granularity = 0;
+    if( bitsRes ) {
+        for( int i = 0; i < ref_num_points; i++ )
+            residual[i] = (int)rb->read_literal(bitsRes) - ( 1 << ( bitsRes - 1 ) );
+        granularity = rb->read_literal(3);
+    }
 
+    *num_points = ref_num_points;
+    for( int i = 0; i < ref_num_points; i++ ) {
+        int value = ( ( ref_points[i][1] * scaling_mult + 8 ) >> 4 ) - scaling_offset + residual[i] * granularity;
+        points[i][0] = ref_points[i][0];
+        points[i][1] = std::max( 0, std::min( value, 255 ) );
     }
+}
 
-    // - Confirm that we don't have duplicate film grain parameter set ids
-    {
+// Read a single set of film grain parameters, the inverse of write_film_grain_params.  ref holds the parameters
+// stored in the buffer slot of the set, or NULL.
+static bool read_film_grain_params( BitReader *rb, const Afgs1_film_grain_params *ref,
+                                    Afgs1_film_grain_params *pars )
+{
+    *pars = Afgs1_film_grain_params();
+
+    // Film grain parameter set id
+    pars->film_grain_param_set_idx = rb->read_literal(3);
 
-        std::set<int> unique;
+    // Apply grain flag
+    pars->apply_grain = rb->read_bit();
+    if( !pars->apply_grain ) return true;
 
-        for( auto p: *sets ){
-            unique.insert(p.film_grain_param_set_idx);
+    // Grain seed
+    pars->grain_seed = (short)rb->read_literal(16);
+
+    // Update grain flag.  The parameters that are not updated are the ones of the buffer.
+    pars->update_parameters = rb->read_bit();
+    if( !pars->update_parameters ) {
+        if( ref ) {
+            short grain_seed = pars->grain_seed;
+            *pars = *ref;
+            pars->grain_seed = grain_seed;
+            pars->update_parameters = 0;
         }
+        return true;
+    }
 
-        if (unique.size() != sets->size()) {
-            printf("Error: Multiple parameter sets have the same value for film_grain_param_set_idx\n");
-            exit(1);
+    // Resolution information
+    int apply_units_resolution_log2 = rb->read_literal(4);
+    pars->apply_horz_resolution = rb->read_literal(12) << apply_units_resolution_log2;
+    pars->apply_vert_resolution = rb->read_literal(12) << apply_units_resolution_log2;
+
+    // Luma only flag
+    pars->luma_only_flag = rb->read_bit();
+    if( !pars->luma_only_flag ) {
+        pars->subsampling_x = rb->read_bit();
+        pars->subsampling_y = rb->read_bit();
+    }
+
+    // Video characteristics flag
+    pars->video_signal_characteristics_flag = rb->read_bit();
+    if( pars->video_signal_characteristics_flag ) {
+        pars->bit_depth = rb->read_literal(3) + 8;
+        int cicp_info_present_flag = rb->read_bit();
+        if( cicp_info_present_flag ) {
+            pars->color_primaries = rb->read_literal(8);
+            pars->transfer_characteristics = rb->read_literal(8);
+            pars->matrix_coefficients = rb->read_literal(8);
+            pars->video_full_range_flag = rb->read_bit();
         }
+    }
+
+    // Predict scaling flags.  The scaling functions are predicted from the parameters of the buffer.
+    int predict_scaling_flag = rb->read_bit();
+    if( predict_scaling_flag && !ref )
+        return false;
 
+    int predict_y_scaling_flag = predict_scaling_flag ? rb->read_bit() : 0;
+    if( predict_y_scaling_flag )
+        read_predicted_scaling_points( rb, ref->scaling_points_y, ref->num_y_points, pars->scaling_points_y,
+                                       &pars->num_y_points );
+    else if( !read_scaling_points( rb, 14, false, pars->scaling_points_y, &pars->num_y_points ) )
+        return false;
+
+    // Chroma scaling from luma flag
+    int predict_cb_scaling_flag = 0;
+    int predict_cr_scaling_flag = 0;
+    if( !pars->luma_only_flag )
+        pars->chroma_scaling_from_luma = rb->read_bit();
+
+    if( !pars->luma_only_flag && !pars->chroma_scaling_from_luma ) {
+
+        predict_cb_scaling_flag = predict_scaling_flag ? rb->read_bit() : 0;
+        if( predict_cb_scaling_flag ) {
+            read_predicted_scaling_points( rb, ref->scaling_points_cb, ref->num_cb_points, pars->scaling_points_cb,
+                                           &pars->num_cb_points );
+            pars->cb_mult = ref->cb_mult;
+            pars->cb_luma_mult = ref->cb_luma_mult;
+            pars->cb_offset = ref->cb_offset;
+        }
+        else if( !read_scaling_points( rb, 10, true, pars->scaling_points_cb, &pars->num_cb_points ) )
+            return false;
+
+        predict_cr_scaling_flag = predict_scaling_flag ? rb->read_bit() : 0;
+        if( predict_cr_scaling_flag ) {
+            read_predicted_scaling_points( rb, ref->scaling_points_cr, ref->num_cr_points, pars->scaling_points_cr,
+                                           &pars->num_cr_points );
+            pars->cr_mult = ref->cr_mult;
+            pars->cr_luma_mult = ref->cr_luma_mult;
+            pars->cr_offset = ref->cr_offset;
+        }
+        else if( !read_scaling_points( rb, 10, true, pars->scaling_points_cr, &pars->num_cr_points ) )
+            return false;
     }
 
-    // Write the bit-stream
-    // - Signal the afgs1_enable_flag
-    int afgs1_enable_flag = 1;
-    wb->write_bit(afgs1_enable_flag);
+    // Grain scaling
+    pars->scaling_shift = rb->read_literal(2) + 8;
 
-    if( !afgs1_enable_flag ){
-        return;
+    // ----------------AR COEFFICIENTS -----------------------
+    pars->ar_coeff_lag = rb->read_literal(2);
+    int numPosLuma = 2 * pars->ar_coeff_lag * (pars->ar_coeff_lag + 1);
+
+    int numPosChroma = numPosLuma;
+    if( pars->num_y_points || predict_y_scaling_flag ) {
+        numPosChroma = numPosLuma + 1;
+        int BitsArY = rb->read_literal(2) + 5;
+        for( int i = 0; i < numPosLuma; i++ )
+            pars->ar_coeffs_y[i] = (int)rb->read_literal(BitsArY) - ( 1 << ( BitsArY - 1 ) );
     }
 
-    // - Add reserved bits so that av1 film_grain_payload is byte aligned */
-    wb->write_literal(0, 4);
+    if( pars->num_cb_points || pars->chroma_scaling_from_luma || predict_cb_scaling_flag ) {
+        int BitsArCb = rb->read_literal(2) + 5;
+        for( int i = 0; i < numPosChroma; i++ )
+            pars->ar_coeffs_cb[i] = (int)rb->read_literal(BitsArCb) - ( 1 << ( BitsArCb - 1 ) );
+    }
 
-    // - Write the film gain payloads
-    int num_film_grain_sets_minus_1 = sets->size() - 1;
-    wb->write_literal(num_film_grain_sets_minus_1, 3);
-    for( auto p : *sets){
-        write_film_grain_payload(&p, wb);
+    if( pars->num_cr_points || pars->chroma_scaling_from_luma || predict_cr_scaling_flag ) {
+        int BitsArCr = rb->read_literal(2) + 5;
+        for( int i = 0; i < numPosChroma; i++ )
+            pars->ar_coeffs_cr[i] = (int)rb->read_literal(BitsArCr) - ( 1 << ( BitsArCr - 1 ) );
     }
 
-    return;
+    pars->ar_coeff_shift = rb->read_literal(2) + 6;
+    pars->grain_scale_shift = rb->read_literal(2);
+
+    if( pars->num_cb_points && !predict_cb_scaling_flag ) {
+        pars->cb_mult = rb->read_literal(8);
+        pars->cb_luma_mult = rb->read_literal(8);
+        pars->cb_offset = rb->read_literal(9);
+    }
+
+    if( pars->num_cr_points && !predict_cr_scaling_flag ) {
+        pars->cr_mult = rb->read_literal(8);
+        pars->cr_luma_mult = rb->read_literal(8);
+        pars->cr_offset = rb->read_literal(9);
+    }
+
+    pars->overlap_flag = rb->read_bit();
+    pars->clip_to_restricted_range = rb->read_bit();
+
+    return true;
+}
+
+// Read the header of the av1_film_grain_param_sets() syntax.  Returns the number of sets, 0 if
+// afgs1_enable_flag is 0, or -1 if the data ends within the header.
+static int read_film_grain_param_sets_header( BitReader *rb )
+{
+    int afgs1_enable_flag = rb->read_bit();
+    rb->skip_bits(4);
+    int num_film_grain_sets_minus_1 = rb->read_literal(3);
+    if( rb->is_overrun() )
+        return -1;
+    return afgs1_enable_flag ? num_film_grain_sets_minus_1 + 1 : 0;
+}
+
+// Read the size of a film_grain_payload(), in bytes including the size information
+static int read_film_grain_payload_size( BitReader *rb )
+{
+    int payload_less_than_4byte_flag = rb->read_bit();
+    return rb->read_literal( payload_less_than_4byte_flag ? 2 : 8 );
+}
+
+int read_film_grain_param_sets( BitReader *rb, Afgs1_film_grain_params *sets, Afgs1_buffer *buffer )
+{
+    int num_sets = read_film_grain_param_sets_header(rb);
+
+    for( int i = 0; i < num_sets; i++ ) {
+
+        // The set is read within its payload, and the padding is skipped
+        size_t startPosition = rb->get_position();
+        int payload_size = read_film_grain_payload_size(rb);
+
+        // The parameters of the slot are taken from the buffer before the set replaces them
+        const Afgs1_film_grain_params *ref = NULL;
+        Afgs1_film_grain_params stored;
+        if( buffer ) {
+            BitReader peek = *rb;
+            stored = buffer->get_params( peek.read_literal(3) );
+            if( stored.apply_grain > 0 )
+                ref = &stored;
+        }
+
+        if( !read_film_grain_params( rb, ref, &sets[i] ) )
+            return -1;
+        if( sets[i].apply_grain && !sets[i].update_parameters && buffer && !ref )
+            return -1;
+
+        size_t payloadBits = rb->get_position() - startPosition;
+        if( payloadBits > (size_t)payload_size * 8 || rb->is_overrun() )
+            return -1;
+        rb->skip_bits( payload_size * 8 - payloadBits );
+        if( rb->is_overrun() )
+            return -1;
+
+        if( buffer )
+            buffer->update_buffer( sets[i] );
+    }
+
+    return num_sets;
+}
+
+int read_film_grain_param_set_indices( BitReader *rb, int *indices )
+{
+    int num_sets = read_film_grain_param_sets_header(rb);
+
+    for( int i = 0; i < num_sets; i++ ) {
+        size_t startPosition = rb->get_position();
+        int payload_size = read_film_grain_payload_size(rb);
+        indices[i] = rb->read_literal(3);
+
+        size_t payloadBits = rb->get_position() - startPosition;
+        if( payloadBits > (size_t)payload_size * 8 )
+            return -1;
+        rb->skip_bits( payload_size * 8 - payloadBits );
+        if( rb->is_overrun() )
+            return -1;
+    }
+
+    return num_sets;
+}
+
+int read_afgs1_t35_payload( const uint8_t *payload, size_t size, Afgs1_film_grain_params *sets,
+                            Afgs1_buffer *buffer )
+{
+    if( size < AFGS1_T35_HEADER_SIZE || payload[0] != 0x58 || payload[1] != 0x90 || payload[2] != 0x01 )
+        return -1;
+
+    BitReader rb( payload + AFGS1_T35_HEADER_SIZE, size - AFGS1_T35_HEADER_SIZE );
+    return read_film_grain_param_sets( &rb, sets, buffer );
 }
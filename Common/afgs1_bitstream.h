@@ -5,7 +5,7 @@
 // for Open Media Patent License 1.0 was not distributed with this source code in
 // the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
 //
-// AFGS1 bitstream syntax class - Supports writing film grain parameters using the AFGS1 syntax
+// AFGS1 bitstream syntax class - Supports writing and reading film grain parameters using the AFGS1 syntax
 //
 // Created by Segall, Andrew on 3/25/24.
 //
@@ -13,9 +13,55 @@
 #ifndef AFGS1_BITSTREAM_H
 #define AFGS1_BITSTREAM_H
 
+#include <vector>
+#include "afgs1_buffer.h"
 #include "afgs1_params.h"
+#include "Utilities/bitreader.h"
 #include "Utilities/bitstream.h"
 
-void write_film_grain_param_sets( std::list<Afgs1_film_grain_params> *sets, BitStream *wb);
+// ITU-T T.35 country code of the AFGS1 message.  The payload starts with the terminal provider code 0x5890
+// and the terminal provider oriented code 0x01.
+#define AFGS1_T35_COUNTRY_CODE 0xB5
+
+// Maximum number of film grain parameter sets in an AFGS1 message (num_film_grain_sets_minus_1 has 3 bits)
+#define AFGS1_MAX_PARAM_SETS 8
+
+// Size of the ITU-T T.35 terminal provider codes that start the AFGS1 payload
+#define AFGS1_T35_HEADER_SIZE 3
+
+// Write the av1_film_grain_param_sets() syntax.  Returns false, without writing, if the sets do not conform (no
+// set, more than AFGS1_MAX_PARAM_SETS sets, or sets with the same resolution or film_grain_param_set_idx).
+bool write_film_grain_param_sets( std::list<Afgs1_film_grain_params> *sets, BitStream *wb);
+
+// As above for an array of sets
+bool write_film_grain_param_sets( const Afgs1_film_grain_params *sets, int num_sets, BitStream *wb );
+
+// Write the ITU-T T.35 payload that follows the country code: the terminal provider codes and the
+// av1_film_grain_param_sets() syntax.  Returns false, leaving the payload unchanged, if the sets do not conform.
+bool write_afgs1_t35_payload( std::list<Afgs1_film_grain_params> *sets, std::vector<uint8_t> *payload );
+
+// As above into a buffer of the caller, without memory allocation.  Returns the payload size, or -1 if the
+// sets do not conform or the payload does not fit the buffer.
+int write_afgs1_t35_payload( const Afgs1_film_grain_params *sets, int num_sets, uint8_t *payload, size_t capacity );
+
+int film_grain_payload_size( const Afgs1_film_grain_params* pars );
+
+// Read an av1_film_grain_param_sets() syntax into sets (an array of AFGS1_MAX_PARAM_SETS).  Returns the number of
+// sets, 0 if afgs1_enable_flag is 0, or -1 if the syntax is malformed or the data ends within it.  With a buffer,
+// the sets are read as a decoder does: the sets with update_parameters equal to 0 are completed with the
+// parameters stored in their slot (keeping their grain seed), the predicted scaling functions are predicted from
+// those parameters, and the sets are then stored in the buffer.  A set that references an empty slot is malformed.
+// Without a buffer, the sets with update_parameters equal to 0 only have their index and grain seed, and the sets
+// with predicted scaling functions are malformed.
+int read_film_grain_param_sets( BitReader *rb, Afgs1_film_grain_params *sets, Afgs1_buffer *buffer = NULL );
+
+// As above for the film_grain_param_set_idx of the sets only.  The payloads are skipped by their size without
+// being decoded.
+int read_film_grain_param_set_indices( BitReader *rb, int *indices );
+
+// Read the ITU-T T.35 payload that follows the country code, as written by write_afgs1_t35_payload.  Returns -1
+// if the payload does not start with the terminal provider codes of AFGS1, and otherwise as above.
+int read_afgs1_t35_payload( const uint8_t *payload, size_t size, Afgs1_film_grain_params *sets,
+                            Afgs1_buffer *buffer = NULL );
 
 #endif
\ No newline at end of file
@@ -16,23 +16,52 @@
 
 Afgs1_buffer::Afgs1_buffer()
 {
+    current_time = 0;
     clear_buffer();
 }
 
 void Afgs1_buffer::clear_buffer()
 {
-    for( int i=0; i < AFGS1_MAX_BUFFERSIZE; i++ )
+    for( int i=0; i < AFGS1_MAX_BUFFERSIZE; i++ ) {
         buffer[i].apply_grain = -1;
+        last_used[i] = 0;
+        update_time[i] = 0;
+    }
+    use_count = 0;
 }
 
 void Afgs1_buffer::update_buffer( Afgs1_film_grain_params p )
 {
-    if( p.apply_grain && p.update_parameters ) {
+    if( p.apply_grain ) {
         int idx = p.film_grain_param_set_idx;
-        buffer[idx] = p;
+        if( p.update_parameters ) {
+            buffer[idx] = p;
+            update_time[idx] = current_time;
+        }
+
+        // Both stored and referenced parameters count as a use of the slot
+        last_used[idx] = ++use_count;
     }
 }
 
+// Set the current time (for example, the picture number in decoding order) used to record when each
+// slot was last updated
+void Afgs1_buffer::set_time( int64_t time )
+{
+    current_time = time;
+}
+
+int64_t Afgs1_buffer::get_time()
+{
+    return current_time;
+}
+
+int64_t Afgs1_buffer::get_update_time( int index )
+{
+    assert( index >=0 && index < AFGS1_MAX_BUFFERSIZE );
+    return update_time[index];
+}
+
 const Afgs1_film_grain_params Afgs1_buffer::get_params( int index )
 {
     assert( index >=0 && index < AFGS1_MAX_BUFFERSIZE );
@@ -53,4 +82,53 @@ int Afgs1_buffer::find_params( Afgs1_film_grain_params p )
 #endif
     }
     return -1;
+}
+
+// Function to determine if the film grain characteristics of p are stored in any slot of the buffer
+int Afgs1_buffer::find_content( const Afgs1_film_grain_params &p )
+{
+    for( int i=0; i < AFGS1_MAX_BUFFERSIZE; i++ )
+    {
+        if( buffer[i].apply_grain == 1 && buffer[i].content_equal(p) )
+#if AFGS1_DEBUG_DISABLE_PRED
+            return -1;
+#else
+            return i;
+#endif
+    }
+    return -1;
+}
+
+// Function to select the slot that will store p.  Slots set in reserved_mask are in use by the current
+// picture and are never replaced.  Empty slots are always used first.  Otherwise, the LRU policy replaces
+// the least recently used slot and the OPTIMAL policy replaces the slot with the largest value in next_use
+// (the next time the stored parameters are needed, as provided by the caller from the database timeline).
+int Afgs1_buffer::allocate_slot( const Afgs1_film_grain_params &p, Afgs1_slot_policy policy,
+                                 unsigned reserved_mask, const int64_t *next_use )
+{
+    if( policy == AFGS1_SLOT_POLICY_FIXED )
+        return p.film_grain_param_set_idx;
+
+    int slot = -1;
+    for( int i=0; i < AFGS1_MAX_BUFFERSIZE; i++ )
+    {
+        if( reserved_mask & (1u << i) )
+            continue;
+
+        if( buffer[i].apply_grain != 1 )
+            return i;
+
+        if( slot < 0 )
+            slot = i;
+        else if( policy == AFGS1_SLOT_POLICY_OPTIMAL && next_use ) {
+            if( next_use[i] > next_use[slot] ||
+                ( next_use[i] == next_use[slot] && last_used[i] < last_used[slot] ) )
+                slot = i;
+        }
+        else if( last_used[i] < last_used[slot] )
+            slot = i;
+    }
+
+    assert( slot >= 0 );
+    return slot;
 }
\ No newline at end of file
@@ -19,6 +19,14 @@
 #define AFGS1_MAX_BUFFERSIZE 8
 #define AFGS1_DEBUG_DISABLE_PRED 0
 
+// Policies for choosing the buffer slot (film_grain_param_set_idx) of a parameter set that is not
+// already stored in the buffer
+enum Afgs1_slot_policy {
+    AFGS1_SLOT_POLICY_FIXED = 0,  // Use the index assigned when the parameter file was loaded
+    AFGS1_SLOT_POLICY_LRU,        // Replace the least recently used slot
+    AFGS1_SLOT_POLICY_OPTIMAL     // Replace the slot whose parameters are needed furthest in the future
+};
+
 class Afgs1_buffer {
 
 public:
@@ -28,9 +36,19 @@ public:
     void update_buffer( Afgs1_film_grain_params params );
     const Afgs1_film_grain_params get_params( int index );
     int find_params( Afgs1_film_grain_params params );
+    int find_content( const Afgs1_film_grain_params &params );
+    int allocate_slot( const Afgs1_film_grain_params &params, Afgs1_slot_policy policy,
+                       unsigned reserved_mask, const int64_t *next_use );
+    void set_time( int64_t time );
+    int64_t get_time();
+    int64_t get_update_time( int index );
 
 private:
     Afgs1_film_grain_params buffer[AFGS1_MAX_BUFFERSIZE];
+    uint64_t last_used[AFGS1_MAX_BUFFERSIZE];
+    uint64_t use_count;
+    int64_t update_time[AFGS1_MAX_BUFFERSIZE];
+    int64_t current_time;
 };
 
 #endif //AFGS1_BUFFER_H
\ No newline at end of file
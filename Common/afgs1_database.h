@@ -15,6 +15,9 @@
 #define AFGS1_DATABASE_H
 
 #include <list>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
 #include <cstdio>
 #include <cstdint>
 #include <cassert>
@@ -26,72 +29,269 @@ class Afgs1_film_grain_database {
     struct record {
         int64_t start_time;
         int64_t end_time;
+        size_t sequence;                    // position in the list, which is the order of the output
         Afgs1_film_grain_params params;
     };
 
     std::list<record> *list;
 
+    // Index of the records by start time, rebuilt after each table is loaded and extended by the records added in
+    // order.  index_max_end holds the largest end time of the records up to each index entry, which bounds the
+    // search for the records that contain a time.
+    std::vector<const record*> index;
+    std::vector<int64_t> index_max_end;
+
+    // The uses of each distinct film grain content, for next_use: the start and end times of its records in the
+    // order of the index, and the largest end time up to each one.  Contents are found by content_hash.
+    struct content_uses {
+        const record* first;
+        std::vector<int64_t> start_time;
+        std::vector<int64_t> end_time;
+        std::vector<int64_t> max_end;
+    };
+    std::vector<content_uses> contents;
+    std::unordered_map<uint64_t, std::vector<size_t>> content_index;
+
+    // Return the position of the content of params in contents, or -1
+    int find_content( const Afgs1_film_grain_params &params, uint64_t hash ) const {
+        std::unordered_map<uint64_t, std::vector<size_t>>::const_iterator it = content_index.find( hash );
+        if( it == content_index.end() )
+            return -1;
+        for( size_t k: it->second )
+            if( contents[k].first->params.content_equal( params ) )
+                return (int)k;
+        return -1;
+    }
+
+    // Append a record to the uses of its content.  Records are added in the order of their start times.
+    void add_content_use( const record* r ) {
+        uint64_t hash = r->params.content_hash();
+        int k = find_content( r->params, hash );
+        if( k < 0 ) {
+            k = (int)contents.size();
+            content_index[hash].push_back( k );
+            contents.push_back( content_uses() );
+            contents.back().first = r;
+        }
+        content_uses *uses = &contents[k];
+        uses->start_time.push_back( r->start_time );
+        uses->end_time.push_back( r->end_time );
+        uses->max_end.push_back( uses->max_end.empty() ? r->end_time : std::max( uses->max_end.back(), r->end_time ) );
+    }
+
+    static bool start_before( const record* a, const record* b ) {
+        return a->start_time < b->start_time;
+    }
+
+    static bool sequence_before( const record* a, const record* b ) {
+        return a->sequence < b->sequence;
+    }
+
+    void build_index() {
+        index.clear();
+        for( std::list<record>::iterator it=list->begin(); it!=list->end(); ++it)
+            index.push_back( &*it );
+        std::stable_sort( index.begin(), index.end(), start_before );
+
+        index_max_end.resize( index.size() );
+        for( size_t i = 0; i < index.size(); i++ )
+            index_max_end[i] = i ? std::max( index_max_end[i - 1], index[i]->end_time ) : index[i]->end_time;
+
+        contents.clear();
+        content_index.clear();
+        for( size_t i = 0; i < index.size(); i++ )
+            add_content_use( index[i] );
+    }
+
+    // Number of tables loaded.  The parameters of each table are assigned their own film_grain_param_set_idx.
+    int num_tables;
+
 public:
     Afgs1_film_grain_database() {
         list = new std::list<record>;
+        num_tables = 0;
     }
 
     ~Afgs1_film_grain_database() {
         delete list;
     }
 
-    void load_table(const char* fname, int width, int height) {
+    // The database owns its list of records and is shared by pointer
+    Afgs1_film_grain_database( const Afgs1_film_grain_database& ) = delete;
+    Afgs1_film_grain_database& operator=( const Afgs1_film_grain_database& ) = delete;
+
+    // Load a "filmgrn1" parameter file.  Returns false if the file cannot be opened or is not a parameter file.
+    bool load_table(const char* fname, int width, int height) {
 
         FILE *fp;
         fp = fopen(fname, "rb");
 
-        static int FilmGrainParamSetIndex = -1;
-        FilmGrainParamSetIndex++;
+        if (fp == NULL) {
+            num_tables++;
+            return false;
+        }
+
+        bool loaded = load_table(fp, width, height);
+        fclose(fp);
+        return loaded;
+    }
+
+    // As above from an open file, which is read to its end.  The records of a table that cannot be read
+    // completely are not added to the database.
+    bool load_table(FILE* fp, int width, int height) {
+
+        int FilmGrainParamSetIndex = num_tables++;
 
         // Check for magic header;
         static const char kFileMagic[9] = "filmgrn1";
         char magic[9];
-        if (!fread(magic, 9, 1, fp) || memcmp(magic, kFileMagic, 8)) {
-            fclose(fp);
-            return;
-        }
+        if (!fread(magic, 9, 1, fp) || memcmp(magic, kFileMagic, 8))
+            return false;
 
+        size_t first_record = list->size();
         while( !feof(fp) ) {
-            struct record *record;
-            record = new struct record;
-            record->params.load_params(fp, &record->start_time, &record->end_time);
+            struct record record;
+            record.start_time = 0;
+            record.end_time = 0;
+            record.sequence = list->size();
+            if( !record.params.load_params(fp, &record.start_time, &record.end_time) ) {
+                while( list->size() > first_record )
+                    list->pop_back();
+                return false;
+            }
 
             // Set values
-            record->params.apply_horz_resolution = width;
-            record->params.apply_vert_resolution = height;
-            record->params.subsampling_x = 1;
-            record->params.subsampling_y = 1;
-            record->params.video_signal_characteristics_flag = 0;
-            record->params.film_grain_param_set_idx = FilmGrainParamSetIndex;
+            record.params.apply_horz_resolution = width;
+            record.params.apply_vert_resolution = height;
+            record.params.subsampling_x = 1;
+            record.params.subsampling_y = 1;
+            record.params.video_signal_characteristics_flag = 0;
+            record.params.film_grain_param_set_idx = FilmGrainParamSetIndex;
 
             // Store record
-            list->push_back(*record);
+            list->push_back(record);
+        }
+        build_index();
+        return true;
+    }
+
+    // Reserve the film_grain_param_set_idx of a table of parameters that are added with add_params, as the
+    // parameters of a loaded table have their own index
+    int new_table() {
+        return num_tables++;
+    }
+
+    // Add parameters for the presentation times from start_time to end_time, after the records already in the
+    // database.  The parameters are stored as given.  Records added in the order of their start times are
+    // appended to the index without sorting it again.
+    void add_params( int64_t start_time, int64_t end_time, const Afgs1_film_grain_params &params ) {
+
+        struct record record;
+        record.start_time = start_time;
+        record.end_time = end_time;
+        record.sequence = list->size();
+        record.params = params;
+        list->push_back(record);
+
+        if( index.empty() || index.back()->start_time <= start_time ) {
+            index.push_back( &list->back() );
+            index_max_end.push_back( index_max_end.empty() ? end_time : std::max( index_max_end.back(), end_time ) );
+            add_content_use( &list->back() );
         }
+        else
+            build_index();
     }
 
-    std::list<Afgs1_film_grain_params> find_frames( int poc ){
+    // Return the parameters of the records that contain the presentation time, in the order they were loaded.
+    // The records starting at or before the time are searched backwards from the last one, until no earlier
+    // record ends after the time.
+    std::list<Afgs1_film_grain_params> find_frames( int64_t time ) const {
+
+        std::vector<const record*> found;
+        size_t i = std::upper_bound( index.begin(), index.end(), time,
+                                     []( int64_t t, const record* r ) { return t < r->start_time; } ) - index.begin();
+        while( i-- > 0 && index_max_end[i] > time )
+        {
+            if( time < index[i]->end_time )
+                found.push_back( index[i] );
+        }
+        std::sort( found.begin(), found.end(), sequence_before );
 
         std::list<Afgs1_film_grain_params> subset;
+        for( size_t k = 0; k < found.size(); k++ )
+            subset.push_back( found[k]->params );
 
-        for( std::list<record>::iterator it=list->begin(); it!=list->end(); ++it)
+        return subset;
+    }
+
+    // As above into an array of the caller, without memory allocation.  At most max_sets (up to 64)
+    // parameters are stored, and the number of records that contain the time is returned.
+    int find_frames( int64_t time, Afgs1_film_grain_params *sets, int max_sets ) const {
+
+        // Insert the records found into the array in load order
+        size_t sequence[64];
+        max_sets = std::min( max_sets, 64 );
+        int num_found = 0;
+        size_t i = std::upper_bound( index.begin(), index.end(), time,
+                                     []( int64_t t, const record* r ) { return t < r->start_time; } ) - index.begin();
+        while( i-- > 0 && index_max_end[i] > time )
         {
-            if( poc >= it->start_time && poc < it->end_time )
-                subset.push_back(it->params);
+            if( time >= index[i]->end_time )
+                continue;
+            int k = std::min( num_found, max_sets );
+            while( k > 0 && sequence[k - 1] > index[i]->sequence ) {
+                if( k < max_sets ) {
+                    sets[k] = sets[k - 1];
+                    sequence[k] = sequence[k - 1];
+                }
+                k--;
+            }
+            if( k < max_sets ) {
+                sets[k] = index[i]->params;
+                sequence[k] = index[i]->sequence;
+            }
+            num_found++;
         }
 
-        return subset;
+        return num_found;
+    }
+
+    // Return the end of the timeline: the largest end time of the records (0 when empty)
+    int64_t end_time() const {
+        return index_max_end.empty() ? 0 : index_max_end.back();
     }
 
-    std::list<Afgs1_film_grain_params> all_frames(){
+    // Return the earliest presentation time at or after time where parameters with the same film grain
+    // characteristics as params are in the timeline.  INT64_MAX is returned if they are not used again.
+    // Only the records of the same content are searched: a record starting at or before the time contains it
+    // if the largest end time up to it is after the time, otherwise the next use is the first record starting
+    // after the time.
+    int64_t next_use( const Afgs1_film_grain_params &params, int64_t time ) const {
+
+        int k = find_content( params, params.content_hash() );
+        if( k < 0 )
+            return INT64_MAX;
+        const content_uses *uses = &contents[k];
+
+        size_t i = std::upper_bound( uses->start_time.begin(), uses->start_time.end(), time ) -
+                   uses->start_time.begin();
+        if( i > 0 && uses->max_end[i - 1] > time )
+            return time;
+
+        for( ; i < uses->start_time.size(); i++ )
+        {
+            if( uses->end_time[i] > time )
+                return uses->start_time[i];
+        }
+
+        return INT64_MAX;
+    }
+
+    std::list<Afgs1_film_grain_params> all_frames() const {
 
         std::list<Afgs1_film_grain_params> subset;
 
-        for( std::list<record>::iterator it=list->begin(); it!=list->end(); ++it)
+        for( std::list<record>::const_iterator it=list->begin(); it!=list->end(); ++it)
         {
             subset.push_back(it->params);
         }
@@ -0,0 +1,631 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Estimation class - Estimates the film grain parameters of a sequence of 4:2:0 frames.
+//
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "afgs1_estimation.h"
+
+// Standard deviation of the innovation of the grain templates in 8-bit units: the Gaussian sequence of the
+// specification (standard deviation of about 512) shifted by 12 - 8 bits, with a grain_scale_shift of 0
+#define GRAIN_STD 32.0
+
+// Flat blocks, from the difference of the block with a plane in 8-bit units.  Below the minimum variance, a
+// block is flat and noiseless.  Otherwise, the eigenvalues of the structure tensor of its gradients are close
+// (the gradients have no direction) and their sum is not small compared to the variance (the difference is not
+// a smooth variation of the signal).
+#define FLAT_MAX_VARIANCE   256.0
+#define FLAT_MIN_VARIANCE   0.0625
+#define FLAT_MAX_ANISOTROPY 1.75
+#define FLAT_MIN_GRADIENT   0.02
+
+// Samples needed to fit the AR coefficients of a plane, and to measure the strength of an intensity bin
+#define MIN_OBSERVATIONS 2048
+#define MIN_BIN_COUNT    256
+
+// A frame starts a new record when the luma AR coefficients move by more than MAX_COEFF_DISTANCE (Euclidean
+// distance), or when the strength of the noise changes by more than MAX_STRENGTH_CHANGE of the strength of
+// the record (and by more than MIN_STRENGTH_CHANGE in 8-bit units)
+#define MAX_COEFF_DISTANCE  0.15
+#define MAX_STRENGTH_CHANGE 0.25
+#define MIN_STRENGTH_CHANGE 0.25
+
+// Scaling points whose removal changes the scaling function by at most this much are removed
+#define SCALING_TOLERANCE 1.0
+
+// Initial grain seed, and its increment from a record to the next
+#define GRAIN_SEED      7391
+#define GRAIN_SEED_STEP 3381
+
+void Afgs1_noise_statistics::clear() {
+    memset( this, 0, sizeof(*this) );
+}
+
+void Afgs1_noise_statistics::add( const Afgs1_noise_statistics &rhs ) {
+
+    for( int plane = 0; plane < 3; plane++ ) {
+        for( int i = 0; i < AFGS1_ESTIMATION_MAX_COEFFS; i++ ) {
+            for( int j = i; j < AFGS1_ESTIMATION_MAX_COEFFS; j++ )
+                ar_matrix[plane][i][j] += rhs.ar_matrix[plane][i][j];
+            ar_vector[plane][i] += rhs.ar_vector[plane][i];
+        }
+        num_observations[plane] += rhs.num_observations[plane];
+
+        for( int bin = 0; bin < AFGS1_ESTIMATION_NUM_BINS; bin++ ) {
+            bin_energy[plane][bin] += rhs.bin_energy[plane][bin];
+            bin_intensity[plane][bin] += rhs.bin_intensity[plane][bin];
+            bin_count[plane][bin] += rhs.bin_count[plane][bin];
+        }
+        num_flat_blocks[plane] += rhs.num_flat_blocks[plane];
+    }
+}
+
+// Load a square block of samples in 8-bit units.  Returns false if a sample is at a limit of the sample range,
+// where the noise is clipped.
+static bool load_block( const Afgs1_frame &frame, int plane, int x0, int y0, int size, double *block ) {
+
+    double scale = 1.0 / ( 1 << ( frame.bit_depth - 8 ) );
+    int max_value = ( 1 << frame.bit_depth ) - 1;
+    bool clipped = false;
+    for( int y = 0; y < size; y++ ) {
+        size_t offset = (size_t)( y0 + y ) * frame.stride[plane] + x0;
+        for( int x = 0; x < size; x++ ) {
+            int value = frame.bit_depth > 8 ? frame.planes_16[plane][offset + x] : frame.planes[plane][offset + x];
+            clipped |= value == 0 || value == max_value;
+            block[y * size + x] = value * scale;
+        }
+    }
+    return !clipped;
+}
+
+// Least squares fit of a plane to a block.  The coordinates are centered, so that the constant and the two
+// gradients are fitted independently.
+static void fit_plane( const double *block, int size, double *plane ) {
+
+    double center = ( size - 1 ) * 0.5;
+    double sum = 0, sum_x = 0, sum_y = 0, sum_squares = 0;
+    for( int y = 0; y < size; y++ ) {
+        for( int x = 0; x < size; x++ ) {
+            double value = block[y * size + x];
+            sum += value;
+            sum_x += value * ( x - center );
+            sum_y += value * ( y - center );
+            sum_squares += ( x - center ) * ( x - center );
+        }
+    }
+
+    double mean = sum / ( size * size );
+    double gradient_x = sum_x / sum_squares;
+    double gradient_y = sum_y / sum_squares;
+    for( int y = 0; y < size; y++ )
+        for( int x = 0; x < size; x++ )
+            plane[y * size + x] = mean + gradient_x * ( x - center ) + gradient_y * ( y - center );
+}
+
+static bool is_flat( const double *block, const double *plane, int size ) {
+
+    double residual[AFGS1_ESTIMATION_BLOCK_SIZE * AFGS1_ESTIMATION_BLOCK_SIZE];
+    double variance = 0;
+    for( int i = 0; i < size * size; i++ ) {
+        residual[i] = block[i] - plane[i];
+        variance += residual[i] * residual[i];
+    }
+    variance /= size * size;
+    if( variance > FLAT_MAX_VARIANCE )
+        return false;
+    if( variance < FLAT_MIN_VARIANCE )
+        return true;
+
+    // Structure tensor of the central differences of the inner samples
+    double gxx = 0, gyy = 0, gxy = 0;
+    for( int y = 1; y < size - 1; y++ ) {
+        for( int x = 1; x < size - 1; x++ ) {
+            const double *r = residual + y * size + x;
+            double gx = ( r[1] - r[-1] ) * 0.5;
+            double gy = ( r[size] - r[-size] ) * 0.5;
+            gxx += gx * gx;
+            gyy += gy * gy;
+            gxy += gx * gy;
+        }
+    }
+    int n = ( size - 2 ) * ( size - 2 );
+    gxx /= n;
+    gyy /= n;
+    gxy /= n;
+
+    double trace = gxx + gyy;
+    double spread = sqrt( std::max( 0.0, ( gxx - gyy ) * ( gxx - gyy ) * 0.25 + gxy * gxy ) );
+    double e1 = trace * 0.5 + spread;
+    double e2 = trace * 0.5 - spread;
+    return trace >= FLAT_MIN_GRADIENT * variance && e1 <= FLAT_MAX_ANISOTROPY * e2;
+}
+
+// Solve the n x n system m x = v by Gaussian elimination with partial pivoting.  m and v are overwritten.
+// Returns false if the system is singular.
+static bool solve_linear_system( double *m, double *v, int n, double *x ) {
+
+    for( int k = 0; k < n; k++ ) {
+        int pivot = k;
+        for( int i = k + 1; i < n; i++ )
+            if( fabs( m[i * n + k] ) > fabs( m[pivot * n + k] ) )
+                pivot = i;
+        if( fabs( m[pivot * n + k] ) < 1e-12 )
+            return false;
+        if( pivot != k ) {
+            for( int j = 0; j < n; j++ )
+                std::swap( m[k * n + j], m[pivot * n + j] );
+            std::swap( v[k], v[pivot] );
+        }
+        for( int i = k + 1; i < n; i++ ) {
+            double factor = m[i * n + k] / m[k * n + k];
+            for( int j = k; j < n; j++ )
+                m[i * n + j] -= factor * m[k * n + j];
+            v[i] -= factor * v[k];
+        }
+    }
+
+    for( int k = n - 1; k >= 0; k-- ) {
+        double sum = v[k];
+        for( int j = k + 1; j < n; j++ )
+            sum -= m[k * n + j] * x[j];
+        x[k] = sum / m[k * n + k];
+    }
+    return true;
+}
+
+// Dot product of two arrays of a multiple of 8 values, in 8 partial sums that are vectorized
+static double dot_product( const float *a, const float *b, int n ) {
+
+    float sums[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    for( int i = 0; i < n; i += 8 )
+        for( int j = 0; j < 8; j++ )
+            sums[j] += a[i + j] * b[i + j];
+    return (double)( sums[0] + sums[4] ) + ( sums[1] + sums[5] ) + ( sums[2] + sums[6] ) + ( sums[3] + sums[7] );
+}
+
+// As above for the dot products of an array with 4 arrays at a stride, which share the loads of the first array
+static void dot_products_4( const float *a, const float *b, int stride, int n, double *products ) {
+
+    float sums[4][8];
+    memset( sums, 0, sizeof(sums) );
+    for( int i = 0; i < n; i += 8 ) {
+        for( int k = 0; k < 4; k++ )
+            for( int j = 0; j < 8; j++ )
+                sums[k][j] += a[i + j] * b[k * stride + i + j];
+    }
+    for( int k = 0; k < 4; k++ )
+        products[k] = (double)( sums[k][0] + sums[k][4] ) + ( sums[k][1] + sums[k][5] ) +
+                      ( sums[k][2] + sums[k][6] ) + ( sums[k][3] + sums[k][7] );
+}
+
+Afgs1_grain_estimation::Afgs1_grain_estimation( Afgs1_film_grain_database *database, int ar_coeff_lag ) {
+
+    this->database = database;
+    this->ar_coeff_lag = std::max( 0, std::min( ar_coeff_lag, 3 ) );
+    num_pos = 2 * this->ar_coeff_lag * ( this->ar_coeff_lag + 1 );
+    table_idx = database->new_table();
+    grain_seed = GRAIN_SEED;
+
+    segment.clear();
+    segment_frames = 0;
+    segment_start = segment_end = 0;
+    width = height = 0;
+    bit_depth = 8;
+}
+
+Afgs1_grain_estimation::~Afgs1_grain_estimation() {
+    flush();
+}
+
+// The observations of a sample are its causal neighbors within the block, in the order of the coefficients of
+// the AR filter, and for chroma the average of the co-located luma noise.  They are gathered in a column per
+// coefficient, so that the normal equations are dot products of columns.  Pass 0 adds the observations to the
+// normal equations, and pass 1 the residual of the prediction of the model to the bin of the luma intensity.
+void Afgs1_grain_estimation::analyze_block_row( const Afgs1_frame &source, const Afgs1_frame *denoised,
+                                                int block_row, int pass, const noise_model *model,
+                                                Afgs1_noise_statistics *stats ) const {
+
+    const int luma_size = AFGS1_ESTIMATION_BLOCK_SIZE;
+    const int block_samples = AFGS1_ESTIMATION_BLOCK_SIZE * AFGS1_ESTIMATION_BLOCK_SIZE;
+    double samples[block_samples], plane_fit[block_samples];
+    double noise[3][block_samples], signal[3][block_samples];
+    float columns[AFGS1_ESTIMATION_MAX_COEFFS + 1][block_samples];
+    int lag = ar_coeff_lag;
+
+    int num_blocks = source.width / luma_size;
+    for( int block = 0; block < num_blocks; block++ ) {
+
+        // Noise of the planes of the block, and the denoised samples that give the intensity of the noise
+        bool flat[3];
+        for( int plane = 0; plane < 3; plane++ ) {
+            int size = plane ? luma_size / 2 : luma_size;
+            int x0 = block * size;
+            int y0 = block_row * size;
+            bool unclipped = load_block( source, plane, x0, y0, size, samples );
+            fit_plane( samples, size, plane_fit );
+            flat[plane] = unclipped && is_flat( samples, plane_fit, size ) && ( plane == 0 || flat[0] );
+            if( !flat[plane] )
+                continue;
+
+            if( denoised )
+                load_block( *denoised, plane, x0, y0, size, signal[plane] );
+            else
+                memcpy( signal[plane], plane_fit, size * size * sizeof(double) );
+            for( int i = 0; i < size * size; i++ )
+                noise[plane][i] = samples[i] - signal[plane][i];
+        }
+
+        for( int plane = 0; plane < 3; plane++ ) {
+            if( !flat[plane] )
+                continue;
+            if( pass == 0 )
+                stats->num_flat_blocks[plane]++;
+
+            int size = plane ? luma_size / 2 : luma_size;
+            int num_coeffs = plane ? num_pos + 1 : num_pos;
+            int num_observations = ( size - lag ) * ( size - 2 * lag );
+            int padded_observations = ( num_observations + 7 ) & ~7;
+            const double *n = noise[plane];
+
+            // Observation columns: the neighbors of each coefficient, the co-located luma noise, and the noise of
+            // the samples, padded with zeros
+            int k = 0;
+            for( int dy = -lag; dy <= 0; dy++ ) {
+                for( int dx = -lag; dx <= lag && k < num_pos; dx++ ) {
+                    float *column = columns[k++];
+                    for( int y = lag; y < size; y++ )
+                        for( int x = lag; x < size - lag; x++ )
+                            *column++ = (float)n[( y + dy ) * size + x + dx];
+                }
+            }
+            if( plane ) {
+                float *column = columns[k++];
+                for( int y = lag; y < size; y++ ) {
+                    for( int x = lag; x < size - lag; x++ ) {
+                        const double *l = noise[0] + 2 * y * luma_size + 2 * x;
+                        *column++ = (float)( ( l[0] + l[1] + l[luma_size] + l[luma_size + 1] ) * 0.25 );
+                    }
+                }
+            }
+            float *target = columns[num_coeffs];
+            for( int y = lag, i = 0; y < size; y++ )
+                for( int x = lag; x < size - lag; x++ )
+                    target[i++] = (float)n[y * size + x];
+            for( int i = 0; i <= num_coeffs; i++ )
+                for( int j = num_observations; j < padded_observations; j++ )
+                    columns[i][j] = 0;
+
+            if( pass == 0 ) {
+                // The target column follows the columns of the coefficients, and gives the vector
+                for( int i = 0; i < num_coeffs; i++ ) {
+                    double products[AFGS1_ESTIMATION_MAX_COEFFS + 4];
+                    int j = i;
+                    for( ; j + 4 <= num_coeffs + 1; j += 4 )
+                        dot_products_4( columns[i], columns[j], block_samples, padded_observations, products + j );
+                    for( ; j <= num_coeffs; j++ )
+                        products[j] = dot_product( columns[i], columns[j], padded_observations );
+                    for( j = i; j < num_coeffs; j++ )
+                        stats->ar_matrix[plane][i][j] += products[j];
+                    stats->ar_vector[plane][i] += products[num_coeffs];
+                }
+                stats->num_observations[plane] += num_observations;
+                continue;
+            }
+
+            float innovation[block_samples];
+            memcpy( innovation, target, padded_observations * sizeof(float) );
+            if( model->has_coeffs[plane] ) {
+                for( int i = 0; i < num_coeffs; i++ ) {
+                    float coeff = (float)model->coeffs[plane][i];
+                    for( int j = 0; j < padded_observations; j++ )
+                        innovation[j] -= coeff * columns[i][j];
+                }
+            }
+
+            for( int y = lag, i = 0; y < size; y++ ) {
+                for( int x = lag; x < size - lag; x++, i++ ) {
+                    double intensity = signal[0][y * luma_size + x];
+                    if( plane ) {
+                        const double *l = signal[0] + 2 * y * luma_size + 2 * x;
+                        intensity = ( l[0] + l[1] + l[luma_size] + l[luma_size + 1] ) * 0.25;
+                    }
+                    int bin = (int)( intensity * AFGS1_ESTIMATION_NUM_BINS / 256 );
+                    bin = std::max( 0, std::min( bin, AFGS1_ESTIMATION_NUM_BINS - 1 ) );
+                    stats->bin_energy[plane][bin] += (double)innovation[i] * innovation[i];
+                    stats->bin_intensity[plane][bin] += intensity;
+                    stats->bin_count[plane][bin]++;
+                }
+            }
+        }
+    }
+}
+
+// The block rows are measured in two passes: the AR coefficients of the frame are fitted to the observations of
+// all the rows before the innovations are measured.  The statistics of the rows are added in order.
+void Afgs1_grain_estimation::analyze_frame( const Afgs1_frame &source, const Afgs1_frame *denoised,
+                                            ThreadPool *pool, Afgs1_noise_statistics *stats ) const {
+
+    stats->clear();
+    int num_rows = source.height / AFGS1_ESTIMATION_BLOCK_SIZE;
+    if( num_rows == 0 || source.width < AFGS1_ESTIMATION_BLOCK_SIZE )
+        return;
+
+    std::vector<Afgs1_noise_statistics> rows( num_rows );
+    noise_model model;
+    for( int pass = 0; pass < 2; pass++ ) {
+        auto analyze_row = [&]( int row, int ) {
+            rows[row].clear();
+            analyze_block_row( source, denoised, row, pass, &model, &rows[row] );
+        };
+        if( pool )
+            pool->run( num_rows, analyze_row );
+        else
+            for( int row = 0; row < num_rows; row++ )
+                analyze_row( row, 0 );
+
+        for( int row = 0; row < num_rows; row++ )
+            stats->add( rows[row] );
+        if( pass == 0 )
+            solve_model( *stats, &model );
+    }
+}
+
+void Afgs1_grain_estimation::solve_model( const Afgs1_noise_statistics &stats, noise_model *model ) const {
+
+    double m[AFGS1_ESTIMATION_MAX_COEFFS * AFGS1_ESTIMATION_MAX_COEFFS];
+    double v[AFGS1_ESTIMATION_MAX_COEFFS];
+    for( int plane = 0; plane < 3; plane++ ) {
+        int n = plane ? num_pos + 1 : num_pos;
+        memset( model->coeffs[plane], 0, sizeof(model->coeffs[plane]) );
+        model->has_coeffs[plane] = false;
+        if( n > 0 && stats.num_observations[plane] >= MIN_OBSERVATIONS ) {
+            for( int i = 0; i < n; i++ ) {
+                for( int j = i; j < n; j++ )
+                    m[i * n + j] = m[j * n + i] = stats.ar_matrix[plane][i][j];
+                v[i] = stats.ar_vector[plane][i];
+            }
+            model->has_coeffs[plane] = solve_linear_system( m, v, n, model->coeffs[plane] );
+            if( !model->has_coeffs[plane] )
+                memset( model->coeffs[plane], 0, sizeof(model->coeffs[plane]) );
+        }
+
+        double energy = 0;
+        uint64_t count = 0;
+        for( int bin = 0; bin < AFGS1_ESTIMATION_NUM_BINS; bin++ ) {
+            uint64_t bin_count = stats.bin_count[plane][bin];
+            model->has_bin[plane][bin] = bin_count >= MIN_BIN_COUNT;
+            model->strength[plane][bin] = bin_count ? sqrt( stats.bin_energy[plane][bin] / bin_count ) : 0;
+            model->intensity[plane][bin] = bin_count ? stats.bin_intensity[plane][bin] / bin_count : 0;
+            energy += stats.bin_energy[plane][bin];
+            count += bin_count;
+        }
+        model->mean_strength[plane] = count ? sqrt( energy / count ) : 0;
+    }
+}
+
+bool Afgs1_grain_estimation::same_noise( const Afgs1_noise_statistics &frame ) const {
+
+    noise_model current, previous;
+    solve_model( frame, &current );
+    solve_model( segment, &previous );
+
+    if( current.has_coeffs[0] && previous.has_coeffs[0] ) {
+        double distance = 0;
+        for( int i = 0; i < num_pos; i++ )
+            distance += ( current.coeffs[0][i] - previous.coeffs[0][i] ) *
+                        ( current.coeffs[0][i] - previous.coeffs[0][i] );
+        if( sqrt( distance ) > MAX_COEFF_DISTANCE )
+            return false;
+    }
+
+    for( int plane = 0; plane < 3; plane++ ) {
+        double change = 0, strength = 0;
+        int num_bins = 0;
+        for( int bin = 0; bin < AFGS1_ESTIMATION_NUM_BINS; bin++ ) {
+            if( current.has_bin[plane][bin] && previous.has_bin[plane][bin] ) {
+                change += fabs( current.strength[plane][bin] - previous.strength[plane][bin] );
+                strength += previous.strength[plane][bin];
+                num_bins++;
+            }
+        }
+        if( num_bins && change > MAX_STRENGTH_CHANGE * strength && change > MIN_STRENGTH_CHANGE * num_bins )
+            return false;
+    }
+    return true;
+}
+
+bool Afgs1_grain_estimation::add_frame( const Afgs1_frame &source, const Afgs1_frame *denoised, int64_t start_time,
+                                        int64_t end_time, ThreadPool *pool ) {
+    return add_frames( &source, denoised, &start_time, &end_time, 1, pool );
+}
+
+// A single frame shares its blocks with the threads of the pool, and several frames are shared whole
+bool Afgs1_grain_estimation::add_frames( const Afgs1_frame *sources, const Afgs1_frame *denoised,
+                                         const int64_t *start_times, const int64_t *end_times, int num_frames,
+                                         ThreadPool *pool ) {
+
+    for( int i = 0; i < num_frames; i++ ) {
+        const Afgs1_frame &source = sources[i];
+        if( source.bit_depth != 8 && source.bit_depth != 10 && source.bit_depth != 12 )
+            return false;
+        if( denoised && ( denoised[i].width != source.width || denoised[i].height != source.height ||
+                          denoised[i].bit_depth != source.bit_depth ) )
+            return false;
+    }
+
+    if( frame_stats.size() < (size_t)num_frames )
+        frame_stats.resize( num_frames );
+    if( num_frames == 1 || !pool ) {
+        for( int i = 0; i < num_frames; i++ )
+            analyze_frame( sources[i], denoised ? &denoised[i] : NULL, pool, &frame_stats[i] );
+    }
+    else {
+        pool->run( num_frames, [&]( int i, int ) {
+            analyze_frame( sources[i], denoised ? &denoised[i] : NULL, NULL, &frame_stats[i] );
+        } );
+    }
+
+    for( int i = 0; i < num_frames; i++ )
+        add_statistics( frame_stats[i], sources[i], start_times[i], end_times[i] );
+    return true;
+}
+
+// The frames of a record have the same size and bit depth, and the same noise
+void Afgs1_grain_estimation::add_statistics( const Afgs1_noise_statistics &stats, const Afgs1_frame &source,
+                                             int64_t start_time, int64_t end_time ) {
+
+    if( segment_frames && ( source.width != width || source.height != height || source.bit_depth != bit_depth ||
+                            !same_noise( stats ) ) )
+        flush();
+
+    if( !segment_frames ) {
+        segment_start = start_time;
+        width = source.width;
+        height = source.height;
+        bit_depth = source.bit_depth;
+    }
+    segment.add( stats );
+    segment_end = end_time;
+    segment_frames++;
+}
+
+void Afgs1_grain_estimation::flush() {
+
+    Afgs1_film_grain_params params;
+    if( !get_params( &params ) )
+        return;
+
+    database->add_params( segment_start, segment_end, params );
+    grain_seed = (uint16_t)( grain_seed + GRAIN_SEED_STEP );
+    segment.clear();
+    segment_frames = 0;
+}
+
+// Scaling points of a plane at the mean intensity of the bins that were measured.  The points are then removed,
+// from the one that changes the piecewise linear function the least, until there are at most max_points and the
+// removal of any other point would change the function by more than the tolerance.
+void Afgs1_grain_estimation::get_scaling_points( const noise_model &model, int plane, int scaling_shift,
+                                                 int (*points)[2], int max_points, int *num_points ) const {
+
+    double x[AFGS1_ESTIMATION_NUM_BINS], y[AFGS1_ESTIMATION_NUM_BINS];
+    int n = 0;
+    for( int bin = 0; bin < AFGS1_ESTIMATION_NUM_BINS; bin++ ) {
+        if( !model.has_bin[plane][bin] )
+            continue;
+        double intensity = std::max( 0.0, std::min( floor( model.intensity[plane][bin] + 0.5 ), 255.0 ) );
+        if( n && intensity <= x[n - 1] )
+            continue;
+        x[n] = intensity;
+        y[n] = std::min( model.strength[plane][bin] * ( 1 << scaling_shift ) / GRAIN_STD, 255.0 );
+        n++;
+    }
+
+    for( ;; ) {
+        int best = -1;
+        double best_error = 0;
+        for( int i = 1; i < n - 1; i++ ) {
+            double t = ( x[i] - x[i - 1] ) / ( x[i + 1] - x[i - 1] );
+            double error = fabs( y[i - 1] + t * ( y[i + 1] - y[i - 1] ) - y[i] );
+            if( best < 0 || error < best_error ) {
+                best = i;
+                best_error = error;
+            }
+        }
+        if( best < 0 || ( n <= max_points && best_error > SCALING_TOLERANCE ) )
+            break;
+        for( int i = best; i < n - 1; i++ ) {
+            x[i] = x[i + 1];
+            y[i] = y[i + 1];
+        }
+        n--;
+    }
+
+    for( int i = 0; i < n; i++ ) {
+        points[i][0] = (int)x[i];
+        points[i][1] = (int)floor( y[i] + 0.5 );
+    }
+    *num_points = n;
+}
+
+bool Afgs1_grain_estimation::get_params( Afgs1_film_grain_params *params ) const {
+
+    if( !segment_frames )
+        return false;
+
+    noise_model model;
+    solve_model( segment, &model );
+
+    Afgs1_film_grain_params &p = *params;
+    p = Afgs1_film_grain_params();
+    p.film_grain_param_set_idx = table_idx;
+    p.apply_grain = 1;
+    p.grain_seed = (short)grain_seed;
+    p.update_parameters = 1;
+    p.apply_horz_resolution = width;
+    p.apply_vert_resolution = height;
+    p.subsampling_x = 1;
+    p.subsampling_y = 1;
+    p.bit_depth = bit_depth;
+
+    // The largest scaling shift whose scaling functions fit in 8 bits
+    double max_strength = 0;
+    for( int plane = 0; plane < 3; plane++ )
+        for( int bin = 0; bin < AFGS1_ESTIMATION_NUM_BINS; bin++ )
+            if( model.has_bin[plane][bin] )
+                max_strength = std::max( max_strength, model.strength[plane][bin] );
+    p.scaling_shift = 11;
+    while( p.scaling_shift > 8 && max_strength * ( 1 << p.scaling_shift ) / GRAIN_STD > 255 )
+        p.scaling_shift--;
+
+    get_scaling_points( model, 0, p.scaling_shift, p.scaling_points_y, 14, &p.num_y_points );
+    get_scaling_points( model, 1, p.scaling_shift, p.scaling_points_cb, 10, &p.num_cb_points );
+    get_scaling_points( model, 2, p.scaling_shift, p.scaling_points_cr, 10, &p.num_cr_points );
+    if( !p.num_y_points && !p.num_cb_points && !p.num_cr_points )
+        p.apply_grain = 0;
+
+    // The chroma scaling functions are indexed by the average luma
+    p.cb_mult = p.cr_mult = 128;
+    p.cb_luma_mult = p.cr_luma_mult = 192;
+    p.cb_offset = p.cr_offset = 256;
+
+    // AR coefficients.  The coefficient of the luma noise in a chroma plane is fitted on the scaled noise, and is
+    // divided by the ratio of the strengths of the chroma and luma noise to apply to the grain templates.
+    double coeffs[3][AFGS1_ESTIMATION_MAX_COEFFS];
+    memcpy( coeffs, model.coeffs, sizeof(coeffs) );
+    for( int plane = 1; plane < 3; plane++ ) {
+        if( model.mean_strength[plane] > 0 )
+            coeffs[plane][num_pos] *= model.mean_strength[0] / model.mean_strength[plane];
+        else
+            coeffs[plane][num_pos] = 0;
+    }
+
+    double max_coeff = 0;
+    for( int plane = 0; plane < 3; plane++ )
+        for( int i = 0; i < ( plane ? num_pos + 1 : num_pos ); i++ )
+            max_coeff = std::max( max_coeff, fabs( coeffs[plane][i] ) );
+    p.ar_coeff_lag = ar_coeff_lag;
+    p.ar_coeff_shift = 9;
+    while( p.ar_coeff_shift > 6 && max_coeff * ( 1 << p.ar_coeff_shift ) > 127.5 )
+        p.ar_coeff_shift--;
+
+    int *ar_coeffs[3] = { p.ar_coeffs_y, p.ar_coeffs_cb, p.ar_coeffs_cr };
+    for( int plane = 0; plane < 3; plane++ ) {
+        for( int i = 0; i < ( plane ? num_pos + 1 : num_pos ); i++ ) {
+            double coeff = floor( coeffs[plane][i] * ( 1 << p.ar_coeff_shift ) + 0.5 );
+            ar_coeffs[plane][i] = (int)std::max( -128.0, std::min( coeff, 127.0 ) );
+        }
+    }
+
+    p.overlap_flag = 1;
+    p.clip_to_restricted_range = 0;
+    p.chroma_scaling_from_luma = 0;
+    p.grain_scale_shift = 0;
+    return true;
+}
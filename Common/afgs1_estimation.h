@@ -0,0 +1,136 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Estimation class - Estimates the film grain parameters of a sequence of 4:2:0 frames and adds them to the
+// timeline of a database, so that the parameters of a title are produced while it is encoded instead of by a
+// separate analysis pass.
+//
+// The noise of a frame is its difference with a denoised frame.  Without a denoised frame, the frame is
+// denoised by fitting a plane to each of its blocks, which only preserves the signal of the flat blocks that
+// the noise is measured on.  The flat blocks are the blocks of 32x32 luma samples (and of the co-located 16x16
+// chroma samples) whose difference with a plane has no structure: an isotropic gradient of a strength
+// consistent with noise, and a bounded variance.
+//
+// The noise of the flat blocks is modeled as the autoregressive process of the film grain synthesis: the AR
+// coefficients are the least squares fit of the noise samples to their causal neighbors (and, for chroma, to
+// the co-located luma noise), and the scaling functions are the strength of the residual of the fit (the
+// innovation) by luma intensity.  Consecutive frames with the same noise share a record of the timeline.
+//
+
+#ifndef AFGS1_ESTIMATION_H
+#define AFGS1_ESTIMATION_H
+
+#include <cstdint>
+#include <vector>
+#include "afgs1_database.h"
+#include "afgs1_params.h"
+#include "afgs1_synthesis.h"
+#include "Utilities/thread_pool.h"
+
+// Size of the luma blocks that the noise is measured on
+#define AFGS1_ESTIMATION_BLOCK_SIZE 32
+
+// Intensity bins of the scaling functions, of 256 / AFGS1_ESTIMATION_NUM_BINS 8-bit values
+#define AFGS1_ESTIMATION_NUM_BINS 16
+
+// AR coefficients of a chroma plane of lag 3, with the coefficient of the luma noise
+#define AFGS1_ESTIMATION_MAX_COEFFS 25
+
+// Noise measurements of the flat blocks of one or more frames, in 8-bit units
+struct Afgs1_noise_statistics {
+    // Normal equations of the AR fit of each plane (upper triangle of the matrix)
+    double ar_matrix[3][AFGS1_ESTIMATION_MAX_COEFFS][AFGS1_ESTIMATION_MAX_COEFFS];
+    double ar_vector[3][AFGS1_ESTIMATION_MAX_COEFFS];
+    uint64_t num_observations[3];
+
+    // Energy of the innovation and luma intensity of the samples of each bin
+    double bin_energy[3][AFGS1_ESTIMATION_NUM_BINS];
+    double bin_intensity[3][AFGS1_ESTIMATION_NUM_BINS];
+    uint64_t bin_count[3][AFGS1_ESTIMATION_NUM_BINS];
+
+    int num_flat_blocks[3];
+
+    void clear();
+    void add( const Afgs1_noise_statistics &rhs );
+};
+
+class Afgs1_grain_estimation {
+
+public:
+    // The parameters are added to the database as a new table of parameter sets of the AR lag.  The database
+    // must outlive the estimation.
+    explicit Afgs1_grain_estimation( Afgs1_film_grain_database *database, int ar_coeff_lag = 3 );
+
+    // Flush the frames that have not been added to the database
+    ~Afgs1_grain_estimation();
+
+    Afgs1_grain_estimation( const Afgs1_grain_estimation& ) = delete;
+    Afgs1_grain_estimation& operator=( const Afgs1_grain_estimation& ) = delete;
+
+    // Analyze a frame presented from start_time to end_time, with its denoised version or NULL.  The frames
+    // are added in presentation order.  With a pool, the blocks of the frame are shared by its threads.  Returns
+    // false if the denoised frame does not have the size and bit depth of the frame, or the bit depth is not 8,
+    // 10 or 12.
+    bool add_frame( const Afgs1_frame &source, const Afgs1_frame *denoised, int64_t start_time, int64_t end_time,
+                    ThreadPool *pool = NULL );
+
+    // As above for num_frames frames in presentation order, with the arrays of their denoised versions (or NULL)
+    // and presentation times.  With a pool, the frames are shared by its threads.
+    bool add_frames( const Afgs1_frame *sources, const Afgs1_frame *denoised, const int64_t *start_times,
+                     const int64_t *end_times, int num_frames, ThreadPool *pool = NULL );
+
+    // Add the parameters of the frames analyzed since the last record to the database
+    void flush();
+
+    // Parameters of the frames analyzed since the last record.  Returns false if there are none.
+    bool get_params( Afgs1_film_grain_params *params ) const;
+
+    // Measure the noise of a frame.  With a pool, the blocks are shared by its threads.  The statistics do not
+    // depend on the number of threads.
+    void analyze_frame( const Afgs1_frame &source, const Afgs1_frame *denoised, ThreadPool *pool,
+                        Afgs1_noise_statistics *stats ) const;
+
+private:
+    // AR coefficients (in noise units) and innovation strength by intensity bin of statistics
+    struct noise_model {
+        double coeffs[3][AFGS1_ESTIMATION_MAX_COEFFS];
+        bool has_coeffs[3];
+        double strength[3][AFGS1_ESTIMATION_NUM_BINS];
+        double intensity[3][AFGS1_ESTIMATION_NUM_BINS];
+        bool has_bin[3][AFGS1_ESTIMATION_NUM_BINS];
+        double mean_strength[3];        // over all the bins, 0 without measurements
+    };
+
+    Afgs1_film_grain_database *database;
+    int ar_coeff_lag;
+    int num_pos;                        // neighbors of the luma AR filter
+    int table_idx;
+    uint16_t grain_seed;
+
+    // Frames since the last record
+    Afgs1_noise_statistics segment;
+    int segment_frames;
+    int64_t segment_start;
+    int64_t segment_end;
+    int width;
+    int height;
+    int bit_depth;
+
+    // Statistics of the frames of add_frames
+    std::vector<Afgs1_noise_statistics> frame_stats;
+
+    void solve_model( const Afgs1_noise_statistics &stats, noise_model *model ) const;
+    bool same_noise( const Afgs1_noise_statistics &frame ) const;
+    void add_statistics( const Afgs1_noise_statistics &stats, const Afgs1_frame &source, int64_t start_time,
+                         int64_t end_time );
+    void get_scaling_points( const noise_model &model, int plane, int scaling_shift, int (*points)[2],
+                             int max_points, int *num_points ) const;
+    void analyze_block_row( const Afgs1_frame &source, const Afgs1_frame *denoised, int block_row, int pass,
+                            const noise_model *model, Afgs1_noise_statistics *stats ) const;
+};
+
+#endif //AFGS1_ESTIMATION_H
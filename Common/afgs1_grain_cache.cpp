@@ -0,0 +1,169 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Grain cache class - Keeps the grain templates and scaling functions of recently used parameter sets.
+//
+
+#include <cstring>
+#include <algorithm>
+#include "afgs1_grain_cache.h"
+
+// Only the values that are used are part of the key, so that sets that differ in unused array entries (the
+// scaling points beyond their number, the coefficients beyond the AR lag) share their templates
+Afgs1_grain_key::Afgs1_grain_key( const Afgs1_film_grain_params &params, int bit_depth ) {
+
+    size = 0;
+    int num_y_points = std::max( 0, std::min( params.num_y_points, 14 ) );
+    int num_cb_points = std::max( 0, std::min( params.num_cb_points, 10 ) );
+    int num_cr_points = std::max( 0, std::min( params.num_cr_points, 10 ) );
+    int num_pos_luma = 2 * params.ar_coeff_lag * ( params.ar_coeff_lag + 1 );
+    num_pos_luma = std::max( 0, std::min( num_pos_luma, 24 ) );
+    bool cb_present = num_cb_points > 0 || params.chroma_scaling_from_luma;
+    bool cr_present = num_cr_points > 0 || params.chroma_scaling_from_luma;
+
+    values[size++] = bit_depth;
+    values[size++] = (uint16_t)params.grain_seed;
+    values[size++] = params.chroma_scaling_from_luma;
+    values[size++] = params.scaling_shift;
+    values[size++] = params.ar_coeff_lag;
+    values[size++] = params.ar_coeff_shift;
+    values[size++] = params.grain_scale_shift;
+    values[size++] = params.clip_to_restricted_range;
+    values[size++] = params.video_signal_characteristics_flag && params.matrix_coefficients == 0;
+
+    values[size++] = num_y_points;
+    for( int i = 0; i < num_y_points; i++ ) {
+        values[size++] = params.scaling_points_y[i][0];
+        values[size++] = params.scaling_points_y[i][1];
+    }
+    values[size++] = num_cb_points;
+    for( int i = 0; i < num_cb_points; i++ ) {
+        values[size++] = params.scaling_points_cb[i][0];
+        values[size++] = params.scaling_points_cb[i][1];
+    }
+    values[size++] = num_cr_points;
+    for( int i = 0; i < num_cr_points; i++ ) {
+        values[size++] = params.scaling_points_cr[i][0];
+        values[size++] = params.scaling_points_cr[i][1];
+    }
+
+    if( num_y_points > 0 ) {
+        for( int i = 0; i < num_pos_luma; i++ )
+            values[size++] = params.ar_coeffs_y[i];
+    }
+    if( cb_present ) {
+        for( int i = 0; i <= num_pos_luma; i++ )
+            values[size++] = params.ar_coeffs_cb[i];
+    }
+    if( cr_present ) {
+        for( int i = 0; i <= num_pos_luma; i++ )
+            values[size++] = params.ar_coeffs_cr[i];
+    }
+
+    if( !params.chroma_scaling_from_luma ) {
+        values[size++] = params.cb_mult;
+        values[size++] = params.cb_luma_mult;
+        values[size++] = params.cb_offset;
+        values[size++] = params.cr_mult;
+        values[size++] = params.cr_luma_mult;
+        values[size++] = params.cr_offset;
+    }
+
+    // 64-bit FNV-1a of the values
+    hash = 14695981039346656037ULL;
+    for( int i = 0; i < size; i++ ) {
+        uint32_t value = (uint32_t)values[i];
+        for( int byte = 0; byte < 4; byte++ ) {
+            hash ^= ( value >> ( 8 * byte ) ) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    }
+}
+
+bool Afgs1_grain_key::operator==( const Afgs1_grain_key &rhs ) const {
+    return hash == rhs.hash && size == rhs.size && !memcmp( values, rhs.values, size * sizeof(int) );
+}
+
+Afgs1_grain_cache::Afgs1_grain_cache( int capacity )
+        : capacity( std::max( capacity, 1 ) ), use_count( 0 ) {
+    entries.reserve( this->capacity );
+    memset( &stats, 0, sizeof(stats) );
+}
+
+int Afgs1_grain_cache::find( const Afgs1_grain_key &key ) const {
+    for( size_t i = 0; i < entries.size(); i++ )
+        if( entries[i].key == key )
+            return (int)i;
+    return -1;
+}
+
+// The templates of a miss are generated without holding the mutex, so that other threads are not blocked.  If
+// two threads miss the same key, the templates of the first one to finish are kept.
+std::shared_ptr<const Afgs1_grain_templates> Afgs1_grain_cache::get_templates( const Afgs1_film_grain_params &params,
+                                                                               int bit_depth ) {
+
+    Afgs1_grain_key key( params, bit_depth );
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        stats.lookups++;
+        int index = find( key );
+        if( index >= 0 ) {
+            stats.hits++;
+            entries[index].last_used = ++use_count;
+            return entries[index].templates;
+        }
+    }
+
+    std::shared_ptr<Afgs1_grain_templates> templates = std::make_shared<Afgs1_grain_templates>();
+    afgs1_generate_templates( params, bit_depth, templates.get() );
+
+    std::lock_guard<std::mutex> lock( mutex );
+    int index = find( key );
+    if( index >= 0 ) {
+        entries[index].last_used = ++use_count;
+        return entries[index].templates;
+    }
+
+    if( (int)entries.size() < capacity ) {
+        entry e = { key, templates, ++use_count };
+        entries.push_back( e );
+        return templates;
+    }
+
+    // Replace the least recently used entry
+    index = 0;
+    for( size_t i = 1; i < entries.size(); i++ )
+        if( entries[i].last_used < entries[index].last_used )
+            index = (int)i;
+    stats.evictions++;
+    entries[index].key = key;
+    entries[index].templates = templates;
+    entries[index].last_used = ++use_count;
+    return templates;
+}
+
+void Afgs1_grain_cache::clear() {
+    std::lock_guard<std::mutex> lock( mutex );
+    entries.clear();
+}
+
+Afgs1_grain_cache::statistics Afgs1_grain_cache::get_statistics() const {
+    std::lock_guard<std::mutex> lock( mutex );
+    return stats;
+}
+
+double Afgs1_grain_cache::get_hit_rate() const {
+    statistics s = get_statistics();
+    return s.lookups ? (double)s.hits / s.lookups : 0.0;
+}
+
+void Afgs1_grain_cache::print_statistics( FILE* fp ) const {
+    statistics s = get_statistics();
+    fprintf(fp, "Grain cache: %llu lookups, %llu hits (%.1f%%), %llu evictions\n", (unsigned long long)s.lookups,
+            (unsigned long long)s.hits, s.lookups ? 100.0 * s.hits / s.lookups : 0.0,
+            (unsigned long long)s.evictions);
+}
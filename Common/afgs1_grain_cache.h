@@ -0,0 +1,92 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Grain cache class - Keeps the grain templates and scaling functions of recently used parameter sets, so that
+// the frames (and the renditions of different resolutions) that use the same film grain characteristics and
+// grain seed share one generation of the templates.
+//
+// The templates are found by a hash of the parameters that determine them.  The resolution, the buffer slot,
+// the overlap flag and the other values that do not change the templates are not part of the key.  A cache may
+// be shared by synthesis objects used from different threads.
+//
+
+#ifndef AFGS1_GRAIN_CACHE_H
+#define AFGS1_GRAIN_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "afgs1_params.h"
+#include "afgs1_synthesis.h"
+
+#define AFGS1_GRAIN_CACHE_DEFAULT_CAPACITY 16
+
+// Values of the parameters that determine the templates: the bit depth, the grain seed, the scaling points, the
+// AR filter, the chroma scaling and the clipping range
+#define AFGS1_GRAIN_KEY_MAX_SIZE 161
+
+struct Afgs1_grain_key {
+    int values[AFGS1_GRAIN_KEY_MAX_SIZE];
+    int size;
+    uint64_t hash;
+
+    Afgs1_grain_key( const Afgs1_film_grain_params &params, int bit_depth );
+
+    bool operator==( const Afgs1_grain_key &rhs ) const;
+};
+
+class Afgs1_grain_cache {
+
+public:
+    // The cache keeps at most capacity templates and evicts the least recently used
+    explicit Afgs1_grain_cache( int capacity = AFGS1_GRAIN_CACHE_DEFAULT_CAPACITY );
+
+    Afgs1_grain_cache( const Afgs1_grain_cache& ) = delete;
+    Afgs1_grain_cache& operator=( const Afgs1_grain_cache& ) = delete;
+
+    // Return the templates of the parameters at a bit depth, generating them if they are not in the cache.  The
+    // templates remain valid after they are evicted for as long as the returned pointer is held.
+    std::shared_ptr<const Afgs1_grain_templates> get_templates( const Afgs1_film_grain_params &params,
+                                                                int bit_depth = 8 );
+
+    // Empty the cache.  The statistics are kept.
+    void clear();
+
+    struct statistics {
+        uint64_t lookups;
+        uint64_t hits;
+        uint64_t evictions;
+    };
+
+    statistics get_statistics() const;
+
+    // Fraction of the lookups found in the cache (0 before the first lookup)
+    double get_hit_rate() const;
+
+    // Print the statistics on one line
+    void print_statistics( FILE* fp ) const;
+
+private:
+    struct entry {
+        Afgs1_grain_key key;
+        std::shared_ptr<const Afgs1_grain_templates> templates;
+        uint64_t last_used;
+    };
+
+    int capacity;
+    std::vector<entry> entries;
+    uint64_t use_count;
+    statistics stats;
+    mutable std::mutex mutex;
+
+    // Entry of the key, or -1.  The mutex must be held.
+    int find( const Afgs1_grain_key &key ) const;
+};
+
+#endif //AFGS1_GRAIN_CACHE_H
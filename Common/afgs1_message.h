@@ -0,0 +1,217 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Message class - Selects the film grain parameters of an AFGS1 message for a picture from the
+// database and signals them against a model of the AFGS1 buffer of a decoder.  The class does
+// not depend on the video format that carries the message.
+//
+
+#ifndef AFGS1_MESSAGE_H
+#define AFGS1_MESSAGE_H
+
+#include <list>
+#include <vector>
+#include <cstdint>
+#include "afgs1_buffer.h"
+#include "afgs1_database.h"
+#include "afgs1_bitstream.h"
+
+// Presentation time of a frame in the units of the "filmgrn1" parameter file (1/10000000 seconds), for
+// a frame rate of numerator / denominator
+inline int64_t afgs1_frame_time( int64_t frame, int numerator, int denominator )
+{
+    return frame * 10000000LL * denominator / numerator;
+}
+
+// The message holds its parameter sets in a fixed array, so that creating and writing a message does not
+// allocate memory.
+class Afgs1_message {
+
+protected:
+    Afgs1_film_grain_params param_sets[AFGS1_MAX_PARAM_SETS];
+    int num_param_sets;
+    int num_database_sets;      // sets found in the database, which may exceed AFGS1_MAX_PARAM_SETS
+
+public:
+
+    // Create the list of one or more film grain parameters from the database corresponding to the input
+    // presentation time.
+    Afgs1_message( const Afgs1_film_grain_database *afgs1_db, int64_t time )
+    {
+        num_database_sets = afgs1_db->find_frames( time, param_sets, AFGS1_MAX_PARAM_SETS );
+        num_param_sets = std::min( num_database_sets, AFGS1_MAX_PARAM_SETS );
+    }
+
+    // Create the list of one or more film grain parameters from the database corresponding to the input
+    // presentation time.  Additionally, update the film grain parameters based on the status of the buffer
+    // (that emulates the AFGS1 buffer at a decoder).  For example, the film grain parameters that already
+    // exist in the buffer can be signaled by setting the update_parameters flag to 0.  Parameters that are
+    // not in the buffer are assigned a slot using the slot allocation policy.  When refresh_interval is
+    // non-zero, buffered parameters that were last sent refresh_interval or more pictures ago are sent again
+    // in the same slot, so that a decoder joining the stream acquires them within the interval.
+    Afgs1_message( const Afgs1_film_grain_database *afgs1_db, int64_t time, Afgs1_buffer buffer,
+                   Afgs1_slot_policy policy = AFGS1_SLOT_POLICY_FIXED, int refresh_interval = 0 )
+            : Afgs1_message( afgs1_db, time )
+    {
+        // Reference the parameters that are already in the buffer.  Sets that are assigned a slot here are
+        // recorded (by position in the list) in assigned_mask.
+        unsigned reserved_mask = 0;
+        unsigned assigned_mask = 0;
+        for( int position = 0; position < num_param_sets; position++ )
+        {
+            Afgs1_film_grain_params *it = &param_sets[position];
+            int index = ( policy == AFGS1_SLOT_POLICY_FIXED ) ? buffer.find_params( *it ) : buffer.find_content( *it );
+            if( index >= 0 && it->apply_grain ) {
+                int64_t age = buffer.get_time() - buffer.get_update_time( index );
+                if( refresh_interval > 0 && age >= refresh_interval ) {
+                    it->film_grain_param_set_idx = index;
+                    reserved_mask |= 1u << index;
+                    assigned_mask |= 1u << position;
+                    num_refreshed_sets++;
+                    continue;
+                }
+                if( age > max_reference_age )
+                    max_reference_age = age;
+
+                int full_size = film_grain_payload_size( it );
+                it->film_grain_param_set_idx = index;
+                it->update_parameters = 0;
+                reserved_mask |= 1u << index;
+                assigned_mask |= 1u << position;
+
+                num_referenced_sets++;
+                full_update_bytes_avoided += full_size - film_grain_payload_size( it );
+            }
+        }
+
+        if( policy == AFGS1_SLOT_POLICY_FIXED )
+            return;
+
+        // Assign slots to the remaining parameters.  The next use is only needed for the slots that may be
+        // replaced: empty slots are taken first and reserved slots are never replaced.
+        int64_t next_use[AFGS1_MAX_BUFFERSIZE];
+        if( policy == AFGS1_SLOT_POLICY_OPTIMAL && assigned_mask != ( 1u << num_param_sets ) - 1 ) {
+            for( int i = 0; i < AFGS1_MAX_BUFFERSIZE; i++ ) {
+                const Afgs1_film_grain_params slot = buffer.get_params(i);
+                if( ( reserved_mask & (1u << i) ) || slot.apply_grain != 1 )
+                    next_use[i] = INT64_MAX;
+                else
+                    next_use[i] = afgs1_db->next_use( slot, time + 1 );
+            }
+        }
+
+        for( int position = 0; position < num_param_sets; position++ )
+        {
+            if( assigned_mask & (1u << position) )
+                continue;
+
+            Afgs1_film_grain_params *it = &param_sets[position];
+            int index = buffer.allocate_slot( *it, policy, reserved_mask,
+                                              ( policy == AFGS1_SLOT_POLICY_OPTIMAL ) ? next_use : NULL );
+            it->film_grain_param_set_idx = index;
+            reserved_mask |= 1u << index;
+        }
+    }
+
+    // Number of parameter sets signaled with update_parameters equal to 0 and the bytes saved by doing so
+    int num_referenced_sets = 0;
+    int full_update_bytes_avoided = 0;
+
+    // Number of buffered parameter sets sent again because of the refresh interval, and the largest number of
+    // pictures since the last full update of a referenced set
+    int num_refreshed_sets = 0;
+    int64_t max_reference_age = 0;
+
+    // Determine if this message signals the same film grain as the parameter sets in state, i.e. the same
+    // characteristics and grain seed for every resolution.  The buffer slots used for signaling are not
+    // considered.
+    bool same_grain_state( const std::list<Afgs1_film_grain_params> &state ) const
+    {
+        if( (int)state.size() != num_param_sets )
+            return false;
+
+        std::list<Afgs1_film_grain_params>::const_iterator a = state.begin();
+        for( int i = 0; i < num_param_sets; ++a, ++i )
+        {
+            const Afgs1_film_grain_params *b = &param_sets[i];
+            if( !a->content_equal( *b ) || ( a->apply_grain && a->grain_seed != b->grain_seed ) )
+                return false;
+        }
+        return true;
+    }
+
+    std::list<Afgs1_film_grain_params> get_param_sets() const
+    {
+        return std::list<Afgs1_film_grain_params>( param_sets, param_sets + num_param_sets );
+    }
+
+    // Number of parameter sets of the message, and of the parameter sets found in the database for its time.
+    // Only the first AFGS1_MAX_PARAM_SETS sets can be signaled.
+    int get_num_param_sets() const
+    {
+        return num_param_sets;
+    }
+
+    int get_num_database_sets() const
+    {
+        return num_database_sets;
+    }
+
+    // Number of parameter sets that will be stored in the buffer by this message
+    int num_full_updates() const
+    {
+        int count = 0;
+        for( int i = 0; i < num_param_sets; i++ )
+            count += ( param_sets[i].apply_grain && param_sets[i].update_parameters ) ? 1 : 0;
+        return count;
+    }
+
+    // Update the AFGS1 buffer using the SEI data
+    void update_buffer( Afgs1_buffer *buffer ) const
+    {
+        for( int i = 0; i < num_param_sets; i++ )
+        {
+            buffer->update_buffer( param_sets[i] );
+        }
+    }
+
+    // Update the grain seed based on the picture number (for example the POC).  The grain seed in the database
+    // is constant for each entry, so this is used to vary the grain pattern from picture to picture.  The
+    // 16-bit seed is taken as unsigned, and the result is in [0, 65534] for negative picture numbers as well.
+    void update_grain_seed( int64_t poc )
+    {
+        for( int i = 0; i < num_param_sets; i++ )
+        {
+            int64_t seed = ( (uint16_t)param_sets[i].grain_seed + poc ) % ( (1<<16) - 1);
+            if( seed < 0 )
+                seed += (1<<16) - 1;
+            param_sets[i].grain_seed = (short)seed;
+        }
+    }
+
+    // Write the ITU-T T.35 payload of the message, i.e. the bytes that follow the country code.  Returns false
+    // if the film grain parameters of the time do not conform (see write_film_grain_param_sets).
+    bool write_t35_payload( std::vector<uint8_t> *payload ) const
+    {
+        if( num_database_sets > AFGS1_MAX_PARAM_SETS )
+            return false;
+        std::list<Afgs1_film_grain_params> sets = get_param_sets();
+        return write_afgs1_t35_payload( &sets, payload );
+    }
+
+    // As above into a buffer of the caller, without memory allocation.  Returns the payload size, or -1 if
+    // the message cannot be written or does not fit the buffer.
+    int write_t35_payload( uint8_t *payload, size_t capacity ) const
+    {
+        if( num_database_sets > AFGS1_MAX_PARAM_SETS )
+            return -1;
+        return write_afgs1_t35_payload( param_sets, num_param_sets, payload, capacity );
+    }
+
+};
+
+#endif
@@ -15,6 +15,7 @@
 #include <cstdlib>
 #include <cstdarg>
 #include <cinttypes>
+#include <cstring>
 
 // Helper Functions
 int error_info = 0;
@@ -25,12 +26,14 @@ void aom_internal_error(int a, int b, const char* fmt, ...)
     va_start(argptr, fmt);
     vfprintf(stderr, fmt, argptr);
     va_end(argptr);
-    exit(1);
+    fprintf(stderr, "\n");
 };
 
 Afgs1_film_grain_params::Afgs1_film_grain_params() {
 
-    apply_grain = 0;
+    // The fields that are not read from a "filmgrn1" file (for example luma_only_flag and
+    // clip_to_restricted_range) are zero, and the parameters compare equal to their copies.
+    memset( this, 0, sizeof(*this) );
 
 };
 
@@ -55,18 +58,18 @@ Afgs1_film_grain_params::Afgs1_film_grain_params() {
 *  cCr <ar_coeff_cr_0> ....
 * E <start-time> ...
 */
-void Afgs1_film_grain_params::load_params(FILE* file, int64_t* start_time, int64_t* end_time){
+bool Afgs1_film_grain_params::load_params(FILE* file, int64_t* start_time, int64_t* end_time){
 
      Afgs1_film_grain_params *pars = this;
 
     int num_read = fscanf(file, "E %" PRId64 " %" PRId64 " %d %hd %d\n", start_time,
                           end_time, &pars->apply_grain, &pars->grain_seed,
                           &pars->update_parameters);
-    if (num_read == 0 && feof(file)) return;
+    if (num_read == 0 && feof(file)) return true;
     if (num_read != 5) {
         aom_internal_error(error_info, AOM_CODEC_ERROR,
                            "Unable to read entry header. Read %d != 5", num_read);
-        return;
+        return false;
     }
     if (pars->update_parameters) {
         num_read = fscanf(file, "p %d %d %d %d %d %d %d %d %d %d %d %d\n",
@@ -79,95 +82,109 @@ void Afgs1_film_grain_params::load_params(FILE* file, int64_t* start_time, int64
             aom_internal_error(error_info, AOM_CODEC_ERROR,
                                "Unable to read entry params. Read %d != 12",
                                num_read);
-            return;
+            return false;
         }
-        if (!fscanf(file, "\tsY %d ", &pars->num_y_points)) {
+        if (pars->ar_coeff_lag < 0 || pars->ar_coeff_lag > 3) {
+            aom_internal_error(error_info, AOM_CODEC_ERROR,
+                               "Invalid ar_coeff_lag %d", pars->ar_coeff_lag);
+            return false;
+        }
+        if (1 != fscanf(file, "\tsY %d ", &pars->num_y_points) ||
+            pars->num_y_points < 0 || pars->num_y_points > 14) {
             aom_internal_error(error_info, AOM_CODEC_ERROR,
                                "Unable to read num y points");
-            return;
+            return false;
         }
         for (int i = 0; i < pars->num_y_points; ++i) {
             if (2 != fscanf(file, "%d %d", &pars->scaling_points_y[i][0],
                             &pars->scaling_points_y[i][1])) {
                 aom_internal_error(error_info, AOM_CODEC_ERROR,
                                    "Unable to read y scaling points");
-                return;
+                return false;
             }
         }
-        if (!fscanf(file, "\n\tsCb %d", &pars->num_cb_points)) {
+        if (1 != fscanf(file, "\n\tsCb %d", &pars->num_cb_points) ||
+            pars->num_cb_points < 0 || pars->num_cb_points > 10) {
             aom_internal_error(error_info, AOM_CODEC_ERROR,
                                "Unable to read num cb points");
-            return;
+            return false;
         }
         for (int i = 0; i < pars->num_cb_points; ++i) {
             if (2 != fscanf(file, "%d %d", &pars->scaling_points_cb[i][0],
                             &pars->scaling_points_cb[i][1])) {
                 aom_internal_error(error_info, AOM_CODEC_ERROR,
                                    "Unable to read cb scaling points");
-                return;
+                return false;
             }
         }
-        if (!fscanf(file, "\n\tsCr %d", &pars->num_cr_points)) {
+        if (1 != fscanf(file, "\n\tsCr %d", &pars->num_cr_points) ||
+            pars->num_cr_points < 0 || pars->num_cr_points > 10) {
             aom_internal_error(error_info, AOM_CODEC_ERROR,
                                "Unable to read num cr points");
-            return;
+            return false;
         }
         for (int i = 0; i < pars->num_cr_points; ++i) {
             if (2 != fscanf(file, "%d %d", &pars->scaling_points_cr[i][0],
                             &pars->scaling_points_cr[i][1])) {
                 aom_internal_error(error_info, AOM_CODEC_ERROR,
                                    "Unable to read cr scaling points");
-                return;
+                return false;
             }
         }
 
         if (fscanf(file, "\n\tcY")) {
             aom_internal_error(error_info, AOM_CODEC_ERROR,
                                "Unable to read Y coeffs header (cY)");
-            return;
+            return false;
         }
         const int n = 2 * pars->ar_coeff_lag * (pars->ar_coeff_lag + 1);
         for (int i = 0; i < n; ++i) {
             if (1 != fscanf(file, "%d", &pars->ar_coeffs_y[i])) {
                 aom_internal_error(error_info, AOM_CODEC_ERROR,
                                    "Unable to read Y coeffs");
-                return;
+                return false;
             }
         }
         if (fscanf(file, "\n\tcCb")) {
             aom_internal_error(error_info, AOM_CODEC_ERROR,
                                "Unable to read Cb coeffs header (cCb)");
-            return;
+            return false;
         }
         for (int i = 0; i <= n; ++i) {
             if (1 != fscanf(file, "%d", &pars->ar_coeffs_cb[i])) {
                 aom_internal_error(error_info, AOM_CODEC_ERROR,
                                    "Unable to read Cb coeffs");
-                return;
+                return false;
             }
         }
         if (fscanf(file, "\n\tcCr")) {
             aom_internal_error(error_info, AOM_CODEC_ERROR,
                                "Unable read to Cr coeffs header (cCr)");
-            return;
+            return false;
         }
         for (int i = 0; i <= n; ++i) {
             if (1 != fscanf(file, "%d", &pars->ar_coeffs_cr[i])) {
                 aom_internal_error(error_info, AOM_CODEC_ERROR,
                                    "Unable to read Cr coeffs");
-                return;
+                return false;
             }
         }
         (void)fscanf(file, "\n");
     }
 
+    return true;
 }
 
 bool Afgs1_film_grain_params::operator==(const Afgs1_film_grain_params &rhs) const {
-    if( film_grain_param_set_idx == rhs.film_grain_param_set_idx &&
-           apply_grain == rhs.apply_grain &&
-           //grain_seed == rhs.grain_seed &&
+    return film_grain_param_set_idx == rhs.film_grain_param_set_idx &&
            update_parameters == rhs.update_parameters &&
+           content_equal(rhs);
+}
+
+// Compare the film grain characteristics of two parameter sets.  The buffer slot (film_grain_param_set_idx),
+// the grain seed and the update_parameters flag are not considered.
+bool Afgs1_film_grain_params::content_equal(const Afgs1_film_grain_params &rhs) const {
+    if( apply_grain == rhs.apply_grain &&
            apply_horz_resolution == rhs.apply_horz_resolution &&
            apply_vert_resolution == rhs.apply_vert_resolution &&
            luma_only_flag == rhs.luma_only_flag &&
@@ -236,6 +253,50 @@ bool Afgs1_film_grain_params::operator==(const Afgs1_film_grain_params &rhs) con
     return 0;
 }
 
+// 64-bit FNV-1a of the values compared by content_equal
+uint64_t Afgs1_film_grain_params::content_hash() const {
+
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash]( int value ) {
+        for( int byte = 0; byte < 4; byte++ ) {
+            hash ^= ( (uint32_t)value >> ( 8 * byte ) ) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    const int header[] = { apply_grain, apply_horz_resolution, apply_vert_resolution, luma_only_flag,
+                           subsampling_x, subsampling_y, video_signal_characteristics_flag, bit_depth,
+                           color_primaries, transfer_characteristics, matrix_coefficients, video_full_range_flag,
+                           num_y_points, num_cb_points, num_cr_points, scaling_shift, ar_coeff_lag, ar_coeff_shift,
+                           cb_mult, cb_luma_mult, cb_offset, cr_mult, cr_luma_mult, cr_offset, overlap_flag,
+                           clip_to_restricted_range, chroma_scaling_from_luma, grain_scale_shift };
+    for( int value: header )
+        add( value );
+
+    for( int i = 0; i < num_y_points; i++ ) {
+        add( scaling_points_y[i][0] );
+        add( scaling_points_y[i][1] );
+    }
+    for( int i = 0; i < num_cb_points; i++ ) {
+        add( scaling_points_cb[i][0] );
+        add( scaling_points_cb[i][1] );
+    }
+    for( int i = 0; i < num_cr_points; i++ ) {
+        add( scaling_points_cr[i][0] );
+        add( scaling_points_cr[i][1] );
+    }
+
+    int numPosLuma = 2 * ar_coeff_lag * (ar_coeff_lag + 1);
+    int numPosChroma = (num_y_points ) ? numPosLuma + 1 : numPosLuma;
+    for( int i = 0; i < numPosLuma; i++ )
+        add( ar_coeffs_y[i] );
+    for( int i = 0; i < numPosChroma; i++ ) {
+        add( ar_coeffs_cb[i] );
+        add( ar_coeffs_cr[i] );
+    }
+    return hash;
+}
+
 bool Afgs1_film_grain_params::operator!=(const Afgs1_film_grain_params &rhs) const {
     return !(rhs == *this);
 };
@@ -87,11 +87,18 @@ public:
 public:
     Afgs1_film_grain_params();
 
-    void load_params(FILE* fp, int64_t* start_time, int64_t* end_time);
+    // Read the next entry of a "filmgrn1" file.  Returns false, after reporting the error on stderr, if the
+    // entry is malformed or its values exceed the sizes of the parameter arrays.
+    bool load_params(FILE* fp, int64_t* start_time, int64_t* end_time);
 
     bool operator==(const Afgs1_film_grain_params &rhs) const;
 
     bool operator!=(const Afgs1_film_grain_params &rhs) const;
 
+    bool content_equal(const Afgs1_film_grain_params &rhs) const;
+
+    // Hash of the values compared by content_equal, so that parameters with the same content have the same hash
+    uint64_t content_hash() const;
+
 };
 #endif //AFGS_T35_AFG1_PARAMS_H
\ No newline at end of file
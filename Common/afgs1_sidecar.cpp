@@ -0,0 +1,105 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Sidecar file - Stores the AFGS1 payloads of a range of frames with an index, so that the payload of any
+// frame can be located in constant time in a memory mapped file.
+//
+
+#include "afgs1_sidecar.h"
+#include <cstdio>
+#include <cstring>
+
+static const char kSidecarMagic[9] = "afgs1idx";
+
+static void put_le( std::vector<uint8_t> *data, uint64_t value, int bytes ) {
+    for( int i = 0; i < bytes; i++ )
+        data->push_back( ( value >> ( 8 * i ) ) & 0xff );
+}
+
+static uint64_t get_le( const uint8_t* p, int bytes ) {
+    uint64_t value = 0;
+    for( int i = bytes - 1; i >= 0; i-- )
+        value = ( value << 8 ) | p[i];
+    return value;
+}
+
+Afgs1_sidecar_writer::Afgs1_sidecar_writer( int64_t first_frame, int frame_rate_num, int frame_rate_denom )
+: first_frame(first_frame)
+, frame_rate_num(frame_rate_num)
+, frame_rate_denom(frame_rate_denom)
+{
+}
+
+void Afgs1_sidecar_writer::add_frame( const std::vector<uint8_t> &payload ) {
+
+    // The payload usually persists over many frames, so a repeated payload is stored once
+    if( !entries.empty() && entries.back().size == payload.size() &&
+        ( payload.empty() || !memcmp( &payload_data[entries.back().offset], payload.data(), payload.size() ) ) ) {
+        entries.push_back( entries.back() );
+        return;
+    }
+
+    entry e = { payload_data.size(), (uint32_t)payload.size() };
+    payload_data.insert( payload_data.end(), payload.begin(), payload.end() );
+    entries.push_back( e );
+}
+
+bool Afgs1_sidecar_writer::write( const char* fname ) const {
+
+    std::vector<uint8_t> header;
+    header.insert( header.end(), kSidecarMagic, kSidecarMagic + 8 );
+    put_le( &header, AFGS1_SIDECAR_VERSION, 4 );
+    put_le( &header, entries.size(), 4 );
+    put_le( &header, (uint64_t)first_frame, 8 );
+    put_le( &header, frame_rate_num, 4 );
+    put_le( &header, frame_rate_denom, 4 );
+
+    // The offsets of the entries are relative to the start of the file
+    uint64_t data_offset = AFGS1_SIDECAR_HEADER_SIZE + (uint64_t)entries.size() * AFGS1_SIDECAR_ENTRY_SIZE;
+    for( size_t i = 0; i < entries.size(); i++ ) {
+        put_le( &header, data_offset + entries[i].offset, 8 );
+        put_le( &header, entries[i].size, 4 );
+        put_le( &header, 0, 4 );
+    }
+
+    FILE *fp = fopen( fname, "wb" );
+    if( fp == NULL )
+        return false;
+    bool ok = fwrite( header.data(), 1, header.size(), fp ) == header.size() &&
+              fwrite( payload_data.data(), 1, payload_data.size(), fp ) == payload_data.size();
+    return fclose( fp ) == 0 && ok;
+}
+
+bool afgs1_sidecar_find( const uint8_t* data, size_t size, int64_t frame, const uint8_t** payload, size_t* payload_size ) {
+
+    if( size < AFGS1_SIDECAR_HEADER_SIZE || memcmp( data, kSidecarMagic, 8 ) ||
+        get_le( data + 8, 4 ) != AFGS1_SIDECAR_VERSION )
+        return false;
+
+    // The index is taken as unsigned, as the difference of the frame numbers may not fit int64_t
+    uint64_t num_frames = get_le( data + 12, 4 );
+    int64_t first_frame = (int64_t)get_le( data + 16, 8 );
+    if( frame < first_frame )
+        return false;
+    uint64_t index = (uint64_t)frame - (uint64_t)first_frame;
+    if( index >= num_frames )
+        return false;
+
+    // The entry is located only once it is known to be within the data
+    uint64_t entry_offset = AFGS1_SIDECAR_HEADER_SIZE + index * AFGS1_SIDECAR_ENTRY_SIZE;
+    if( entry_offset > size || size - entry_offset < AFGS1_SIDECAR_ENTRY_SIZE )
+        return false;
+    const uint8_t *e = data + entry_offset;
+    uint64_t offset = get_le( e, 8 );
+    uint64_t length = get_le( e + 8, 4 );
+    if( offset > size || length > size - offset )
+        return false;
+
+    *payload = data + offset;
+    *payload_size = (size_t)length;
+    return true;
+}
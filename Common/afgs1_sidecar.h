@@ -0,0 +1,67 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Sidecar file - Stores the AFGS1 payloads of a range of frames with an index, so that the payload of any
+// frame can be located in constant time in a memory mapped file.
+//
+// All values are little-endian.  The file starts with a header of AFGS1_SIDECAR_HEADER_SIZE bytes:
+//
+//   offset  size  field
+//    0      8     magic "afgs1idx"
+//    8      4     version (AFGS1_SIDECAR_VERSION)
+//   12      4     number of frames
+//   16      8     first frame number (signed)
+//   24      4     frame rate numerator
+//   28      4     frame rate denominator
+//
+// The header is followed by one entry of AFGS1_SIDECAR_ENTRY_SIZE bytes per frame: the offset of the payload
+// from the start of the file (8 bytes), its length in bytes (4 bytes) and 4 reserved zero bytes.  The payloads
+// follow the entries.  A frame without film grain parameters has a length of zero, and consecutive frames
+// with identical payloads share the same bytes.
+//
+
+#ifndef AFGS1_SIDECAR_H
+#define AFGS1_SIDECAR_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define AFGS1_SIDECAR_VERSION     1
+#define AFGS1_SIDECAR_HEADER_SIZE 32
+#define AFGS1_SIDECAR_ENTRY_SIZE  16
+
+class Afgs1_sidecar_writer {
+
+public:
+    Afgs1_sidecar_writer( int64_t first_frame, int frame_rate_num, int frame_rate_denom );
+
+    // Add the payload of the next frame
+    void add_frame( const std::vector<uint8_t> &payload );
+
+    // Write the sidecar file.  Returns false if the file cannot be written.
+    bool write( const char* fname ) const;
+
+private:
+    struct entry {
+        uint64_t offset;    // offset in payload_data
+        uint32_t size;
+    };
+
+    int64_t first_frame;
+    int frame_rate_num;
+    int frame_rate_denom;
+    std::vector<entry> entries;
+    std::vector<uint8_t> payload_data;
+
+};
+
+// Locate the payload of a frame in a sidecar file held in memory.  Returns false if the data is not a valid
+// sidecar or the frame is outside of its range.
+bool afgs1_sidecar_find( const uint8_t* data, size_t size, int64_t frame, const uint8_t** payload, size_t* payload_size );
+
+#endif
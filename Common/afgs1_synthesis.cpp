@@ -0,0 +1,723 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Synthesis class - Film grain synthesis process of the AV1 specification (section 7.18.3)
+// for 4:2:0 frames of 8, 10 and 12-bit samples.
+//
+
+#include "afgs1_synthesis.h"
+#include "afgs1_grain_cache.h"
+#include <cstring>
+#include <algorithm>
+#if defined(AFGS1_X86_SIMD) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Gaussian_Sequence of the AV1 specification: 2048 samples of a Gaussian distribution (mean 0, standard
+// deviation about 512)
+static const int16_t gaussian_sequence[2048] = {
+    56, 568, -180, 172, 124, -84, 172, -64, -900, 24, 820, 224, 1248, 996, 272, -8,
+    -916, -388, -732, -104, -188, 800, 112, -652, -320, -376, 140, -252, 492, -168, 44, -788,
+    588, -584, 500, -228, 12, 680, 272, -476, 972, -100, 652, 368, 432, -196, -720, -192,
+    1000, -332, 652, -136, -552, -604, -4, 192, -220, -136, 1000, -52, 372, -96, -624, 124,
+    -24, 396, 540, -12, -104, 640, 464, 244, -208, -84, 368, -528, -740, 248, -968, -848,
+    608, 376, -60, -292, -40, -156, 252, -292, 248, 224, -280, 400, -244, 244, -60, 76,
+    -80, 212, 532, 340, 128, -36, 824, -352, -60, -264, -96, -612, 416, -704, 220, -204,
+    640, -160, 1220, -408, 900, 336, 20, -336, -96, -792, 304, 48, -28, -1232, -1172, -448,
+    104, -292, -520, 244, 60, -948, 0, -708, 268, 108, 356, -548, 488, -344, -136, 488,
+    -196, -224, 656, -236, -1128, 60, 4, 140, 276, -676, -376, 168, -108, 464, 8, 564,
+    64, 240, 308, -300, -400, -456, -136, 56, 120, -408, -116, 436, 504, -232, 328, 844,
+    -164, -84, 784, -168, 232, -224, 348, -376, 128, 568, 96, -1244, -288, 276, 848, 832,
+    -360, 656, 464, -384, -332, -356, 728, -388, 160, -192, 468, 296, 224, 140, -776, -100,
+    280, 4, 196, 44, -36, -648, 932, 16, 1428, 28, 528, 808, 772, 20, 268, 88,
+    -332, -284, 124, -384, -448, 208, -228, -1044, -328, 660, 380, -148, -300, 588, 240, 540,
+    28, 136, -88, -436, 256, 296, -1000, 1400, 0, -48, 1056, -136, 264, -528, -1108, 632,
+    -484, -592, -344, 796, 124, -668, -768, 388, 1296, -232, -188, -200, -288, -4, 308, 100,
+    -168, 256, -500, 204, -508, 648, -136, 372, -272, -120, -1004, -552, -548, -384, 548, -296,
+    428, -108, -8, -912, -324, -224, -88, -112, -220, -100, 996, -796, 548, 360, -216, 180,
+    428, -200, -212, 148, 96, 148, 284, 216, -412, -320, 120, -300, -384, -604, -572, -332,
+    -8, -180, -176, 696, 116, -88, 628, 76, 44, -516, 240, -208, -40, 100, -592, 344,
+    -308, -452, -228, 20, 916, -1752, -136, -340, -804, 140, 40, 512, 340, 248, 184, -492,
+    896, -156, 932, -628, 328, -688, -448, -616, -752, -100, 560, -1020, 180, -800, -64, 76,
+    576, 1068, 396, 660, 552, -108, -28, 320, -628, 312, -92, -92, -472, 268, 16, 560,
+    516, -672, -52, 492, -100, 260, 384, 284, 292, 304, -148, 88, -152, 1012, 1064, -228,
+    164, -376, -684, 592, -392, 156, 196, -524, -64, -884, 160, -176, 636, 648, 404, -396,
+    -436, 864, 424, -728, 988, -604, 904, -592, 296, -224, 536, -176, -920, 436, -48, 1176,
+    -884, 416, -776, -824, -884, 524, -548, -564, -68, -164, -96, 692, 364, -692, -1012, -68,
+    260, -480, 876, -1116, 452, -332, -352, 892, -1088, 1220, -676, 12, -292, 244, 496, 372,
+    -32, 280, 200, 112, -440, -96, 24, -644, -184, 56, -432, 224, -980, 272, -260, 144,
+    -436, 420, 356, 364, -528, 76, 172, -744, -368, 404, -752, -416, 684, -688, 72, 540,
+    416, 92, 444, 480, -72, -1416, 164, -1172, -68, 24, 424, 264, 1040, 128, -912, -524,
+    -356, 64, 876, -12, 4, -88, 532, 272, -524, 320, 276, -508, 940, 24, -400, -120,
+    756, 60, 236, -412, 100, 376, -484, 400, -100, -740, -108, -260, 328, -268, 224, -200,
+    -416, 184, -604, -564, -20, 296, 60, 892, -888, 60, 164, 68, -760, 216, -296, 904,
+    -336, -28, 404, -356, -568, -208, -1480, -512, 296, 328, -360, -164, -1560, -776, 1156, -428,
+    164, -504, -112, 120, -216, -148, -264, 308, 32, 64, -72, 72, 116, 176, -64, -272,
+    460, -536, -784, -280, 348, 108, -752, -132, 524, -540, -776, 116, -296, -1196, -288, -560,
+    1040, -472, 116, -848, -1116, 116, 636, 696, 284, -176, 1016, 204, -864, -648, -248, 356,
+    972, -584, -204, 264, 880, 528, -24, -184, 116, 448, -144, 828, 524, 212, -212, 52,
+    12, 200, 268, -488, -404, -880, 824, -672, -40, 908, -248, 500, 716, -576, 492, -576,
+    16, 720, -108, 384, 124, 344, 280, 576, -500, 252, 104, -308, 196, -188, -8, 1268,
+    296, 1032, -1196, 436, 316, 372, -432, -200, -660, 704, -224, 596, -132, 268, 32, -452,
+    884, 104, -1008, 424, -1348, -280, 4, -1168, 368, 476, 696, 300, -8, 24, 180, -592,
+    -196, 388, 304, 500, 724, -160, 244, -84, 272, -256, -420, 320, 208, -144, -156, 156,
+    364, 452, 28, 540, 316, 220, -644, -248, 464, 72, 360, 32, -388, 496, -680, -48,
+    208, -116, -408, 60, -604, -392, 548, -840, 784, -460, 656, -544, -388, -264, 908, -800,
+    -628, -612, -568, 572, -220, 164, 288, -16, -308, 308, -112, -636, -760, 280, -668, 432,
+    364, 240, -196, 604, 340, 384, 196, 592, -44, -500, 432, -580, -132, 636, -76, 392,
+    4, -412, 540, 508, 328, -356, -36, 16, -220, -64, -248, -60, 24, -192, 368, 1040,
+    92, -24, -1044, -32, 40, 104, 148, 192, -136, -520, 56, -816, -224, 732, 392, 356,
+    212, -80, -424, -1008, -324, 588, -1496, 576, 460, -816, -848, 56, -580, -92, -1372, -112,
+    -496, 200, 364, 52, -140, 48, -48, -60, 84, 72, 40, 132, -356, -268, -104, -284,
+    -404, 732, -520, 164, -304, -540, 120, 328, -76, -460, 756, 388, 588, 236, -436, -72,
+    -176, -404, -316, -148, 716, -604, 404, -72, -88, -888, -68, 944, 88, -220, -344, 960,
+    472, 460, -232, 704, 120, 832, -228, 692, -508, 132, -476, 844, -748, -364, -44, 1116,
+    -1104, -1056, 76, 428, 552, -692, 60, 356, 96, -384, -188, -612, -576, 736, 508, 892,
+    352, -1132, 504, -24, -352, 324, 332, -600, -312, 292, 508, -144, -8, 484, 48, 284,
+    -260, -240, 256, -100, -292, -204, -44, 472, -204, 908, -188, -1000, -256, 92, 1164, -392,
+    564, 356, 652, -28, -884, 256, 484, -192, 760, -176, 376, -524, -452, -436, 860, -736,
+    212, 124, 504, -476, 468, 76, -472, 552, -692, -944, -620, 740, -240, 400, 132, 20,
+    192, -196, 264, -668, -1012, -60, 296, -316, -828, 76, -156, 284, -768, -448, -832, 148,
+    248, 652, 616, 1236, 288, -328, -400, -124, 588, 220, 520, -696, 1032, 768, -740, -92,
+    -272, 296, 448, -464, 412, -200, 392, 440, -200, 264, -152, -260, 320, 1032, 216, 320,
+    -8, -64, 156, -1016, 1084, 1172, 536, 484, -432, 132, 372, -52, -256, 84, 116, -352,
+    48, 116, 304, -384, 412, 924, -300, 528, 628, 180, 648, 44, -980, -220, 1320, 48,
+    332, 748, 524, -268, -720, 540, -276, 564, -344, -208, -196, 436, 896, 88, -392, 132,
+    80, -964, -288, 568, 56, -48, -456, 888, 8, 552, -156, -292, 948, 288, 128, -716,
+    -292, 1192, -152, 876, 352, -600, -260, -812, -468, -28, -120, -32, -44, 1284, 496, 192,
+    464, 312, -76, -516, -380, -456, -1012, -48, 308, -156, 36, 492, -156, -808, 188, 1652,
+    68, -120, -116, 316, 160, -140, 352, 808, -416, 592, 316, -480, 56, 528, -204, -568,
+    372, -232, 752, -344, 744, -4, 324, -416, -600, 768, 268, -248, -88, -132, -420, -432,
+    80, -288, 404, -316, -1216, -588, 520, -108, 92, -320, 368, -480, -216, -92, 1688, -300,
+    180, 1020, -176, 820, -68, -228, -260, 436, -904, 20, 40, -508, 440, -736, 312, 332,
+    204, 760, -372, 728, 96, -20, -632, -520, -560, 336, 1076, -64, -532, 776, 584, 192,
+    396, -728, -520, 276, -188, 80, -52, -612, -252, -48, 648, 212, -688, 228, -52, -260,
+    428, -412, -272, -404, 180, 816, -796, 48, 152, 484, -88, -216, 988, 696, 188, -528,
+    648, -116, -180, 316, 476, 12, -564, 96, 476, -252, -364, -376, -392, 556, -256, -576,
+    260, -352, 120, -16, -136, -260, -492, 72, 556, 660, 580, 616, 772, 436, 424, -32,
+    -324, -1268, 416, -324, -80, 920, 160, 228, 724, 32, -516, 64, 384, 68, -128, 136,
+    240, 248, -204, -68, 252, -932, -120, -480, -628, -84, 192, 852, -404, -288, -132, 204,
+    100, 168, -68, -196, -868, 460, 1080, 380, -80, 244, 0, 484, -888, 64, 184, 352,
+    600, 460, 164, 604, -196, 320, -64, 588, -184, 228, 12, 372, 48, -848, -344, 224,
+    208, -200, 484, 128, -20, 272, -468, -840, 384, 256, -720, -520, -464, -580, 112, -120,
+    644, -356, -208, -608, -528, 704, 560, -424, 392, 828, 40, 84, 200, -152, 0, -144,
+    584, 280, -120, 80, -556, -972, -196, -472, 724, 80, 168, -32, 88, 160, -688, 0,
+    160, 356, 372, -776, 740, -128, 676, -248, -480, 4, -364, 96, 544, 232, -1032, 956,
+    236, 356, 20, -40, 300, 24, -676, -596, 132, 1120, -104, 532, -1096, 568, 648, 444,
+    508, 380, 188, -376, -604, 1488, 424, 24, 756, -220, -192, 716, 120, 920, 688, 168,
+    44, -460, 568, 284, 1144, 1160, 600, 424, 888, 656, -356, -320, 220, 316, -176, -724,
+    -188, -816, -628, -348, -228, -380, 1012, -452, -660, 736, 928, 404, -696, -72, -268, -892,
+    128, 184, -344, -780, 360, 336, 400, 344, 428, 548, -112, 136, -228, -216, -820, -516,
+    340, 92, -136, 116, -300, 376, -244, 100, -316, -520, -284, -12, 824, 164, -548, -180,
+    -128, 116, -924, -828, 268, -368, -580, 620, 192, 160, 0, -1676, 1068, 424, -56, -360,
+    468, -156, 720, 288, -528, 556, -364, 548, -148, 504, 316, 152, -648, -620, -684, -24,
+    -376, -384, -108, -920, -1032, 768, 180, -264, -508, -1268, -260, -60, 300, -240, 988, 724,
+    -376, -576, -212, -736, 556, 192, 1092, -620, -880, 376, -56, -4, -216, -32, 836, 268,
+    396, 1332, 864, -600, 100, 56, -412, -92, 356, 180, 884, -468, -436, 292, -388, -804,
+    -704, -840, 368, -348, 140, -724, 1536, 940, 372, 112, -372, 436, -480, 1136, 296, -32,
+    -228, 132, -48, -220, 868, -1016, -60, -1044, -464, 328, 916, 244, 12, -736, -296, 360,
+    468, -376, -108, -92, 788, 368, -56, 544, 400, -672, -420, 728, 16, 320, 44, -284,
+    -380, -796, 488, 132, 204, -596, -372, 88, -152, -908, -636, -572, -624, -116, -692, -200,
+    -56, 276, -88, 484, -324, 948, 864, 1000, -456, -184, -276, 292, -296, 156, 676, 320,
+    160, 908, -84, -1236, -288, -116, 260, -372, -644, 732, -756, -96, 84, 344, -520, 348,
+    -688, 240, -84, 216, -1044, -136, -676, -396, -1500, 960, -40, 176, 168, 1516, 420, -504,
+    -344, -364, -360, 1216, -940, -380, -212, 252, -660, -708, 484, -444, -152, 928, -120, 1112,
+    476, -260, 560, -148, -344, 108, -196, 228, -288, 504, 560, -328, -88, 288, -1008, 460,
+    -228, 468, -836, -196, 76, 388, 232, 412, -1168, -716, -644, 756, -172, -356, -504, 116,
+    432, 528, 48, 476, -168, -608, 448, 160, -532, -272, 28, -676, -12, 828, 980, 456,
+    520, 104, -104, 256, -344, -4, -28, -368, -52, -524, -572, -556, -200, 768, 1124, -208,
+    -512, 176, 232, 248, -148, -888, 604, -600, -304, 804, -156, -212, 488, -192, -804, -256,
+    368, -360, -916, -328, 228, -240, -448, -472, 856, -556, -364, 572, -12, -156, -368, -340,
+    432, 252, -752, -152, 288, 268, -580, -848, -592, 108, -76, 244, 312, -716, 592, -80,
+    436, 360, 4, -248, 160, 516, 584, 732, 44, -468, -280, -292, -156, -588, 28, 308,
+    912, 24, 124, 156, 180, -252, 944, -924, -772, -520, -428, -624, 300, -212, -1144, 32,
+    -724, 800, -1128, -212, -1288, -848, 180, -416, 440, 192, -576, -792, -76, -1080, 80, -532,
+    -352, -132, 380, -820, 148, 1112, 128, 164, 456, 700, -924, 144, -668, -384, 648, -832,
+    508, 552, -52, -100, -656, 208, -568, 748, -88, 680, 232, 300, 192, -408, -1012, -152,
+    -252, -268, 272, -876, -664, -648, -332, -136, 16, 12, 1152, -28, 332, -536, 320, -672,
+    -460, -316, 532, -260, 228, -40, 1052, -816, 180, 88, -496, -556, -672, -368, 428, 92,
+    356, 404, -408, 252, 196, -176, -556, 792, 268, 32, 372, 40, 96, -332, 328, 120,
+    372, -900, -40, 472, -264, -592, 952, 128, 656, 112, 664, -232, 420, 4, -344, -464,
+    556, 244, -416, -32, 252, 0, -412, 188, -696, 508, -476, 324, -1096, 656, -312, 560,
+    264, -136, 304, 160, -64, -580, 248, 336, -720, 560, -348, -288, -276, -196, -500, 852,
+    -544, -236, -1128, -992, -776, 116, 56, 52, 860, 884, 212, -12, 168, 1020, 512, -552,
+    924, -148, 716, 188, 164, -340, -520, -184, 880, -152, -680, -208, -1156, -300, -528, -472,
+    364, 100, -744, -1056, -32, 540, 280, 144, -676, -32, -232, -280, -224, 96, 568, -76,
+    172, 148, 148, 104, 32, -296, -32, 788, -80, 32, -16, 280, 288, 944, 428, -484
+};
+
+static inline int round2( int x, int n ) {
+    return n ? ( x + ( 1 << ( n - 1 ) ) ) >> n : x;
+}
+
+static inline int clip3( int low, int high, int x ) {
+    return x < low ? low : ( x > high ? high : x );
+}
+
+// Pseudo-random number generator of the film grain synthesis process (a 16-bit linear feedback shift register)
+static inline int get_random_number( int bits, uint16_t *random_register ) {
+    int r = *random_register;
+    int bit = ( ( r >> 0 ) ^ ( r >> 1 ) ^ ( r >> 3 ) ^ ( r >> 12 ) ) & 1;
+    r = ( r >> 1 ) | ( bit << 15 );
+    *random_register = (uint16_t)r;
+    return ( r >> ( 16 - bits ) ) & ( ( 1 << bits ) - 1 );
+}
+
+// The 8-bit function is interpolated between the points in 16.16 fixed point, and the entries of higher bit
+// depths between the entries of the 8-bit function.  The loops over the entries of a segment have no dependencies
+// between iterations, so that the compiler can vectorize them.
+void afgs1_build_scaling_lut( const int (*points)[2], int num_points, int bit_depth, uint8_t *lut ) {
+
+    uint8_t lut_8[256];
+    memset( lut_8, 0, sizeof(lut_8) );
+    if( num_points > 0 ) {
+        int first = clip3( 0, 256, points[0][0] );
+        for( int x = 0; x < first; x++ )
+            lut_8[x] = points[0][1];
+
+        for( int i = 0; i < num_points - 1; i++ ) {
+            int delta_y = points[i + 1][1] - points[i][1];
+            int delta_x = points[i + 1][0] - points[i][0];
+            if( delta_x <= 0 || points[i][0] < 0 || points[i][0] > 255 )
+                continue;
+            int delta = delta_y * ( ( 65536 + ( delta_x >> 1 ) ) / delta_x );
+            int start = points[i][0];
+            int count = std::min( delta_x, 256 - start );
+            int base = points[i][1];
+            for( int x = 0; x < count; x++ )
+                lut_8[start + x] = (uint8_t)( base + ( ( x * delta + 32768 ) >> 16 ) );
+        }
+
+        int last = clip3( 0, 256, points[num_points - 1][0] );
+        for( int x = last; x < 256; x++ )
+            lut_8[x] = points[num_points - 1][1];
+    }
+
+    if( bit_depth <= 8 ) {
+        memcpy( lut, lut_8, 256 );
+        return;
+    }
+
+    // scale_lut(): start + Round2( ( end - start ) * rem, shift ) for the samples between two 8-bit values, and
+    // the last 8-bit entry for the samples above 255 << shift
+    int shift = bit_depth - 8;
+    int step = 1 << shift;
+    for( int x = 0; x < 255; x++ ) {
+        int start = lut_8[x];
+        int delta = lut_8[x + 1] - start;
+        uint8_t *entries = lut + ( x << shift );
+        for( int rem = 0; rem < step; rem++ )
+            entries[rem] = (uint8_t)( start + ( ( delta * rem + ( step >> 1 ) ) >> shift ) );
+    }
+    memset( lut + ( 255 << shift ), lut_8[255], step );
+}
+
+// Scalar grain application kernels, which are also used for the samples at the end of the rows by the SIMD
+// kernels
+void afgs1_add_luma_noise_c( uint8_t *pixels, const int16_t *noise, int width, const Afgs1_plane_scaling *scaling ) {
+
+    for( int x = 0; x < width; x++ ) {
+        int orig = pixels[x];
+        int value = orig + round2( scaling->lut[orig] * noise[x], scaling->scaling_shift );
+        pixels[x] = (uint8_t)clip3( scaling->min_value, scaling->max_value, value );
+    }
+}
+
+void afgs1_add_chroma_noise_c( uint8_t *pixels, const uint8_t *luma, const int16_t *noise, int width,
+                               const Afgs1_plane_scaling *scaling ) {
+
+    for( int x = 0; x < width; x++ ) {
+        int orig = pixels[x];
+        int average_luma = ( luma[2 * x] + luma[2 * x + 1] + 1 ) >> 1;
+        int combined = average_luma * scaling->luma_mult + orig * scaling->mult;
+        int merged = clip3( 0, 255, ( combined >> 6 ) + scaling->offset );
+        int value = orig + round2( scaling->lut[merged] * noise[x], scaling->scaling_shift );
+        pixels[x] = (uint8_t)clip3( scaling->min_value, scaling->max_value, value );
+    }
+}
+
+void afgs1_add_luma_noise_16_c( uint16_t *pixels, const int16_t *noise, int width,
+                                const Afgs1_plane_scaling *scaling ) {
+
+    for( int x = 0; x < width; x++ ) {
+        int orig = pixels[x];
+        int value = orig + round2( scaling->lut[orig] * noise[x], scaling->scaling_shift );
+        pixels[x] = (uint16_t)clip3( scaling->min_value, scaling->max_value, value );
+    }
+}
+
+void afgs1_add_chroma_noise_16_c( uint16_t *pixels, const uint16_t *luma, const int16_t *noise, int width,
+                                  const Afgs1_plane_scaling *scaling ) {
+
+    int max_index = ( 1 << scaling->bit_depth ) - 1;
+    for( int x = 0; x < width; x++ ) {
+        int orig = pixels[x];
+        int average_luma = ( luma[2 * x] + luma[2 * x + 1] + 1 ) >> 1;
+        int combined = average_luma * scaling->luma_mult + orig * scaling->mult;
+        int merged = clip3( 0, max_index, ( combined >> 6 ) + scaling->offset );
+        int value = orig + round2( scaling->lut[merged] * noise[x], scaling->scaling_shift );
+        pixels[x] = (uint16_t)clip3( scaling->min_value, scaling->max_value, value );
+    }
+}
+
+void afgs1_blend_noise_c( const int16_t *previous, const int16_t *current, int16_t *blended, int width,
+                          int weight_previous, int weight_current, int grain_min, int grain_max ) {
+
+    for( int x = 0; x < width; x++ )
+        blended[x] = clip3( grain_min, grain_max, round2( previous[x] * weight_previous + current[x] * weight_current,
+                                                          5 ) );
+}
+
+void afgs1_lookup_scaling_c( const uint8_t *lut, const uint8_t *index, int16_t *scale, int n ) {
+    for( int x = 0; x < n; x++ )
+        scale[x] = lut[index[x]];
+}
+
+void afgs1_lookup_scaling_16_c( const uint8_t *lut, const uint16_t *index, int16_t *scale, int n ) {
+    for( int x = 0; x < n; x++ )
+        scale[x] = lut[index[x]];
+}
+
+void afgs1_grain_kernels_c( Afgs1_grain_kernels *kernels ) {
+    kernels->add_luma_noise = afgs1_add_luma_noise_c;
+    kernels->add_chroma_noise = afgs1_add_chroma_noise_c;
+    kernels->add_luma_noise_16 = afgs1_add_luma_noise_16_c;
+    kernels->add_chroma_noise_16 = afgs1_add_chroma_noise_16_c;
+    kernels->blend_noise = afgs1_blend_noise_c;
+    kernels->lookup_scaling = afgs1_lookup_scaling_c;
+    kernels->lookup_scaling_16 = afgs1_lookup_scaling_16_c;
+}
+
+Afgs1_simd_level afgs1_detect_simd_level() {
+
+#if defined(AFGS1_X86_SIMD) && defined(_MSC_VER)
+    int info[4];
+    __cpuid( info, 0 );
+    int max_leaf = info[0];
+    __cpuid( info, 1 );
+    bool sse4 = ( info[2] & ( 1 << 19 ) ) != 0;
+    bool avx = ( info[2] & ( 1 << 27 ) ) && ( info[2] & ( 1 << 28 ) ) && ( _xgetbv( 0 ) & 6 ) == 6;
+    bool avx2 = false;
+    if( avx && max_leaf >= 7 ) {
+        __cpuidex( info, 7, 0 );
+        avx2 = ( info[1] & ( 1 << 5 ) ) != 0;
+    }
+    if( avx2 )
+        return AFGS1_SIMD_AVX2;
+    if( sse4 )
+        return AFGS1_SIMD_SSE4;
+#elif defined(AFGS1_X86_SIMD)
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) )
+        return AFGS1_SIMD_AVX2;
+    if( __builtin_cpu_supports( "sse4.1" ) )
+        return AFGS1_SIMD_SSE4;
+#endif
+    return AFGS1_SIMD_NONE;
+}
+
+Afgs1_grain_synthesis::Afgs1_grain_synthesis( Afgs1_simd_level max_level ) {
+
+    simd_level = std::min( afgs1_detect_simd_level(), max_level );
+    if( simd_level == AFGS1_SIMD_AVX2 )
+        afgs1_grain_kernels_avx2( &kernels );
+    else if( simd_level == AFGS1_SIMD_SSE4 )
+        afgs1_grain_kernels_sse4( &kernels );
+    else
+        afgs1_grain_kernels_c( &kernels );
+
+    memset( &own_templates, 0, sizeof(own_templates) );
+    own_templates.bit_depth = 8;
+    apply[0] = apply[1] = apply[2] = false;
+    stripe_stride[0] = stripe_stride[1] = stripe_stride[2] = 0;
+}
+
+void Afgs1_grain_synthesis::set_params( const Afgs1_film_grain_params &p, int bit_depth, Afgs1_grain_cache *cache ) {
+
+    params = p;
+    bit_depth = clip3( 8, 12, bit_depth );
+    apply[0] = params.apply_grain && params.num_y_points > 0;
+    apply[1] = params.apply_grain && ( params.num_cb_points > 0 || params.chroma_scaling_from_luma );
+    apply[2] = params.apply_grain && ( params.num_cr_points > 0 || params.chroma_scaling_from_luma );
+
+    if( cache ) {
+        cached_templates = cache->get_templates( params, bit_depth );
+    }
+    else {
+        cached_templates.reset();
+        afgs1_generate_templates( params, bit_depth, &own_templates );
+    }
+}
+
+// Grain templates: white noise from the Gaussian sequence filtered by the auto-regressive filter
+static void generate_grain( const Afgs1_film_grain_params &params, Afgs1_grain_templates *templates ) {
+
+    int16_t (*luma_grain)[AFGS1_LUMA_GRAIN_WIDTH] = templates->luma_grain;
+    int16_t (*cb_grain)[AFGS1_CHROMA_GRAIN_WIDTH] = templates->cb_grain;
+    int16_t (*cr_grain)[AFGS1_CHROMA_GRAIN_WIDTH] = templates->cr_grain;
+
+    int shift = 12 - templates->bit_depth + params.grain_scale_shift;
+    int grain_min = templates->grain_min;
+    int grain_max = templates->grain_max;
+    int ar_shift = params.ar_coeff_shift;
+    int lag = params.ar_coeff_lag;
+
+    // Luma
+    uint16_t random_register = (uint16_t)params.grain_seed;
+    for( int y = 0; y < AFGS1_LUMA_GRAIN_HEIGHT; y++ )
+        for( int x = 0; x < AFGS1_LUMA_GRAIN_WIDTH; x++ )
+            luma_grain[y][x] = params.num_y_points > 0 ?
+                               round2( gaussian_sequence[get_random_number( 11, &random_register )], shift ) : 0;
+
+    if( params.num_y_points > 0 ) {
+        for( int y = 3; y < AFGS1_LUMA_GRAIN_HEIGHT; y++ ) {
+            for( int x = 3; x < AFGS1_LUMA_GRAIN_WIDTH - 3; x++ ) {
+                int sum = 0;
+                int pos = 0;
+                for( int delta_row = -lag; delta_row <= 0; delta_row++ ) {
+                    for( int delta_col = -lag; delta_col <= lag; delta_col++ ) {
+                        if( delta_row == 0 && delta_col == 0 )
+                            break;
+                        sum += luma_grain[y + delta_row][x + delta_col] * params.ar_coeffs_y[pos++];
+                    }
+                }
+                luma_grain[y][x] = clip3( grain_min, grain_max, luma_grain[y][x] + round2( sum, ar_shift ) );
+            }
+        }
+    }
+
+    // Chroma
+    bool cb_grain_present = params.num_cb_points > 0 || params.chroma_scaling_from_luma;
+    bool cr_grain_present = params.num_cr_points > 0 || params.chroma_scaling_from_luma;
+
+    random_register = (uint16_t)params.grain_seed ^ 0xb524;
+    for( int y = 0; y < AFGS1_CHROMA_GRAIN_HEIGHT; y++ )
+        for( int x = 0; x < AFGS1_CHROMA_GRAIN_WIDTH; x++ )
+            cb_grain[y][x] = cb_grain_present ?
+                             round2( gaussian_sequence[get_random_number( 11, &random_register )], shift ) : 0;
+
+    random_register = (uint16_t)params.grain_seed ^ 0x49d8;
+    for( int y = 0; y < AFGS1_CHROMA_GRAIN_HEIGHT; y++ )
+        for( int x = 0; x < AFGS1_CHROMA_GRAIN_WIDTH; x++ )
+            cr_grain[y][x] = cr_grain_present ?
+                             round2( gaussian_sequence[get_random_number( 11, &random_register )], shift ) : 0;
+
+    for( int y = 3; y < AFGS1_CHROMA_GRAIN_HEIGHT; y++ ) {
+        for( int x = 3; x < AFGS1_CHROMA_GRAIN_WIDTH - 3; x++ ) {
+            int sum_cb = 0;
+            int sum_cr = 0;
+            int pos = 0;
+            for( int delta_row = -lag; delta_row <= 0; delta_row++ ) {
+                for( int delta_col = -lag; delta_col <= lag; delta_col++ ) {
+                    int coeff_cb = params.ar_coeffs_cb[pos];
+                    int coeff_cr = params.ar_coeffs_cr[pos];
+                    if( delta_row == 0 && delta_col == 0 ) {
+                        // The last coefficient applies to the average of the co-located luma grain
+                        if( params.num_y_points > 0 ) {
+                            int luma_x = ( ( x - 3 ) << 1 ) + 3;
+                            int luma_y = ( ( y - 3 ) << 1 ) + 3;
+                            int luma = luma_grain[luma_y][luma_x] + luma_grain[luma_y][luma_x + 1] +
+                                       luma_grain[luma_y + 1][luma_x] + luma_grain[luma_y + 1][luma_x + 1];
+                            luma = round2( luma, 2 );
+                            sum_cb += luma * coeff_cb;
+                            sum_cr += luma * coeff_cr;
+                        }
+                        break;
+                    }
+                    sum_cb += coeff_cb * cb_grain[y + delta_row][x + delta_col];
+                    sum_cr += coeff_cr * cr_grain[y + delta_row][x + delta_col];
+                    pos++;
+                }
+            }
+            if( cb_grain_present )
+                cb_grain[y][x] = clip3( grain_min, grain_max, cb_grain[y][x] + round2( sum_cb, ar_shift ) );
+            if( cr_grain_present )
+                cr_grain[y][x] = clip3( grain_min, grain_max, cr_grain[y][x] + round2( sum_cr, ar_shift ) );
+        }
+    }
+}
+
+void afgs1_generate_templates( const Afgs1_film_grain_params &params, int bit_depth,
+                               Afgs1_grain_templates *templates ) {
+
+    int depth_shift = bit_depth - 8;
+    templates->bit_depth = bit_depth;
+    templates->grain_min = -( 128 << depth_shift );
+    templates->grain_max = ( 128 << depth_shift ) - 1;
+    generate_grain( params, templates );
+
+    // Scaling functions
+    int lut_size = 1 << bit_depth;
+    afgs1_build_scaling_lut( params.scaling_points_y, params.num_y_points, bit_depth, templates->scaling[0].lut );
+    if( params.chroma_scaling_from_luma ) {
+        memcpy( templates->scaling[1].lut, templates->scaling[0].lut, lut_size );
+        memcpy( templates->scaling[2].lut, templates->scaling[0].lut, lut_size );
+    }
+    else {
+        afgs1_build_scaling_lut( params.scaling_points_cb, params.num_cb_points, bit_depth,
+                                 templates->scaling[1].lut );
+        afgs1_build_scaling_lut( params.scaling_points_cr, params.num_cr_points, bit_depth,
+                                 templates->scaling[2].lut );
+    }
+
+    // Clipping range.  The chroma range is the luma range for the identity matrix (only signaled with the video
+    // signal characteristics).
+    int min_value = params.clip_to_restricted_range ? 16 << depth_shift : 0;
+    int max_luma = params.clip_to_restricted_range ? 235 << depth_shift : ( 256 << depth_shift ) - 1;
+    bool mc_identity = params.video_signal_characteristics_flag && params.matrix_coefficients == 0;
+    int max_chroma = params.clip_to_restricted_range && !mc_identity ? 240 << depth_shift : max_luma;
+
+    for( int plane = 0; plane < 3; plane++ ) {
+        templates->scaling[plane].bit_depth = bit_depth;
+        templates->scaling[plane].scaling_shift = params.scaling_shift;
+        templates->scaling[plane].min_value = min_value;
+        templates->scaling[plane].max_value = plane ? max_chroma : max_luma;
+    }
+
+    templates->scaling[0].luma_mult = 64;
+    templates->scaling[0].mult = 0;
+    templates->scaling[0].offset = 0;
+    if( params.chroma_scaling_from_luma ) {
+        templates->scaling[1].luma_mult = templates->scaling[2].luma_mult = 64;
+        templates->scaling[1].mult = templates->scaling[2].mult = 0;
+        templates->scaling[1].offset = templates->scaling[2].offset = 0;
+    }
+    else {
+        templates->scaling[1].luma_mult = params.cb_luma_mult - 128;
+        templates->scaling[1].mult = params.cb_mult - 128;
+        templates->scaling[1].offset = ( params.cb_offset - 256 ) << depth_shift;
+        templates->scaling[2].luma_mult = params.cr_luma_mult - 128;
+        templates->scaling[2].mult = params.cr_mult - 128;
+        templates->scaling[2].offset = ( params.cr_offset - 256 ) << depth_shift;
+    }
+}
+
+// Build the noise of the 32 luma row stripe luma_num from 32x32 blocks (16x16 in chroma) of the grain templates
+// at pseudo-random offsets.  The blocks are 34x34 (17x17) so that they overlap the block on their right and the
+// stripe below, and the left columns of each block are blended with the previous block when overlap_flag is set.
+void Afgs1_grain_synthesis::build_noise_stripe( int luma_num, int width, int16_t *noise[3] ) const {
+
+    const Afgs1_grain_templates &templates = get_templates();
+    int grain_min = templates.grain_min;
+    int grain_max = templates.grain_max;
+
+    uint16_t random_register = (uint16_t)params.grain_seed;
+    random_register ^= ( ( luma_num * 37 + 178 ) & 255 ) << 8;
+    random_register ^= ( ( luma_num * 173 + 105 ) & 255 );
+
+    for( int x = 0; x < ( width + 1 ) / 2; x += 16 ) {
+        int rand = get_random_number( 8, &random_register );
+        int offset_x = rand >> 4;
+        int offset_y = rand & 15;
+
+        if( apply[0] ) {
+            int16_t *stripe = noise[0];
+            int stride = stripe_stride[0];
+            for( int i = 0; i < 34; i++ ) {
+                const int16_t *grain = &templates.luma_grain[9 + offset_y * 2 + i][9 + offset_x * 2];
+                int16_t *row = stripe + i * stride + x * 2;
+                int j = 0;
+                if( params.overlap_flag && x > 0 ) {
+                    row[0] = clip3( grain_min, grain_max, round2( row[0] * 27 + grain[0] * 17, 5 ) );
+                    row[1] = clip3( grain_min, grain_max, round2( row[1] * 17 + grain[1] * 27, 5 ) );
+                    j = 2;
+                }
+                for( ; j < 34; j++ )
+                    row[j] = grain[j];
+            }
+        }
+
+        for( int plane = 1; plane < 3; plane++ ) {
+            if( !apply[plane] )
+                continue;
+            int16_t *stripe = noise[plane];
+            int stride = stripe_stride[plane];
+            const int16_t (*template_grain)[AFGS1_CHROMA_GRAIN_WIDTH] = ( plane == 1 ) ? templates.cb_grain
+                                                                                           : templates.cr_grain;
+            for( int i = 0; i < 17; i++ ) {
+                const int16_t *grain = &template_grain[6 + offset_y + i][6 + offset_x];
+                int16_t *row = stripe + i * stride + x;
+                int j = 0;
+                if( params.overlap_flag && x > 0 ) {
+                    row[0] = clip3( grain_min, grain_max, round2( row[0] * 23 + grain[0] * 22, 5 ) );
+                    j = 1;
+                }
+                for( ; j < 17; j++ )
+                    row[j] = grain[j];
+            }
+        }
+    }
+}
+
+// Noise of a row of a stripe, blended with the rows of the previous stripe that overlap it
+const int16_t *Afgs1_grain_synthesis::noise_row( int plane, int luma_num, int row, int width, int16_t *noise[3],
+                                                 int16_t *prev_noise[3], int16_t *blended ) const {
+
+    int stride = stripe_stride[plane];
+    const int16_t *current = noise[plane] + row * stride;
+    int overlap_rows = plane ? 1 : 2;
+    if( !params.overlap_flag || luma_num == 0 || row >= overlap_rows )
+        return current;
+
+    const int16_t *previous = prev_noise[plane] + ( row + ( plane ? 16 : 32 ) ) * stride;
+    int weight_old = plane ? 23 : ( row == 0 ? 27 : 17 );
+    int weight_new = plane ? 22 : ( row == 0 ? 17 : 27 );
+    const Afgs1_grain_templates &templates = get_templates();
+    kernels.blend_noise( previous, current, blended, width, weight_old, weight_new, templates.grain_min,
+                         templates.grain_max );
+    return blended;
+}
+
+bool Afgs1_grain_synthesis::add_grain( Afgs1_frame *frame, ThreadPool *pool ) {
+
+    int bit_depth = get_templates().bit_depth;
+    if( frame->bit_depth != bit_depth )
+        return false;
+    if( !params.apply_grain || !( apply[0] || apply[1] || apply[2] ) )
+        return true;
+
+    int width = frame->width;
+    int num_stripes = ( frame->height + 31 ) / 32;
+    int num_tasks = std::min( num_stripes, pool ? pool->get_num_threads() : 1 );
+
+    // The blocks of a stripe start every 32 luma columns and extend 34 columns
+    int num_blocks = ( ( width + 1 ) / 2 + 15 ) / 16;
+    stripe_stride[0] = num_blocks * 32 + 2;
+    stripe_stride[1] = stripe_stride[2] = num_blocks * 16 + 1;
+    if( buffers.size() < (size_t)num_tasks )
+        buffers.resize( num_tasks );
+    for( int task = 0; task < num_tasks; task++ ) {
+        stripe_buffers &b = buffers[task];
+        for( int plane = 0; plane < 3; plane++ ) {
+            size_t size = (size_t)stripe_stride[plane] * ( plane ? 17 : 34 );
+            for( int k = 0; k < 2; k++ )
+                if( b.stripe[k][plane].size() < size )
+                    b.stripe[k][plane].resize( size );
+        }
+        if( b.blended_row.size() < (size_t)stripe_stride[0] )
+            b.blended_row.resize( stripe_stride[0] );
+    }
+
+    // Each task processes a range of consecutive stripes with the buffers of its index
+    if( num_tasks == 1 ) {
+        if( bit_depth == 8 )
+            add_grain_stripes<uint8_t>( frame, 0, num_stripes, &buffers[0] );
+        else
+            add_grain_stripes<uint16_t>( frame, 0, num_stripes, &buffers[0] );
+        return true;
+    }
+    pool->run( num_tasks, [&]( int task, int ) {
+        int first_stripe = task * num_stripes / num_tasks;
+        int end_stripe = ( task + 1 ) * num_stripes / num_tasks;
+        if( bit_depth == 8 )
+            add_grain_stripes<uint8_t>( frame, first_stripe, end_stripe, &buffers[task] );
+        else
+            add_grain_stripes<uint16_t>( frame, first_stripe, end_stripe, &buffers[task] );
+    } );
+    return true;
+}
+
+// Samples and kernels of the 8-bit and of the 10 and 12-bit frames
+static inline uint8_t *frame_plane( Afgs1_frame *frame, int plane, uint8_t * ) {
+    return frame->planes[plane];
+}
+
+static inline uint16_t *frame_plane( Afgs1_frame *frame, int plane, uint16_t * ) {
+    return frame->planes_16[plane];
+}
+
+static inline void add_luma_noise( const Afgs1_grain_kernels &kernels, uint8_t *pixels, const int16_t *noise,
+                                   int width, const Afgs1_plane_scaling *scaling ) {
+    kernels.add_luma_noise( pixels, noise, width, scaling );
+}
+
+static inline void add_luma_noise( const Afgs1_grain_kernels &kernels, uint16_t *pixels, const int16_t *noise,
+                                   int width, const Afgs1_plane_scaling *scaling ) {
+    kernels.add_luma_noise_16( pixels, noise, width, scaling );
+}
+
+static inline void add_chroma_noise( const Afgs1_grain_kernels &kernels, uint8_t *pixels, const uint8_t *luma,
+                                     const int16_t *noise, int width, const Afgs1_plane_scaling *scaling ) {
+    kernels.add_chroma_noise( pixels, luma, noise, width, scaling );
+}
+
+static inline void add_chroma_noise( const Afgs1_grain_kernels &kernels, uint16_t *pixels, const uint16_t *luma,
+                                     const int16_t *noise, int width, const Afgs1_plane_scaling *scaling ) {
+    kernels.add_chroma_noise_16( pixels, luma, noise, width, scaling );
+}
+
+static inline void add_chroma_noise_c( uint8_t *pixels, const uint8_t *luma, const int16_t *noise, int width,
+                                       const Afgs1_plane_scaling *scaling ) {
+    afgs1_add_chroma_noise_c( pixels, luma, noise, width, scaling );
+}
+
+static inline void add_chroma_noise_c( uint16_t *pixels, const uint16_t *luma, const int16_t *noise, int width,
+                                       const Afgs1_plane_scaling *scaling ) {
+    afgs1_add_chroma_noise_16_c( pixels, luma, noise, width, scaling );
+}
+
+// Add the grain to the stripes from first_stripe to end_stripe - 1.  The stripes do not share samples: the chroma
+// noise of a stripe is scaled with the luma samples of the same stripe.  The noise of the stripe before the range
+// is built again for the vertical overlap of its first stripe.
+template<class Pixel>
+void Afgs1_grain_synthesis::add_grain_stripes( Afgs1_frame *frame, int first_stripe, int end_stripe,
+                                               stripe_buffers *b ) const {
+
+    Pixel *planes[3];
+    for( int plane = 0; plane < 3; plane++ )
+        planes[plane] = frame_plane( frame, plane, (Pixel*)NULL );
+
+    const Afgs1_plane_scaling *scaling = get_templates().scaling;
+    int width = frame->width;
+    int height = frame->height;
+    int chroma_width = ( width + 1 ) >> 1;
+    int chroma_height = ( height + 1 ) >> 1;
+
+    if( params.overlap_flag && first_stripe > 0 ) {
+        int16_t *noise[3];
+        for( int plane = 0; plane < 3; plane++ )
+            noise[plane] = &b->stripe[( first_stripe - 1 ) & 1][plane][0];
+        build_noise_stripe( first_stripe - 1, width, noise );
+    }
+
+    for( int luma_num = first_stripe; luma_num < end_stripe; luma_num++ ) {
+        int16_t *noise[3], *prev_noise[3];
+        for( int plane = 0; plane < 3; plane++ ) {
+            noise[plane] = &b->stripe[luma_num & 1][plane][0];
+            prev_noise[plane] = &b->stripe[( luma_num + 1 ) & 1][plane][0];
+        }
+        build_noise_stripe( luma_num, width, noise );
+
+        // The chroma noise is scaled with the luma samples before the luma noise is added to them
+        for( int plane = 1; plane < 3; plane++ ) {
+            if( !apply[plane] )
+                continue;
+            for( int y = luma_num * 16; y < std::min( chroma_height, luma_num * 16 + 16 ); y++ ) {
+                const int16_t *row_noise = noise_row( plane, luma_num, y - luma_num * 16, chroma_width, noise,
+                                                      prev_noise, &b->blended_row[0] );
+                Pixel *pixels = planes[plane] + (size_t)y * frame->stride[plane];
+                const Pixel *luma = planes[0] + (size_t)( y << 1 ) * frame->stride[0];
+                int pairs = width >> 1;
+                add_chroma_noise( kernels, pixels, luma, row_noise, pairs, &scaling[plane] );
+
+                // The last chroma sample of an odd width has a single luma sample
+                if( width & 1 ) {
+                    Pixel last_luma[2] = { luma[width - 1], luma[width - 1] };
+                    add_chroma_noise_c( pixels + pairs, last_luma, row_noise + pairs, 1, &scaling[plane] );
+                }
+            }
+        }
+
+        if( apply[0] ) {
+            for( int y = luma_num * 32; y < std::min( height, luma_num * 32 + 32 ); y++ ) {
+                const int16_t *row_noise = noise_row( 0, luma_num, y - luma_num * 32, width, noise, prev_noise,
+                                                      &b->blended_row[0] );
+                add_luma_noise( kernels, planes[0] + (size_t)y * frame->stride[0], row_noise, width, &scaling[0] );
+            }
+        }
+    }
+}
@@ -0,0 +1,195 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// Synthesis class - Renders the film grain described by a set of film grain parameters onto a
+// planar 4:2:0 frame of 8, 10 or 12-bit samples, following the film grain synthesis process of the
+// AV1 specification (section 7.18.3).  "Afgs1Bench --self_check" checks the output against stored
+// regression hashes of this implementation.
+//
+
+#ifndef AFGS1_SYNTHESIS_H
+#define AFGS1_SYNTHESIS_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "afgs1_params.h"
+#include "Utilities/thread_pool.h"
+
+// Size of the grain templates.  The chroma templates are for 4:2:0 sub-sampling.
+#define AFGS1_LUMA_GRAIN_WIDTH    82
+#define AFGS1_LUMA_GRAIN_HEIGHT   73
+#define AFGS1_CHROMA_GRAIN_WIDTH  44
+#define AFGS1_CHROMA_GRAIN_HEIGHT 38
+
+// Instruction sets of the grain application kernels
+enum Afgs1_simd_level {
+    AFGS1_SIMD_NONE = 0,
+    AFGS1_SIMD_SSE4,
+    AFGS1_SIMD_AVX2
+};
+
+// Best instruction set supported by the processor (and by the build)
+Afgs1_simd_level afgs1_detect_simd_level();
+
+// A planar 4:2:0 frame.  The samples of 8-bit frames are in planes, and those of 10 and 12-bit frames in planes_16
+// (in the least significant bits).  The strides are in samples.
+struct Afgs1_frame {
+    uint8_t *planes[3];
+    uint16_t *planes_16[3];
+    int stride[3];
+    int width;
+    int height;
+    int bit_depth;
+};
+
+// Size of the scaling lookup tables: one entry per sample value, up to 12 bits.  The tables are padded so that the
+// 32-bit gathers of the SIMD kernels can read their last entry.
+#define AFGS1_MAX_SCALING_LUT_SIZE 4096
+#define AFGS1_SCALING_LUT_PADDING  3
+
+// Scaling function and clipping range of a plane.  For chroma, the scaling function is indexed by
+// Clip1( ( average_luma * luma_mult + chroma * mult ) >> 6 ) + offset ), which is the average luma itself when the
+// chroma scaling is derived from luma (luma_mult = 64, mult = 0, offset = 0).  The lookup table has an entry per
+// sample value of the bit depth, and the clipping range and the offset are in the sample range of the bit depth.
+struct Afgs1_plane_scaling {
+    uint8_t lut[AFGS1_MAX_SCALING_LUT_SIZE + AFGS1_SCALING_LUT_PADDING];
+    int bit_depth;
+    int scaling_shift;
+    int min_value;
+    int max_value;
+    int luma_mult;
+    int mult;
+    int offset;
+};
+
+// Grain templates and scaling functions of a parameter set.  They depend only on the film grain characteristics
+// and the grain seed of the parameters and on the bit depth, not on the frame they are applied to.  The grain
+// range is -( 128 << ( bit_depth - 8 ) ) to ( 128 << ( bit_depth - 8 ) ) - 1.
+struct Afgs1_grain_templates {
+    int16_t luma_grain[AFGS1_LUMA_GRAIN_HEIGHT][AFGS1_LUMA_GRAIN_WIDTH];
+    int16_t cb_grain[AFGS1_CHROMA_GRAIN_HEIGHT][AFGS1_CHROMA_GRAIN_WIDTH];
+    int16_t cr_grain[AFGS1_CHROMA_GRAIN_HEIGHT][AFGS1_CHROMA_GRAIN_WIDTH];
+    Afgs1_plane_scaling scaling[3];
+    int bit_depth;
+    int grain_min;
+    int grain_max;
+};
+
+// Build the scaling lookup table of 1 << bit_depth entries (bit_depth 8, 10 or 12) of a piecewise linear scaling
+// function.  The entries of 10 and 12-bit samples interpolate the 8-bit function as the scale_lut() function of
+// the specification does.  Points outside of the 8-bit range, or that are not increasing, are ignored.
+void afgs1_build_scaling_lut( const int (*points)[2], int num_points, int bit_depth, uint8_t *lut );
+
+// Generate the grain templates and the scaling functions of a parameter set for samples of bit_depth (8, 10 or 12)
+void afgs1_generate_templates( const Afgs1_film_grain_params &params, int bit_depth,
+                               Afgs1_grain_templates *templates );
+
+class Afgs1_grain_cache;
+
+// Grain application kernels: add the scaled noise of a row to its samples.  The chroma kernel reads the two luma
+// samples of each chroma sample, so the caller handles the last chroma sample of a row of odd luma width.
+//
+// The _16 kernels are the ones of 10 and 12-bit samples.  The blending kernel blends the noise of the rows of two
+// stripes that overlap vertically.  The lookup kernels write the scaling function of a row of n indices (8-bit
+// samples, or 10 and 12-bit samples) from a lookup table built by afgs1_build_scaling_lut.
+typedef void (*afgs1_add_luma_noise_fn)( uint8_t *pixels, const int16_t *noise, int width,
+                                         const Afgs1_plane_scaling *scaling );
+typedef void (*afgs1_add_chroma_noise_fn)( uint8_t *pixels, const uint8_t *luma, const int16_t *noise, int width,
+                                           const Afgs1_plane_scaling *scaling );
+
+typedef void (*afgs1_add_luma_noise_16_fn)( uint16_t *pixels, const int16_t *noise, int width,
+                                            const Afgs1_plane_scaling *scaling );
+typedef void (*afgs1_add_chroma_noise_16_fn)( uint16_t *pixels, const uint16_t *luma, const int16_t *noise, int width,
+                                              const Afgs1_plane_scaling *scaling );
+typedef void (*afgs1_blend_noise_fn)( const int16_t *previous, const int16_t *current, int16_t *blended, int width,
+                                      int weight_previous, int weight_current, int grain_min, int grain_max );
+typedef void (*afgs1_lookup_scaling_fn)( const uint8_t *lut, const uint8_t *index, int16_t *scale, int n );
+typedef void (*afgs1_lookup_scaling_16_fn)( const uint8_t *lut, const uint16_t *index, int16_t *scale, int n );
+
+struct Afgs1_grain_kernels {
+    afgs1_add_luma_noise_fn add_luma_noise;
+    afgs1_add_chroma_noise_fn add_chroma_noise;
+    afgs1_add_luma_noise_16_fn add_luma_noise_16;
+    afgs1_add_chroma_noise_16_fn add_chroma_noise_16;
+    afgs1_blend_noise_fn blend_noise;
+    afgs1_lookup_scaling_fn lookup_scaling;
+    afgs1_lookup_scaling_16_fn lookup_scaling_16;
+};
+
+void afgs1_add_luma_noise_c( uint8_t *pixels, const int16_t *noise, int width, const Afgs1_plane_scaling *scaling );
+void afgs1_add_chroma_noise_c( uint8_t *pixels, const uint8_t *luma, const int16_t *noise, int width,
+                               const Afgs1_plane_scaling *scaling );
+void afgs1_add_luma_noise_16_c( uint16_t *pixels, const int16_t *noise, int width,
+                                const Afgs1_plane_scaling *scaling );
+void afgs1_add_chroma_noise_16_c( uint16_t *pixels, const uint16_t *luma, const int16_t *noise, int width,
+                                  const Afgs1_plane_scaling *scaling );
+void afgs1_blend_noise_c( const int16_t *previous, const int16_t *current, int16_t *blended, int width,
+                          int weight_previous, int weight_current, int grain_min, int grain_max );
+void afgs1_lookup_scaling_c( const uint8_t *lut, const uint8_t *index, int16_t *scale, int n );
+void afgs1_lookup_scaling_16_c( const uint8_t *lut, const uint16_t *index, int16_t *scale, int n );
+
+// Kernels of an instruction set
+void afgs1_grain_kernels_c( Afgs1_grain_kernels *kernels );
+void afgs1_grain_kernels_sse4( Afgs1_grain_kernels *kernels );
+void afgs1_grain_kernels_avx2( Afgs1_grain_kernels *kernels );
+
+class Afgs1_grain_synthesis {
+
+public:
+    // The kernels use the best instruction set of the processor up to max_level
+    explicit Afgs1_grain_synthesis( Afgs1_simd_level max_level = AFGS1_SIMD_AVX2 );
+
+    // Generate the grain templates and the scaling functions of a parameter set for frames of bit_depth (8, 10 or
+    // 12), or take them from the cache when one is given.  The parameters must be complete (update_parameters
+    // equal to 1, or copied from the AFGS1 buffer).
+    void set_params( const Afgs1_film_grain_params &params, int bit_depth = 8, Afgs1_grain_cache *cache = NULL );
+
+    // Add the film grain to a frame, in place.  With a pool, the 32 row stripes of the frame are shared by its
+    // threads.  The noise of a stripe depends only on the parameters and the position of the stripe, so the
+    // output is the same for any number of threads.  Returns false, without changing the frame, if the bit depth
+    // of the frame is not the one of set_params.
+    bool add_grain( Afgs1_frame *frame, ThreadPool *pool = NULL );
+
+    Afgs1_simd_level get_simd_level() const { return simd_level; }
+    const Afgs1_grain_kernels &get_kernels() const { return kernels; }
+
+    const Afgs1_grain_templates &get_templates() const { return cached_templates ? *cached_templates : own_templates; }
+
+    const int16_t *get_luma_grain() const { return &get_templates().luma_grain[0][0]; }
+    const int16_t *get_cb_grain() const { return &get_templates().cb_grain[0][0]; }
+    const int16_t *get_cr_grain() const { return &get_templates().cr_grain[0][0]; }
+
+private:
+    Afgs1_film_grain_params params;
+    Afgs1_simd_level simd_level;
+    Afgs1_grain_kernels kernels;
+
+    // Templates generated for this object, or shared with a cache (which may evict them while they are used)
+    Afgs1_grain_templates own_templates;
+    std::shared_ptr<const Afgs1_grain_templates> cached_templates;
+    bool apply[3];                      // planes that receive grain
+
+    // Noise of the current and of the previous 32 luma row stripe, with the rows below the stripe that
+    // overlap the next stripe (34 luma rows, 17 chroma rows), and a row after the vertical overlap blending.
+    // Each thread of the pool has its own buffers.
+    struct stripe_buffers {
+        std::vector<int16_t> stripe[2][3];
+        std::vector<int16_t> blended_row;
+    };
+
+    int stripe_stride[3];
+    std::vector<stripe_buffers> buffers;
+
+    void build_noise_stripe( int luma_num, int width, int16_t *noise[3] ) const;
+    const int16_t *noise_row( int plane, int luma_num, int row, int width, int16_t *noise[3], int16_t *prev_noise[3],
+                              int16_t *blended ) const;
+    template<class Pixel>
+    void add_grain_stripes( Afgs1_frame *frame, int first_stripe, int end_stripe, stripe_buffers *b ) const;
+};
+
+#endif //AFGS1_SYNTHESIS_H
@@ -0,0 +1,241 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// AVX2 grain application kernels (see afgs1_synthesis.h).  This file is compiled with AVX2 code
+// generation and its kernels are only selected when the processor supports them.  The arithmetic is
+// the one of the SSE4.1 kernels on 16 samples per vector.
+//
+// The scaling functions are looked up with 32-bit gathers of the bytes of the table, which is padded so that
+// the gathers of its last entries stay in the table.
+//
+// The noise of 10 and 12-bit samples does not fit in 16 bits once multiplied by 1 << ( 15 - scaling_shift ), so
+// the kernels of these samples multiply the scaling function instead, which is at most 255 << 7.
+//
+
+#include "afgs1_synthesis.h"
+
+#if defined(AFGS1_X86_SIMD)
+
+#include <immintrin.h>
+
+// Scaling function of 16 samples given as two vectors of 8 indices.  The results are in the order of
+// _mm256_packus_epi32, which interleaves the 128-bit lanes of the two vectors.
+static inline __m256i gather_scale( const uint8_t *lut, __m256i index_lo, __m256i index_hi ) {
+
+    const __m256i byte_mask = _mm256_set1_epi32( 0xff );
+    __m256i scale_lo = _mm256_and_si256( _mm256_i32gather_epi32( (const int*)lut, index_lo, 1 ), byte_mask );
+    __m256i scale_hi = _mm256_and_si256( _mm256_i32gather_epi32( (const int*)lut, index_hi, 1 ), byte_mask );
+    return _mm256_packus_epi32( scale_lo, scale_hi );
+}
+
+// Add the scaled noise of 16 samples and return them as bytes
+static inline __m128i add_scaled_noise( __m256i pixels, __m256i scale, const int16_t *noise, __m256i noise_mult,
+                                        __m256i min_value, __m256i max_value ) {
+
+    __m256i n = _mm256_mullo_epi16( _mm256_loadu_si256( (const __m256i*)noise ), noise_mult );
+    n = _mm256_mulhrs_epi16( scale, n );
+    pixels = _mm256_min_epi16( _mm256_max_epi16( _mm256_add_epi16( pixels, n ), min_value ), max_value );
+    return _mm_packus_epi16( _mm256_castsi256_si128( pixels ), _mm256_extracti128_si256( pixels, 1 ) );
+}
+
+static void lookup_scaling_avx2( const uint8_t *lut, const uint8_t *index, int16_t *scale, int n ) {
+
+    int x = 0;
+    for( ; x + 16 <= n; x += 16 ) {
+        __m256i index_lo = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)( index + x ) ) );
+        __m256i index_hi = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)( index + x + 8 ) ) );
+        __m256i s = _mm256_permute4x64_epi64( gather_scale( lut, index_lo, index_hi ), 0xd8 );
+        _mm256_storeu_si256( (__m256i*)( scale + x ), s );
+    }
+
+    afgs1_lookup_scaling_c( lut, index + x, scale + x, n - x );
+}
+
+static void lookup_scaling_16_avx2( const uint8_t *lut, const uint16_t *index, int16_t *scale, int n ) {
+
+    int x = 0;
+    for( ; x + 16 <= n; x += 16 ) {
+        __m256i index_lo = _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)( index + x ) ) );
+        __m256i index_hi = _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)( index + x + 8 ) ) );
+        __m256i s = _mm256_permute4x64_epi64( gather_scale( lut, index_lo, index_hi ), 0xd8 );
+        _mm256_storeu_si256( (__m256i*)( scale + x ), s );
+    }
+
+    afgs1_lookup_scaling_16_c( lut, index + x, scale + x, n - x );
+}
+
+static void add_luma_noise_avx2( uint8_t *pixels, const int16_t *noise, int width,
+                                 const Afgs1_plane_scaling *scaling ) {
+
+    const __m256i noise_mult = _mm256_set1_epi16( (short)( 1 << ( 15 - scaling->scaling_shift ) ) );
+    const __m256i min_value = _mm256_set1_epi16( (short)scaling->min_value );
+    const __m256i max_value = _mm256_set1_epi16( (short)scaling->max_value );
+
+    int x = 0;
+    for( ; x + 16 <= width; x += 16 ) {
+        __m128i p = _mm_loadu_si128( (const __m128i*)( pixels + x ) );
+        __m256i scale = gather_scale( scaling->lut, _mm256_cvtepu8_epi32( p ),
+                                      _mm256_cvtepu8_epi32( _mm_srli_si128( p, 8 ) ) );
+        scale = _mm256_permute4x64_epi64( scale, 0xd8 );
+        _mm_storeu_si128( (__m128i*)( pixels + x ), add_scaled_noise( _mm256_cvtepu8_epi16( p ), scale, noise + x,
+                                                                      noise_mult, min_value, max_value ) );
+    }
+
+    afgs1_add_luma_noise_c( pixels + x, noise + x, width - x, scaling );
+}
+
+static void add_chroma_noise_avx2( uint8_t *pixels, const uint8_t *luma, const int16_t *noise, int width,
+                                   const Afgs1_plane_scaling *scaling ) {
+
+    const __m256i noise_mult = _mm256_set1_epi16( (short)( 1 << ( 15 - scaling->scaling_shift ) ) );
+    const __m256i min_value = _mm256_set1_epi16( (short)scaling->min_value );
+    const __m256i max_value = _mm256_set1_epi16( (short)scaling->max_value );
+    const __m256i mults = _mm256_set1_epi32( (int)( ( scaling->luma_mult & 0xffff ) |
+                                                    ( (unsigned)scaling->mult << 16 ) ) );
+    const __m256i offset = _mm256_set1_epi32( scaling->offset );
+    const __m256i max_index = _mm256_set1_epi32( 255 );
+    const __m256i ones = _mm256_set1_epi8( 1 );
+    const __m256i zero = _mm256_setzero_si256();
+
+    int x = 0;
+    for( ; x + 16 <= width; x += 16 ) {
+        __m256i l = _mm256_maddubs_epi16( _mm256_loadu_si256( (const __m256i*)( luma + 2 * x ) ), ones );
+        l = _mm256_avg_epu16( l, zero );
+        __m256i p = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*)( pixels + x ) ) );
+
+        // Index of the scaling function: Clip1( ( ( luma * luma_mult + chroma * mult ) >> 6 ) + offset ).  The
+        // unpacks work within 128-bit lanes, so c0 holds samples 0-3 and 8-11 and c1 samples 4-7 and 12-15, which
+        // the pack of the gathers puts back in order.
+        __m256i c0 = _mm256_madd_epi16( _mm256_unpacklo_epi16( l, p ), mults );
+        __m256i c1 = _mm256_madd_epi16( _mm256_unpackhi_epi16( l, p ), mults );
+        c0 = _mm256_add_epi32( _mm256_srai_epi32( c0, 6 ), offset );
+        c1 = _mm256_add_epi32( _mm256_srai_epi32( c1, 6 ), offset );
+        c0 = _mm256_min_epi32( _mm256_max_epi32( c0, zero ), max_index );
+        c1 = _mm256_min_epi32( _mm256_max_epi32( c1, zero ), max_index );
+
+        __m256i scale = gather_scale( scaling->lut, c0, c1 );
+        _mm_storeu_si128( (__m128i*)( pixels + x ),
+                          add_scaled_noise( p, scale, noise + x, noise_mult, min_value, max_value ) );
+    }
+
+    afgs1_add_chroma_noise_c( pixels + x, luma + 2 * x, noise + x, width - x, scaling );
+}
+
+// Add the noise of 16 samples of 10 or 12 bits whose scaling function, multiplied by 1 << ( 15 - scaling_shift ),
+// is scale
+static inline __m256i add_scaled_noise_16( __m256i pixels, __m256i scale, const int16_t *noise, __m256i min_value,
+                                           __m256i max_value ) {
+
+    __m256i n = _mm256_mulhrs_epi16( scale, _mm256_loadu_si256( (const __m256i*)noise ) );
+    return _mm256_min_epi16( _mm256_max_epi16( _mm256_add_epi16( pixels, n ), min_value ), max_value );
+}
+
+static void add_luma_noise_16_avx2( uint16_t *pixels, const int16_t *noise, int width,
+                                    const Afgs1_plane_scaling *scaling ) {
+
+    const __m128i scale_shift = _mm_cvtsi32_si128( 15 - scaling->scaling_shift );
+    const __m256i min_value = _mm256_set1_epi16( (short)scaling->min_value );
+    const __m256i max_value = _mm256_set1_epi16( (short)scaling->max_value );
+
+    int x = 0;
+    for( ; x + 16 <= width; x += 16 ) {
+        __m256i p = _mm256_loadu_si256( (const __m256i*)( pixels + x ) );
+        __m256i scale = gather_scale( scaling->lut, _mm256_cvtepu16_epi32( _mm256_castsi256_si128( p ) ),
+                                      _mm256_cvtepu16_epi32( _mm256_extracti128_si256( p, 1 ) ) );
+        scale = _mm256_sll_epi16( _mm256_permute4x64_epi64( scale, 0xd8 ), scale_shift );
+        _mm256_storeu_si256( (__m256i*)( pixels + x ), add_scaled_noise_16( p, scale, noise + x, min_value,
+                                                                            max_value ) );
+    }
+
+    afgs1_add_luma_noise_16_c( pixels + x, noise + x, width - x, scaling );
+}
+
+static void add_chroma_noise_16_avx2( uint16_t *pixels, const uint16_t *luma, const int16_t *noise, int width,
+                                      const Afgs1_plane_scaling *scaling ) {
+
+    const __m128i scale_shift = _mm_cvtsi32_si128( 15 - scaling->scaling_shift );
+    const __m256i min_value = _mm256_set1_epi16( (short)scaling->min_value );
+    const __m256i max_value = _mm256_set1_epi16( (short)scaling->max_value );
+    const __m256i mults = _mm256_set1_epi32( (int)( ( scaling->luma_mult & 0xffff ) |
+                                                    ( (unsigned)scaling->mult << 16 ) ) );
+    const __m256i offset = _mm256_set1_epi32( scaling->offset );
+    const __m256i max_index = _mm256_set1_epi32( ( 1 << scaling->bit_depth ) - 1 );
+    const __m256i ones = _mm256_set1_epi16( 1 );
+    const __m256i zero = _mm256_setzero_si256();
+
+    int x = 0;
+    for( ; x + 16 <= width; x += 16 ) {
+        // Average of the two luma samples of chroma samples 0-7 and 8-15, in 32 bits
+        __m256i l0 = _mm256_madd_epi16( _mm256_loadu_si256( (const __m256i*)( luma + 2 * x ) ), ones );
+        __m256i l1 = _mm256_madd_epi16( _mm256_loadu_si256( (const __m256i*)( luma + 2 * x + 16 ) ), ones );
+        l0 = _mm256_srai_epi32( _mm256_add_epi32( l0, _mm256_set1_epi32( 1 ) ), 1 );
+        l1 = _mm256_srai_epi32( _mm256_add_epi32( l1, _mm256_set1_epi32( 1 ) ), 1 );
+
+        // Index of the scaling function: Clip1( ( ( luma * luma_mult + chroma * mult ) >> 6 ) + offset ), with the
+        // luma and chroma samples paired in the 32-bit elements
+        __m256i p = _mm256_loadu_si256( (const __m256i*)( pixels + x ) );
+        __m256i c0 = _mm256_slli_epi32( _mm256_cvtepu16_epi32( _mm256_castsi256_si128( p ) ), 16 );
+        __m256i c1 = _mm256_slli_epi32( _mm256_cvtepu16_epi32( _mm256_extracti128_si256( p, 1 ) ), 16 );
+        c0 = _mm256_madd_epi16( _mm256_or_si256( l0, c0 ), mults );
+        c1 = _mm256_madd_epi16( _mm256_or_si256( l1, c1 ), mults );
+        c0 = _mm256_add_epi32( _mm256_srai_epi32( c0, 6 ), offset );
+        c1 = _mm256_add_epi32( _mm256_srai_epi32( c1, 6 ), offset );
+        c0 = _mm256_min_epi32( _mm256_max_epi32( c0, zero ), max_index );
+        c1 = _mm256_min_epi32( _mm256_max_epi32( c1, zero ), max_index );
+
+        __m256i scale = _mm256_permute4x64_epi64( gather_scale( scaling->lut, c0, c1 ), 0xd8 );
+        scale = _mm256_sll_epi16( scale, scale_shift );
+        _mm256_storeu_si256( (__m256i*)( pixels + x ), add_scaled_noise_16( p, scale, noise + x, min_value,
+                                                                            max_value ) );
+    }
+
+    afgs1_add_chroma_noise_16_c( pixels + x, luma + 2 * x, noise + x, width - x, scaling );
+}
+
+static void blend_noise_avx2( const int16_t *previous, const int16_t *current, int16_t *blended, int width,
+                              int weight_previous, int weight_current, int grain_min, int grain_max ) {
+
+    const __m256i weights = _mm256_set1_epi32( (int)( ( weight_previous & 0xffff ) |
+                                                      ( (unsigned)weight_current << 16 ) ) );
+    const __m256i rounding = _mm256_set1_epi32( 16 );
+    const __m256i min_value = _mm256_set1_epi16( (short)grain_min );
+    const __m256i max_value = _mm256_set1_epi16( (short)grain_max );
+
+    int x = 0;
+    for( ; x + 16 <= width; x += 16 ) {
+        __m256i a = _mm256_loadu_si256( (const __m256i*)( previous + x ) );
+        __m256i b = _mm256_loadu_si256( (const __m256i*)( current + x ) );
+        __m256i lo = _mm256_madd_epi16( _mm256_unpacklo_epi16( a, b ), weights );
+        __m256i hi = _mm256_madd_epi16( _mm256_unpackhi_epi16( a, b ), weights );
+        lo = _mm256_srai_epi32( _mm256_add_epi32( lo, rounding ), 5 );
+        hi = _mm256_srai_epi32( _mm256_add_epi32( hi, rounding ), 5 );
+        __m256i result = _mm256_packs_epi32( lo, hi );
+        result = _mm256_min_epi16( _mm256_max_epi16( result, min_value ), max_value );
+        _mm256_storeu_si256( (__m256i*)( blended + x ), result );
+    }
+
+    afgs1_blend_noise_c( previous + x, current + x, blended + x, width - x, weight_previous, weight_current,
+                         grain_min, grain_max );
+}
+
+void afgs1_grain_kernels_avx2( Afgs1_grain_kernels *kernels ) {
+    kernels->add_luma_noise = add_luma_noise_avx2;
+    kernels->add_chroma_noise = add_chroma_noise_avx2;
+    kernels->add_luma_noise_16 = add_luma_noise_16_avx2;
+    kernels->add_chroma_noise_16 = add_chroma_noise_16_avx2;
+    kernels->blend_noise = blend_noise_avx2;
+    kernels->lookup_scaling = lookup_scaling_avx2;
+    kernels->lookup_scaling_16 = lookup_scaling_16_avx2;
+}
+
+#else
+
+void afgs1_grain_kernels_avx2( Afgs1_grain_kernels *kernels ) {
+    afgs1_grain_kernels_c( kernels );
+}
+
+#endif
@@ -0,0 +1,141 @@
+// This source code is subject to the terms of the BSD 3-Clause Clear License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 3-Clause Clear
+// License was not distributed with this source code in the LICENSE file, you can
+// obtain it at aomedia.org/license/software-license/bsd-3-c-c/.  If the Alliance
+// for Open Media Patent License 1.0 was not distributed with this source code in
+// the PATENTS file, you can obtain it at aomedia.org/license/patent-license/.
+//
+// SSE4.1 grain application kernels (see afgs1_synthesis.h).  This file is compiled with SSE4.1 code
+// generation and its kernels are only selected when the processor supports them.
+//
+// The noise is scaled with _mm_mulhrs_epi16, which computes ( a * b + ( 1 << 14 ) ) >> 15.  With the noise
+// multiplied by 1 << ( 15 - scaling_shift ), this is Round2( scale * noise, scaling_shift ) for the 8-bit
+// grain range and scaling_shift from 8 to 11.
+//
+
+#include "afgs1_synthesis.h"
+
+#if defined(AFGS1_X86_SIMD)
+
+#include <smmintrin.h>
+
+// Samples whose scaling function is looked up before they are processed
+#define KERNEL_CHUNK 256
+
+// Whole vectors of the remaining samples, up to a chunk.  (Templates of the standard library are not used in this
+// file, as their instances could be shared with code that runs on processors without SSE4.1.)
+static inline int chunk_size( int remaining ) {
+    int size = remaining & ~15;
+    return size < KERNEL_CHUNK ? size : KERNEL_CHUNK;
+}
+
+// Add the scaled noise of 16 samples given as two vectors of 8 samples
+static inline __m128i add_scaled_noise( __m128i pixels_lo, __m128i pixels_hi, const int16_t *scale,
+                                        const int16_t *noise, __m128i noise_mult, __m128i min_value,
+                                        __m128i max_value ) {
+
+    __m128i noise_lo = _mm_mullo_epi16( _mm_loadu_si128( (const __m128i*)noise ), noise_mult );
+    __m128i noise_hi = _mm_mullo_epi16( _mm_loadu_si128( (const __m128i*)( noise + 8 ) ), noise_mult );
+    noise_lo = _mm_mulhrs_epi16( _mm_loadu_si128( (const __m128i*)scale ), noise_lo );
+    noise_hi = _mm_mulhrs_epi16( _mm_loadu_si128( (const __m128i*)( scale + 8 ) ), noise_hi );
+
+    pixels_lo = _mm_min_epi16( _mm_max_epi16( _mm_add_epi16( pixels_lo, noise_lo ), min_value ), max_value );
+    pixels_hi = _mm_min_epi16( _mm_max_epi16( _mm_add_epi16( pixels_hi, noise_hi ), min_value ), max_value );
+    return _mm_packus_epi16( pixels_lo, pixels_hi );
+}
+
+static void add_luma_noise_sse4( uint8_t *pixels, const int16_t *noise, int width,
+                                 const Afgs1_plane_scaling *scaling ) {
+
+    const __m128i noise_mult = _mm_set1_epi16( (short)( 1 << ( 15 - scaling->scaling_shift ) ) );
+    const __m128i min_value = _mm_set1_epi16( (short)scaling->min_value );
+    const __m128i max_value = _mm_set1_epi16( (short)scaling->max_value );
+    const __m128i zero = _mm_setzero_si128();
+
+    // The scaling function is looked up for a chunk of samples by the scalar lookup kernel before the vector loop,
+    // so that the vectors are not loaded right after the scalar stores of their elements
+    int16_t scale[KERNEL_CHUNK];
+    int x = 0;
+    while( width - x >= 16 ) {
+        int chunk = chunk_size( width - x );
+        afgs1_lookup_scaling_c( scaling->lut, pixels + x, scale, chunk );
+
+        for( int i = 0; i < chunk; i += 16, x += 16 ) {
+            __m128i p = _mm_loadu_si128( (const __m128i*)( pixels + x ) );
+            __m128i result = add_scaled_noise( _mm_cvtepu8_epi16( p ), _mm_unpackhi_epi8( p, zero ), scale + i,
+                                               noise + x, noise_mult, min_value, max_value );
+            _mm_storeu_si128( (__m128i*)( pixels + x ), result );
+        }
+    }
+
+    afgs1_add_luma_noise_c( pixels + x, noise + x, width - x, scaling );
+}
+
+static void add_chroma_noise_sse4( uint8_t *pixels, const uint8_t *luma, const int16_t *noise, int width,
+                                   const Afgs1_plane_scaling *scaling ) {
+
+    const __m128i noise_mult = _mm_set1_epi16( (short)( 1 << ( 15 - scaling->scaling_shift ) ) );
+    const __m128i min_value = _mm_set1_epi16( (short)scaling->min_value );
+    const __m128i max_value = _mm_set1_epi16( (short)scaling->max_value );
+    const __m128i mults = _mm_set1_epi32( (int)( ( scaling->luma_mult & 0xffff ) |
+                                                 ( (unsigned)scaling->mult << 16 ) ) );
+    const __m128i offset = _mm_set1_epi32( scaling->offset );
+    const __m128i ones = _mm_set1_epi8( 1 );
+    const __m128i zero = _mm_setzero_si128();
+
+    uint8_t merged[KERNEL_CHUNK];
+    int16_t scale[KERNEL_CHUNK];
+    int x = 0;
+    while( width - x >= 16 ) {
+        int chunk = chunk_size( width - x );
+
+        // Index of the scaling function: Clip1( ( ( luma * luma_mult + chroma * mult ) >> 6 ) + offset ), with
+        // the average of the two luma samples of each chroma sample
+        for( int i = 0; i < chunk; i += 16 ) {
+            const uint8_t *l = luma + 2 * ( x + i );
+            __m128i luma_lo = _mm_avg_epu16( _mm_maddubs_epi16( _mm_loadu_si128( (const __m128i*)l ), ones ), zero );
+            __m128i luma_hi = _mm_avg_epu16( _mm_maddubs_epi16( _mm_loadu_si128( (const __m128i*)( l + 16 ) ), ones ),
+                                             zero );
+
+            __m128i p = _mm_loadu_si128( (const __m128i*)( pixels + x + i ) );
+            __m128i pixels_lo = _mm_cvtepu8_epi16( p );
+            __m128i pixels_hi = _mm_unpackhi_epi8( p, zero );
+            __m128i c0 = _mm_madd_epi16( _mm_unpacklo_epi16( luma_lo, pixels_lo ), mults );
+            __m128i c1 = _mm_madd_epi16( _mm_unpackhi_epi16( luma_lo, pixels_lo ), mults );
+            __m128i c2 = _mm_madd_epi16( _mm_unpacklo_epi16( luma_hi, pixels_hi ), mults );
+            __m128i c3 = _mm_madd_epi16( _mm_unpackhi_epi16( luma_hi, pixels_hi ), mults );
+            c0 = _mm_add_epi32( _mm_srai_epi32( c0, 6 ), offset );
+            c1 = _mm_add_epi32( _mm_srai_epi32( c1, 6 ), offset );
+            c2 = _mm_add_epi32( _mm_srai_epi32( c2, 6 ), offset );
+            c3 = _mm_add_epi32( _mm_srai_epi32( c3, 6 ), offset );
+            _mm_storeu_si128( (__m128i*)( merged + i ),
+                              _mm_packus_epi16( _mm_packs_epi32( c0, c1 ), _mm_packs_epi32( c2, c3 ) ) );
+        }
+
+        afgs1_lookup_scaling_c( scaling->lut, merged, scale, chunk );
+
+        for( int i = 0; i < chunk; i += 16, x += 16 ) {
+            __m128i p = _mm_loadu_si128( (const __m128i*)( pixels + x ) );
+            __m128i result = add_scaled_noise( _mm_cvtepu8_epi16( p ), _mm_unpackhi_epi8( p, zero ), scale + i,
+                                               noise + x, noise_mult, min_value, max_value );
+            _mm_storeu_si128( (__m128i*)( pixels + x ), result );
+        }
+    }
+
+    afgs1_add_chroma_noise_c( pixels + x, luma + 2 * x, noise + x, width - x, scaling );
+}
+
+// SSE4.1 has no gathers, and the scaling functions are looked up by the scalar kernels
+void afgs1_grain_kernels_sse4( Afgs1_grain_kernels *kernels ) {
+    afgs1_grain_kernels_c( kernels );
+    kernels->add_luma_noise = add_luma_noise_sse4;
+    kernels->add_chroma_noise = add_chroma_noise_sse4;
+}
+
+#else
+
+void afgs1_grain_kernels_sse4( Afgs1_grain_kernels *kernels ) {
+    afgs1_grain_kernels_c( kernels );
+}
+
+#endif